@@ -34,7 +34,10 @@
  */
 
 #include <algorithm>
+#include <atomic>
+#include <cstdio>
 #include <iostream>
+#include <thread>
 
 #include "common.hpp"
 
@@ -59,10 +62,17 @@ namespace lsdj
         char name[9] = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
         lsdj_project_get_name(project, name, sizeof(name));
         
+        return constructProjectName(name, underscore);
+    }
+    
+    std::string constructProjectName(const char* name, bool underscore)
+    {
+        std::string result(name, std::find(name, name + 8, '\0'));
+        
         if (underscore)
-            std::replace(name, name + 9, 'x', '_');
+            std::replace(result.begin(), result.end(), 'x', '_');
         
-        return name;
+        return result;
     }
     
     bool isHiddenFile(const std::string& str)
@@ -74,4 +84,178 @@ namespace lsdj
             default: return str[0] == '.' && str[1] != '.' && str[1] != '/';
         }
     }
+    
+    std::size_t convertSongToMono(lsdj_song_t* song, bool instruments, bool tables, bool phrases)
+    {
+        std::size_t changed = 0;
+        
+        if (instruments)
+        {
+            static const lsdj_panning panning[4] = { LSDJ_PAN_NONE, LSDJ_PAN_LEFT_RIGHT, LSDJ_PAN_LEFT_RIGHT, LSDJ_PAN_LEFT_RIGHT };
+            changed += lsdj_song_map_instrument_panning(song, panning);
+        }
+        
+        const unsigned int filter = (tables ? LSDJ_MAP_TABLE_COMMANDS : 0) | (phrases ? LSDJ_MAP_PHRASE_COMMANDS : 0);
+        if (filter == 0)
+            return changed;
+        
+        // Any O command that pans somewhere gets panned both ways
+        static const lsdj_command_map_t map = []
+        {
+            lsdj_command_map_t map;
+            lsdj_command_map_init(&map);
+            for (int value = 0; value < 256; ++value)
+            {
+                if (value != LSDJ_PAN_NONE)
+                    map.values[LSDJ_COMMAND_O][value] = LSDJ_PAN_LEFT_RIGHT;
+            }
+            return map;
+        }();
+        
+        changed += lsdj_song_map_commands(song, filter, &map);
+        
+        return changed;
+    }
+    
+    void parallelFor(std::size_t count, unsigned int threadCount, const std::function<void(std::size_t)>& function)
+    {
+        if (threadCount > count)
+            threadCount = static_cast<unsigned int>(count);
+        
+        if (threadCount <= 1)
+        {
+            for (std::size_t i = 0; i < count; ++i)
+                function(i);
+            return;
+        }
+        
+        // Every thread grabs the next index that hasn't been taken yet
+        std::atomic<std::size_t> next{0};
+        const auto work = [&]
+        {
+            for (auto i = next++; i < count; i = next++)
+                function(i);
+        };
+        
+        std::vector<std::thread> threads;
+        threads.reserve(threadCount - 1);
+        for (unsigned int t = 1; t < threadCount; ++t)
+            threads.emplace_back(work);
+        
+        work();
+        
+        for (auto& thread : threads)
+            thread.join();
+    }
+    
+    OrderedOutput::OrderedOutput(std::size_t count, std::ostream& stream) :
+        stream(stream),
+        texts(count),
+        finished(count, false)
+    {
+    }
+    
+    void OrderedOutput::finish(std::size_t index, std::string text)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        
+        texts[index] = std::move(text);
+        finished[index] = true;
+        
+        while (next < finished.size() && finished[next])
+        {
+            stream << texts[next];
+            texts[next].clear();
+            ++next;
+        }
+        
+        stream.flush();
+    }
+    
+    FileLoader::FileLoader(std::vector<std::string> paths, unsigned int threadCount, std::size_t window) :
+        paths(std::move(paths)),
+        contents(this->paths.size()),
+        states(this->paths.size(), State::Waiting),
+        window(std::max<std::size_t>(window, 1))
+    {
+        threadCount = static_cast<unsigned int>(std::min<std::size_t>(std::max(threadCount, 1u), this->paths.size()));
+        
+        threads.reserve(threadCount);
+        for (unsigned int t = 0; t < threadCount; ++t)
+            threads.emplace_back([this]{ load(); });
+    }
+    
+    FileLoader::~FileLoader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        
+        taken.notify_all();
+        for (auto& thread : threads)
+            thread.join();
+    }
+    
+    std::vector<unsigned char> FileLoader::take(std::size_t index, lsdj_error_t** error)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        loaded.wait(lock, [&]{ return states[index] != State::Waiting; });
+        
+        std::vector<unsigned char> data;
+        if (states[index] == State::Unopened)
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not open file");
+        else if (states[index] == State::Failed)
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read file");
+        else if (states[index] == State::Loaded)
+            data = std::move(contents[index]);
+        
+        states[index] = State::Taken;
+        --held;
+        lock.unlock();
+        
+        taken.notify_all();
+        return data;
+    }
+    
+    void FileLoader::load()
+    {
+        while (true)
+        {
+            // Claim the next file, as long as the window has room for it
+            std::unique_lock<std::mutex> lock(mutex);
+            taken.wait(lock, [&]{ return stopping || next == paths.size() || held < window; });
+            if (stopping || next == paths.size())
+                return;
+            
+            const auto index = next++;
+            ++held;
+            lock.unlock();
+            
+            std::vector<unsigned char> data;
+            bool success = false;
+            std::FILE* file = std::fopen(paths[index].c_str(), "rb");
+            if (file != nullptr)
+            {
+                success = std::fseek(file, 0, SEEK_END) == 0;
+                const long size = success ? std::ftell(file) : -1L;
+                if (size >= 0 && std::fseek(file, 0, SEEK_SET) == 0)
+                {
+                    data.resize(static_cast<std::size_t>(size));
+                    success = std::fread(data.data(), 1, data.size(), file) == data.size();
+                } else {
+                    success = false;
+                }
+                
+                std::fclose(file);
+            }
+            
+            lock.lock();
+            contents[index] = std::move(data);
+            states[index] = success ? State::Loaded : (file == nullptr ? State::Unopened : State::Failed);
+            lock.unlock();
+            
+            loaded.notify_all();
+        }
+    }
 }
@@ -36,7 +36,14 @@
 #ifndef LSDJ_COMMON_HPP
 #define LSDJ_COMMON_HPP
 
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <ostream>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "../liblsdj/error.h"
 #include "../liblsdj/project.h"
@@ -48,7 +55,74 @@ namespace lsdj
     int handle_error(lsdj_error_t* error);
     bool compareCaseInsensitive(std::string str1, std::string str2);
     std::string constructProjectName(const lsdj_project_t* project, bool underscore);
+    std::string constructProjectName(const char* name, bool underscore);
     bool isHiddenFile(const std::string& str);
+    
+    // Convert a song to mono, returns the amount of instruments and commands that were changed
+    /*! Instruments and O commands that pan left or right are panned both ways instead */
+    std::size_t convertSongToMono(lsdj_song_t* song, bool instruments, bool tables, bool phrases);
+    
+    // Call a function for every index in [0, count), spread out over a number of threads
+    /*! The calling thread takes part in the work. A threadCount of 0 or 1 runs everything
+        on the calling thread, in order. */
+    void parallelFor(std::size_t count, unsigned int threadCount, const std::function<void(std::size_t)>& function);
+    
+    // Prints the output of parallel work in index order, as soon as all preceding output is done
+    class OrderedOutput
+    {
+    public:
+        OrderedOutput(std::size_t count, std::ostream& stream);
+        
+        // Hand in the (possibly empty) output for a given index, prints what it can
+        void finish(std::size_t index, std::string text);
+        
+    private:
+        std::ostream& stream;
+        std::vector<std::string> texts;
+        std::vector<bool> finished;
+        std::size_t next = 0;
+        std::mutex mutex;
+    };
+    
+    // The amount of reads a FileLoader keeps in flight by default
+    const unsigned int FILE_LOADER_THREAD_COUNT = 4;
+    
+    // Reads files into memory on background threads, ahead of the code decoding them
+    /*! Several reads are kept in flight at once, so storage latency overlaps with decoding.
+        At most window files are held loaded before being taken, which bounds the memory
+        used on large collections. Every file should be taken exactly once, in about the
+        order they were passed in (like parallelFor() hands out indices). */
+    class FileLoader
+    {
+    public:
+        FileLoader(std::vector<std::string> paths, unsigned int threadCount, std::size_t window);
+        ~FileLoader();
+        
+        FileLoader(const FileLoader&) = delete;
+        FileLoader& operator=(const FileLoader&) = delete;
+        
+        // Wait for a file to have been read and take its contents
+        /*! Sets error and returns an empty buffer if the file couldn't be read */
+        std::vector<unsigned char> take(std::size_t index, lsdj_error_t** error);
+        
+    private:
+        enum class State { Waiting, Loaded, Unopened, Failed, Taken };
+        
+        void load();
+        
+        std::vector<std::string> paths;
+        std::vector<std::vector<unsigned char>> contents;
+        std::vector<State> states;
+        std::size_t window;
+        std::size_t next = 0;
+        std::size_t held = 0;
+        bool stopping = false;
+        
+        std::mutex mutex;
+        std::condition_variable loaded;
+        std::condition_variable taken;
+        std::vector<std::thread> threads;
+    };
 }
 
 #endif
@@ -0,0 +1,96 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+
+void* default_allocate(size_t size, void* user_data)
+{
+    (void)user_data;
+    return malloc(size);
+}
+
+void default_deallocate(void* ptr, void* user_data)
+{
+    (void)user_data;
+    free(ptr);
+}
+
+static lsdj_allocator_t allocator = { default_allocate, default_deallocate, NULL };
+
+void lsdj_set_allocator(const lsdj_allocator_t* newAllocator)
+{
+    if (newAllocator && newAllocator->allocate && newAllocator->deallocate)
+    {
+        allocator = *newAllocator;
+    } else {
+        allocator.allocate = default_allocate;
+        allocator.deallocate = default_deallocate;
+        allocator.user_data = NULL;
+    }
+}
+
+void lsdj_get_allocator(lsdj_allocator_t* result)
+{
+    *result = allocator;
+}
+
+void* lsdj_malloc(size_t size)
+{
+    // Like malloc(), never ask for zero bytes
+    return allocator.allocate(size == 0 ? 1 : size, allocator.user_data);
+}
+
+void* lsdj_calloc(size_t count, size_t size)
+{
+    if (size != 0 && count > SIZE_MAX / size)
+        return NULL;
+    
+    void* ptr = lsdj_malloc(count * size);
+    if (ptr)
+        memset(ptr, 0, count * size);
+    
+    return ptr;
+}
+
+void lsdj_free(void* ptr)
+{
+    if (ptr)
+        allocator.deallocate(ptr, allocator.user_data);
+}
@@ -0,0 +1,79 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_ALLOC_H
+#define LSDJ_ALLOC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+// Function pointer types for a custom allocator
+/*! allocate() should return memory aligned for any type (like malloc() does), or NULL if
+    it can't. deallocate() is never called with NULL. */
+typedef void* (*lsdj_allocate_t)(size_t size, void* user_data);
+typedef void (*lsdj_deallocate_t)(void* ptr, void* user_data);
+
+typedef struct
+{
+    lsdj_allocate_t allocate;
+    lsdj_deallocate_t deallocate;
+    void* user_data;
+} lsdj_allocator_t;
+
+// Route every allocation liblsdj makes through a custom allocator, or NULL for malloc()/free()
+/*! The allocator is copied. Install it before creating any liblsdj objects and keep it
+    until all of them have been freed, since memory is returned to whichever allocator is
+    installed at that time. The parallel functions allocate from their worker threads, so
+    the allocator has to be thread-safe (or hand out per-thread memory itself). */
+void lsdj_set_allocator(const lsdj_allocator_t* allocator);
+
+// Retrieve the allocator that's currently installed
+void lsdj_get_allocator(lsdj_allocator_t* allocator);
+
+// Allocate and free memory through the installed allocator
+/*! lsdj_calloc() zeroes the memory, and returns NULL if count * size overflows */
+void* lsdj_malloc(size_t size);
+void* lsdj_calloc(size_t count, size_t size);
+void lsdj_free(void* ptr);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <stdlib.h>
+
+#include "alloc.h"
+#include "arena.h"
+#include "thread.h"
+
+struct lsdj_arena_t
+{
+    // The memory handed out by the arena, directly following this header
+    unsigned char* memory;
+    size_t size;
+    size_t used;
+    
+    // The amount of owners sharing this arena, changed atomically
+    unsigned int referenceCount;
+};
+
+size_t lsdj_arena_align(size_t size)
+{
+    return (size + LSDJ_ARENA_ALIGNMENT - 1) & ~(size_t)(LSDJ_ARENA_ALIGNMENT - 1);
+}
+
+lsdj_arena_t* lsdj_arena_new(size_t size, lsdj_error_t** error)
+{
+    // Allocate the header and memory in one go, keeping the memory aligned
+    const size_t headerSize = lsdj_arena_align(sizeof(lsdj_arena_t));
+    unsigned char* block = (unsigned char*)lsdj_malloc(headerSize + size);
+    if (block == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate arena");
+        return NULL;
+    }
+    
+    lsdj_arena_t* arena = (lsdj_arena_t*)block;
+    arena->memory = block + headerSize;
+    arena->size = size;
+    arena->used = 0;
+    arena->referenceCount = 1;
+    
+    return arena;
+}
+
+void lsdj_arena_free(lsdj_arena_t* arena)
+{
+    lsdj_free(arena);
+}
+
+void lsdj_arena_retain(lsdj_arena_t* arena)
+{
+    lsdj_atomic_increment(&arena->referenceCount);
+}
+
+void lsdj_arena_release(lsdj_arena_t* arena)
+{
+    if (arena && lsdj_atomic_decrement(&arena->referenceCount) == 0)
+        lsdj_arena_free(arena);
+}
+
+unsigned int lsdj_arena_get_reference_count(const lsdj_arena_t* arena)
+{
+    return lsdj_atomic_load(&arena->referenceCount);
+}
+
+void* lsdj_arena_alloc(lsdj_arena_t* arena, size_t size)
+{
+    const size_t alignedSize = lsdj_arena_align(size);
+    if (alignedSize > arena->size - arena->used)
+        return NULL;
+    
+    void* memory = arena->memory + arena->used;
+    arena->used += alignedSize;
+    
+    return memory;
+}
+
+void lsdj_arena_reset(lsdj_arena_t* arena)
+{
+    arena->used = 0;
+}
+
+size_t lsdj_arena_get_size(const lsdj_arena_t* arena)
+{
+    return arena->size;
+}
+
+size_t lsdj_arena_get_used(const lsdj_arena_t* arena)
+{
+    return arena->used;
+}
+
+size_t lsdj_arena_get_memory_usage(const lsdj_arena_t* arena)
+{
+    // The header and memory are allocated together
+    return lsdj_arena_align(sizeof(lsdj_arena_t)) + arena->size;
+}
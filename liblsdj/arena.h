@@ -0,0 +1,91 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_ARENA_H
+#define LSDJ_ARENA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "error.h"
+
+// The alignment of every allocation handed out by an arena
+#define LSDJ_ARENA_ALIGNMENT (16)
+
+// A fixed-size block of memory that hands out allocations front to back
+/*! Memory allocated from an arena can't be freed on its own, only the arena as a whole.
+    Songs use these to keep their chains, phrases, instruments and tables together. */
+typedef struct lsdj_arena_t lsdj_arena_t;
+
+// Create/free arenas
+lsdj_arena_t* lsdj_arena_new(size_t size, lsdj_error_t** error);
+void lsdj_arena_free(lsdj_arena_t* arena);
+
+// Share an arena between multiple owners
+/*! A new arena starts out with one reference, and lsdj_arena_release() frees it once the
+    last reference is gone. lsdj_arena_free() frees it right away, regardless of the count.
+    The count is changed atomically, so owners on different threads can share an arena
+    (allocating from it still isn't thread-safe). */
+void lsdj_arena_retain(lsdj_arena_t* arena);
+void lsdj_arena_release(lsdj_arena_t* arena);
+unsigned int lsdj_arena_get_reference_count(const lsdj_arena_t* arena);
+
+// Allocate memory from the arena
+/*! Returns NULL if the arena doesn't have enough room left */
+void* lsdj_arena_alloc(lsdj_arena_t* arena, size_t size);
+
+// Make all memory in the arena available again
+/*! Anything allocated from the arena before this is invalidated */
+void lsdj_arena_reset(lsdj_arena_t* arena);
+
+// Retrieve the total and used amount of memory in the arena
+size_t lsdj_arena_get_size(const lsdj_arena_t* arena);
+size_t lsdj_arena_get_used(const lsdj_arena_t* arena);
+
+// The amount of heap memory the arena takes, including its own bookkeeping
+size_t lsdj_arena_get_memory_usage(const lsdj_arena_t* arena);
+
+// Round a size up to the arena alignment, to find out how much an allocation really takes
+size_t lsdj_arena_align(size_t size);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
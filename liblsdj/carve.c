@@ -0,0 +1,342 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <string.h>
+
+#include "carve.h"
+#include "codec.h"
+#include "compression.h"
+#include "sav.h"
+#include "song_layout.h"
+
+// Offsets of the parts of a sav, relative to its start
+#define CARVE_HEADER_START LSDJ_SONG_DECOMPRESSED_SIZE
+#define CARVE_VERSIONS_OFFSET (CARVE_HEADER_START + LSDJ_SAV_PROJECT_COUNT * LSDJ_PROJECT_NAME_LENGTH)
+#define CARVE_INIT_OFFSET (CARVE_HEADER_START + 0x13E)
+#define CARVE_ACTIVE_PROJECT_OFFSET (CARVE_HEADER_START + 0x140)
+#define CARVE_ALLOC_TABLE_OFFSET (CARVE_HEADER_START + 0x141)
+#define CARVE_BLOCKS_OFFSET (CARVE_HEADER_START + BLOCK_SIZE)
+
+// The state shared by everything found in a single dump
+typedef struct
+{
+    lsdj_carve_visitor_t visitor;
+    void* user_data;
+    lsdj_codec_context_t* context;
+    
+    // Scratch memory for the compressed blocks of one project
+    unsigned char* blocks;
+    
+    size_t count;
+    int stopped;
+} carve_state_t;
+
+// Find the first position in [from, end - 1) where two given bytes follow each other
+/*! Returns end if there is none. memchr() does the actual scanning, which C libraries
+    implement with vector instructions, so the scan runs well past byte-at-a-time speed. */
+size_t carve_find_pair(const unsigned char* data, size_t from, size_t end, unsigned char first, unsigned char second)
+{
+    while (from + 1 < end)
+    {
+        const unsigned char* match = (const unsigned char*)memchr(data + from, first, end - from - 1);
+        if (match == NULL)
+            break;
+        
+        from = (size_t)(match - data);
+        if (data[from + 1] == second)
+            return from;
+        
+        ++from;
+    }
+    
+    return end;
+}
+
+// Check whether the header of a possible sav holds up
+/*! The active project and every entry in the block allocation table should either refer
+    to one of the projects, or be empty */
+int is_carved_sav_header(const unsigned char* sav)
+{
+    const unsigned char active = sav[CARVE_ACTIVE_PROJECT_OFFSET];
+    if (active >= LSDJ_SAV_PROJECT_COUNT && active != LSDJ_NO_ACTIVE_PROJECT)
+        return 0;
+    
+    const unsigned char* table = sav + CARVE_ALLOC_TABLE_OFFSET;
+    for (int i = 0; i < BLOCK_COUNT; ++i)
+    {
+        if (table[i] >= LSDJ_SAV_PROJECT_COUNT && table[i] != 0xFF)
+            return 0;
+    }
+    
+    return 1;
+}
+
+// Find the start of the next possible sav, at or after from
+/*! Returns size if there is none */
+size_t find_carved_sav(const unsigned char* data, size_t size, size_t from)
+{
+    // A sav needs at least its header and block allocation table
+    if (size < CARVE_BLOCKS_OFFSET)
+        return size;
+    
+    const size_t end = size - CARVE_BLOCKS_OFFSET + CARVE_INIT_OFFSET + 2;
+    for (size_t init = carve_find_pair(data, from + CARVE_INIT_OFFSET, end, 'j', 'k'); init < end; init = carve_find_pair(data, init + 1, end, 'j', 'k'))
+    {
+        if (is_carved_sav_header(data + init - CARVE_INIT_OFFSET))
+            return init - CARVE_INIT_OFFSET;
+    }
+    
+    return size;
+}
+
+// Find the start of the next possible decompressed song, at or after from
+/*! Returns size if there is none */
+size_t find_carved_song(const unsigned char* data, size_t size, size_t from)
+{
+    if (size < LSDJ_SONG_DECOMPRESSED_SIZE)
+        return size;
+    
+    // Scan for the first 'rb' flag, and check the other two at their fixed distance from it
+    const size_t end = size - LSDJ_SONG_DECOMPRESSED_SIZE + SONG_RB0_ADDRESS + 2;
+    for (size_t flag = carve_find_pair(data, from + SONG_RB0_ADDRESS, end, 'r', 'b'); flag < end; flag = carve_find_pair(data, flag + 1, end, 'r', 'b'))
+    {
+        const unsigned char* song = data + flag - SONG_RB0_ADDRESS;
+        if (memcmp(song + SONG_RB1_ADDRESS, "rb", 2) == 0 && memcmp(song + SONG_RB2_ADDRESS, "rb", 2) == 0)
+            return flag - SONG_RB0_ADDRESS;
+    }
+    
+    return size;
+}
+
+// Hand a recovered project to the visitor
+void carve_emit(carve_state_t* state, lsdj_carve_kind_t kind, size_t offset, unsigned char projectIndex, lsdj_project_t* project)
+{
+    lsdj_carve_result_t result;
+    result.kind = kind;
+    result.offset = offset;
+    result.projectIndex = projectIndex;
+    result.project = project;
+    
+    state->count += 1;
+    state->stopped = state->visitor(&result, state->user_data) != 0;
+    
+    lsdj_project_free(project);
+}
+
+// Turn a decompressed song into a project
+/*! Returns NULL if the song can't be read. error is only set if the project can't be made. */
+lsdj_project_t* carve_decompressed_song(const unsigned char* data, lsdj_error_t** error)
+{
+    // Problems with the data itself just mean there's nothing to recover here
+    lsdj_error_t* failure = NULL;
+    lsdj_song_t* song = lsdj_song_read_from_memory(data, LSDJ_SONG_DECOMPRESSED_SIZE, &failure);
+    if (failure)
+    {
+        lsdj_error_free(failure);
+        return NULL;
+    }
+    
+    lsdj_project_t* project = lsdj_project_new(error);
+    if (project == NULL)
+    {
+        lsdj_song_free(song);
+        return NULL;
+    }
+    
+    lsdj_project_set_song(project, song);
+    return project;
+}
+
+// Turn the chain of compressed blocks starting at a given block of a sav into a project
+/*! Returns NULL if the chain is broken or doesn't decompress into a valid song.
+    error is only set if the project can't be made. */
+lsdj_project_t* carve_compressed_song(const unsigned char* sav, size_t size, unsigned char block, carve_state_t* state, lsdj_error_t** error)
+{
+    lsdj_memory_data_t mem;
+    mem.begin = (unsigned char*)sav;
+    mem.cur = mem.begin + CARVE_BLOCKS_OFFSET + block * BLOCK_SIZE;
+    mem.size = size;
+    
+    lsdj_vio_t vio;
+    vio.read = lsdj_mread;
+    vio.tell = lsdj_mtell;
+    vio.seek = lsdj_mseek;
+    vio.user_data = &mem;
+    
+    // Problems with the data itself just mean there's nothing to recover here
+    lsdj_error_t* failure = NULL;
+    long block1position = CARVE_BLOCKS_OFFSET;
+    const unsigned int blockCount = lsdj_copy_compressed_blocks(&vio, &block1position, BLOCK_SIZE, 1, state->blocks, BLOCK_COUNT, &failure);
+    if (failure || blockCount == 0)
+    {
+        lsdj_error_free(failure);
+        return NULL;
+    }
+    
+    lsdj_project_t* project = lsdj_project_new(error);
+    if (project == NULL)
+        return NULL;
+    
+    lsdj_project_set_compressed_song(project, state->blocks, blockCount, error);
+    if (error && *error)
+    {
+        lsdj_project_free(project);
+        return NULL;
+    }
+    
+    // Decompress once to make sure the blocks hold a song, they're kept for writing it out again
+    lsdj_project_load_song_with_context(project, state->context, &failure);
+    if (failure)
+    {
+        lsdj_error_free(failure);
+        lsdj_project_free(project);
+        return NULL;
+    }
+    
+    return project;
+}
+
+// Recover everything that can be recovered from a possible sav
+/*! size is the amount of bytes available from the start of the sav, which might be less
+    than a whole sav at the end of a dump. Returns the amount of projects found. */
+size_t carve_sav(const unsigned char* sav, size_t size, size_t offset, carve_state_t* state, lsdj_error_t** error)
+{
+    const size_t count = state->count;
+    const char* names = (const char*)sav + CARVE_HEADER_START;
+    const unsigned char* versions = sav + CARVE_VERSIONS_OFFSET;
+    const unsigned char* table = sav + CARVE_ALLOC_TABLE_OFFSET;
+    
+    // The working memory song is named after the active project, if there is one
+    lsdj_project_t* project = carve_decompressed_song(sav, error);
+    if (project)
+    {
+        const unsigned char active = sav[CARVE_ACTIVE_PROJECT_OFFSET];
+        if (active != LSDJ_NO_ACTIVE_PROJECT)
+        {
+            lsdj_project_set_name(project, names + active * LSDJ_PROJECT_NAME_LENGTH, LSDJ_PROJECT_NAME_LENGTH);
+            lsdj_project_set_version(project, versions[active]);
+        }
+        
+        carve_emit(state, LSDJ_CARVE_WORKING_MEMORY, offset, LSDJ_NO_ACTIVE_PROJECT, project);
+    }
+    
+    // Every project's block chain starts at the first block allocated to it
+    for (unsigned char index = 0; index < LSDJ_SAV_PROJECT_COUNT && !state->stopped && !(error && *error); ++index)
+    {
+        const unsigned char* first = (const unsigned char*)memchr(table, index, BLOCK_COUNT);
+        if (first == NULL)
+            continue;
+        
+        project = carve_compressed_song(sav, size, (unsigned char)(first - table), state, error);
+        if (project == NULL)
+            continue;
+        
+        lsdj_project_set_name(project, names + index * LSDJ_PROJECT_NAME_LENGTH, LSDJ_PROJECT_NAME_LENGTH);
+        lsdj_project_set_version(project, versions[index]);
+        carve_emit(state, LSDJ_CARVE_PROJECT, offset, index, project);
+    }
+    
+    return state->count - count;
+}
+
+size_t lsdj_carve_memory(const unsigned char* data, size_t size, lsdj_carve_visitor_t visitor, void* user_data, lsdj_error_t** error)
+{
+    if (data == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
+        return 0;
+    }
+    
+    if (visitor == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "visitor is NULL");
+        return 0;
+    }
+    
+    carve_state_t state;
+    state.visitor = visitor;
+    state.user_data = user_data;
+    state.count = 0;
+    state.stopped = 0;
+    
+    state.context = lsdj_codec_context_new(error);
+    if (state.context == NULL)
+        return 0;
+    
+    state.blocks = lsdj_codec_context_borrow_block_buffer(state.context, error);
+    if (state.blocks == NULL)
+    {
+        lsdj_codec_context_free(state.context);
+        return 0;
+    }
+    
+    // Walk through the candidates for both kinds in the order they appear
+    size_t sav = find_carved_sav(data, size, 0);
+    size_t song = find_carved_song(data, size, 0);
+    while ((sav < size || song < size) && !state.stopped && !(error && *error))
+    {
+        if (sav <= song)
+        {
+            const size_t available = size - sav < LSDJ_SAV_SIZE ? size - sav : LSDJ_SAV_SIZE;
+            if (carve_sav(data + sav, available, sav, &state, error) == 0)
+            {
+                // Nothing in there, so it was probably a coincidental 'jk'
+                sav = find_carved_sav(data, size, sav + 1);
+                continue;
+            }
+            
+            // Savs don't overlap, and any 'rb' flags in this one have been dealt with
+            const size_t end = sav + available;
+            if (song < end)
+                song = find_carved_song(data, size, end);
+            sav = find_carved_sav(data, size, end);
+        } else {
+            lsdj_project_t* project = carve_decompressed_song(data + song, error);
+            if (project)
+            {
+                carve_emit(&state, LSDJ_CARVE_SONG, song, LSDJ_NO_ACTIVE_PROJECT, project);
+                song = find_carved_song(data, size, song + LSDJ_SONG_DECOMPRESSED_SIZE);
+            } else {
+                song = find_carved_song(data, size, song + 1);
+            }
+        }
+    }
+    
+    lsdj_codec_context_return_buffer(state.context, state.blocks);
+    lsdj_codec_context_free(state.context);
+    
+    return state.count;
+}
@@ -0,0 +1,92 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_CARVE_H
+#define LSDJ_CARVE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "error.h"
+#include "project.h"
+
+// Where a carved project was recovered from
+typedef enum
+{
+    // A project stored in the blocks of a sav
+    LSDJ_CARVE_PROJECT,
+    
+    // The working memory song of a sav
+    LSDJ_CARVE_WORKING_MEMORY,
+    
+    // A decompressed song outside of any recognisable sav
+    LSDJ_CARVE_SONG
+} lsdj_carve_kind_t;
+
+// A single project recovered from a dump
+typedef struct
+{
+    lsdj_carve_kind_t kind;
+    
+    // Offset of the sav (or loose song) the project was found in
+    size_t offset;
+    
+    // The index of the project in its sav, LSDJ_NO_ACTIVE_PROJECT for other kinds
+    unsigned char projectIndex;
+    
+    // The recovered project, which is freed once the visitor returns
+    const lsdj_project_t* project;
+} lsdj_carve_result_t;
+
+// Called for every recovered project, return non-zero to stop carving
+typedef int (*lsdj_carve_visitor_t)(const lsdj_carve_result_t* result, void* user_data);
+
+// Recover savs and songs from a raw memory dump, such as SRAM or a flash cart image
+/*! The dump is scanned once. Savs are found by their 'jk' initialization bytes and
+    checked against their block allocation table, after which every project's blocks are
+    decompressed separately, so one corrupt project doesn't lose the others. Songs outside
+    of a sav are found by their three 'rb' flags. Returns the amount of projects found.
+    error is only set when carving couldn't continue, like when running out of memory. */
+size_t lsdj_carve_memory(const unsigned char* data, size_t size, lsdj_carve_visitor_t visitor, void* user_data, lsdj_error_t** error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
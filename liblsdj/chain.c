@@ -36,11 +36,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "chain.h"
 
 lsdj_chain_t* lsdj_chain_copy(const lsdj_chain_t* chain)
 {
-    lsdj_chain_t* newChain = malloc(sizeof(lsdj_chain_t));
+    lsdj_chain_t* newChain = lsdj_malloc(sizeof(lsdj_chain_t));
     memcpy(newChain, chain, sizeof(lsdj_chain_t));
     return newChain;
 }
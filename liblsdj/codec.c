@@ -0,0 +1,155 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <stdbool.h>
+#include <stdlib.h>
+
+#include "alloc.h"
+#include "codec.h"
+#include "compression.h"
+#include "song.h"
+
+struct lsdj_codec_context_t
+{
+    unsigned char song[LSDJ_SONG_DECOMPRESSED_SIZE];
+    unsigned char blocks[BLOCK_COUNT * BLOCK_SIZE];
+    
+    // Whether the buffers are currently handed out
+    bool songBorrowed;
+    bool blocksBorrowed;
+    
+    // The way songs written with this context are compressed
+    lsdj_compression_mode_t compressionMode;
+    
+    // Whether files that wouldn't change are left alone
+    bool skipIdenticalFiles;
+    
+    // Whether errors are given a detailed message
+    bool errorMessages;
+};
+
+lsdj_codec_context_t* lsdj_codec_context_new(lsdj_error_t** error)
+{
+    lsdj_codec_context_t* context = (lsdj_codec_context_t*)lsdj_malloc(sizeof(lsdj_codec_context_t));
+    if (context == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate codec context");
+        return NULL;
+    }
+    
+    context->songBorrowed = false;
+    context->blocksBorrowed = false;
+    context->compressionMode = LSDJ_COMPRESSION_GREEDY;
+    context->skipIdenticalFiles = false;
+    context->errorMessages = true;
+    
+    return context;
+}
+
+void lsdj_codec_context_free(lsdj_codec_context_t* context)
+{
+    lsdj_free(context);
+}
+
+// Borrow one of the buffers of a context, or allocate one of the same size
+unsigned char* borrow_buffer(unsigned char* buffer, bool* borrowed, size_t size, lsdj_error_t** error)
+{
+    if (borrowed && !*borrowed)
+    {
+        *borrowed = true;
+        return buffer;
+    }
+    
+    unsigned char* allocated = (unsigned char*)lsdj_malloc(size);
+    if (allocated == NULL)
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate codec scratch buffer");
+    
+    return allocated;
+}
+
+unsigned char* lsdj_codec_context_borrow_song_buffer(lsdj_codec_context_t* context, lsdj_error_t** error)
+{
+    return context ?
+        borrow_buffer(context->song, &context->songBorrowed, sizeof(context->song), error) :
+        borrow_buffer(NULL, NULL, LSDJ_SONG_DECOMPRESSED_SIZE, error);
+}
+
+unsigned char* lsdj_codec_context_borrow_block_buffer(lsdj_codec_context_t* context, lsdj_error_t** error)
+{
+    return context ?
+        borrow_buffer(context->blocks, &context->blocksBorrowed, sizeof(context->blocks), error) :
+        borrow_buffer(NULL, NULL, BLOCK_COUNT * BLOCK_SIZE, error);
+}
+
+void lsdj_codec_context_return_buffer(lsdj_codec_context_t* context, unsigned char* buffer)
+{
+    if (context && buffer == context->song)
+        context->songBorrowed = false;
+    else if (context && buffer == context->blocks)
+        context->blocksBorrowed = false;
+    else
+        lsdj_free(buffer);
+}
+
+void lsdj_codec_context_set_compression_mode(lsdj_codec_context_t* context, lsdj_compression_mode_t mode)
+{
+    context->compressionMode = mode;
+}
+
+lsdj_compression_mode_t lsdj_codec_context_get_compression_mode(const lsdj_codec_context_t* context)
+{
+    return context ? context->compressionMode : LSDJ_COMPRESSION_GREEDY;
+}
+
+void lsdj_codec_context_set_skip_identical_files(lsdj_codec_context_t* context, int enabled)
+{
+    context->skipIdenticalFiles = enabled != 0;
+}
+
+int lsdj_codec_context_get_skip_identical_files(const lsdj_codec_context_t* context)
+{
+    return context && context->skipIdenticalFiles ? 1 : 0;
+}
+
+void lsdj_codec_context_set_error_messages(lsdj_codec_context_t* context, int enabled)
+{
+    context->errorMessages = enabled != 0;
+}
+
+int lsdj_codec_context_get_error_messages(const lsdj_codec_context_t* context)
+{
+    return context == NULL || context->errorMessages ? 1 : 0;
+}
@@ -0,0 +1,90 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_CODEC_H
+#define LSDJ_CODEC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "compression.h"
+#include "error.h"
+
+// Scratch memory for decompressing, compressing and packing songs
+/*! Reading and writing savs and lsdsngs needs a decompressed song and a sav's worth of
+    compressed blocks as working memory. Passing a context to the *_with_context() functions
+    reuses its buffers between calls, instead of taking them from the stack or the allocator
+    every time. A context also carries the settings of those calls, such as the compression
+    mode. Only one call can use a context at a time, so give every thread its own. */
+typedef struct lsdj_codec_context_t lsdj_codec_context_t;
+
+// Create/free codec contexts
+lsdj_codec_context_t* lsdj_codec_context_new(lsdj_error_t** error);
+void lsdj_codec_context_free(lsdj_codec_context_t* context);
+
+// Borrow the song buffer (0x8000 bytes) or the block buffer (every block in a sav) of a context
+/*! Without a context (NULL), or when the buffer is already borrowed, a new one is allocated
+    instead. Their contents aren't cleared, nor kept between calls. Hand the buffer back with
+    lsdj_codec_context_return_buffer(). */
+unsigned char* lsdj_codec_context_borrow_song_buffer(lsdj_codec_context_t* context, lsdj_error_t** error);
+unsigned char* lsdj_codec_context_borrow_block_buffer(lsdj_codec_context_t* context, lsdj_error_t** error);
+void lsdj_codec_context_return_buffer(lsdj_codec_context_t* context, unsigned char* buffer);
+
+// Change the way the songs written with a context are compressed
+/*! This is LSDJ_COMPRESSION_GREEDY by default, which is also what calls without a context
+    (NULL) use. Block counts follow the same mode. */
+void lsdj_codec_context_set_compression_mode(lsdj_codec_context_t* context, lsdj_compression_mode_t mode);
+lsdj_compression_mode_t lsdj_codec_context_get_compression_mode(const lsdj_codec_context_t* context);
+
+// Enable or disable leaving files alone that already contain what would be written to them
+/*! Applies to the *_to_file_with_context() writers, see lsdj_atomic_file_update(). This is
+    disabled by default, and without a context (NULL). */
+void lsdj_codec_context_set_skip_identical_files(lsdj_codec_context_t* context, int enabled);
+int lsdj_codec_context_get_skip_identical_files(const lsdj_codec_context_t* context);
+
+// Enable or disable giving the errors of the probing functions a detailed message
+/*! Messages are enabled by default, and without a context (NULL). Disable them when probing
+    large amounts of input you expect to be rejected with lsdj_sav_is_likely_valid_with_context()
+    and the like, so failures only carry a code and never touch the heap. */
+void lsdj_codec_context_set_error_messages(lsdj_codec_context_t* context, int enabled);
+int lsdj_codec_context_get_error_messages(const lsdj_codec_context_t* context);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_COLUMNS_H
+#define LSDJ_COLUMNS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "song.h"
+
+// The phrases and tables of a song, stored column by column instead of object by object
+/*! Every column is one contiguous array covering all phrases or tables, so whole-song passes
+    over (for example) every command in the song become a single loop over flat memory.
+    Unallocated phrases and tables are zeroed out, check the allocation columns to tell them apart. */
+typedef struct
+{
+    unsigned char phraseAllocated[LSDJ_PHRASE_COUNT];
+    unsigned char phraseNotes[LSDJ_PHRASE_COUNT][LSDJ_PHRASE_LENGTH];
+    unsigned char phraseInstruments[LSDJ_PHRASE_COUNT][LSDJ_PHRASE_LENGTH];
+    unsigned char phraseCommands[LSDJ_PHRASE_COUNT][LSDJ_PHRASE_LENGTH];
+    unsigned char phraseValues[LSDJ_PHRASE_COUNT][LSDJ_PHRASE_LENGTH];
+    
+    unsigned char tableAllocated[LSDJ_TABLE_COUNT];
+    unsigned char tableVolumes[LSDJ_TABLE_COUNT][LSDJ_TABLE_LENGTH];
+    unsigned char tableTranspositions[LSDJ_TABLE_COUNT][LSDJ_TABLE_LENGTH];
+    unsigned char tableCommands1[LSDJ_TABLE_COUNT][LSDJ_TABLE_LENGTH];
+    unsigned char tableValues1[LSDJ_TABLE_COUNT][LSDJ_TABLE_LENGTH];
+    unsigned char tableCommands2[LSDJ_TABLE_COUNT][LSDJ_TABLE_LENGTH];
+    unsigned char tableValues2[LSDJ_TABLE_COUNT][LSDJ_TABLE_LENGTH];
+} lsdj_song_columns_t;
+
+// Gather the phrases and tables of a song into columns
+void lsdj_song_get_columns(const lsdj_song_t* song, lsdj_song_columns_t* columns);
+
+// Scatter columns back into the phrases and tables of a song
+/*! Only phrases and tables the song has allocated are written, the allocation columns are
+    ignored. Like the non-const getters, this marks the song dirty. */
+void lsdj_song_set_columns(lsdj_song_t* song, const lsdj_song_columns_t* columns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
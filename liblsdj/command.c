@@ -33,6 +33,8 @@
  
  */
 
+#include <string.h>
+
 #include "command.h"
 
 void lsdj_command_clear(lsdj_command_t* command)
@@ -40,3 +42,51 @@ void lsdj_command_clear(lsdj_command_t* command)
     command->command = 0;
     command->value = 0;
 }
+
+void lsdj_command_map_init(lsdj_command_map_t* map)
+{
+    for (int value = 0; value < 256; ++value)
+        map->values[0][value] = (unsigned char)value;
+    
+    for (int command = 1; command < LSDJ_COMMAND_COUNT; ++command)
+        memcpy(map->values[command], map->values[0], 256);
+}
+
+void lsdj_command_map_set(lsdj_command_map_t* map, unsigned char command, const unsigned char values[256])
+{
+    if (command < LSDJ_COMMAND_COUNT)
+        memcpy(map->values[command], values, 256);
+}
+
+size_t lsdj_command_map_apply(const lsdj_command_map_t* map, lsdj_command_t* commands, size_t count)
+{
+    size_t changed = 0;
+    
+    // A plain lookup per command, a gather like this doesn't vectorize with SSE2/NEON
+    for (size_t i = 0; i < count; ++i)
+    {
+        const unsigned char command = commands[i].command;
+        if (command < LSDJ_COMMAND_COUNT)
+        {
+            const unsigned char value = map->values[command][commands[i].value];
+            changed += value != commands[i].value;
+            commands[i].value = value;
+        }
+    }
+    
+    return changed;
+}
+
+size_t lsdj_command_map_count(const lsdj_command_map_t* map, const lsdj_command_t* commands, size_t count)
+{
+    size_t changed = 0;
+    
+    for (size_t i = 0; i < count; ++i)
+    {
+        const unsigned char command = commands[i].command;
+        if (command < LSDJ_COMMAND_COUNT)
+            changed += map->values[command][commands[i].value] != commands[i].value;
+    }
+    
+    return changed;
+}
@@ -66,6 +66,9 @@ extern "C" {
 #define LSDJ_COMMAND_ARDUINO_BOY_X (0x14)
 #define LSDJ_COMMAND_ARDUINO_BOY_Q (0x15)
 #define LSDJ_COMMAND_ARDUINO_BOY_Y (0x16)
+
+// The amount of known command types
+#define LSDJ_COMMAND_COUNT (0x17)
     
 // Structure representing an effect command with its argument value
 typedef struct
@@ -76,6 +79,27 @@ typedef struct
     
 // Clear the command to factory settings
 void lsdj_command_clear(lsdj_command_t* command);
+
+// A lookup table for rewriting command values, keyed on command type and value
+/*! values[command][value] replaces value for that command. Unknown command types are left alone. */
+typedef struct
+{
+    unsigned char values[LSDJ_COMMAND_COUNT][256];
+} lsdj_command_map_t;
+
+// Set up a command map that leaves every command as it is
+void lsdj_command_map_init(lsdj_command_map_t* map);
+
+// Change what a command map does with one command type
+/*! The table is indexed by the current value and holds the new values */
+void lsdj_command_map_set(lsdj_command_map_t* map, unsigned char command, const unsigned char values[256]);
+
+// Rewrite a range of commands through a command map
+/*! Returns the amount of command values that were changed */
+size_t lsdj_command_map_apply(const lsdj_command_map_t* map, lsdj_command_t* commands, size_t count);
+
+// Count the command values in a range that a command map would change, without changing them
+size_t lsdj_command_map_count(const lsdj_command_map_t* map, const lsdj_command_t* commands, size_t count);
     
 #ifdef __cplusplus
 }
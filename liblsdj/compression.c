@@ -34,11 +34,26 @@
  */
 
 #include <assert.h>
+#include <limits.h>
 #include <string.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LSDJ_COMPRESSION_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LSDJ_COMPRESSION_NEON
+#include <arm_neon.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include "alloc.h"
 #include "compression.h"
 #include "instrument.h"
 #include "song.h"
+#include "trace.h"
 #include "wave.h"
 
 #define RUN_LENGTH_ENCODING_BYTE 0xC0
@@ -47,29 +62,101 @@
 #define LSDJ_DEFAULT_WAVE_BYTE 0xF0
 #define LSDJ_DEFAULT_INSTRUMENT_BYTE 0xF1
 
+// A jump byte can't address more blocks than this, so no song needs more jumps when the read size is unknown
+#define MAX_BLOCK_JUMP_COUNT 0xFF
+
 static const unsigned char LSDJ_DEFAULT_INSTRUMENT_COMPRESSION[LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH] = { 0xA8, 0, 0, 0xFF, 0, 0, 3, 0, 0, 0xD0, 0, 0, 0, 0xF3, 0, 0 };
 
+// Find the index of the lowest set bit in a (non-zero) mask
+unsigned int lowest_set_bit(unsigned int mask)
+{
+    assert(mask != 0);
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (unsigned int)index;
+#elif defined(__GNUC__)
+    return (unsigned int)__builtin_ctz(mask);
+#else
+    unsigned int index = 0;
+    while ((mask & 1) == 0)
+    {
+        mask >>= 1;
+        ++index;
+    }
+    return index;
+#endif
+}
+
+// Compare 16 bytes of data against a 16-byte pattern
+int matches_pattern_16(const unsigned char* data, const unsigned char* pattern)
+{
+#if defined(LSDJ_COMPRESSION_SSE2)
+    const __m128i lhs = _mm_loadu_si128((const __m128i*)data);
+    const __m128i rhs = _mm_loadu_si128((const __m128i*)pattern);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(lhs, rhs)) == 0xFFFF;
+#elif defined(LSDJ_COMPRESSION_NEON)
+    const uint8x16_t equal = vceqq_u8(vld1q_u8(data), vld1q_u8(pattern));
+    const uint64x2_t halves = vreinterpretq_u64_u8(equal);
+    return (vgetq_lane_u64(halves, 0) & vgetq_lane_u64(halves, 1)) == ~(uint64_t)0;
+#else
+    return memcmp(data, pattern, 16) == 0;
+#endif
+}
+
+// Count how many consecutive bytes are equal to the first one, up to max
+unsigned int count_run(const unsigned char* data, unsigned int max)
+{
+    const unsigned char c = data[0];
+    unsigned int count = 0;
+    
+#if defined(LSDJ_COMPRESSION_SSE2)
+    const __m128i needle = _mm_set1_epi8((char)c);
+    for (; count + 16 <= max; count += 16)
+    {
+        const __m128i chunk = _mm_loadu_si128((const __m128i*)(data + count));
+        const unsigned int mismatch = ~(unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, needle)) & 0xFFFF;
+        if (mismatch)
+            return count + lowest_set_bit(mismatch);
+    }
+#elif defined(LSDJ_COMPRESSION_NEON)
+    const uint8x16_t needle = vdupq_n_u8(c);
+    for (; count + 16 <= max; count += 16)
+    {
+        const uint8x16_t equal = vceqq_u8(vld1q_u8(data + count), needle);
+        const uint64x2_t halves = vreinterpretq_u64_u8(equal);
+        if ((vgetq_lane_u64(halves, 0) & vgetq_lane_u64(halves, 1)) != ~(uint64_t)0)
+            break;
+    }
+#endif
+    
+    while (count < max && data[count] == c)
+        ++count;
+    
+    return count;
+}
+
 void decompress_rle_byte(lsdj_vio_t* rvio, lsdj_vio_t* wvio, lsdj_error_t** error)
 {
     unsigned char byte;
     if (rvio->read(&byte, 1, rvio->user_data) != 1)
-        return lsdj_error_new(error, "could not read RLE byte");
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read RLE byte");
     
     if (byte == RUN_LENGTH_ENCODING_BYTE)
     {
         if (wvio->write(&byte, 1, wvio->user_data) != 1)
-            return lsdj_error_new(error, "could not write RLE byte");
+            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write RLE byte");
     }
     else
     {
         unsigned char count = 0;
         if (rvio->read(&count, 1, rvio->user_data) != 1)
-            return lsdj_error_new(error, "could not read RLE count byte");
+            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read RLE count byte");
         
         for (int i = 0; i < count; ++i)
         {
             if (wvio->write(&byte, 1, wvio->user_data) != 1)
-                return lsdj_error_new(error, "could not write byte for RLE expansion");
+                return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write byte for RLE expansion");
         }
     }
 }
@@ -78,12 +165,12 @@ void decompress_LSDJ_DEFAULT_WAVE_byte(lsdj_vio_t* rvio, lsdj_vio_t* wvio, lsdj_
 {
     unsigned char count = 0;
     if (rvio->read(&count, 1, rvio->user_data) != 1)
-        return lsdj_error_new(error, "could not read default wave count byte");
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read default wave count byte");
     
     for (int i = 0; i < count; ++i)
     {
         if (wvio->write(LSDJ_DEFAULT_WAVE, sizeof(LSDJ_DEFAULT_WAVE), wvio->user_data) != sizeof(LSDJ_DEFAULT_WAVE))
-            return lsdj_error_new(error, "could not write default wave byte");
+            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write default wave byte");
     }
 }
 
@@ -91,26 +178,42 @@ void decompress_LSDJ_DEFAULT_INSTRUMENT_byte(lsdj_vio_t* rvio, lsdj_vio_t* wvio,
 {
     unsigned char count = 0;
     if (rvio->read(&count, 1, rvio->user_data) != 1)
-        return lsdj_error_new(error, "could not read default instrument count byte");
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read default instrument count byte");
     
     for (int i = 0; i < count; ++i)
     {
         if (wvio->write(LSDJ_DEFAULT_INSTRUMENT_COMPRESSION, sizeof(LSDJ_DEFAULT_INSTRUMENT_COMPRESSION), wvio->user_data) != sizeof(LSDJ_DEFAULT_INSTRUMENT_COMPRESSION))
-            return lsdj_error_new(error, "could not write default instrument byte");
+            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write default instrument byte");
     }
 }
 
-void decompress_sa_byte(lsdj_vio_t* rvio, long* currentBlockPosition, long* block1position, size_t blockSize, lsdj_vio_t* wvio, int* reading, lsdj_error_t** error)
+// Move to the block a jump byte points at, or simply to the next one without a first block position
+/*! Every block can be jumped to at most once, so going over maxJumpCount means the blocks
+    form a cycle. Returns 0 on success, 1 for a cycle, in which case nothing moves. */
+int jump_to_block(unsigned char byte, long* currentBlockPosition, const long* block1position, size_t blockSize, size_t* jumpCount, size_t maxJumpCount)
+{
+    if (++(*jumpCount) > maxJumpCount)
+        return 1;
+    
+    if (block1position)
+        *currentBlockPosition = *block1position + (long)((byte - 1) * blockSize);
+    else
+        *currentBlockPosition += (long)blockSize;
+    
+    return 0;
+}
+
+void decompress_sa_byte(lsdj_vio_t* rvio, long* currentBlockPosition, long* block1position, size_t blockSize, size_t* jumpCount, lsdj_vio_t* wvio, int* reading, lsdj_error_t** error)
 {
     unsigned char byte = 0;
     if (rvio->read(&byte, 1, rvio->user_data) != 1)
-        return lsdj_error_new(error, "could not read SA byte");
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read SA byte");
     
     switch (byte)
     {
         case SPECIAL_ACTION_BYTE:
             if (wvio->write(&byte, 1, wvio->user_data) != 1)
-                return lsdj_error_new(error, "could not write SA byte");
+                return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write SA byte");
             break;
         case LSDJ_DEFAULT_WAVE_BYTE:
             decompress_LSDJ_DEFAULT_WAVE_byte(rvio, wvio, error);
@@ -126,24 +229,276 @@ void decompress_sa_byte(lsdj_vio_t* rvio, long* currentBlockPosition, long* bloc
             *reading = 0;
             break;
         default:
-            if (block1position)
-                *currentBlockPosition = *block1position + (long)((byte - 1) * blockSize);
-            else
-                *currentBlockPosition += blockSize;
+            if (jump_to_block(byte, currentBlockPosition, block1position, blockSize, jumpCount, MAX_BLOCK_JUMP_COUNT) != 0)
+                return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "compressed blocks jump to each other in a cycle");
             
             if (rvio->seek(*currentBlockPosition, SEEK_SET, rvio->user_data) != 0)
-                return lsdj_error_new(error, "could not seek to new block position");
+                return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not seek to new block position");
             break;
     }
 }
 
-void lsdj_decompress(lsdj_vio_t* rvio, lsdj_vio_t* wvio, long* block1position, size_t blockSize, lsdj_error_t** error)
+// Write a byte pattern count times into memory, as far as there's room for it
+/*! Returns 0 if the entire expansion fit, 1 otherwise */
+int expand_into_memory(lsdj_memory_data_t* wmem, const unsigned char* pattern, size_t patternSize, size_t count)
+{
+    const size_t available = wmem->size - (size_t)(wmem->cur - wmem->begin);
+    const size_t total = patternSize * count;
+    const size_t minSize = total < available ? total : available;
+
+    if (patternSize == 1)
+    {
+        memset(wmem->cur, pattern[0], minSize);
+    } else {
+        for (size_t i = 0; i < minSize; i += patternSize)
+            memcpy(wmem->cur + i, pattern, minSize - i < patternSize ? minSize - i : patternSize);
+    }
+
+    wmem->cur += minSize;
+    return minSize == total ? 0 : 1;
+}
+
+// Decompress directly between two memory buffers
+/*! This is the same algorithm as the generic lsdj_decompress(), but it works on the
+    raw pointers instead of dispatching every single byte through the vio functions */
+void decompress_memory(lsdj_memory_data_t* rmem, lsdj_memory_data_t* wmem, long* block1position, size_t blockSize, lsdj_error_t** error)
+{
+    const unsigned char* rend = rmem->begin + rmem->size;
+    const unsigned char* wend = wmem->begin + wmem->size;
+
+    if (rmem->cur < rmem->begin || rmem->cur > rend)
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not tell current block position");
+    if (wmem->cur < wmem->begin || wmem->cur > wend)
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not tell compression end");
+
+    const unsigned char* wstart = wmem->cur;
+    long currentBlockPosition = rmem->cur - rmem->begin;
+
+    // More jumps than there are blocks means they form a cycle, see jump_to_block()
+    const size_t maxJumpCount = rmem->size / blockSize;
+    size_t jumpCount = 0;
+
+    int reading = 1;
+    while (reading == 1)
+    {
+        if (rmem->cur >= rend)
+            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read byte for decompression");
+
+        unsigned char byte = *rmem->cur++;
+        switch (byte)
+        {
+            case RUN_LENGTH_ENCODING_BYTE:
+                if (rmem->cur >= rend)
+                    return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read RLE byte");
+
+                byte = *rmem->cur++;
+                if (byte == RUN_LENGTH_ENCODING_BYTE)
+                {
+                    if (expand_into_memory(wmem, &byte, 1, 1) != 0)
+                        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write RLE byte");
+                } else {
+                    if (rmem->cur >= rend)
+                        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read RLE count byte");
+
+                    const unsigned char count = *rmem->cur++;
+                    if (expand_into_memory(wmem, &byte, 1, count) != 0)
+                        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write byte for RLE expansion");
+                }
+                break;
+
+            case SPECIAL_ACTION_BYTE:
+                if (rmem->cur >= rend)
+                    return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read SA byte");
+
+                byte = *rmem->cur++;
+                switch (byte)
+                {
+                    case SPECIAL_ACTION_BYTE:
+                        if (expand_into_memory(wmem, &byte, 1, 1) != 0)
+                            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write SA byte");
+                        break;
+                    case LSDJ_DEFAULT_WAVE_BYTE:
+                        if (rmem->cur >= rend)
+                            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read default wave count byte");
+                        if (expand_into_memory(wmem, LSDJ_DEFAULT_WAVE, sizeof(LSDJ_DEFAULT_WAVE), *rmem->cur++) != 0)
+                            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write default wave byte");
+                        break;
+                    case LSDJ_DEFAULT_INSTRUMENT_BYTE:
+                        if (rmem->cur >= rend)
+                            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read default instrument count byte");
+                        if (expand_into_memory(wmem, LSDJ_DEFAULT_INSTRUMENT_COMPRESSION, sizeof(LSDJ_DEFAULT_INSTRUMENT_COMPRESSION), *rmem->cur++) != 0)
+                            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write default instrument byte");
+                        break;
+                    case END_OF_FILE_BYTE:
+                        reading = 0;
+                        break;
+                    default:
+                        if (jump_to_block(byte, &currentBlockPosition, block1position, blockSize, &jumpCount, maxJumpCount) != 0)
+                            return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "compressed blocks jump to each other in a cycle");
+
+                        if (currentBlockPosition < 0 || currentBlockPosition > (long)rmem->size)
+                            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not seek to new block position");
+
+                        rmem->cur = rmem->begin + currentBlockPosition;
+                        break;
+                }
+                break;
+
+            default:
+                if (expand_into_memory(wmem, &byte, 1, 1) != 0)
+                    return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write decompression byte");
+                break;
+        }
+    }
+
+    const long readSize = wmem->cur - wstart;
+    if (readSize != LSDJ_SONG_DECOMPRESSED_SIZE)
+    {
+        if (error)
+        {
+            char buffer[100];
+            memset(buffer, '\0', sizeof(buffer));
+            snprintf(buffer, sizeof(buffer), "decompressed size does not line up with 0x8000 bytes (but 0x%lx)", readSize);
+            lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, buffer);
+        }
+    }
+}
+
+// A range of decompressed output that is being looked for
+typedef struct
+{
+    // The amount of decompressed bytes produced so far
+    size_t position;
+    
+    // Where the range starts in the decompressed song, and where its bytes are stored
+    size_t offset;
+    unsigned char* data;
+    size_t size;
+} decompression_range_t;
+
+// Account for a byte pattern being written count times, keeping the bytes that fall within range
+void expand_into_range(decompression_range_t* range, const unsigned char* pattern, size_t patternSize, size_t count)
+{
+    const size_t start = range->position;
+    const size_t end = start + patternSize * count;
+    
+    const size_t first = start > range->offset ? start : range->offset;
+    const size_t last = end < range->offset + range->size ? end : range->offset + range->size;
+    for (size_t i = first; i < last; ++i)
+        range->data[i - range->offset] = pattern[(i - start) % patternSize];
+    
+    range->position = end;
+}
+
+// Walk a compressed song in memory without decompressing it, only storing the bytes in range
+void decompress_memory_range(lsdj_memory_data_t* rmem, long* block1position, size_t blockSize, decompression_range_t* range, lsdj_error_t** error)
+{
+    const unsigned char* rend = rmem->begin + rmem->size;
+    if (rmem->cur < rmem->begin || rmem->cur > rend)
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not tell current block position");
+    
+    long currentBlockPosition = rmem->cur - rmem->begin;
+    
+    // More jumps than there are blocks means they form a cycle, see jump_to_block()
+    const size_t maxJumpCount = rmem->size / blockSize;
+    size_t jumpCount = 0;
+    
+    int reading = 1;
+    while (reading == 1)
+    {
+        if (rmem->cur >= rend)
+            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read byte for decompression");
+        
+        unsigned char byte = *rmem->cur++;
+        switch (byte)
+        {
+            case RUN_LENGTH_ENCODING_BYTE:
+                if (rmem->cur >= rend)
+                    return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read RLE byte");
+                
+                byte = *rmem->cur++;
+                if (byte == RUN_LENGTH_ENCODING_BYTE)
+                {
+                    expand_into_range(range, &byte, 1, 1);
+                } else {
+                    if (rmem->cur >= rend)
+                        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read RLE count byte");
+                    
+                    expand_into_range(range, &byte, 1, *rmem->cur++);
+                }
+                break;
+                
+            case SPECIAL_ACTION_BYTE:
+                if (rmem->cur >= rend)
+                    return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read SA byte");
+                
+                byte = *rmem->cur++;
+                switch (byte)
+                {
+                    case SPECIAL_ACTION_BYTE:
+                        expand_into_range(range, &byte, 1, 1);
+                        break;
+                    case LSDJ_DEFAULT_WAVE_BYTE:
+                        if (rmem->cur >= rend)
+                            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read default wave count byte");
+                        expand_into_range(range, LSDJ_DEFAULT_WAVE, sizeof(LSDJ_DEFAULT_WAVE), *rmem->cur++);
+                        break;
+                    case LSDJ_DEFAULT_INSTRUMENT_BYTE:
+                        if (rmem->cur >= rend)
+                            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read default instrument count byte");
+                        expand_into_range(range, LSDJ_DEFAULT_INSTRUMENT_COMPRESSION, sizeof(LSDJ_DEFAULT_INSTRUMENT_COMPRESSION), *rmem->cur++);
+                        break;
+                    case END_OF_FILE_BYTE:
+                        reading = 0;
+                        break;
+                    default:
+                        if (jump_to_block(byte, &currentBlockPosition, block1position, blockSize, &jumpCount, maxJumpCount) != 0)
+                            return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "compressed blocks jump to each other in a cycle");
+                        
+                        if (currentBlockPosition < 0 || currentBlockPosition > (long)rmem->size)
+                            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not seek to new block position");
+                        
+                        rmem->cur = rmem->begin + currentBlockPosition;
+                        break;
+                }
+                break;
+                
+            default:
+                expand_into_range(range, &byte, 1, 1);
+                break;
+        }
+        
+        if (range->position > LSDJ_SONG_DECOMPRESSED_SIZE)
+            return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "decompressed size exceeds 0x8000 bytes");
+    }
+    
+    if (range->position != LSDJ_SONG_DECOMPRESSED_SIZE)
+    {
+        if (error)
+        {
+            char buffer[100];
+            memset(buffer, '\0', sizeof(buffer));
+            snprintf(buffer, sizeof(buffer), "decompressed size does not line up with 0x8000 bytes (but 0x%lx)", (long)range->position);
+            lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, buffer);
+        }
+    }
+}
+
+void decompress_song(lsdj_vio_t* rvio, lsdj_vio_t* wvio, long* block1position, size_t blockSize, lsdj_error_t** error)
 {
+    // When both sides are plain memory, skip the per-byte vio dispatching entirely
+    if (rvio->read == lsdj_mread && rvio->seek == lsdj_mseek && rvio->tell == lsdj_mtell &&
+        wvio->write == lsdj_mwrite && wvio->tell == lsdj_mtell)
+    {
+        return decompress_memory((lsdj_memory_data_t*)rvio->user_data, (lsdj_memory_data_t*)wvio->user_data, block1position, blockSize, error);
+    }
+
     long wstart = wvio->tell(wvio->user_data);
     long currentBlockPosition = rvio->tell(rvio->user_data);
     if (currentBlockPosition == -1L)
-        return lsdj_error_new(error, "could not tell current block position");
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not tell current block position");
     
+    size_t jumpCount = 0;
     unsigned char byte = 0;
     
     int reading = 1;
@@ -155,7 +510,7 @@ void lsdj_decompress(lsdj_vio_t* rvio, lsdj_vio_t* wvio, long* block1position, s
 //        printf("read: 0x%lx\twrite: 0x%lx\n", rcur, wcur);
         
         if (rvio->read(&byte, 1, rvio->user_data) != 1)
-            return lsdj_error_new(error, "could not read byte for decompression");
+            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read byte for decompression");
         
         switch (byte)
         {
@@ -165,28 +520,50 @@ void lsdj_decompress(lsdj_vio_t* rvio, lsdj_vio_t* wvio, long* block1position, s
                     return;
                 break;
             case SPECIAL_ACTION_BYTE:
-                decompress_sa_byte(rvio, &currentBlockPosition, block1position, blockSize, wvio, &reading, error);
+                decompress_sa_byte(rvio, &currentBlockPosition, block1position, blockSize, &jumpCount, wvio, &reading, error);
                 if (error && *error)
                     return;
                 break;
             default:
                 if (wvio->write(&byte, 1, wvio->user_data) != 1)
-                    return lsdj_error_new(error, "could not write decompression byte");
+                    return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write decompression byte");
                 break;
         }
     }
 
     const long wend = wvio->tell(wvio->user_data);
     if (wend == -1L)
-        return lsdj_error_new(error, "could not tell compression end");
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not tell compression end");
     
     const long readSize = wend - wstart;
     if (readSize != LSDJ_SONG_DECOMPRESSED_SIZE)
     {
-        char buffer[100];
-        memset(buffer, '\0', sizeof(buffer));
-        snprintf(buffer, sizeof(buffer), "decompressed size does not line up with 0x8000 bytes (but 0x%lx)", wend - wstart);
-        return lsdj_error_new(error, buffer);
+        if (error)
+        {
+            char buffer[100];
+            memset(buffer, '\0', sizeof(buffer));
+            snprintf(buffer, sizeof(buffer), "decompressed size does not line up with 0x8000 bytes (but 0x%lx)", wend - wstart);
+            lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, buffer);
+        }
+    }
+}
+
+void lsdj_decompress(lsdj_vio_t* rvio, lsdj_vio_t* wvio, long* block1position, size_t blockSize, lsdj_error_t** error)
+{
+    LSDJ_TRACE_BEGIN(LSDJ_TRACE_DECOMPRESS);
+    
+    lsdj_error_t* decompressError = NULL;
+    decompress_song(rvio, wvio, block1position, blockSize, &decompressError);
+    
+    LSDJ_TRACE_COUNT(LSDJ_TRACE_DECOMPRESS, LSDJ_TRACE_BYTES_OUT, decompressError ? 0 : LSDJ_SONG_DECOMPRESSED_SIZE);
+    LSDJ_TRACE_END(LSDJ_TRACE_DECOMPRESS);
+    
+    if (decompressError)
+    {
+        if (error)
+            *error = decompressError;
+        else
+            lsdj_error_free(decompressError);
     }
 }
 
@@ -194,46 +571,175 @@ void lsdj_decompress_from_file(const char* path, lsdj_vio_t* wvio, long* firstBl
 {
     if (path == NULL)
     {
-        lsdj_error_new(error, "path is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
         return;
     }
     
-    FILE* file = fopen(path, "rb");
+    lsdj_buffered_file_t* file = lsdj_buffered_file_open(path, "rb", LSDJ_BUFFERED_FILE_DEFAULT_SIZE, error);
     if (file == NULL)
-    {
-        char message[512];
-        snprintf(message, 512, "could not open %s for reading", path);
-        return lsdj_error_new(error, message);
-    }
+        return;
     
     lsdj_vio_t vio;
-    vio.read = lsdj_fread;
-    vio.tell = lsdj_ftell;
-    vio.seek = lsdj_fseek;
-    vio.user_data = file;
+    lsdj_buffered_file_init_vio(file, &vio);
     
     lsdj_decompress(&vio, wvio, firstBlockOffset, blockSize, error);
     
-    fclose(file);
+    lsdj_buffered_file_close(file, error);
 }
 
-unsigned int lsdj_compress(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, lsdj_vio_t* wvio, lsdj_error_t** error)
+void lsdj_decompress_range(lsdj_vio_t* rvio, long* block1position, size_t blockSize, size_t offset, unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    if (offset + size > LSDJ_SONG_DECOMPRESSED_SIZE)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "decompression range lies outside of the song");
+    
+    // Memory can be walked without decompressing anything outside of the range
+    if (rvio->read == lsdj_mread && rvio->seek == lsdj_mseek && rvio->tell == lsdj_mtell)
+    {
+        decompression_range_t range;
+        range.position = 0;
+        range.offset = offset;
+        range.data = data;
+        range.size = size;
+        
+        return decompress_memory_range((lsdj_memory_data_t*)rvio->user_data, block1position, blockSize, &range, error);
+    }
+    
+    // Other sources are decompressed in full, after which the range is copied out
+    unsigned char decompressed[LSDJ_SONG_DECOMPRESSED_SIZE];
+    
+    lsdj_memory_data_t wmem;
+    wmem.begin = wmem.cur = decompressed;
+    wmem.size = sizeof(decompressed);
+    
+    lsdj_vio_t wvio;
+    wvio.write = lsdj_mwrite;
+    wvio.tell = lsdj_mtell;
+    wvio.seek = lsdj_mseek;
+    wvio.user_data = &wmem;
+    
+    lsdj_decompress(rvio, &wvio, block1position, blockSize, error);
+    if (error && *error)
+        return;
+    
+    memcpy(data, decompressed + offset, size);
+}
+
+// The amount of special events a compression wrote, for tracing
+typedef struct
+{
+    size_t rle;
+    size_t defaultWave;
+    size_t defaultInstrument;
+} compression_events_t;
+
+// Choose the next event greedily, the first one that matches at the read position
+/*! Writes the event to event, and returns the read position right after what it encodes */
+const unsigned char* next_greedy_event(const unsigned char* read, const unsigned char* end, unsigned char* event, unsigned short* eventSize, compression_events_t* events)
+{
+    // Are we reading a default wave? If so, we can compress these!
+    unsigned char defaultWaveLengthCount = 0;
+    while (read + LSDJ_WAVE_LENGTH < end && matches_pattern_16(read, LSDJ_DEFAULT_WAVE) && defaultWaveLengthCount != 0xFF)
+    {
+        read += LSDJ_WAVE_LENGTH;
+        ++defaultWaveLengthCount;
+    }
+    
+    if (defaultWaveLengthCount > 0)
+    {
+        event[0] = SPECIAL_ACTION_BYTE;
+        event[1] = LSDJ_DEFAULT_WAVE_BYTE;
+        event[2] = defaultWaveLengthCount;
+        *eventSize = 3;
+        ++events->defaultWave;
+    } else {
+        // Are we reading a default instrument? If so, we can compress these!
+        unsigned char defaultInstrumentLengthCount = 0;
+        while (read + LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH < end && matches_pattern_16(read, LSDJ_DEFAULT_INSTRUMENT_COMPRESSION) && defaultInstrumentLengthCount != 0xFF)
+        {
+            read += LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH;
+            ++defaultInstrumentLengthCount;
+        }
+        
+        if (defaultInstrumentLengthCount > 0)
+        {
+            event[0] = SPECIAL_ACTION_BYTE;
+            event[1] = LSDJ_DEFAULT_INSTRUMENT_BYTE;
+            event[2] = defaultInstrumentLengthCount;
+            *eventSize = 3;
+            ++events->defaultInstrument;
+        } else {
+            // Not a default wave, time to do "normal" compression
+            switch (*read)
+            {
+                case RUN_LENGTH_ENCODING_BYTE:
+                    event[0] = RUN_LENGTH_ENCODING_BYTE;
+                    event[1] = RUN_LENGTH_ENCODING_BYTE;
+                    *eventSize = 2;
+                    read++;
+                    break;
+                    
+                case SPECIAL_ACTION_BYTE:
+                    event[0] = SPECIAL_ACTION_BYTE;
+                    event[1] = SPECIAL_ACTION_BYTE;
+                    *eventSize = 2;
+                    read++;
+                    break;
+                    
+                default:
+                {
+                    unsigned char c = *read;
+                    
+                    // See if we can do run-length encoding
+                    const unsigned int remaining = (unsigned int)(end - read);
+                    const unsigned int count = (read + 3 < end) ? count_run(read, remaining < 0xFF ? remaining : 0xFF) : 0;
+                    if (count >= 4)
+                    {
+                        read += count;
+                        
+                        event[0] = RUN_LENGTH_ENCODING_BYTE;
+                        event[1] = c;
+                        event[2] = (unsigned char)count;
+                        
+                        *eventSize = 3;
+                        ++events->rle;
+                    } else {
+                        event[0] = *read++;
+                        *eventSize = 1;
+                    }
+                    
+                    break;
+                }
+            }
+        }
+    }
+    
+    return read;
+}
+
+unsigned int compress_song(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, lsdj_vio_t* wvio, compression_events_t* events, lsdj_error_t** error)
 {
     if (startBlock == blockCount + 1)
         return 0;
     
+    if (blockSize > BLOCK_SIZE)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "block size is larger than the compression buffer");
+        return 0;
+    }
+    
     unsigned char nextEvent[3] = { 0, 0, 0 };
     unsigned short eventSize = 0;
     
     unsigned char currentBlock = startBlock;
     unsigned int currentBlockSize = 0;
     
-    unsigned char byte = 0;
+    // Each block is assembled here, and written out in one go once it's full
+    unsigned char block[BLOCK_SIZE];
     
     long wstart = wvio->tell(wvio->user_data);
     if (wstart == -1L)
     {
-        lsdj_error_new(error, "could not tell write position on compression");
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not tell write position on compression");
         return 0;
     }
     
@@ -244,128 +750,23 @@ unsigned int lsdj_compress(const unsigned char* data, unsigned int blockSize, un
 //        long wcur = wvio->tell(wvio->user_data) - wstart;
 //        printf("read: 0x%lx\twrite: 0x%lx\n", read - data, wcur);
         
-        // Are we reading a default wave? If so, we can compress these!
-        unsigned char defaultWaveLengthCount = 0;
-        while (read + LSDJ_WAVE_LENGTH < end && memcmp(read, LSDJ_DEFAULT_WAVE, LSDJ_WAVE_LENGTH) == 0 && defaultWaveLengthCount != 0xFF)
-        {
-            read += LSDJ_WAVE_LENGTH;
-            ++defaultWaveLengthCount;
-        }
-        
-        if (defaultWaveLengthCount > 0)
-        {
-            nextEvent[0] = SPECIAL_ACTION_BYTE;
-            nextEvent[1] = LSDJ_DEFAULT_WAVE_BYTE;
-            nextEvent[2] = defaultWaveLengthCount;
-            eventSize = 3;
-        } else {
-            // Are we reading a default instrument? If so, we can compress these!
-            unsigned char defaultInstrumentLengthCount = 0;
-            while (read + LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH < end && memcmp(read, LSDJ_DEFAULT_INSTRUMENT_COMPRESSION, LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH) == 0 && defaultInstrumentLengthCount != 0xFF)
-            {
-                read += LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH;
-                ++defaultInstrumentLengthCount;
-            }
-            
-            if (defaultInstrumentLengthCount > 0)
-            {
-                nextEvent[0] = SPECIAL_ACTION_BYTE;
-                nextEvent[1] = LSDJ_DEFAULT_INSTRUMENT_BYTE;
-                nextEvent[2] = defaultInstrumentLengthCount;
-                eventSize = 3;
-            } else {
-                // Not a default wave, time to do "normal" compression
-                switch (*read)
-                {
-                    case RUN_LENGTH_ENCODING_BYTE:
-                        nextEvent[0] = RUN_LENGTH_ENCODING_BYTE;
-                        nextEvent[1] = RUN_LENGTH_ENCODING_BYTE;
-                        eventSize = 2;
-                        read++;
-                        break;
-                        
-                    case SPECIAL_ACTION_BYTE:
-                        nextEvent[0] = SPECIAL_ACTION_BYTE;
-                        nextEvent[1] = SPECIAL_ACTION_BYTE;
-                        eventSize = 2;
-                        read++;
-                        break;
-                        
-                    default:
-                    {
-                        const unsigned char* beg = read;
-                        
-                        unsigned char c = *read;
-                        
-                        // See if we can do run-length encoding
-                        if ((read + 3 < end) &&
-                            *(read + 1) == c &&
-                            *(read + 2) == c &&
-                            *(read + 3) == c)
-                        {
-                            unsigned char count = 0;
-                            
-                            while (read < end && *read == c && count != 0xFF)
-                            {
-                                ++count;
-                                ++read;
-                            }
-                            
-                            assert((read - beg) == count);
-                            
-                            nextEvent[0] = RUN_LENGTH_ENCODING_BYTE;
-                            nextEvent[1] = c;
-                            nextEvent[2] = count;
-                            
-                            eventSize = 3;
-                        } else {
-                            nextEvent[0] = *read++;
-                            eventSize = 1;
-                        }
-                        
-                        break;
-                    }
-                }
-            }
-        }
+        read = next_greedy_event(read, end, nextEvent, &eventSize, events);
         
         // See if the event would still fit in this block
         // If not, move to a new block
         if (currentBlockSize + eventSize + 2 >= blockSize)
         {
             // Write the "next block" command
-            byte = SPECIAL_ACTION_BYTE;
-            if (wvio->write(&byte, 1, wvio->user_data) != 1)
-            {
-                lsdj_error_new(error, "could not write SA byte for next block command");
-                return 0;
-            }
-            
-            byte = currentBlock + 1;
-            if (wvio->write(&byte, 1, wvio->user_data) != 1)
-            {
-                lsdj_error_new(error, "could not write next block byte for compression");
-                return 0;
-            }
-            
-            currentBlockSize += 2;
+            block[currentBlockSize++] = SPECIAL_ACTION_BYTE;
+            block[currentBlockSize++] = currentBlock + 1;
             assert(currentBlockSize <= blockSize);
             
             // Fill the rest of the block with 0's
-            byte = 0;
-            for (; currentBlockSize < blockSize; currentBlockSize++)
-            {
-                if (wvio->write(&byte, 1, wvio->user_data) != 1)
-                {
-                    lsdj_error_new(error, "could not write 0 for block padding");
-                    return 0;
-                }
-            }
+            memset(block + currentBlockSize, 0, blockSize - currentBlockSize);
             
-            // Make sure we filled up the block entirely
-            if (currentBlockSize != blockSize)
+            if (wvio->write(block, blockSize, wvio->user_data) != blockSize)
             {
-                lsdj_error_new(error, "block wasn't completely filled upon compression");
+                lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write block for compression");
                 return 0;
             }
             
@@ -380,23 +781,25 @@ unsigned int lsdj_compress(const unsigned char* data, unsigned int blockSize, un
                 long pos = wvio->tell(wvio->user_data);
                 if (wvio->seek(wstart, SEEK_SET, wvio->user_data) != 0)
                 {
-                    lsdj_error_new(error, "could not roll back after reaching max block count for compression");
+                    lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not roll back after reaching max block count for compression");
                     return 0;
                 }
                 
-                byte = 0;
-                for (long i = 0; i < pos - wstart; ++i)
+                // Everything written so far consists of whole blocks, so zero it a block at a time
+                memset(block, 0, blockSize);
+                for (long i = 0; i < pos - wstart; i += blockSize)
                 {
-                    if (wvio->write(&byte, 1, wvio->user_data) != 1)
+                    const size_t count = (pos - wstart - i) < (long)blockSize ? (size_t)(pos - wstart - i) : blockSize;
+                    if (wvio->write(block, count, wvio->user_data) != count)
                     {
-                        lsdj_error_new(error, "could not fill rolled back data with 0 for compression");
+                        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not fill rolled back data with 0 for compression");
                         return 0;
                     }
                 }
                 
                 if (wvio->seek(wstart, SEEK_SET, wvio->user_data) != 0)
                 {
-                    lsdj_error_new(error, "could not fill roll back to start for compression roll back");
+                    lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not fill roll back to start for compression roll back");
                     return 0;
                 }
                 
@@ -406,79 +809,451 @@ unsigned int lsdj_compress(const unsigned char* data, unsigned int blockSize, un
             // Don't "continue;" but fall through. We still need to write the event *in the next block*
         }
         
-        if (wvio->write(nextEvent, eventSize, wvio->user_data) != eventSize)
-        {
-            lsdj_error_new(error, "could not write event for compression");
-            return 0;
-        }
+        memcpy(block + currentBlockSize, nextEvent, eventSize);
         
         currentBlockSize += eventSize;
         nextEvent[0] = nextEvent[1] = nextEvent[2] = 0;
         eventSize = 0;
     }
     
-    byte = SPECIAL_ACTION_BYTE;
-    if (wvio->write(&byte, 1, wvio->user_data) != 1)
+    block[currentBlockSize++] = SPECIAL_ACTION_BYTE;
+    block[currentBlockSize++] = END_OF_FILE_BYTE;
+    
+    // Pad and flush the final block
+    memset(block + currentBlockSize, 0, blockSize - currentBlockSize);
+    if (wvio->write(block, blockSize, wvio->user_data) != blockSize)
     {
-        lsdj_error_new(error, "could not write SA for EOF for compression");
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write block for compression");
         return 0;
     }
     
-    byte = END_OF_FILE_BYTE;
-    if (wvio->write(&byte, 1, wvio->user_data) != 1)
+    return currentBlock - startBlock + 1;
+}
+
+// The kinds of events the optimal compressor chooses between
+typedef enum
+{
+    OPTIMAL_LITERAL,
+    OPTIMAL_RLE,
+    OPTIMAL_DEFAULT_WAVE,
+    OPTIMAL_DEFAULT_INSTRUMENT
+} optimal_event_t;
+
+// The cheapest way found to encode the song up to a given position
+typedef struct
+{
+    // blockIndex * blockSize + the bytes already used in that block, UINT_MAX if unreachable
+    unsigned int cost;
+    
+    // Where the last event started, and what kind of event it was
+    unsigned short from;
+    unsigned char event;
+    
+    // Filled in after the search, the position the next event ends at
+    unsigned short next;
+    
+    // The amount of equal bytes, default waves and default instruments starting here
+    unsigned short run;
+    unsigned char waves;
+    unsigned char instruments;
+} optimal_node_t;
+
+// The cost after appending an event of eventSize bytes
+/*! Every block keeps two bytes free for the "next block" or "end of file" command, and
+    an event that doesn't fit anymore moves to a new block */
+unsigned int append_optimal_event(unsigned int cost, unsigned int eventSize, unsigned int blockSize)
+{
+    const unsigned int fill = cost % blockSize;
+    if (fill + eventSize + 2 <= blockSize)
+        return cost + eventSize;
+    
+    return (cost / blockSize + 1) * blockSize + eventSize;
+}
+
+void relax_optimal_node(optimal_node_t* nodes, unsigned int from, unsigned int to, unsigned int eventSize, optimal_event_t event, unsigned int blockSize)
+{
+    const unsigned int cost = append_optimal_event(nodes[from].cost, eventSize, blockSize);
+    if (cost < nodes[to].cost)
     {
-        lsdj_error_new(error, "could not write EOF for compression");
+        nodes[to].cost = cost;
+        nodes[to].from = (unsigned short)from;
+        nodes[to].event = (unsigned char)event;
+    }
+}
+
+// Count the consecutive 16-byte patterns starting at position i, given the count behind it
+unsigned char count_optimal_pattern(const unsigned char* data, unsigned int i, const unsigned char* pattern, unsigned char countBehind)
+{
+    if (i + 16 > LSDJ_SONG_DECOMPRESSED_SIZE || !matches_pattern_16(data + i, pattern))
         return 0;
+    
+    return countBehind < 0xFF ? (unsigned char)(countBehind + 1) : 0xFF;
+}
+
+// Write the bytes for the event that encodes data[from, to)
+unsigned short write_optimal_event(const unsigned char* data, unsigned int from, unsigned int to, optimal_event_t event, unsigned char* bytes, compression_events_t* events)
+{
+    switch (event)
+    {
+        case OPTIMAL_RLE:
+            bytes[0] = RUN_LENGTH_ENCODING_BYTE;
+            bytes[1] = data[from];
+            bytes[2] = (unsigned char)(to - from);
+            ++events->rle;
+            return 3;
+            
+        case OPTIMAL_DEFAULT_WAVE:
+            bytes[0] = SPECIAL_ACTION_BYTE;
+            bytes[1] = LSDJ_DEFAULT_WAVE_BYTE;
+            bytes[2] = (unsigned char)((to - from) / LSDJ_WAVE_LENGTH);
+            ++events->defaultWave;
+            return 3;
+            
+        case OPTIMAL_DEFAULT_INSTRUMENT:
+            bytes[0] = SPECIAL_ACTION_BYTE;
+            bytes[1] = LSDJ_DEFAULT_INSTRUMENT_BYTE;
+            bytes[2] = (unsigned char)((to - from) / LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH);
+            ++events->defaultInstrument;
+            return 3;
+            
+        default:
+            bytes[0] = data[from];
+            if (data[from] != RUN_LENGTH_ENCODING_BYTE && data[from] != SPECIAL_ACTION_BYTE)
+                return 1;
+            
+            bytes[1] = data[from];
+            return 2;
+    }
+}
+
+// Search for the cheapest sequence of events to compress a song with
+/*! Since events never span blocks and ending up earlier in a block is never worse, the
+    cheapest way to reach each position is all that needs to be remembered. Returns the
+    nodes with every event linked to the next one, free them with lsdj_free(). */
+optimal_node_t* plan_optimal_compression(const unsigned char* data, unsigned int blockSize, lsdj_error_t** error)
+{
+    const unsigned int size = LSDJ_SONG_DECOMPRESSED_SIZE;
+    optimal_node_t* nodes = (optimal_node_t*)lsdj_malloc((size + 1) * sizeof(optimal_node_t));
+    if (nodes == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate optimal compression nodes");
+        return NULL;
     }
     
-    if (currentBlockSize > 0)
+    // Find the runs and default waves/instruments starting at every position, back to front
+    nodes[size].run = 0;
+    nodes[size].waves = nodes[size].instruments = 0;
+    for (unsigned int i = size; i-- > 0; )
     {
-        byte = 0;
-        for (currentBlockSize += 2; currentBlockSize < blockSize; currentBlockSize++)
+        nodes[i].run = (unsigned short)((i + 1 < size && data[i + 1] == data[i]) ? nodes[i + 1].run + 1 : 1);
+        nodes[i].waves = count_optimal_pattern(data, i, LSDJ_DEFAULT_WAVE, nodes[i + LSDJ_WAVE_LENGTH <= size ? i + LSDJ_WAVE_LENGTH : size].waves);
+        nodes[i].instruments = count_optimal_pattern(data, i, LSDJ_DEFAULT_INSTRUMENT_COMPRESSION, nodes[i + LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH <= size ? i + LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH : size].instruments);
+        nodes[i].cost = UINT_MAX;
+    }
+    
+    nodes[size].cost = UINT_MAX;
+    nodes[0].cost = 0;
+    
+    // Relax every event that can start at each position, front to back
+    for (unsigned int i = 0; i < size; ++i)
+    {
+        const unsigned char c = data[i];
+        relax_optimal_node(nodes, i, i + 1, (c == RUN_LENGTH_ENCODING_BYTE || c == SPECIAL_ACTION_BYTE) ? 2 : 1, OPTIMAL_LITERAL, blockSize);
+        
+        // The RLE byte itself can't be run-length encoded, C0 C0 is a literal C0
+        if (c != RUN_LENGTH_ENCODING_BYTE)
         {
-            if (wvio->write(&byte, 1, wvio->user_data) != 1)
+            const unsigned int maxRun = nodes[i].run < 0xFF ? nodes[i].run : 0xFF;
+            for (unsigned int count = 2; count <= maxRun; ++count)
+                relax_optimal_node(nodes, i, i + count, 3, OPTIMAL_RLE, blockSize);
+        }
+        
+        for (unsigned int count = 1; count <= nodes[i].waves; ++count)
+            relax_optimal_node(nodes, i, i + count * LSDJ_WAVE_LENGTH, 3, OPTIMAL_DEFAULT_WAVE, blockSize);
+        
+        for (unsigned int count = 1; count <= nodes[i].instruments; ++count)
+            relax_optimal_node(nodes, i, i + count * LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH, 3, OPTIMAL_DEFAULT_INSTRUMENT, blockSize);
+    }
+    
+    // Walk back from the end to link every event to the next one
+    for (unsigned int i = size; i > 0; i = nodes[i].from)
+        nodes[nodes[i].from].next = (unsigned short)i;
+    
+    return nodes;
+}
+
+// Compress a song with the fewest blocks possible
+/*! Where compress_song() greedily takes the first event it can, this searches for the cheapest
+    sequence of events, including where they're split over the blocks */
+unsigned int compress_song_optimal(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, lsdj_vio_t* wvio, compression_events_t* events, lsdj_error_t** error)
+{
+    if (startBlock == blockCount + 1)
+        return 0;
+    
+    if (blockSize > BLOCK_SIZE || blockSize < 5)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "block size is outside of the range the compressor supports");
+        return 0;
+    }
+    
+    const unsigned int size = LSDJ_SONG_DECOMPRESSED_SIZE;
+    optimal_node_t* nodes = plan_optimal_compression(data, blockSize, error);
+    if (nodes == NULL)
+        return 0;
+    
+    // Don't write anything if the song doesn't fit
+    const unsigned int totalBlockCount = nodes[size].cost / blockSize + 1;
+    if (startBlock + totalBlockCount - 1 > blockCount)
+    {
+        lsdj_free(nodes);
+        return 0;
+    }
+    
+    unsigned char block[BLOCK_SIZE];
+    unsigned int currentBlockSize = 0;
+    unsigned char currentBlock = startBlock;
+    
+    for (unsigned int i = 0; i < size; i = nodes[i].next)
+    {
+        const unsigned int next = nodes[i].next;
+        
+        unsigned char event[3];
+        const unsigned short eventSize = write_optimal_event(data, i, next, (optimal_event_t)nodes[next].event, event, events);
+        
+        // Move to the next block exactly where the search decided to
+        if (currentBlockSize + eventSize + 2 > blockSize)
+        {
+            block[currentBlockSize++] = SPECIAL_ACTION_BYTE;
+            block[currentBlockSize++] = currentBlock + 1;
+            memset(block + currentBlockSize, 0, blockSize - currentBlockSize);
+            
+            if (wvio->write(block, blockSize, wvio->user_data) != blockSize)
             {
-                lsdj_error_new(error, "could not write 0 for block padding");
+                lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write block for compression");
+                lsdj_free(nodes);
                 return 0;
             }
+            
+            currentBlock += 1;
+            currentBlockSize = 0;
         }
+        
+        memcpy(block + currentBlockSize, event, eventSize);
+        currentBlockSize += eventSize;
     }
     
-    return currentBlock - startBlock + 1;
+    lsdj_free(nodes);
+    
+    block[currentBlockSize++] = SPECIAL_ACTION_BYTE;
+    block[currentBlockSize++] = END_OF_FILE_BYTE;
+    
+    memset(block + currentBlockSize, 0, blockSize - currentBlockSize);
+    if (wvio->write(block, blockSize, wvio->user_data) != blockSize)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write block for compression");
+        return 0;
+    }
+    
+    assert(currentBlock - startBlock + 1u == totalBlockCount);
+    return (unsigned int)(currentBlock - startBlock) + 1u;
+}
+
+unsigned int lsdj_compress_with_mode(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, lsdj_vio_t* wvio, lsdj_compression_mode_t mode, lsdj_error_t** error)
+{
+    LSDJ_TRACE_BEGIN(LSDJ_TRACE_COMPRESS);
+    
+    compression_events_t events;
+    memset(&events, 0, sizeof(events));
+    
+    const unsigned int written = mode == LSDJ_COMPRESSION_OPTIMAL ?
+        compress_song_optimal(data, blockSize, startBlock, blockCount, wvio, &events, error) :
+        compress_song(data, blockSize, startBlock, blockCount, wvio, &events, error);
+    
+    LSDJ_TRACE_COUNT(LSDJ_TRACE_COMPRESS, LSDJ_TRACE_BYTES_IN, LSDJ_SONG_DECOMPRESSED_SIZE);
+    LSDJ_TRACE_COUNT(LSDJ_TRACE_COMPRESS, LSDJ_TRACE_BYTES_OUT, written * blockSize);
+    LSDJ_TRACE_COUNT(LSDJ_TRACE_COMPRESS, LSDJ_TRACE_RLE_EVENTS, events.rle);
+    LSDJ_TRACE_COUNT(LSDJ_TRACE_COMPRESS, LSDJ_TRACE_DEFAULT_WAVE_EVENTS, events.defaultWave);
+    LSDJ_TRACE_COUNT(LSDJ_TRACE_COMPRESS, LSDJ_TRACE_DEFAULT_INSTRUMENT_EVENTS, events.defaultInstrument);
+    LSDJ_TRACE_COUNT(LSDJ_TRACE_COMPRESS, LSDJ_TRACE_BLOCKS, written);
+    LSDJ_TRACE_END(LSDJ_TRACE_COMPRESS);
+    
+    return written;
+}
+
+unsigned int lsdj_compress(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, lsdj_vio_t* wvio, lsdj_error_t** error)
+{
+    return lsdj_compress_with_mode(data, blockSize, startBlock, blockCount, wvio, LSDJ_COMPRESSION_GREEDY, error);
+}
+
+unsigned int lsdj_compress_optimal(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, lsdj_vio_t* wvio, lsdj_error_t** error)
+{
+    return lsdj_compress_with_mode(data, blockSize, startBlock, blockCount, wvio, LSDJ_COMPRESSION_OPTIMAL, error);
+}
+
+size_t lsdj_compress_size(const unsigned char* data, unsigned int blockSize, lsdj_compression_mode_t mode, unsigned int* blockCount, lsdj_error_t** error)
+{
+    if (blockSize < 5)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "block size is too small to hold any events");
+        return 0;
+    }
+    
+    compression_events_t events;
+    memset(&events, 0, sizeof(events));
+    
+    const unsigned char* end = data + LSDJ_SONG_DECOMPRESSED_SIZE;
+    unsigned char event[3];
+    unsigned short eventSize = 0;
+    
+    // Walk the same events the compressor writes, and split them over blocks the same way
+    /*! The greedy compressor never uses the last byte of a block, the optimal one does */
+    optimal_node_t* nodes = NULL;
+    unsigned int reserved = 3;
+    if (mode == LSDJ_COMPRESSION_OPTIMAL)
+    {
+        nodes = plan_optimal_compression(data, blockSize, error);
+        if (nodes == NULL)
+            return 0;
+        
+        reserved = 2;
+    }
+    
+    size_t totalSize = 0;
+    unsigned int blocks = 1;
+    unsigned int currentBlockSize = 0;
+    for (const unsigned char* read = data; read < end; )
+    {
+        if (nodes)
+        {
+            const unsigned int i = (unsigned int)(read - data);
+            const unsigned int next = nodes[i].next;
+            eventSize = write_optimal_event(data, i, next, (optimal_event_t)nodes[next].event, event, &events);
+            read = data + next;
+        } else {
+            read = next_greedy_event(read, end, event, &eventSize, &events);
+        }
+        
+        // Every block ends in a two-byte next block command
+        if (currentBlockSize + eventSize + reserved > blockSize)
+        {
+            totalSize += currentBlockSize + 2;
+            currentBlockSize = 0;
+            ++blocks;
+        }
+        
+        currentBlockSize += eventSize;
+    }
+    
+    lsdj_free(nodes);
+    
+    // And the last one in an end of file command
+    totalSize += currentBlockSize + 2;
+    
+    if (blockCount)
+        *blockCount = blocks;
+    
+    return totalSize;
 }
 
 unsigned int lsdj_compress_to_file(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, const char* path, lsdj_error_t** error)
 {
     if (path == NULL)
     {
-        lsdj_error_new(error, "path is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
         return 0;
     }
     
     if (data == NULL)
     {
-        lsdj_error_new(error, "data is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
         return 0;
     }
     
-    FILE* file = fopen(path, "wb");
+    lsdj_buffered_file_t* file = lsdj_buffered_file_open(path, "wb", LSDJ_BUFFERED_FILE_DEFAULT_SIZE, error);
     if (file == NULL)
-    {
-        char message[512];
-        snprintf(message, 512, "could not open %s for writing", path);
-        lsdj_error_new(error, message);
         return 0;
-    }
     
     lsdj_vio_t vio;
-    vio.write = lsdj_fwrite;
-    vio.tell = lsdj_ftell;
-    vio.seek = lsdj_fseek;
-    vio.user_data = file;
+    lsdj_buffered_file_init_vio(file, &vio);
     
     unsigned int result = lsdj_compress(data, blockSize, startBlock, blockCount, &vio, error);
     
-    fclose(file);
+    lsdj_buffered_file_close(file, error);
     
     return result;
 }
+
+unsigned int lsdj_copy_compressed_blocks(lsdj_vio_t* rvio, long* block1position, size_t blockSize, unsigned char startBlock, unsigned char* blocks, unsigned int blockCount, lsdj_error_t** error)
+{
+    long currentBlockPosition = rvio->tell(rvio->user_data);
+    if (currentBlockPosition == -1L)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not tell read position for block copy");
+        return 0;
+    }
+    
+    for (unsigned int copied = 0; copied < blockCount; )
+    {
+        unsigned char* block = blocks + copied * blockSize;
+        if (rvio->read(block, blockSize, rvio->user_data) != blockSize)
+        {
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read compressed block");
+            return 0;
+        }
+        
+        ++copied;
+        
+        // Walk the events until we find out where this block leads
+        int jumped = 0;
+        for (size_t i = 0; i < blockSize && !jumped; )
+        {
+            if (block[i] == RUN_LENGTH_ENCODING_BYTE)
+            {
+                i += (i + 1 < blockSize && block[i + 1] == RUN_LENGTH_ENCODING_BYTE) ? 2 : 3;
+            }
+            else if (block[i] == SPECIAL_ACTION_BYTE && i + 1 < blockSize)
+            {
+                const unsigned char action = block[i + 1];
+                switch (action)
+                {
+                    case SPECIAL_ACTION_BYTE:
+                        i += 2;
+                        break;
+                    case LSDJ_DEFAULT_WAVE_BYTE:
+                    case LSDJ_DEFAULT_INSTRUMENT_BYTE:
+                        i += 3;
+                        break;
+                    case END_OF_FILE_BYTE:
+                        return copied;
+                    default:
+                        if (block1position)
+                            currentBlockPosition = *block1position + (long)((action - 1) * blockSize);
+                        else
+                            currentBlockPosition += (long)blockSize;
+                        
+                        if (rvio->seek(currentBlockPosition, SEEK_SET, rvio->user_data) != 0)
+                        {
+                            lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not seek to new block position");
+                            return 0;
+                        }
+                        
+                        // Point the copy to the block that will follow it
+                        block[i + 1] = (unsigned char)(startBlock + copied);
+                        jumped = 1;
+                        break;
+                }
+            } else {
+                ++i;
+            }
+        }
+        
+        if (!jumped)
+        {
+            lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "compressed block does not end in a next block or end of file command");
+            return 0;
+        }
+    }
+    
+    lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "compressed song spans more blocks than were available");
+    return 0;
+}
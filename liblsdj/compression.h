@@ -47,13 +47,52 @@ extern "C" {
 #define BLOCK_COUNT (191)
 
 // Decompress blocks to a song buffer
+/*! Reading from a source that can't seek works through lsdj_forward_init_vio(), as long as
+    every block jumps to one further on */
 void lsdj_decompress(lsdj_vio_t* rvio, lsdj_vio_t* wvio, long* firstBlockOffset, size_t blockSize, lsdj_error_t** error);
 void lsdj_decompress_from_file(const char* path, lsdj_vio_t* wvio, long* firstBlockOffset, size_t blockSize, lsdj_error_t** error);
 
+// Decompress only part of a song, by walking the compressed data without storing anything else
+/*! Only the decompressed bytes in [offset, offset + size) are written to data. This is cheap
+    when rvio reads from memory; other vios are decompressed in full first. */
+void lsdj_decompress_range(lsdj_vio_t* rvio, long* firstBlockOffset, size_t blockSize, size_t offset, unsigned char* data, size_t size, lsdj_error_t** error);
+
+// The ways songs can be compressed, see lsdj_codec_context_set_compression_mode()
+typedef enum
+{
+    // Take the first event that matches (the default, what lsdj_compress() does)
+    LSDJ_COMPRESSION_GREEDY,
+    
+    // Use as few blocks as possible, see lsdj_compress_optimal()
+    LSDJ_COMPRESSION_OPTIMAL
+} lsdj_compression_mode_t;
+
 // Compress a song buffer to a set of blocks
 /*! Returns the amount of blocks written */
 unsigned int lsdj_compress(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, lsdj_vio_t* wvio, lsdj_error_t** error);
 unsigned int lsdj_compress_to_file(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, const char* path, lsdj_error_t** error);
+
+// Compute the size of a compressed song buffer, without writing any blocks
+/*! Returns the exact amount of bytes the compression events and block commands take, leaving
+    out the padding at the end of every block, and stores the amount of blocks in blockCount
+    (if it isn't NULL), for songs compressed the given way. Returns 0 on error. */
+size_t lsdj_compress_size(const unsigned char* data, unsigned int blockSize, lsdj_compression_mode_t mode, unsigned int* blockCount, lsdj_error_t** error);
+
+// Compress a song buffer using as few blocks as possible
+/*! Searches for the cheapest sequence of compression events instead of taking the first one
+    that matches, which is slower but often saves a block. The output decompresses the
+    same way. Writes nothing if the song doesn't fit in the remaining blocks. */
+unsigned int lsdj_compress_optimal(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, lsdj_vio_t* wvio, lsdj_error_t** error);
+
+// Compress a song buffer to a set of blocks, the way the mode says
+unsigned int lsdj_compress_with_mode(const unsigned char* data, unsigned int blockSize, unsigned char startBlock, unsigned int blockCount, lsdj_vio_t* wvio, lsdj_compression_mode_t mode, lsdj_error_t** error);
+
+// Copy the compressed blocks of a song without decompressing them
+/*! Starts reading at the current position of rvio and follows the next block commands
+    the same way lsdj_decompress() does. The blocks are stored consecutively, and their
+    next block commands are renumbered to count up from startBlock.
+    Returns the amount of blocks copied */
+unsigned int lsdj_copy_compressed_blocks(lsdj_vio_t* rvio, long* firstBlockOffset, size_t blockSize, unsigned char startBlock, unsigned char* blocks, unsigned int blockCount, lsdj_error_t** error);
     
 #ifdef __cplusplus
 }
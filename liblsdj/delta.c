@@ -0,0 +1,444 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "chain.h"
+#include "delta.h"
+#include "groove.h"
+#include "hash.h"
+#include "instrument.h"
+#include "phrase.h"
+#include "song_layout.h"
+#include "table.h"
+#include "wave.h"
+#include "word.h"
+
+#define DELTA_MAGIC "LSDD"
+#define DELTA_MAGIC_LENGTH (4)
+#define DELTA_VERSION (1)
+
+// The magic number, version and the hashes of the base and target images
+#define DELTA_HEADER_SIZE (DELTA_MAGIC_LENGTH + 1 + 8 + 8)
+
+// Follows the last record in a delta
+#define DELTA_END (0xFF)
+
+#define DELTA_MAX_COLUMN_COUNT (6)
+
+// More than any record takes
+#define DELTA_MAX_RECORD_SIZE (0x100)
+
+// A stretch of the song image
+typedef struct
+{
+    size_t address;
+    size_t size;
+} delta_region_t;
+
+// Where the bytes of every record of a kind are, one column after the other
+/*! Record i takes size bytes from address + i * size in every column */
+typedef struct
+{
+    size_t count;
+    size_t columnCount;
+    delta_region_t columns[DELTA_MAX_COLUMN_COUNT];
+} delta_layout_t;
+
+static const delta_layout_t DELTA_LAYOUTS[LSDJ_DELTA_META] =
+{
+    { LSDJ_ROW_COUNT, 1, { { SONG_ROWS_ADDRESS, LSDJ_CHANNEL_COUNT } } },
+    { LSDJ_CHAIN_COUNT, 2, { { SONG_CHAIN_PHRASES_ADDRESS, LSDJ_CHAIN_LENGTH }, { SONG_CHAIN_TRANSPOSITIONS_ADDRESS, LSDJ_CHAIN_LENGTH } } },
+    { LSDJ_PHRASE_COUNT, 4, { { SONG_PHRASE_NOTES_ADDRESS, LSDJ_PHRASE_LENGTH }, { SONG_PHRASE_COMMANDS_ADDRESS, LSDJ_PHRASE_LENGTH }, { SONG_PHRASE_VALUES_ADDRESS, LSDJ_PHRASE_LENGTH }, { SONG_PHRASE_INSTRUMENTS_ADDRESS, LSDJ_PHRASE_LENGTH } } },
+    { LSDJ_INSTRUMENT_COUNT, 2, { { SONG_INSTRUMENTS_ADDRESS, SONG_INSTRUMENT_BYTE_COUNT }, { SONG_INSTRUMENT_NAMES_ADDRESS, LSDJ_INSTRUMENT_NAME_LENGTH } } },
+    { LSDJ_TABLE_COUNT, 6, { { SONG_TABLE_VOLUMES_ADDRESS, LSDJ_TABLE_LENGTH }, { SONG_TABLE_TRANSPOSITIONS_ADDRESS, LSDJ_TABLE_LENGTH }, { SONG_TABLE_COMMAND1_ADDRESS, LSDJ_TABLE_LENGTH }, { SONG_TABLE_VALUE1_ADDRESS, LSDJ_TABLE_LENGTH }, { SONG_TABLE_COMMAND2_ADDRESS, LSDJ_TABLE_LENGTH }, { SONG_TABLE_VALUE2_ADDRESS, LSDJ_TABLE_LENGTH } } },
+    { LSDJ_WAVE_COUNT, 1, { { SONG_WAVES_ADDRESS, LSDJ_WAVE_LENGTH } } },
+    { LSDJ_GROOVE_COUNT, 1, { { SONG_GROOVES_ADDRESS, LSDJ_GROOVE_LENGTH } } },
+    { LSDJ_WORD_COUNT, 2, { { SONG_WORDS_ADDRESS, LSDJ_WORD_LENGTH * 2 }, { SONG_WORD_NAMES_ADDRESS, LSDJ_WORD_NAME_LENGTH } } },
+    { LSDJ_SYNTH_COUNT, 1, { { SONG_SYNTHS_ADDRESS, SONG_SYNTH_BYTE_COUNT } } }
+};
+
+// Everything the other kinds leave uncovered, every region being a record of its own
+static const delta_region_t DELTA_META_REGIONS[] =
+{
+    { SONG_BOOKMARKS_ADDRESS, SONG_RESERVED_1030_ADDRESS - SONG_BOOKMARKS_ADDRESS },
+    { SONG_RESERVED_1030_ADDRESS, SONG_GROOVES_ADDRESS - SONG_RESERVED_1030_ADDRESS },
+    { SONG_RB0_ADDRESS, SONG_INSTRUMENT_NAMES_ADDRESS - SONG_RB0_ADDRESS },
+    { SONG_RESERVED_1FBA_ADDRESS, SONG_RESERVED_2000_ADDRESS - SONG_RESERVED_1FBA_ADDRESS },
+    { SONG_RESERVED_2000_ADDRESS, SONG_TABLE_ALLOC_TABLE_ADDRESS - SONG_RESERVED_2000_ADDRESS },
+    { SONG_TABLE_ALLOC_TABLE_ADDRESS, SONG_INSTR_ALLOC_TABLE_ADDRESS - SONG_TABLE_ALLOC_TABLE_ADDRESS },
+    { SONG_INSTR_ALLOC_TABLE_ADDRESS, SONG_CHAIN_PHRASES_ADDRESS - SONG_INSTR_ALLOC_TABLE_ADDRESS },
+    { SONG_RB1_ADDRESS, SONG_PHRASE_ALLOC_TABLE_ADDRESS - SONG_RB1_ADDRESS },
+    { SONG_PHRASE_ALLOC_TABLE_ADDRESS, SONG_CHAIN_ALLOC_TABLE_ADDRESS - SONG_PHRASE_ALLOC_TABLE_ADDRESS },
+    { SONG_CHAIN_ALLOC_TABLE_ADDRESS, SONG_SYNTHS_ADDRESS - SONG_CHAIN_ALLOC_TABLE_ADDRESS },
+    { SONG_WORK_TIME_ADDRESS, SONG_PHRASE_COMMANDS_ADDRESS - SONG_WORK_TIME_ADDRESS },
+    { SONG_RESERVED_5FE0_ADDRESS, SONG_WAVES_ADDRESS - SONG_RESERVED_5FE0_ADDRESS },
+    { SONG_RB2_ADDRESS, LSDJ_SONG_DECOMPRESSED_SIZE - SONG_RB2_ADDRESS }
+};
+
+#define DELTA_META_COUNT (sizeof(DELTA_META_REGIONS) / sizeof(DELTA_META_REGIONS[0]))
+
+size_t delta_record_count(lsdj_delta_kind_t kind)
+{
+    return kind == LSDJ_DELTA_META ? DELTA_META_COUNT : DELTA_LAYOUTS[kind].count;
+}
+
+size_t delta_record_size(lsdj_delta_kind_t kind, size_t index)
+{
+    if (kind == LSDJ_DELTA_META)
+        return DELTA_META_REGIONS[index].size;
+    
+    size_t size = 0;
+    for (size_t i = 0; i < DELTA_LAYOUTS[kind].columnCount; ++i)
+        size += DELTA_LAYOUTS[kind].columns[i].size;
+    
+    return size;
+}
+
+// Copy a record out of a song image
+/*! Returns the size of the record */
+size_t gather_delta_record(const unsigned char* image, lsdj_delta_kind_t kind, size_t index, unsigned char* record)
+{
+    if (kind == LSDJ_DELTA_META)
+    {
+        memcpy(record, image + DELTA_META_REGIONS[index].address, DELTA_META_REGIONS[index].size);
+        return DELTA_META_REGIONS[index].size;
+    }
+    
+    size_t size = 0;
+    for (size_t i = 0; i < DELTA_LAYOUTS[kind].columnCount; ++i)
+    {
+        const delta_region_t* column = &DELTA_LAYOUTS[kind].columns[i];
+        memcpy(record + size, image + column->address + index * column->size, column->size);
+        size += column->size;
+    }
+    
+    return size;
+}
+
+// Copy a record into a song image
+void scatter_delta_record(const unsigned char* record, lsdj_delta_kind_t kind, size_t index, unsigned char* image)
+{
+    if (kind == LSDJ_DELTA_META)
+    {
+        memcpy(image + DELTA_META_REGIONS[index].address, record, DELTA_META_REGIONS[index].size);
+        return;
+    }
+    
+    for (size_t i = 0; i < DELTA_LAYOUTS[kind].columnCount; ++i)
+    {
+        const delta_region_t* column = &DELTA_LAYOUTS[kind].columns[i];
+        memcpy(image + column->address + index * column->size, record, column->size);
+        record += column->size;
+    }
+}
+
+void delta_encode_u64(unsigned char* data, uint64_t value)
+{
+    for (int i = 0; i < 8; ++i)
+        data[i] = (unsigned char)((value >> (i * 8)) & 0xFF);
+}
+
+uint64_t delta_decode_u64(const unsigned char* data)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i)
+        value |= (uint64_t)data[i] << (i * 8);
+    
+    return value;
+}
+
+// Write both songs to images of their own, returns the base image with the target right after it
+unsigned char* write_delta_images(const lsdj_song_t* base, const lsdj_song_t* target, lsdj_error_t** error)
+{
+    unsigned char* images = (unsigned char*)lsdj_malloc(LSDJ_SONG_DECOMPRESSED_SIZE * 2);
+    if (images == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate song images for delta");
+        return NULL;
+    }
+    
+    lsdj_error_t* writeError = NULL;
+    lsdj_song_write_to_memory(base, images, LSDJ_SONG_DECOMPRESSED_SIZE, &writeError);
+    if (writeError == NULL && target)
+        lsdj_song_write_to_memory(target, images + LSDJ_SONG_DECOMPRESSED_SIZE, LSDJ_SONG_DECOMPRESSED_SIZE, &writeError);
+    
+    if (writeError)
+    {
+        lsdj_free(images);
+        if (error)
+            *error = writeError;
+        else
+            lsdj_error_free(writeError);
+        return NULL;
+    }
+    
+    return images;
+}
+
+size_t lsdj_delta_write(const lsdj_song_t* base, const lsdj_song_t* target, lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    if (base == NULL || target == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "song is NULL");
+        return 0;
+    }
+    
+    unsigned char* images = write_delta_images(base, target, error);
+    if (images == NULL)
+        return 0;
+    
+    const unsigned char* baseImage = images;
+    const unsigned char* targetImage = images + LSDJ_SONG_DECOMPRESSED_SIZE;
+    
+    unsigned char header[DELTA_HEADER_SIZE];
+    memcpy(header, DELTA_MAGIC, DELTA_MAGIC_LENGTH);
+    header[DELTA_MAGIC_LENGTH] = DELTA_VERSION;
+    delta_encode_u64(header + DELTA_MAGIC_LENGTH + 1, lsdj_hash(baseImage, LSDJ_SONG_DECOMPRESSED_SIZE, 0));
+    delta_encode_u64(header + DELTA_MAGIC_LENGTH + 9, lsdj_hash(targetImage, LSDJ_SONG_DECOMPRESSED_SIZE, 0));
+    
+    size_t written = vio->write(header, sizeof(header), vio->user_data);
+    if (written != sizeof(header))
+    {
+        lsdj_free(images);
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write delta header");
+        return written;
+    }
+    
+    // Every record is followed by its kind and index, then the record itself
+    unsigned char baseRecord[2 + DELTA_MAX_RECORD_SIZE];
+    unsigned char targetRecord[2 + DELTA_MAX_RECORD_SIZE];
+    for (int kind = 0; kind < LSDJ_DELTA_KIND_COUNT; ++kind)
+    {
+        const size_t count = delta_record_count((lsdj_delta_kind_t)kind);
+        for (size_t i = 0; i < count; ++i)
+        {
+            const size_t size = gather_delta_record(baseImage, (lsdj_delta_kind_t)kind, i, baseRecord + 2);
+            gather_delta_record(targetImage, (lsdj_delta_kind_t)kind, i, targetRecord + 2);
+            if (memcmp(baseRecord + 2, targetRecord + 2, size) == 0)
+                continue;
+            
+            targetRecord[0] = (unsigned char)kind;
+            targetRecord[1] = (unsigned char)i;
+            if (vio->write(targetRecord, size + 2, vio->user_data) != size + 2)
+            {
+                lsdj_free(images);
+                lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write delta record");
+                return written;
+            }
+            
+            written += size + 2;
+        }
+    }
+    
+    lsdj_free(images);
+    
+    const unsigned char end = DELTA_END;
+    if (vio->write(&end, 1, vio->user_data) != 1)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write delta end");
+        return written;
+    }
+    
+    assert(written + 1 <= LSDJ_DELTA_MAX_SIZE);
+    return written + 1;
+}
+
+size_t lsdj_delta_write_to_memory(const lsdj_song_t* base, const lsdj_song_t* target, unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    if (data == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
+        return 0;
+    }
+    
+    lsdj_memory_data_t mem;
+    mem.begin = mem.cur = data;
+    mem.size = size;
+    
+    lsdj_vio_t vio;
+    vio.write = lsdj_mwrite;
+    vio.tell = lsdj_mtell;
+    vio.seek = lsdj_mseek;
+    vio.user_data = &mem;
+    
+    return lsdj_delta_write(base, target, &vio, error);
+}
+
+// Walk the records of a delta, copying them into an image and counting them (either can be NULL)
+void read_delta_records(lsdj_vio_t* vio, unsigned char* image, size_t* counts, lsdj_error_t** error)
+{
+    unsigned char record[DELTA_MAX_RECORD_SIZE];
+    
+    while (1)
+    {
+        unsigned char kind = 0;
+        if (vio->read(&kind, 1, vio->user_data) != 1)
+            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read delta record kind");
+        
+        if (kind == DELTA_END)
+            return;
+        
+        unsigned char index = 0;
+        if (kind >= LSDJ_DELTA_KIND_COUNT || vio->read(&index, 1, vio->user_data) != 1 || index >= delta_record_count((lsdj_delta_kind_t)kind))
+            return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "delta contains an unknown record");
+        
+        const size_t size = delta_record_size((lsdj_delta_kind_t)kind, index);
+        if (vio->read(record, size, vio->user_data) != size)
+            return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read delta record");
+        
+        if (image)
+            scatter_delta_record(record, (lsdj_delta_kind_t)kind, index, image);
+        
+        if (counts)
+            counts[kind] += 1;
+    }
+}
+
+// Read the delta header, returns the base and target hashes
+int read_delta_header(lsdj_vio_t* vio, uint64_t* baseHash, uint64_t* targetHash, lsdj_error_t** error)
+{
+    unsigned char header[DELTA_HEADER_SIZE];
+    if (vio->read(header, sizeof(header), vio->user_data) != sizeof(header))
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read delta header");
+        return 0;
+    }
+    
+    if (memcmp(header, DELTA_MAGIC, DELTA_MAGIC_LENGTH) != 0 || header[DELTA_MAGIC_LENGTH] != DELTA_VERSION)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "data is not an lsdj song delta");
+        return 0;
+    }
+    
+    *baseHash = delta_decode_u64(header + DELTA_MAGIC_LENGTH + 1);
+    *targetHash = delta_decode_u64(header + DELTA_MAGIC_LENGTH + 9);
+    return 1;
+}
+
+lsdj_song_t* lsdj_delta_apply(const lsdj_song_t* base, lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    if (base == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "song is NULL");
+        return NULL;
+    }
+    
+    uint64_t baseHash = 0;
+    uint64_t targetHash = 0;
+    if (!read_delta_header(vio, &baseHash, &targetHash, error))
+        return NULL;
+    
+    unsigned char* image = write_delta_images(base, NULL, error);
+    if (image == NULL)
+        return NULL;
+    
+    if (lsdj_hash(image, LSDJ_SONG_DECOMPRESSED_SIZE, 0) != baseHash)
+    {
+        lsdj_free(image);
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "delta was made against a different song");
+        return NULL;
+    }
+    
+    lsdj_error_t* readError = NULL;
+    read_delta_records(vio, image, NULL, &readError);
+    if (readError == NULL && lsdj_hash(image, LSDJ_SONG_DECOMPRESSED_SIZE, 0) != targetHash)
+        lsdj_error_new_code(&readError, LSDJ_ERROR_INVALID_DATA, "applying the delta does not give the song it was made for");
+    
+    lsdj_song_t* song = NULL;
+    if (readError == NULL)
+        song = lsdj_song_read_from_memory(image, LSDJ_SONG_DECOMPRESSED_SIZE, &readError);
+    
+    lsdj_free(image);
+    
+    if (readError)
+    {
+        if (error)
+            *error = readError;
+        else
+            lsdj_error_free(readError);
+        return NULL;
+    }
+    
+    return song;
+}
+
+lsdj_song_t* lsdj_delta_apply_from_memory(const lsdj_song_t* base, const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    if (data == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
+        return NULL;
+    }
+    
+    lsdj_memory_data_t mem;
+    mem.begin = mem.cur = (unsigned char*)data;
+    mem.size = size;
+    
+    lsdj_vio_t vio;
+    vio.read = lsdj_mread;
+    vio.tell = lsdj_mtell;
+    vio.seek = lsdj_mseek;
+    vio.user_data = &mem;
+    
+    return lsdj_delta_apply(base, &vio, error);
+}
+
+void lsdj_delta_count_records(const unsigned char* data, size_t size, size_t* counts, lsdj_error_t** error)
+{
+    if (data == NULL || counts == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data or counts is NULL");
+    
+    memset(counts, 0, LSDJ_DELTA_KIND_COUNT * sizeof(size_t));
+    
+    lsdj_memory_data_t mem;
+    mem.begin = mem.cur = (unsigned char*)data;
+    mem.size = size;
+    
+    lsdj_vio_t vio;
+    vio.read = lsdj_mread;
+    vio.tell = lsdj_mtell;
+    vio.seek = lsdj_mseek;
+    vio.user_data = &mem;
+    
+    uint64_t baseHash = 0;
+    uint64_t targetHash = 0;
+    if (read_delta_header(&vio, &baseHash, &targetHash, error))
+        read_delta_records(&vio, NULL, counts, error);
+}
@@ -0,0 +1,91 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_DELTA_H
+#define LSDJ_DELTA_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "error.h"
+#include "song.h"
+#include "vio.h"
+
+// The kinds of records a delta replaces
+/*! The meta records cover everything in the song image that isn't part of another
+    record: bookmarks, allocation tables, song settings and the reserved regions */
+typedef enum
+{
+    LSDJ_DELTA_ROW,
+    LSDJ_DELTA_CHAIN,
+    LSDJ_DELTA_PHRASE,
+    LSDJ_DELTA_INSTRUMENT,
+    LSDJ_DELTA_TABLE,
+    LSDJ_DELTA_WAVE,
+    LSDJ_DELTA_GROOVE,
+    LSDJ_DELTA_WORD,
+    LSDJ_DELTA_SYNTH,
+    LSDJ_DELTA_META,
+    
+    LSDJ_DELTA_KIND_COUNT
+} lsdj_delta_kind_t;
+
+// The most bytes a delta can take, when every record changed
+#define LSDJ_DELTA_MAX_SIZE (LSDJ_SONG_DECOMPRESSED_SIZE + 0x1000)
+
+// Write the delta that turns one song into another
+/*! Only the records that differ are stored, whole. The delta holds hashes of both song
+    images, so applying it to anything but the base song fails instead of giving garbage.
+    Returns the amount of bytes written. */
+size_t lsdj_delta_write(const lsdj_song_t* base, const lsdj_song_t* target, lsdj_vio_t* vio, lsdj_error_t** error);
+size_t lsdj_delta_write_to_memory(const lsdj_song_t* base, const lsdj_song_t* target, unsigned char* data, size_t size, lsdj_error_t** error);
+
+// Apply a delta to the song it was made against, creating the song it leads to
+lsdj_song_t* lsdj_delta_apply(const lsdj_song_t* base, lsdj_vio_t* vio, lsdj_error_t** error);
+lsdj_song_t* lsdj_delta_apply_from_memory(const lsdj_song_t* base, const unsigned char* data, size_t size, lsdj_error_t** error);
+
+// Count the records of every kind a delta replaces, without applying it
+/*! counts should hold LSDJ_DELTA_KIND_COUNT entries */
+void lsdj_delta_count_records(const unsigned char* data, size_t size, size_t* counts, lsdj_error_t** error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
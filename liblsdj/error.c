@@ -36,36 +36,91 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "error.h"
 
 struct lsdj_error_t
 {
-    char* message;
+    lsdj_error_code_t code;
+    const char* message;
+    
+    //! Is this one of the shared, code-only errors that shouldn't be freed?
+    unsigned char isStatic;
+};
+
+static const char* CODE_DESCRIPTIONS[LSDJ_ERROR_CODE_COUNT] =
+{
+    "success",
+    "unknown error",
+    "invalid argument",
+    "out of memory",
+    "input/output error",
+    "invalid data",
+    "out of space"
+};
+
+static lsdj_error_t STATIC_ERRORS[LSDJ_ERROR_CODE_COUNT] =
+{
+    { LSDJ_SUCCESS, "success", 1 },
+    { LSDJ_ERROR_UNKNOWN, "unknown error", 1 },
+    { LSDJ_ERROR_INVALID_ARGUMENT, "invalid argument", 1 },
+    { LSDJ_ERROR_OUT_OF_MEMORY, "out of memory", 1 },
+    { LSDJ_ERROR_IO, "input/output error", 1 },
+    { LSDJ_ERROR_INVALID_DATA, "invalid data", 1 },
+    { LSDJ_ERROR_OUT_OF_SPACE, "out of space", 1 }
 };
 
 void lsdj_error_new(lsdj_error_t** error, const char* message)
+{
+    lsdj_error_new_code(error, LSDJ_ERROR_UNKNOWN, message);
+}
+
+void lsdj_error_new_code(lsdj_error_t** error, lsdj_error_code_t code, const char* message)
 {
     if (error == NULL)
         return;
     
-    *error = (lsdj_error_t*)malloc(sizeof(lsdj_error_t));
-    size_t length = strlen(message) + 1; // Add one for the null-termination
-    (*error)->message = malloc(length * sizeof(char));
-    strncpy((*error)->message, message, length);
+    if (code < 0 || code >= LSDJ_ERROR_CODE_COUNT)
+        code = LSDJ_ERROR_UNKNOWN;
+    
+    if (message == NULL)
+    {
+        *error = &STATIC_ERRORS[code];
+        return;
+    }
+    
+    lsdj_error_t* result = (lsdj_error_t*)lsdj_malloc(sizeof(lsdj_error_t));
+    const size_t length = strlen(message) + 1; // Add one for the null-termination
+    char* copy = result ? (char*)lsdj_malloc(length * sizeof(char)) : NULL;
+    
+    // If we can't even allocate the error, fall back to the code-only one
+    if (copy == NULL)
+    {
+        lsdj_free(result);
+        *error = &STATIC_ERRORS[LSDJ_ERROR_OUT_OF_MEMORY];
+        return;
+    }
+    
+    strncpy(copy, message, length);
+    result->code = code;
+    result->message = copy;
+    result->isStatic = 0;
+    
+    *error = result;
 }
 
 void lsdj_error_free(lsdj_error_t* error)
 {
-    if (error)
+    if (error == NULL || error->isStatic)
+        return;
+    
+    if (error->message)
     {
-        if (error->message)
-        {
-            free(error->message);
-            error->message = NULL;
-        }
-        
-        free(error);
+        lsdj_free((char*)error->message);
+        error->message = NULL;
     }
+    
+    lsdj_free(error);
 }
 
 const char* lsdj_error_get_c_str(lsdj_error_t* error)
@@ -75,3 +130,19 @@ const char* lsdj_error_get_c_str(lsdj_error_t* error)
     else
         return error->message;
 }
+
+lsdj_error_code_t lsdj_error_get_code(const lsdj_error_t* error)
+{
+    if (error == NULL)
+        return LSDJ_SUCCESS;
+    else
+        return error->code;
+}
+
+const char* lsdj_error_code_get_c_str(lsdj_error_code_t code)
+{
+    if (code < 0 || code >= LSDJ_ERROR_CODE_COUNT)
+        return CODE_DESCRIPTIONS[LSDJ_ERROR_UNKNOWN];
+    
+    return CODE_DESCRIPTIONS[code];
+}
@@ -42,10 +42,30 @@ extern "C" {
 
 // Structure containing specific error details
 typedef struct lsdj_error_t lsdj_error_t;
+
+// Numeric codes describing the category of an error
+typedef enum
+{
+    LSDJ_SUCCESS = 0,
+    LSDJ_ERROR_UNKNOWN,
+    LSDJ_ERROR_INVALID_ARGUMENT,
+    LSDJ_ERROR_OUT_OF_MEMORY,
+    LSDJ_ERROR_IO,
+    LSDJ_ERROR_INVALID_DATA,
+    LSDJ_ERROR_OUT_OF_SPACE,
+    
+    LSDJ_ERROR_CODE_COUNT
+} lsdj_error_code_t;
     
 // Create an error with a given message
-/*! Every call to lsdj_error_new() should be paired with one to lsdj_error_free() */
+/*! Every call to lsdj_error_new() should be paired with one to lsdj_error_free().
+    The error's code is set to LSDJ_ERROR_UNKNOWN. */
 void lsdj_error_new(lsdj_error_t** error, const char* message);
+
+// Create an error with a given code and message
+/*! Without a message (NULL) this doesn't allocate, but hands out a shared error that only
+    carries the code and a short description of it. Freeing that error is a no-op. */
+void lsdj_error_new_code(lsdj_error_t** error, lsdj_error_code_t code, const char* message);
     
 // Free error data returned from an lsdj function call
 /*! Every call to lsdj_error_new() should be paired with one to lsdj_error_free() */
@@ -53,6 +73,13 @@ void lsdj_error_free(lsdj_error_t* error);
     
 // Retrieve a string description of an error
 const char* lsdj_error_get_c_str(lsdj_error_t* error);
+
+// Retrieve the numeric code of an error
+/*! Returns LSDJ_SUCCESS for a NULL error */
+lsdj_error_code_t lsdj_error_get_code(const lsdj_error_t* error);
+
+// Retrieve a short description of an error code
+const char* lsdj_error_code_get_c_str(lsdj_error_code_t code);
     
 #ifdef __cplusplus
 }
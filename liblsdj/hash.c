@@ -0,0 +1,291 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "compression.h"
+#include "hash.h"
+
+#define PRIME1 (11400714785074694791ULL)
+#define PRIME2 (14029467366897019727ULL)
+#define PRIME3 (1609587929392839161ULL)
+#define PRIME4 (9650029242287828579ULL)
+#define PRIME5 (2870177450012600261ULL)
+
+uint64_t rotate_left(uint64_t value, int count)
+{
+    return (value << count) | (value >> (64 - count));
+}
+
+// Little endian loads, so hashes are the same on every platform
+uint64_t load64(const unsigned char* data)
+{
+    return (uint64_t)data[0] | ((uint64_t)data[1] << 8) | ((uint64_t)data[2] << 16) | ((uint64_t)data[3] << 24) |
+           ((uint64_t)data[4] << 32) | ((uint64_t)data[5] << 40) | ((uint64_t)data[6] << 48) | ((uint64_t)data[7] << 56);
+}
+
+uint64_t load32(const unsigned char* data)
+{
+    return (uint64_t)data[0] | ((uint64_t)data[1] << 8) | ((uint64_t)data[2] << 16) | ((uint64_t)data[3] << 24);
+}
+
+uint64_t hash_round(uint64_t accumulator, uint64_t input)
+{
+    accumulator += input * PRIME2;
+    accumulator = rotate_left(accumulator, 31);
+    return accumulator * PRIME1;
+}
+
+uint64_t hash_merge_round(uint64_t accumulator, uint64_t value)
+{
+    accumulator ^= hash_round(0, value);
+    return accumulator * PRIME1 + PRIME4;
+}
+
+void hash_stripe(uint64_t* accumulators, const unsigned char* data)
+{
+    accumulators[0] = hash_round(accumulators[0], load64(data));
+    accumulators[1] = hash_round(accumulators[1], load64(data + 8));
+    accumulators[2] = hash_round(accumulators[2], load64(data + 16));
+    accumulators[3] = hash_round(accumulators[3], load64(data + 24));
+}
+
+void lsdj_hash_init(lsdj_hash_state_t* state, uint64_t seed)
+{
+    state->accumulators[0] = seed + PRIME1 + PRIME2;
+    state->accumulators[1] = seed + PRIME2;
+    state->accumulators[2] = seed;
+    state->accumulators[3] = seed - PRIME1;
+    state->totalSize = 0;
+    state->bufferSize = 0;
+    state->seed = seed;
+}
+
+void lsdj_hash_update(lsdj_hash_state_t* state, const void* data, size_t size)
+{
+    const unsigned char* bytes = (const unsigned char*)data;
+    state->totalSize += size;
+    
+    // Complete a partially filled stripe first
+    if (state->bufferSize > 0)
+    {
+        const size_t count = (size < 32 - state->bufferSize) ? size : 32 - state->bufferSize;
+        memcpy(state->buffer + state->bufferSize, bytes, count);
+        state->bufferSize += count;
+        bytes += count;
+        size -= count;
+        
+        if (state->bufferSize < 32)
+            return;
+        
+        hash_stripe(state->accumulators, state->buffer);
+        state->bufferSize = 0;
+    }
+    
+    for (; size >= 32; bytes += 32, size -= 32)
+        hash_stripe(state->accumulators, bytes);
+    
+    memcpy(state->buffer, bytes, size);
+    state->bufferSize = size;
+}
+
+uint64_t lsdj_hash_finish(const lsdj_hash_state_t* state)
+{
+    const uint64_t* accumulators = state->accumulators;
+    
+    uint64_t hash = 0;
+    if (state->totalSize >= 32)
+    {
+        hash = rotate_left(accumulators[0], 1) + rotate_left(accumulators[1], 7) + rotate_left(accumulators[2], 12) + rotate_left(accumulators[3], 18);
+        for (int i = 0; i < 4; ++i)
+            hash = hash_merge_round(hash, accumulators[i]);
+    } else {
+        hash = state->seed + PRIME5;
+    }
+    
+    hash += state->totalSize;
+    
+    // Mix in whatever didn't fill up a full stripe
+    const unsigned char* bytes = state->buffer;
+    size_t size = state->bufferSize;
+    
+    for (; size >= 8; bytes += 8, size -= 8)
+    {
+        hash ^= hash_round(0, load64(bytes));
+        hash = rotate_left(hash, 27) * PRIME1 + PRIME4;
+    }
+    
+    if (size >= 4)
+    {
+        hash ^= load32(bytes) * PRIME1;
+        hash = rotate_left(hash, 23) * PRIME2 + PRIME3;
+        bytes += 4;
+        size -= 4;
+    }
+    
+    for (; size > 0; ++bytes, --size)
+    {
+        hash ^= (*bytes) * PRIME5;
+        hash = rotate_left(hash, 11) * PRIME1;
+    }
+    
+    // Final avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    
+    return hash;
+}
+
+uint64_t lsdj_hash(const void* data, size_t size, uint64_t seed)
+{
+    lsdj_hash_state_t state;
+    lsdj_hash_init(&state, seed);
+    lsdj_hash_update(&state, data, size);
+    return lsdj_hash_finish(&state);
+}
+
+uint64_t lsdj_song_hash(const lsdj_song_t* song, lsdj_error_t** error)
+{
+    unsigned char data[LSDJ_SONG_DECOMPRESSED_SIZE];
+    lsdj_song_write_to_memory(song, data, sizeof(data), error);
+    if (error && *error)
+        return 0;
+    
+    return lsdj_hash(data, sizeof(data), 0);
+}
+
+void hash_project_header(lsdj_hash_state_t* state, const lsdj_project_t* project)
+{
+    char name[LSDJ_PROJECT_NAME_LENGTH];
+    memset(name, '\0', sizeof(name));
+    lsdj_project_get_name(project, name, sizeof(name));
+    
+    const unsigned char version = lsdj_project_get_version(project);
+    
+    lsdj_hash_update(state, name, sizeof(name));
+    lsdj_hash_update(state, &version, 1);
+}
+
+uint64_t lsdj_project_hash(const lsdj_project_t* project, lsdj_error_t** error)
+{
+    const lsdj_song_t* song = lsdj_project_load_song(project, error);
+    if (song == NULL)
+    {
+        if (error && *error == NULL)
+            lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "project does not contain a song");
+        return 0;
+    }
+    
+    unsigned char data[LSDJ_SONG_DECOMPRESSED_SIZE];
+    lsdj_song_write_to_memory(song, data, sizeof(data), error);
+    if (error && *error)
+        return 0;
+    
+    lsdj_hash_state_t state;
+    lsdj_hash_init(&state, 0);
+    hash_project_header(&state, project);
+    lsdj_hash_update(&state, data, sizeof(data));
+    
+    return lsdj_hash_finish(&state);
+}
+
+uint64_t lsdj_project_hash_compressed(const lsdj_project_t* project, lsdj_error_t** error)
+{
+    lsdj_hash_state_t state;
+    lsdj_hash_init(&state, 0);
+    hash_project_header(&state, project);
+    
+    // Hash the blocks the project was read from, if they're still up to date
+    unsigned int blockCount = 0;
+    const unsigned char* blocks = lsdj_project_get_compressed_song(project, &blockCount);
+    if (blocks)
+    {
+        lsdj_hash_update(&state, blocks, blockCount * BLOCK_SIZE);
+        return lsdj_hash_finish(&state);
+    }
+    
+    // Otherwise compress the song the same way lsdsng files are written
+    const lsdj_song_t* song = lsdj_project_load_song(project, error);
+    if (song == NULL)
+    {
+        if (error && *error == NULL)
+            lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "project does not contain a song");
+        return 0;
+    }
+    
+    unsigned char data[LSDJ_SONG_DECOMPRESSED_SIZE];
+    lsdj_song_write_to_memory(song, data, sizeof(data), error);
+    if (error && *error)
+        return 0;
+    
+    unsigned char* compressed = (unsigned char*)lsdj_malloc(BLOCK_COUNT * BLOCK_SIZE);
+    if (compressed == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate compression buffer");
+        return 0;
+    }
+    
+    lsdj_memory_data_t memory;
+    memory.begin = compressed;
+    memory.cur = memory.begin;
+    memory.size = BLOCK_COUNT * BLOCK_SIZE;
+    
+    lsdj_vio_t vio;
+    vio.read = lsdj_mread;
+    vio.write = lsdj_mwrite;
+    vio.tell = lsdj_mtell;
+    vio.seek = lsdj_mseek;
+    vio.user_data = &memory;
+    
+    blockCount = lsdj_compress(data, BLOCK_SIZE, 1, BLOCK_COUNT, &vio, error);
+    if ((error && *error) || blockCount == 0)
+    {
+        if (error && *error == NULL)
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not compress song");
+        lsdj_free(compressed);
+        return 0;
+    }
+    
+    lsdj_hash_update(&state, compressed, blockCount * BLOCK_SIZE);
+    lsdj_free(compressed);
+    
+    return lsdj_hash_finish(&state);
+}
@@ -0,0 +1,89 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_HASH_H
+#define LSDJ_HASH_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "error.h"
+#include "project.h"
+#include "song.h"
+
+// Incremental state for a 64-bit content hash (XXH64)
+/*! The result only depends on the bytes fed in, not on how they were split up over
+    calls to lsdj_hash_update(), nor on the platform. */
+typedef struct
+{
+    uint64_t accumulators[4];
+    uint64_t totalSize;
+    unsigned char buffer[32];
+    size_t bufferSize;
+    uint64_t seed;
+} lsdj_hash_state_t;
+
+// Hash data incrementally
+void lsdj_hash_init(lsdj_hash_state_t* state, uint64_t seed);
+void lsdj_hash_update(lsdj_hash_state_t* state, const void* data, size_t size);
+uint64_t lsdj_hash_finish(const lsdj_hash_state_t* state);
+
+// Hash a block of memory in one go
+uint64_t lsdj_hash(const void* data, size_t size, uint64_t seed);
+
+// Hash the decompressed image of a song
+/*! Every byte of the image counts, reserved regions included, so two songs hash the same
+    exactly when lsdj_song_write() would give the same bytes for both. Returns 0 on errors. */
+uint64_t lsdj_song_hash(const lsdj_song_t* song, lsdj_error_t** error);
+
+// Hash the name, version and decompressed song image of a project
+uint64_t lsdj_project_hash(const lsdj_project_t* project, lsdj_error_t** error);
+
+// Hash the name, version and compressed song blocks of a project
+/*! Uses the blocks the project was read from when they're still up to date, and compresses
+    the song otherwise. This skips decompression, but only tells identical input apart: the
+    same song compressed by different software can give different blocks. */
+uint64_t lsdj_project_hash_compressed(const lsdj_project_t* project, lsdj_error_t** error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,868 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <assert.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "codec.h"
+#include "compression.h"
+#include "hash.h"
+#include "index.h"
+#include "sav.h"
+#include "song_view.h"
+#include "vio.h"
+
+#define INDEX_MAGIC "LSDJINDX"
+#define INDEX_MAGIC_LENGTH (8)
+#define INDEX_VERSION (1)
+
+// The sizes of the records in an index file, which are all little endian
+#define INDEX_HEADER_SIZE (32)
+#define INDEX_FILE_RECORD_SIZE (40)
+#define INDEX_SONG_RECORD_SIZE (24)
+#define INDEX_INSTRUMENT_RECORD_SIZE (8)
+
+// The locations of the fields in a file record
+#define FILE_PATH_OFFSET (0)
+#define FILE_PATH_LENGTH (4)
+#define FILE_SIZE (8)
+#define FILE_MODIFICATION_TIME (16)
+#define FILE_HASH (24)
+#define FILE_FIRST_SONG (32)
+#define FILE_SONG_COUNT (36)
+
+// The locations of the fields in a song record
+#define SONG_FILE (0)
+#define SONG_FIRST_INSTRUMENT (4)
+#define SONG_NAME (8)
+#define SONG_KIND (16)
+#define SONG_PROJECT (17)
+#define SONG_VERSION (18)
+#define SONG_FORMAT_VERSION (19)
+#define SONG_TEMPO (20)
+#define SONG_BLOCK_COUNT (21)
+#define SONG_INSTRUMENT_COUNT (22)
+
+// The locations of the fields in an instrument record
+#define INSTRUMENT_INDEX (0)
+#define INSTRUMENT_TYPE (1)
+#define INSTRUMENT_NAME (2)
+
+struct lsdj_index_t
+{
+    lsdj_mapped_file_t* file;
+    
+    // The record tables, pointing into the mapping
+    const unsigned char* files;
+    const unsigned char* songs;
+    const unsigned char* instruments;
+    const char* strings;
+    
+    uint32_t fileCount;
+    uint32_t songCount;
+    uint32_t instrumentCount;
+    uint32_t stringsSize;
+};
+
+// A block of memory that grows as records are appended to it
+typedef struct
+{
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+} index_buffer_t;
+
+// Lookup entries for the files of a previous index
+typedef struct
+{
+    const char* path;
+    uint32_t file;
+} index_path_entry_t;
+
+typedef struct
+{
+    uint64_t hash;
+    uint64_t size;
+    uint32_t file;
+} index_hash_entry_t;
+
+struct lsdj_index_builder_t
+{
+    const lsdj_index_t* previous;
+    
+    // The files of the previous index, sorted by path and by content hash
+    index_path_entry_t* previousByPath;
+    index_hash_entry_t* previousByHash;
+    
+    index_buffer_t files;
+    index_buffer_t songs;
+    index_buffer_t instruments;
+    index_buffer_t strings;
+    
+    // Scratch memory for decompressing songs
+    lsdj_codec_context_t* context;
+};
+
+uint32_t index_read_u32(const unsigned char* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+uint64_t index_read_u64(const unsigned char* data)
+{
+    return (uint64_t)index_read_u32(data) | ((uint64_t)index_read_u32(data + 4) << 32);
+}
+
+void index_write_u32(unsigned char* data, uint32_t value)
+{
+    data[0] = (unsigned char)(value & 0xFF);
+    data[1] = (unsigned char)((value >> 8) & 0xFF);
+    data[2] = (unsigned char)((value >> 16) & 0xFF);
+    data[3] = (unsigned char)((value >> 24) & 0xFF);
+}
+
+void index_write_u64(unsigned char* data, uint64_t value)
+{
+    index_write_u32(data, (uint32_t)(value & 0xFFFFFFFF));
+    index_write_u32(data + 4, (uint32_t)(value >> 32));
+}
+
+
+// --- Reading --- //
+
+// Check that every record only refers to what's inside the index
+int validate_index(const lsdj_index_t* index)
+{
+    for (uint32_t i = 0; i < index->fileCount; ++i)
+    {
+        const unsigned char* record = index->files + i * INDEX_FILE_RECORD_SIZE;
+        const uint64_t pathOffset = index_read_u32(record + FILE_PATH_OFFSET);
+        const uint64_t pathLength = index_read_u32(record + FILE_PATH_LENGTH);
+        if (pathOffset + pathLength >= index->stringsSize || index->strings[pathOffset + pathLength] != '\0')
+            return 0;
+        
+        const uint64_t firstSong = index_read_u32(record + FILE_FIRST_SONG);
+        if (firstSong + index_read_u32(record + FILE_SONG_COUNT) > index->songCount)
+            return 0;
+    }
+    
+    for (uint32_t i = 0; i < index->songCount; ++i)
+    {
+        const unsigned char* record = index->songs + i * INDEX_SONG_RECORD_SIZE;
+        if (index_read_u32(record + SONG_FILE) >= index->fileCount || record[SONG_KIND] > LSDJ_INDEX_LSDSNG)
+            return 0;
+        
+        const uint64_t firstInstrument = index_read_u32(record + SONG_FIRST_INSTRUMENT);
+        if (firstInstrument + record[SONG_INSTRUMENT_COUNT] > index->instrumentCount)
+            return 0;
+    }
+    
+    return 1;
+}
+
+lsdj_index_t* lsdj_index_open(const char* path, lsdj_error_t** error)
+{
+    lsdj_mapped_file_t* file = lsdj_mapped_file_open(path, error);
+    if (file == NULL)
+        return NULL;
+    
+    const unsigned char* data = lsdj_mapped_file_get_data(file);
+    const size_t size = lsdj_mapped_file_get_size(file);
+    
+    if (size < INDEX_HEADER_SIZE || memcmp(data, INDEX_MAGIC, INDEX_MAGIC_LENGTH) != 0)
+    {
+        lsdj_mapped_file_close(file);
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "file is not an lsdj index");
+        return NULL;
+    }
+    
+    if (index_read_u32(data + 8) != INDEX_VERSION)
+    {
+        lsdj_mapped_file_close(file);
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "unsupported lsdj index version");
+        return NULL;
+    }
+    
+    lsdj_index_t* index = (lsdj_index_t*)lsdj_calloc(1, sizeof(lsdj_index_t));
+    if (index == NULL)
+    {
+        lsdj_mapped_file_close(file);
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate index");
+        return NULL;
+    }
+    
+    index->file = file;
+    index->fileCount = index_read_u32(data + 12);
+    index->songCount = index_read_u32(data + 16);
+    index->instrumentCount = index_read_u32(data + 20);
+    index->stringsSize = index_read_u32(data + 24);
+    
+    // Computed in 64 bits, so that corrupt counts can't wrap around
+    const uint64_t expectedSize = INDEX_HEADER_SIZE +
+        (uint64_t)index->fileCount * INDEX_FILE_RECORD_SIZE +
+        (uint64_t)index->songCount * INDEX_SONG_RECORD_SIZE +
+        (uint64_t)index->instrumentCount * INDEX_INSTRUMENT_RECORD_SIZE +
+        index->stringsSize;
+    
+    if (expectedSize != size)
+    {
+        lsdj_index_close(index);
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "lsdj index size does not match its contents");
+        return NULL;
+    }
+    
+    index->files = data + INDEX_HEADER_SIZE;
+    index->songs = index->files + index->fileCount * INDEX_FILE_RECORD_SIZE;
+    index->instruments = index->songs + index->songCount * INDEX_SONG_RECORD_SIZE;
+    index->strings = (const char*)(index->instruments + index->instrumentCount * INDEX_INSTRUMENT_RECORD_SIZE);
+    
+    if (!validate_index(index))
+    {
+        lsdj_index_close(index);
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "lsdj index contains records that point outside of it");
+        return NULL;
+    }
+    
+    return index;
+}
+
+void lsdj_index_close(lsdj_index_t* index)
+{
+    if (index == NULL)
+        return;
+    
+    lsdj_mapped_file_close(index->file);
+    lsdj_free(index);
+}
+
+size_t lsdj_index_get_file_count(const lsdj_index_t* index)
+{
+    return index->fileCount;
+}
+
+size_t lsdj_index_get_song_count(const lsdj_index_t* index)
+{
+    return index->songCount;
+}
+
+const char* index_file_path(const lsdj_index_t* index, size_t file)
+{
+    return index->strings + index_read_u32(index->files + file * INDEX_FILE_RECORD_SIZE + FILE_PATH_OFFSET);
+}
+
+void lsdj_index_get_song(const lsdj_index_t* index, size_t song, lsdj_index_song_t* result)
+{
+    assert(song < index->songCount);
+    const unsigned char* record = index->songs + song * INDEX_SONG_RECORD_SIZE;
+    
+    result->path = index_file_path(index, index_read_u32(record + SONG_FILE));
+    result->kind = (lsdj_index_song_kind_t)record[SONG_KIND];
+    result->project = record[SONG_PROJECT];
+    
+    memcpy(result->name, record + SONG_NAME, LSDJ_PROJECT_NAME_LENGTH);
+    result->name[LSDJ_PROJECT_NAME_LENGTH] = '\0';
+    
+    result->version = record[SONG_VERSION];
+    result->formatVersion = record[SONG_FORMAT_VERSION];
+    result->tempo = record[SONG_TEMPO];
+    result->blockCount = record[SONG_BLOCK_COUNT];
+    result->instrumentCount = record[SONG_INSTRUMENT_COUNT];
+}
+
+void lsdj_index_get_instrument(const lsdj_index_t* index, size_t song, size_t instrument, lsdj_index_instrument_t* result)
+{
+    assert(song < index->songCount);
+    const unsigned char* songRecord = index->songs + song * INDEX_SONG_RECORD_SIZE;
+    
+    assert(instrument < songRecord[SONG_INSTRUMENT_COUNT]);
+    const unsigned char* record = index->instruments + (index_read_u32(songRecord + SONG_FIRST_INSTRUMENT) + instrument) * INDEX_INSTRUMENT_RECORD_SIZE;
+    
+    result->index = record[INSTRUMENT_INDEX];
+    result->type = (instrument_type)record[INSTRUMENT_TYPE];
+    
+    memcpy(result->name, record + INSTRUMENT_NAME, LSDJ_INSTRUMENT_NAME_LENGTH);
+    result->name[LSDJ_INSTRUMENT_NAME_LENGTH] = '\0';
+}
+
+
+// --- Searching --- //
+
+void lsdj_index_query_init(lsdj_index_query_t* query)
+{
+    query->name = NULL;
+    query->instrumentName = NULL;
+    query->instrumentType = LSDJ_INDEX_ANY;
+    query->formatVersion = LSDJ_INDEX_ANY;
+    query->minTempo = LSDJ_INDEX_ANY;
+    query->maxTempo = LSDJ_INDEX_ANY;
+}
+
+// Find out whether a fixed-length name contains text, ignoring case
+int index_name_contains(const unsigned char* name, size_t length, const char* text)
+{
+    const size_t textLength = strlen(text);
+    length = strnlen((const char*)name, length);
+    
+    if (textLength > length)
+        return 0;
+    
+    for (size_t start = 0; start + textLength <= length; ++start)
+    {
+        size_t i = 0;
+        while (i < textLength && tolower(name[start + i]) == tolower((unsigned char)text[i]))
+            ++i;
+        
+        if (i == textLength)
+            return 1;
+    }
+    
+    return 0;
+}
+
+int index_song_matches(const lsdj_index_t* index, const unsigned char* record, const lsdj_index_query_t* query)
+{
+    if (query->formatVersion != LSDJ_INDEX_ANY && record[SONG_FORMAT_VERSION] != query->formatVersion)
+        return 0;
+    
+    if (query->minTempo != LSDJ_INDEX_ANY && record[SONG_TEMPO] < query->minTempo)
+        return 0;
+    
+    if (query->maxTempo != LSDJ_INDEX_ANY && record[SONG_TEMPO] > query->maxTempo)
+        return 0;
+    
+    if (query->name && !index_name_contains(record + SONG_NAME, LSDJ_PROJECT_NAME_LENGTH, query->name))
+        return 0;
+    
+    if (query->instrumentName == NULL && query->instrumentType == LSDJ_INDEX_ANY)
+        return 1;
+    
+    const unsigned char* instrument = index->instruments + index_read_u32(record + SONG_FIRST_INSTRUMENT) * INDEX_INSTRUMENT_RECORD_SIZE;
+    for (unsigned char i = 0; i < record[SONG_INSTRUMENT_COUNT]; ++i, instrument += INDEX_INSTRUMENT_RECORD_SIZE)
+    {
+        if (query->instrumentType != LSDJ_INDEX_ANY && instrument[INSTRUMENT_TYPE] != query->instrumentType)
+            continue;
+        
+        if (query->instrumentName && !index_name_contains(instrument + INSTRUMENT_NAME, LSDJ_INSTRUMENT_NAME_LENGTH, query->instrumentName))
+            continue;
+        
+        return 1;
+    }
+    
+    return 0;
+}
+
+size_t lsdj_index_search(const lsdj_index_t* index, const lsdj_index_query_t* query, lsdj_index_match_t match, void* user_data)
+{
+    size_t count = 0;
+    
+    for (uint32_t i = 0; i < index->songCount; ++i)
+    {
+        if (!index_song_matches(index, index->songs + i * INDEX_SONG_RECORD_SIZE, query))
+            continue;
+        
+        if (match)
+            match(index, i, user_data);
+        ++count;
+    }
+    
+    return count;
+}
+
+
+// --- Building --- //
+
+// Append uninitialized bytes to a buffer, returns where they start
+unsigned char* index_buffer_append(index_buffer_t* buffer, size_t size, lsdj_error_t** error)
+{
+    if (buffer->size + size > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity ? buffer->capacity * 2 : 0x1000;
+        while (capacity < buffer->size + size)
+            capacity *= 2;
+        
+        unsigned char* data = (unsigned char*)lsdj_malloc(capacity);
+        if (data == NULL)
+        {
+            lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not grow index buffer");
+            return NULL;
+        }
+        
+        if (buffer->size)
+            memcpy(data, buffer->data, buffer->size);
+        
+        lsdj_free(buffer->data);
+        buffer->data = data;
+        buffer->capacity = capacity;
+    }
+    
+    unsigned char* result = buffer->data + buffer->size;
+    buffer->size += size;
+    return result;
+}
+
+int compare_path_entries(const void* lhs, const void* rhs)
+{
+    return strcmp(((const index_path_entry_t*)lhs)->path, ((const index_path_entry_t*)rhs)->path);
+}
+
+int compare_hash_entries(const void* lhs, const void* rhs)
+{
+    const uint64_t a = ((const index_hash_entry_t*)lhs)->hash;
+    const uint64_t b = ((const index_hash_entry_t*)rhs)->hash;
+    return a < b ? -1 : (a > b ? 1 : 0);
+}
+
+lsdj_index_builder_t* lsdj_index_builder_new(const lsdj_index_t* previous, lsdj_error_t** error)
+{
+    lsdj_index_builder_t* builder = (lsdj_index_builder_t*)lsdj_calloc(1, sizeof(lsdj_index_builder_t));
+    if (builder == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate index builder");
+        return NULL;
+    }
+    
+    builder->context = lsdj_codec_context_new(error);
+    if (builder->context == NULL)
+    {
+        lsdj_index_builder_free(builder);
+        return NULL;
+    }
+    
+    if (previous == NULL || previous->fileCount == 0)
+        return builder;
+    
+    builder->previous = previous;
+    builder->previousByPath = (index_path_entry_t*)lsdj_malloc(previous->fileCount * sizeof(index_path_entry_t));
+    builder->previousByHash = (index_hash_entry_t*)lsdj_malloc(previous->fileCount * sizeof(index_hash_entry_t));
+    if (builder->previousByPath == NULL || builder->previousByHash == NULL)
+    {
+        lsdj_index_builder_free(builder);
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate previous index lookup");
+        return NULL;
+    }
+    
+    for (uint32_t i = 0; i < previous->fileCount; ++i)
+    {
+        const unsigned char* record = previous->files + i * INDEX_FILE_RECORD_SIZE;
+        
+        builder->previousByPath[i].path = index_file_path(previous, i);
+        builder->previousByPath[i].file = i;
+        
+        builder->previousByHash[i].hash = index_read_u64(record + FILE_HASH);
+        builder->previousByHash[i].size = index_read_u64(record + FILE_SIZE);
+        builder->previousByHash[i].file = i;
+    }
+    
+    qsort(builder->previousByPath, previous->fileCount, sizeof(index_path_entry_t), compare_path_entries);
+    qsort(builder->previousByHash, previous->fileCount, sizeof(index_hash_entry_t), compare_hash_entries);
+    
+    return builder;
+}
+
+void lsdj_index_builder_free(lsdj_index_builder_t* builder)
+{
+    if (builder == NULL)
+        return;
+    
+    lsdj_free(builder->previousByPath);
+    lsdj_free(builder->previousByHash);
+    lsdj_free(builder->files.data);
+    lsdj_free(builder->songs.data);
+    lsdj_free(builder->instruments.data);
+    lsdj_free(builder->strings.data);
+    lsdj_codec_context_free(builder->context);
+    lsdj_free(builder);
+}
+
+// Find the file with a given path in the previous index, returns -1 if it isn't there
+long find_previous_path(const lsdj_index_builder_t* builder, const char* path)
+{
+    size_t begin = 0;
+    size_t end = builder->previous ? builder->previous->fileCount : 0;
+    
+    while (begin < end)
+    {
+        const size_t middle = begin + (end - begin) / 2;
+        const int order = strcmp(builder->previousByPath[middle].path, path);
+        if (order == 0)
+            return (long)builder->previousByPath[middle].file;
+        
+        if (order < 0)
+            begin = middle + 1;
+        else
+            end = middle;
+    }
+    
+    return -1;
+}
+
+// Find a file with given contents in the previous index, returns -1 if there is none
+long find_previous_hash(const lsdj_index_builder_t* builder, uint64_t hash, uint64_t size)
+{
+    const size_t count = builder->previous ? builder->previous->fileCount : 0;
+    size_t begin = 0;
+    size_t end = count;
+    
+    // Find the first file with the hash
+    while (begin < end)
+    {
+        const size_t middle = begin + (end - begin) / 2;
+        if (builder->previousByHash[middle].hash < hash)
+            begin = middle + 1;
+        else
+            end = middle;
+    }
+    
+    // Hashes can collide, the size has to match too
+    for (; begin < count && builder->previousByHash[begin].hash == hash; ++begin)
+    {
+        if (builder->previousByHash[begin].size == size)
+            return (long)builder->previousByHash[begin].file;
+    }
+    
+    return -1;
+}
+
+// Start a new file record, which has no songs yet
+unsigned char* append_file_record(lsdj_index_builder_t* builder, const char* path, uint64_t size, int64_t modificationTime, uint64_t hash, lsdj_error_t** error)
+{
+    const size_t pathLength = strlen(path);
+    if (builder->strings.size + pathLength + 1 > 0xFFFFFFFF || builder->files.size / INDEX_FILE_RECORD_SIZE >= 0xFFFFFFFF)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_SPACE, "too many files for an lsdj index");
+        return NULL;
+    }
+    
+    const uint32_t pathOffset = (uint32_t)builder->strings.size;
+    unsigned char* string = index_buffer_append(&builder->strings, pathLength + 1, error);
+    if (string == NULL)
+        return NULL;
+    memcpy(string, path, pathLength + 1);
+    
+    unsigned char* record = index_buffer_append(&builder->files, INDEX_FILE_RECORD_SIZE, error);
+    if (record == NULL)
+        return NULL;
+    
+    index_write_u32(record + FILE_PATH_OFFSET, pathOffset);
+    index_write_u32(record + FILE_PATH_LENGTH, (uint32_t)pathLength);
+    index_write_u64(record + FILE_SIZE, size);
+    index_write_u64(record + FILE_MODIFICATION_TIME, (uint64_t)modificationTime);
+    index_write_u64(record + FILE_HASH, hash);
+    index_write_u32(record + FILE_FIRST_SONG, (uint32_t)(builder->songs.size / INDEX_SONG_RECORD_SIZE));
+    index_write_u32(record + FILE_SONG_COUNT, 0);
+    
+    return record;
+}
+
+// Copy the songs of a file in the previous index over to the file last added to the builder
+void copy_previous_songs(lsdj_index_builder_t* builder, uint32_t previousFile, lsdj_error_t** error)
+{
+    const lsdj_index_t* previous = builder->previous;
+    const unsigned char* previousRecord = previous->files + previousFile * INDEX_FILE_RECORD_SIZE;
+    const uint32_t firstSong = index_read_u32(previousRecord + FILE_FIRST_SONG);
+    const uint32_t songCount = index_read_u32(previousRecord + FILE_SONG_COUNT);
+    const uint32_t file = (uint32_t)(builder->files.size / INDEX_FILE_RECORD_SIZE - 1);
+    
+    for (uint32_t i = 0; i < songCount; ++i)
+    {
+        const unsigned char* previousSong = previous->songs + (firstSong + i) * INDEX_SONG_RECORD_SIZE;
+        const uint32_t firstInstrument = index_read_u32(previousSong + SONG_FIRST_INSTRUMENT);
+        const size_t instrumentsSize = previousSong[SONG_INSTRUMENT_COUNT] * INDEX_INSTRUMENT_RECORD_SIZE;
+        
+        unsigned char* song = index_buffer_append(&builder->songs, INDEX_SONG_RECORD_SIZE, error);
+        if (song == NULL)
+            return;
+        
+        memcpy(song, previousSong, INDEX_SONG_RECORD_SIZE);
+        index_write_u32(song + SONG_FILE, file);
+        index_write_u32(song + SONG_FIRST_INSTRUMENT, (uint32_t)(builder->instruments.size / INDEX_INSTRUMENT_RECORD_SIZE));
+        
+        unsigned char* instruments = index_buffer_append(&builder->instruments, instrumentsSize, error);
+        if (instruments == NULL)
+            return;
+        
+        if (instrumentsSize)
+            memcpy(instruments, previous->instruments + firstInstrument * INDEX_INSTRUMENT_RECORD_SIZE, instrumentsSize);
+    }
+    
+    index_write_u32(builder->files.data + file * INDEX_FILE_RECORD_SIZE + FILE_SONG_COUNT, songCount);
+}
+
+// Append a song record for a decompressed song image to the file last added to the builder
+void append_song_record(lsdj_index_builder_t* builder, const unsigned char* image, lsdj_index_song_kind_t kind, unsigned char project, const char* name, unsigned char version, unsigned int blockCount, lsdj_error_t** error)
+{
+    lsdj_song_view_t* view = lsdj_song_view_new(image, LSDJ_SONG_DECOMPRESSED_SIZE, error);
+    if (view == NULL)
+        return;
+    
+    const uint32_t file = (uint32_t)(builder->files.size / INDEX_FILE_RECORD_SIZE - 1);
+    unsigned char* song = index_buffer_append(&builder->songs, INDEX_SONG_RECORD_SIZE, error);
+    if (song == NULL)
+    {
+        lsdj_song_view_free(view);
+        return;
+    }
+    
+    memset(song, 0, INDEX_SONG_RECORD_SIZE);
+    index_write_u32(song + SONG_FILE, file);
+    index_write_u32(song + SONG_FIRST_INSTRUMENT, (uint32_t)(builder->instruments.size / INDEX_INSTRUMENT_RECORD_SIZE));
+    strncpy((char*)song + SONG_NAME, name, LSDJ_PROJECT_NAME_LENGTH);
+    song[SONG_KIND] = (unsigned char)kind;
+    song[SONG_PROJECT] = project;
+    song[SONG_VERSION] = version;
+    song[SONG_FORMAT_VERSION] = lsdj_song_view_get_format_version(view);
+    song[SONG_TEMPO] = lsdj_song_view_get_tempo(view);
+    song[SONG_BLOCK_COUNT] = (unsigned char)blockCount;
+    
+    // The instruments go into a buffer of their own, so growing it doesn't move the song record
+    unsigned char instrumentCount = 0;
+    for (size_t i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+    {
+        if (!lsdj_song_view_has_instrument(view, i))
+            continue;
+        
+        unsigned char* instrument = index_buffer_append(&builder->instruments, INDEX_INSTRUMENT_RECORD_SIZE, error);
+        if (instrument == NULL)
+            break;
+        
+        char name[LSDJ_INSTRUMENT_NAME_LENGTH + 1];
+        lsdj_song_view_get_instrument_name(view, i, name, sizeof(name));
+        
+        memset(instrument, 0, INDEX_INSTRUMENT_RECORD_SIZE);
+        instrument[INSTRUMENT_INDEX] = (unsigned char)i;
+        instrument[INSTRUMENT_TYPE] = (unsigned char)lsdj_song_view_get_instrument_type(view, i);
+        memcpy(instrument + INSTRUMENT_NAME, name, LSDJ_INSTRUMENT_NAME_LENGTH);
+        ++instrumentCount;
+    }
+    
+    song[SONG_INSTRUMENT_COUNT] = instrumentCount;
+    lsdj_song_view_free(view);
+    
+    unsigned char* fileRecord = builder->files.data + file * INDEX_FILE_RECORD_SIZE + FILE_SONG_COUNT;
+    index_write_u32(fileRecord, index_read_u32(fileRecord) + 1);
+}
+
+// Decompress the song of a project and append its record
+void append_project_song(lsdj_index_builder_t* builder, const lsdj_project_t* project, lsdj_index_song_kind_t kind, unsigned char slot, lsdj_error_t** error)
+{
+    unsigned int blockCount = 0;
+    const unsigned char* blocks = lsdj_project_get_compressed_song(project, &blockCount);
+    if (blocks == NULL)
+        return;
+    
+    unsigned char* image = lsdj_codec_context_borrow_song_buffer(builder->context, error);
+    if (image == NULL)
+        return;
+    
+    lsdj_memory_data_t rmem;
+    rmem.begin = rmem.cur = (unsigned char*)blocks;
+    rmem.size = blockCount * BLOCK_SIZE;
+    
+    lsdj_vio_t rvio;
+    rvio.read = lsdj_mread;
+    rvio.tell = lsdj_mtell;
+    rvio.seek = lsdj_mseek;
+    rvio.user_data = &rmem;
+    
+    lsdj_memory_data_t wmem;
+    wmem.begin = wmem.cur = image;
+    wmem.size = LSDJ_SONG_DECOMPRESSED_SIZE;
+    
+    lsdj_vio_t wvio;
+    wvio.write = lsdj_mwrite;
+    wvio.tell = lsdj_mtell;
+    wvio.seek = lsdj_mseek;
+    wvio.user_data = &wmem;
+    
+    lsdj_decompress(&rvio, &wvio, NULL, BLOCK_SIZE, error);
+    if (error == NULL || *error == NULL)
+    {
+        char name[LSDJ_PROJECT_NAME_LENGTH + 1] = { 0 };
+        lsdj_project_get_name(project, name, LSDJ_PROJECT_NAME_LENGTH);
+        append_song_record(builder, image, kind, slot, name, lsdj_project_get_version(project), blockCount, error);
+    }
+    
+    lsdj_codec_context_return_buffer(builder->context, image);
+}
+
+// Read the songs of a sav, straight from its compressed blocks
+void extract_sav(lsdj_index_builder_t* builder, const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    lsdj_sav_t* sav = lsdj_sav_read_lazy_from_memory(data, size, error);
+    if (sav == NULL)
+        return;
+    
+    for (unsigned char i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
+    {
+        const lsdj_project_t* project = lsdj_sav_get_project_const(sav, i);
+        if (project == NULL)
+            continue;
+        
+        append_project_song(builder, project, LSDJ_INDEX_SAV_PROJECT, i, error);
+        if (error && *error)
+            break;
+    }
+    
+    // The working memory song is right at the start of the sav, decompressed already
+    if (error == NULL || *error == NULL)
+    {
+        const unsigned char active = lsdj_sav_get_active_project(sav);
+        const lsdj_project_t* project = active == LSDJ_NO_ACTIVE_PROJECT ? NULL : lsdj_sav_get_project_const(sav, active);
+        
+        char name[LSDJ_PROJECT_NAME_LENGTH + 1] = { 0 };
+        if (project)
+            lsdj_project_get_name(project, name, LSDJ_PROJECT_NAME_LENGTH);
+        
+        append_song_record(builder, data, LSDJ_INDEX_WORKING_MEMORY, active, name, project ? lsdj_project_get_version(project) : 0, 0, error);
+    }
+    
+    lsdj_sav_free(sav);
+}
+
+// Read the song of an lsdsng
+void extract_lsdsng(lsdj_index_builder_t* builder, const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    lsdj_project_t* project = lsdj_project_read_lsdsng_lazy_from_memory(data, size, error);
+    if (project == NULL)
+        return;
+    
+    append_project_song(builder, project, LSDJ_INDEX_LSDSNG, 0, error);
+    lsdj_project_free(project);
+}
+
+// Drop the songs and instruments added after a given point, so a failed file leaves no traces
+void rollback_builder(lsdj_index_builder_t* builder, size_t fileSize, size_t songSize, size_t instrumentSize, size_t stringSize)
+{
+    builder->files.size = fileSize;
+    builder->songs.size = songSize;
+    builder->instruments.size = instrumentSize;
+    builder->strings.size = stringSize;
+}
+
+lsdj_index_update_t lsdj_index_builder_add_file(lsdj_index_builder_t* builder, const char* path, uint64_t size, int64_t modificationTime, lsdj_error_t** error)
+{
+    const size_t fileSize = builder->files.size;
+    const size_t songSize = builder->songs.size;
+    const size_t instrumentSize = builder->instruments.size;
+    const size_t stringSize = builder->strings.size;
+    
+    // Files that weren't touched can be taken over without reading them
+    const long previousFile = find_previous_path(builder, path);
+    if (previousFile >= 0)
+    {
+        const unsigned char* record = builder->previous->files + previousFile * INDEX_FILE_RECORD_SIZE;
+        if (index_read_u64(record + FILE_SIZE) == size && (int64_t)index_read_u64(record + FILE_MODIFICATION_TIME) == modificationTime)
+        {
+            if (append_file_record(builder, path, size, modificationTime, index_read_u64(record + FILE_HASH), error) == NULL)
+                return LSDJ_INDEX_UNRECOGNIZED;
+            
+            copy_previous_songs(builder, (uint32_t)previousFile, error);
+            if (error && *error)
+                rollback_builder(builder, fileSize, songSize, instrumentSize, stringSize);
+            return LSDJ_INDEX_UNCHANGED;
+        }
+    }
+    
+    lsdj_mapped_file_t* file = lsdj_mapped_file_open(path, error);
+    if (file == NULL)
+        return LSDJ_INDEX_UNRECOGNIZED;
+    
+    const unsigned char* data = lsdj_mapped_file_get_data(file);
+    const size_t dataSize = lsdj_mapped_file_get_size(file);
+    const uint64_t hash = lsdj_hash(data, dataSize, 0);
+    
+    lsdj_index_update_t result = LSDJ_INDEX_UNRECOGNIZED;
+    if (append_file_record(builder, path, size, modificationTime, hash, error) != NULL)
+    {
+        const long sameContent = find_previous_hash(builder, hash, size);
+        if (sameContent >= 0)
+        {
+            copy_previous_songs(builder, (uint32_t)sameContent, error);
+            result = LSDJ_INDEX_SAME_CONTENT;
+        }
+        else if (dataSize == LSDJ_SAV_SIZE && lsdj_sav_is_likely_valid_memory(data, dataSize, NULL))
+        {
+            extract_sav(builder, data, dataSize, error);
+            result = LSDJ_INDEX_EXTRACTED;
+        }
+        else if (lsdj_project_is_likely_valid_lsdsng_memory(data, dataSize, NULL))
+        {
+            extract_lsdsng(builder, data, dataSize, error);
+            result = LSDJ_INDEX_EXTRACTED;
+        }
+    }
+    
+    lsdj_mapped_file_close(file);
+    
+    if (error && *error)
+    {
+        rollback_builder(builder, fileSize, songSize, instrumentSize, stringSize);
+        return LSDJ_INDEX_UNRECOGNIZED;
+    }
+    
+    return result;
+}
+
+void lsdj_index_builder_write(const lsdj_index_builder_t* builder, const char* path, lsdj_error_t** error)
+{
+    const size_t size = INDEX_HEADER_SIZE + builder->files.size + builder->songs.size + builder->instruments.size + builder->strings.size;
+    unsigned char* data = (unsigned char*)lsdj_malloc(size);
+    if (data == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate index file");
+    
+    memset(data, 0, INDEX_HEADER_SIZE);
+    memcpy(data, INDEX_MAGIC, INDEX_MAGIC_LENGTH);
+    index_write_u32(data + 8, INDEX_VERSION);
+    index_write_u32(data + 12, (uint32_t)(builder->files.size / INDEX_FILE_RECORD_SIZE));
+    index_write_u32(data + 16, (uint32_t)(builder->songs.size / INDEX_SONG_RECORD_SIZE));
+    index_write_u32(data + 20, (uint32_t)(builder->instruments.size / INDEX_INSTRUMENT_RECORD_SIZE));
+    index_write_u32(data + 24, (uint32_t)builder->strings.size);
+    
+    unsigned char* cur = data + INDEX_HEADER_SIZE;
+    const index_buffer_t* buffers[4] = { &builder->files, &builder->songs, &builder->instruments, &builder->strings };
+    for (int i = 0; i < 4; ++i)
+    {
+        if (buffers[i]->size)
+            memcpy(cur, buffers[i]->data, buffers[i]->size);
+        cur += buffers[i]->size;
+    }
+    
+    lsdj_atomic_file_write(path, data, size, error);
+    lsdj_free(data);
+}
@@ -0,0 +1,179 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_INDEX_H
+#define LSDJ_INDEX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "error.h"
+#include "instrument.h"
+#include "project.h"
+
+// Where a song in the index comes from
+typedef enum
+{
+    LSDJ_INDEX_SAV_PROJECT,
+    LSDJ_INDEX_WORKING_MEMORY,
+    LSDJ_INDEX_LSDSNG
+} lsdj_index_song_kind_t;
+
+// The metadata of one song in an index
+typedef struct
+{
+    // The file the song is in, pointing into the index
+    const char* path;
+    lsdj_index_song_kind_t kind;
+    
+    // The project slot in the sav, the active project for working memory songs (which can
+    // be LSDJ_NO_ACTIVE_PROJECT), and 0 for lsdsngs
+    unsigned char project;
+    
+    // The name of the project, null-terminated
+    char name[LSDJ_PROJECT_NAME_LENGTH + 1];
+    unsigned char version;
+    
+    unsigned char formatVersion;
+    unsigned char tempo;
+    
+    // The amount of blocks the compressed song takes, 0 for working memory songs
+    unsigned int blockCount;
+    
+    // The amount of allocated instruments, see lsdj_index_get_instrument()
+    unsigned int instrumentCount;
+} lsdj_index_song_t;
+
+// One of the allocated instruments of a song in an index
+typedef struct
+{
+    // The slot of the instrument in the song
+    unsigned char index;
+    instrument_type type;
+    
+    // The name of the instrument, null-terminated
+    char name[LSDJ_INSTRUMENT_NAME_LENGTH + 1];
+} lsdj_index_instrument_t;
+
+// A metadata index over a collection of savs and lsdsngs
+/*! An index is a single file, which is memory mapped when opened. Queries are answered from
+    the index alone, without touching any of the files it describes. */
+typedef struct lsdj_index_t lsdj_index_t;
+
+// Open/close index files
+lsdj_index_t* lsdj_index_open(const char* path, lsdj_error_t** error);
+void lsdj_index_close(lsdj_index_t* index);
+
+// Retrieve the amount of files and songs in the index
+size_t lsdj_index_get_file_count(const lsdj_index_t* index);
+size_t lsdj_index_get_song_count(const lsdj_index_t* index);
+
+// Retrieve the metadata of a song, and of its instruments
+void lsdj_index_get_song(const lsdj_index_t* index, size_t song, lsdj_index_song_t* result);
+void lsdj_index_get_instrument(const lsdj_index_t* index, size_t song, size_t instrument, lsdj_index_instrument_t* result);
+
+// Query fields that don't have a value match any song
+#define LSDJ_INDEX_ANY (-1)
+
+// What to search an index for, every field has to match
+/*! Names match when they contain the given text, regardless of case. A song matches the
+    instrument fields when one of its instruments matches both of them. */
+typedef struct
+{
+    const char* name;
+    const char* instrumentName;
+    int instrumentType;
+    
+    int formatVersion;
+    
+    // An inclusive tempo range
+    int minTempo;
+    int maxTempo;
+} lsdj_index_query_t;
+
+// Clear a query to match every song
+void lsdj_index_query_init(lsdj_index_query_t* query);
+
+// Called for every song that matches a query
+typedef void (*lsdj_index_match_t)(const lsdj_index_t* index, size_t song, void* user_data);
+
+// Search an index for songs, returns the amount that matched
+/*! match can be NULL to only count them */
+size_t lsdj_index_search(const lsdj_index_t* index, const lsdj_index_query_t* query, lsdj_index_match_t match, void* user_data);
+
+// Assembles a new index, reusing what it can from a previous one
+/*! Keep the previous index open until the last file has been added. Files that aren't added
+    to the builder are left out of the new index. */
+typedef struct lsdj_index_builder_t lsdj_index_builder_t;
+
+lsdj_index_builder_t* lsdj_index_builder_new(const lsdj_index_t* previous, lsdj_error_t** error);
+void lsdj_index_builder_free(lsdj_index_builder_t* builder);
+
+// What happened to a file added to an index builder
+typedef enum
+{
+    // The path, size and modification time are the same as in the previous index
+    LSDJ_INDEX_UNCHANGED,
+    
+    // The file was touched, but its contents hash the same as a file in the previous index
+    LSDJ_INDEX_SAME_CONTENT,
+    
+    // The metadata was read from the file
+    LSDJ_INDEX_EXTRACTED,
+    
+    // The file isn't a sav or lsdsng, it's indexed without songs
+    LSDJ_INDEX_UNRECOGNIZED
+} lsdj_index_update_t;
+
+// Add a file to an index builder
+/*! The size and modification time (in any unit, as long as it's used consistently) tell
+    whether the file changed since the previous index was built. Unchanged files aren't
+    read at all, the others are hashed to see if the contents changed, and only new
+    contents are decompressed for their metadata. */
+lsdj_index_update_t lsdj_index_builder_add_file(lsdj_index_builder_t* builder, const char* path, uint64_t size, int64_t modificationTime, lsdj_error_t** error);
+
+// Write the assembled index to a file, atomically replacing what was there
+void lsdj_index_builder_write(const lsdj_index_builder_t* builder, const char* path, lsdj_error_t** error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -33,10 +33,10 @@
  
  */
 
-#include <assert.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "instrument.h"
 
 // Structure representing one instrument
@@ -62,21 +62,42 @@ typedef struct lsdj_instrument_t
 
 lsdj_instrument_t* lsdj_instrument_new()
 {
-    lsdj_instrument_t* instrument = malloc(sizeof(lsdj_instrument_t));
+    lsdj_instrument_t* instrument = lsdj_malloc(sizeof(lsdj_instrument_t));
     lsdj_instrument_clear(instrument);
     return instrument;
 }
 
 lsdj_instrument_t* lsdj_instrument_copy(const lsdj_instrument_t* instrument)
 {
-    lsdj_instrument_t* newInstrument = malloc(sizeof(lsdj_instrument_t));
+    lsdj_instrument_t* newInstrument = lsdj_malloc(sizeof(lsdj_instrument_t));
     memcpy(newInstrument, instrument, sizeof(lsdj_instrument_t));
     return newInstrument;
 }
 
 void lsdj_instrument_free(lsdj_instrument_t* instrument)
 {
-    free(instrument);
+    lsdj_free(instrument);
+}
+
+lsdj_instrument_t* lsdj_instrument_new_in_arena(lsdj_arena_t* arena)
+{
+    lsdj_instrument_t* instrument = (lsdj_instrument_t*)lsdj_arena_alloc(arena, sizeof(lsdj_instrument_t));
+    if (instrument)
+        lsdj_instrument_clear(instrument);
+    return instrument;
+}
+
+lsdj_instrument_t* lsdj_instrument_copy_in_arena(const lsdj_instrument_t* instrument, lsdj_arena_t* arena)
+{
+    lsdj_instrument_t* newInstrument = (lsdj_instrument_t*)lsdj_arena_alloc(arena, sizeof(lsdj_instrument_t));
+    if (newInstrument)
+        memcpy(newInstrument, instrument, sizeof(lsdj_instrument_t));
+    return newInstrument;
+}
+
+size_t lsdj_instrument_size(void)
+{
+    return sizeof(lsdj_instrument_t);
 }
 
 void lsdj_instrument_clear(lsdj_instrument_t* instrument)
@@ -163,395 +184,274 @@ void lsdj_instrument_clear_as_noise(lsdj_instrument_t* instrument)
     instrument->noise.sCommand = LSDJ_SCOMMAND_FREE;
 }
 
-// --- Reading --- //
-
-unsigned char parseLength(unsigned char byte)
-{
-    if (byte & 0x40)
-        return (~byte) & 0x3F;
-    else
-        return LSDJ_INSTRUMENT_UNLIMITED_LENGTH;
-}
-
-unsigned char parseTable(unsigned char byte)
-{
-    if (byte & 0x20)
-        return byte & 0x1F;
-    else
-        return LSDJ_NO_TABLE;
-}
-
-lsdj_panning parsePanning(unsigned char byte)
-{
-    return byte & 3;
-}
+// --- Format tables --- //
 
-char parseDrumMode(unsigned char byte, unsigned char version)
+// The versions in which the instrument format changed
+typedef enum
 {
-    if (version < 3)
-        return 0;
-    else
-        return (byte & 0x40) ? 1 : 0;
-}
+    INSTRUMENT_FORMAT_V0, // Drum mode and transpose aren't stored yet
+    INSTRUMENT_FORMAT_V3, // Drum mode and transpose in byte 5
+    INSTRUMENT_FORMAT_V4, // Vibrato speed and shape become separate fields
+    INSTRUMENT_FORMAT_V6, // Wave length and speed move to bytes 10 and 11
+    INSTRUMENT_FORMAT_V7, // Wave length is stored inverted, and speed starts at 4
+    INSTRUMENT_FORMAT_COUNT
+} instrument_format;
 
-char parseTranspose(unsigned char byte, unsigned char version)
+instrument_format instrument_format_for_version(unsigned char version)
 {
     if (version < 3)
-        return 0;
+        return INSTRUMENT_FORMAT_V0;
+    else if (version < 4)
+        return INSTRUMENT_FORMAT_V3;
+    else if (version < 6)
+        return INSTRUMENT_FORMAT_V4;
+    else if (version < 7)
+        return INSTRUMENT_FORMAT_V6;
     else
-        return (byte & 0x20) ? 0 : 1;
+        return INSTRUMENT_FORMAT_V7;
 }
 
-unsigned char parseAutomate(unsigned char byte)
-{
-    return (byte >> 3) & 0x1;
-}
+// A field that is left as it was, for byte values LSDJ doesn't use
+#define INSTRUMENT_FIELD_KEPT (0xFF)
 
-lsdj_pulse_wave parsePulseWidth(unsigned char byte)
+// Everything that is stored in byte 5, the flags of an instrument
+typedef struct
 {
-    return (byte >> 6) & 0x3;
-}
-
-lsdj_playback_mode parsePlaybackMode(unsigned char byte)
-{
-    return byte & 0x3;
-}
+    unsigned char drumMode;
+    unsigned char transpose;
+    unsigned char automate;
+    lsdj_vib_direction vibratoDirection;
+    lsdj_plvib_speed plvibSpeed;
+    lsdj_vib_shape vibShape;
+    lsdj_kit_loop_mode loop1;
+    lsdj_kit_loop_mode loop2;
+} instrument_flags_t;
+
+// Call F(version, byte) for every byte value, to generate the tables below at compile time
+#define INSTRUMENT_REPEAT_4(F, v, b) F(v, (b)) F(v, (b) + 1) F(v, (b) + 2) F(v, (b) + 3)
+#define INSTRUMENT_REPEAT_16(F, v, b) INSTRUMENT_REPEAT_4(F, v, (b)) INSTRUMENT_REPEAT_4(F, v, (b) + 4) INSTRUMENT_REPEAT_4(F, v, (b) + 8) INSTRUMENT_REPEAT_4(F, v, (b) + 12)
+#define INSTRUMENT_REPEAT_64(F, v, b) INSTRUMENT_REPEAT_16(F, v, (b)) INSTRUMENT_REPEAT_16(F, v, (b) + 16) INSTRUMENT_REPEAT_16(F, v, (b) + 32) INSTRUMENT_REPEAT_16(F, v, (b) + 48)
+#define INSTRUMENT_REPEAT_256(F, v) INSTRUMENT_REPEAT_64(F, v, 0) INSTRUMENT_REPEAT_64(F, v, 64) INSTRUMENT_REPEAT_64(F, v, 128) INSTRUMENT_REPEAT_64(F, v, 192)
+
+// The vibrato bits of byte 5, shared by all instrument types since version 4
+#define INSTRUMENT_VIB_BITS(b) (((b) >> 1) & 3)
+#define INSTRUMENT_SPEED_V4(b) (((b) & 0x80) ? LSDJ_PLVIB_STEP : (((b) & 0x10) ? LSDJ_PLVIB_TICK : LSDJ_PLVIB_FAST))
+#define INSTRUMENT_SHAPE_V4(b) \
+    (INSTRUMENT_VIB_BITS(b) == 0 ? LSDJ_VIB_TRIANGLE : \
+     INSTRUMENT_VIB_BITS(b) == 1 ? LSDJ_VIB_SAWTOOTH : \
+     INSTRUMENT_VIB_BITS(b) == 2 ? LSDJ_VIB_SQUARE : INSTRUMENT_FIELD_KEPT)
+
+// Byte 5 of pulse and wave instruments
+#define INSTRUMENT_MELODIC_FLAGS(v, b) \
+{ \
+    (v) < 3 ? 0 : (((b) & 0x40) ? 1 : 0), \
+    (v) < 3 ? 0 : (((b) & 0x20) ? 0 : 1), \
+    ((b) >> 3) & 1, \
+    (b) & 1, \
+    (v) < 4 ? (INSTRUMENT_VIB_BITS(b) == 0 ? LSDJ_PLVIB_FAST : LSDJ_PLVIB_TICK) : INSTRUMENT_SPEED_V4(b), \
+    (v) < 4 ? (INSTRUMENT_VIB_BITS(b) == 1 ? LSDJ_VIB_SAWTOOTH : (INSTRUMENT_VIB_BITS(b) == 3 ? LSDJ_VIB_SQUARE : LSDJ_VIB_TRIANGLE)) : INSTRUMENT_SHAPE_V4(b), \
+    LSDJ_KIT_LOOP_OFF, \
+    LSDJ_KIT_LOOP_OFF \
+},
+
+// Byte 5 of kit instruments
+/*! Before version 4 the speed is stored as is. Bits 3 don't stand for a speed LSDJ has, but
+    are kept as they are, so they're written back unchanged. */
+#define INSTRUMENT_KIT_FLAGS(v, b) \
+{ \
+    0, \
+    0, \
+    ((b) >> 3) & 1, \
+    (b) & 1, \
+    (v) < 4 ? INSTRUMENT_VIB_BITS(b) : INSTRUMENT_SPEED_V4(b), \
+    (v) < 4 ? (INSTRUMENT_VIB_BITS(b) == 3 ? INSTRUMENT_FIELD_KEPT : LSDJ_VIB_TRIANGLE) : INSTRUMENT_SHAPE_V4(b), \
+    ((b) & 0x40) ? LSDJ_KIT_LOOP_ON : LSDJ_KIT_LOOP_OFF, \
+    ((b) & 0x20) ? LSDJ_KIT_LOOP_ON : LSDJ_KIT_LOOP_OFF \
+},
+
+#define INSTRUMENT_LENGTH(v, b) (((b) & 0x40) ? ((~(b)) & 0x3F) : LSDJ_INSTRUMENT_UNLIMITED_LENGTH),
+#define INSTRUMENT_TABLE(v, b) (((b) & 0x20) ? ((b) & 0x1F) : LSDJ_NO_TABLE),
+
+// The flags of every value of byte 5, for every format version
+static const instrument_flags_t INSTRUMENT_MELODIC_FLAGS_TABLE[INSTRUMENT_FORMAT_COUNT][256] =
+{
+    { INSTRUMENT_REPEAT_256(INSTRUMENT_MELODIC_FLAGS, 0) },
+    { INSTRUMENT_REPEAT_256(INSTRUMENT_MELODIC_FLAGS, 3) },
+    { INSTRUMENT_REPEAT_256(INSTRUMENT_MELODIC_FLAGS, 4) },
+    { INSTRUMENT_REPEAT_256(INSTRUMENT_MELODIC_FLAGS, 6) },
+    { INSTRUMENT_REPEAT_256(INSTRUMENT_MELODIC_FLAGS, 7) }
+};
+
+static const instrument_flags_t INSTRUMENT_KIT_FLAGS_TABLE[INSTRUMENT_FORMAT_COUNT][256] =
+{
+    { INSTRUMENT_REPEAT_256(INSTRUMENT_KIT_FLAGS, 0) },
+    { INSTRUMENT_REPEAT_256(INSTRUMENT_KIT_FLAGS, 3) },
+    { INSTRUMENT_REPEAT_256(INSTRUMENT_KIT_FLAGS, 4) },
+    { INSTRUMENT_REPEAT_256(INSTRUMENT_KIT_FLAGS, 6) },
+    { INSTRUMENT_REPEAT_256(INSTRUMENT_KIT_FLAGS, 7) }
+};
+
+// The length (byte 3) and table (byte 6) every byte value stands for
+static const unsigned char INSTRUMENT_LENGTH_TABLE[256] = { INSTRUMENT_REPEAT_256(INSTRUMENT_LENGTH, 0) };
+static const unsigned char INSTRUMENT_TABLE_TABLE[256] = { INSTRUMENT_REPEAT_256(INSTRUMENT_TABLE, 0) };
+
+// Bytes 8-15 of pulse and noise instruments, which they don't use
+static const unsigned char INSTRUMENT_UNUSED_BYTES[8] = { 0, 0, 0xD0, 0, 0, 0, 0xF3, 0 };
 
-lsdj_kit_distortion parseKitDistortion(unsigned char byte)
-{
-    return byte;
-}
+// --- Reading --- //
 
-lsdj_scommand_type parseScommand(unsigned char byte)
+void decode_vibrato_flags(const instrument_flags_t* flags, lsdj_plvib_speed* plvibSpeed, lsdj_vib_shape* vibShape)
 {
-    return byte & 1;
+    if (flags->plvibSpeed != INSTRUMENT_FIELD_KEPT)
+        *plvibSpeed = flags->plvibSpeed;
+    if (flags->vibShape != INSTRUMENT_FIELD_KEPT)
+        *vibShape = flags->vibShape;
 }
 
-void read_pulse_instrument(lsdj_vio_t* vio, unsigned char version, lsdj_instrument_t* instrument, lsdj_error_t** error)
+void decode_pulse_instrument(const unsigned char* data, instrument_format format, lsdj_instrument_t* instrument)
 {
-    instrument->type = LSDJ_INSTR_PULSE; // 0
-    
-    vio->read(&instrument->envelope, 1, vio->user_data); // 1
-    
-    vio->read(&instrument->pulse.pulse2tune, 1, vio->user_data); // 2
-    
-    // 3
-    unsigned char byte;
-    vio->read(&byte, 1, vio->user_data);
-    instrument->pulse.length = parseLength(byte);
-    
-    // 4
-    vio->read(&instrument->pulse.sweep, 1, vio->user_data);
-    
-    // 5
-    vio->read(&byte, 1, vio->user_data);
-    instrument->pulse.drumMode = parseDrumMode(byte, version);
-    instrument->pulse.transpose = parseTranspose(byte, version);
-    instrument->automate = parseAutomate(byte);
-    instrument->pulse.vibratoDirection = byte & 1;
-    
-    if (version < 4)
-    {
-        switch ((byte >> 1) & 3)
-        {
-            case 0:
-                instrument->pulse.plvibSpeed = LSDJ_PLVIB_FAST;
-                instrument->pulse.vibShape = LSDJ_VIB_TRIANGLE;
-                break;
-            case 1:
-                instrument->pulse.plvibSpeed = LSDJ_PLVIB_TICK;
-                instrument->pulse.vibShape = LSDJ_VIB_SAWTOOTH;
-                break;
-            case 2:
-                instrument->pulse.plvibSpeed = LSDJ_PLVIB_TICK;
-                instrument->pulse.vibShape = LSDJ_VIB_TRIANGLE;
-                break;
-            case 3:
-                instrument->pulse.plvibSpeed = LSDJ_PLVIB_TICK;
-                instrument->pulse.vibShape = LSDJ_VIB_SQUARE;
-                break;
-        }
-    } else {
-        if (byte & 0x80)
-            instrument->pulse.plvibSpeed = LSDJ_PLVIB_STEP;
-        else if (byte & 0x10)
-            instrument->pulse.plvibSpeed = LSDJ_PLVIB_TICK;
-        else
-            instrument->pulse.plvibSpeed = LSDJ_PLVIB_FAST;
-        
-        switch ((byte >> 1) & 3)
-        {
-            case 0: instrument->pulse.vibShape = LSDJ_VIB_TRIANGLE; break;
-            case 1: instrument->pulse.vibShape = LSDJ_VIB_SAWTOOTH; break;
-            case 2: instrument->pulse.vibShape = LSDJ_VIB_SQUARE; break;
-        }
-    }
-    
-    vio->read(&byte, 1, vio->user_data);
-    instrument->table = parseTable(byte);
+    instrument->type = LSDJ_INSTR_PULSE;
+    instrument->envelope = data[1];
+    instrument->pulse.pulse2tune = data[2];
+    instrument->pulse.length = INSTRUMENT_LENGTH_TABLE[data[3]];
+    instrument->pulse.sweep = data[4];
     
-    vio->read(&byte, 1, vio->user_data);
-    instrument->pulse.pulseWidth = parsePulseWidth(byte);
-    instrument->pulse.fineTune = ((byte >> 2) & 0xF);
-    instrument->panning = parsePanning(byte);
+    const instrument_flags_t* flags = &INSTRUMENT_MELODIC_FLAGS_TABLE[format][data[5]];
+    instrument->pulse.drumMode = (char)flags->drumMode;
+    instrument->pulse.transpose = (char)flags->transpose;
+    instrument->automate = flags->automate;
+    instrument->pulse.vibratoDirection = flags->vibratoDirection;
+    decode_vibrato_flags(flags, &instrument->pulse.plvibSpeed, &instrument->pulse.vibShape);
     
-//    unsigned char data[8];
-//    read(data, 8, vio->user_data);
-    vio->seek(8, SEEK_CUR, vio->user_data); // Bytes 8-15 are empty
+    instrument->table = INSTRUMENT_TABLE_TABLE[data[6]];
+    instrument->pulse.pulseWidth = (data[7] >> 6) & 0x3;
+    instrument->pulse.fineTune = (data[7] >> 2) & 0xF;
+    instrument->panning = data[7] & 3;
 }
 
-void read_wave_instrument(lsdj_vio_t* vio, unsigned char version, lsdj_instrument_t* instrument, lsdj_error_t** error)
+void decode_wave_instrument(const unsigned char* data, instrument_format format, lsdj_instrument_t* instrument)
 {
     instrument->type = LSDJ_INSTR_WAVE;
-    vio->read(&instrument->volume, 1, vio->user_data);
-    
-    unsigned char byte;
-    vio->read(&byte, 1, vio->user_data);
-    instrument->wave.synth = (byte >> 4) & 0xF;
-    instrument->wave.repeat = (byte & 0xF);
-    vio->seek(2, SEEK_CUR, vio->user_data); // Bytes 3 and 4 are empty
-    
-    vio->read(&byte, 1, vio->user_data);
-    instrument->wave.drumMode = parseDrumMode(byte, version);
-    instrument->wave.transpose = parseTranspose(byte, version);
-    instrument->automate = parseAutomate(byte);
-    instrument->wave.vibratoDirection = byte & 1;
-    
-    if (version < 4)
-    {
-        switch ((byte >> 1) & 3)
-        {
-            case 0:
-                instrument->wave.plvibSpeed = LSDJ_PLVIB_FAST;
-                instrument->wave.vibShape = LSDJ_VIB_TRIANGLE;
-                break;
-            case 1:
-                instrument->wave.plvibSpeed = LSDJ_PLVIB_TICK;
-                instrument->wave.vibShape = LSDJ_VIB_SAWTOOTH;
-                break;
-            case 2:
-                instrument->wave.plvibSpeed = LSDJ_PLVIB_TICK;
-                instrument->wave.vibShape = LSDJ_VIB_TRIANGLE;
-                break;
-            case 3:
-                instrument->wave.plvibSpeed = LSDJ_PLVIB_TICK;
-                instrument->wave.vibShape = LSDJ_VIB_SQUARE;
-                break;
-        }
-    } else {
-        if (byte & 0x80)
-            instrument->wave.plvibSpeed = LSDJ_PLVIB_STEP;
-        else if (byte & 0x10)
-            instrument->wave.plvibSpeed = LSDJ_PLVIB_TICK;
-        else
-            instrument->wave.plvibSpeed = LSDJ_PLVIB_FAST;
-        
-        switch ((byte >> 1) & 3)
-        {
-            case 0: instrument->wave.vibShape = LSDJ_VIB_TRIANGLE; break;
-            case 1: instrument->wave.vibShape = LSDJ_VIB_SAWTOOTH; break;
-            case 2: instrument->wave.vibShape = LSDJ_VIB_SQUARE; break;
-        }
-        
-        instrument->kit.vibratoDirection = (byte & 1) == 1 ? LSDJ_VIB_UP : LSDJ_VIB_DOWN;
-    }
-    
-    vio->read(&byte, 1, vio->user_data);
-    instrument->table = parseTable(byte);
-    
-    vio->read(&byte, 1, vio->user_data);
-    instrument->panning = parsePanning(byte);
-    
-    vio->seek(1, SEEK_CUR, vio->user_data); // Byte 8 is empty
-    
-    vio->read(&byte, 1, vio->user_data);
-    instrument->wave.playback = parsePlaybackMode(byte);
-    
-    // WAVE length and speed changed in version 6
-    if (version >= 7)
-    {
-        vio->read(&byte, 1, vio->user_data); // Byte 10
-        instrument->wave.length = 0xF - (byte & 0xF);
-        
-        vio->read(&byte, 1, vio->user_data); // Byte 11
-        instrument->wave.speed = byte + 4;
-    }
-    else if (version == 6)
-    {
-        vio->read(&byte, 1, vio->user_data); // Byte 10
-        instrument->wave.length = (byte & 0xF);
-        
-        vio->read(&byte, 1, vio->user_data); // Byte 11
-        instrument->wave.speed = byte + 1;
-    } else {
-        vio->seek(2, SEEK_CUR, vio->user_data); // Bytes 12-13 are empty
-    }
-    
-    vio->seek(2, SEEK_CUR, vio->user_data); // Bytes 10-13 are empty
-    
-    vio->read(&byte, 1, vio->user_data);
-    
-    // WAVE length and speed changed in version 6
-    if (version < 6)
+    instrument->volume = data[1];
+    instrument->wave.synth = (data[2] >> 4) & 0xF;
+    instrument->wave.repeat = data[2] & 0xF;
+    
+    const instrument_flags_t* flags = &INSTRUMENT_MELODIC_FLAGS_TABLE[format][data[5]];
+    instrument->wave.drumMode = (char)flags->drumMode;
+    instrument->wave.transpose = (char)flags->transpose;
+    instrument->automate = flags->automate;
+    instrument->wave.vibratoDirection = flags->vibratoDirection;
+    decode_vibrato_flags(flags, &instrument->wave.plvibSpeed, &instrument->wave.vibShape);
+    
+    instrument->table = INSTRUMENT_TABLE_TABLE[data[6]];
+    instrument->panning = data[7] & 3;
+    instrument->wave.playback = data[9] & 0x3;
+    
+    switch (format)
     {
-        instrument->wave.length = ((byte >> 4) & 0xF);
-        instrument->wave.speed = (byte & 0xF) + 1;
+        case INSTRUMENT_FORMAT_V7:
+            instrument->wave.length = 0xF - (data[10] & 0xF);
+            instrument->wave.speed = (unsigned char)(data[11] + 4);
+            break;
+        case INSTRUMENT_FORMAT_V6:
+            instrument->wave.length = data[10] & 0xF;
+            instrument->wave.speed = (unsigned char)(data[11] + 1);
+            break;
+        default:
+            instrument->wave.length = (data[14] >> 4) & 0xF;
+            instrument->wave.speed = (data[14] & 0xF) + 1;
+            break;
     }
-    
-    vio->seek(1, SEEK_CUR, vio->user_data); // Byte 15 is empty
 }
 
-void read_kit_instrument(lsdj_vio_t* vio, unsigned char version, lsdj_instrument_t* instrument, lsdj_error_t** error)
+void decode_kit_instrument(const unsigned char* data, instrument_format format, lsdj_instrument_t* instrument)
 {
     instrument->type = LSDJ_INSTR_KIT;
-    vio->read(&instrument->volume, 1, vio->user_data);
+    instrument->volume = data[1];
     
-    instrument->kit.loop1 = LSDJ_KIT_LOOP_OFF;
-    instrument->kit.loop2 = LSDJ_KIT_LOOP_OFF;
+    instrument->kit.loop1 = (data[2] & 0x80) ? LSDJ_KIT_LOOP_ATTACK : LSDJ_KIT_LOOP_OFF;
+    instrument->kit.halfSpeed = (data[2] >> 6) & 1;
+    instrument->kit.kit1 = data[2] & 0x3F;
+    instrument->kit.length1 = data[3];
     
-    unsigned char byte;
-    vio->read(&byte, 1, vio->user_data);
-    if ((byte >> 7) & 1)
-        instrument->kit.loop1 = LSDJ_KIT_LOOP_ATTACK;
-    instrument->kit.halfSpeed = (byte >> 6) & 1;
-    instrument->kit.kit1 = byte & 0x3F;
-    vio->read(&instrument->kit.length1, 1, vio->user_data);
-    
-    vio->seek(1, SEEK_CUR, vio->user_data); // Byte 4 is empty
-    
-    // Byte 5
-    vio->read(&byte, 1, vio->user_data);
+    const instrument_flags_t* flags = &INSTRUMENT_KIT_FLAGS_TABLE[format][data[5]];
     if (instrument->kit.loop1 != LSDJ_KIT_LOOP_ATTACK)
-        instrument->kit.loop1 = (byte & 0x40) ? LSDJ_KIT_LOOP_ON : LSDJ_KIT_LOOP_OFF;
-    instrument->kit.loop2 = (byte & 0x20) ? LSDJ_KIT_LOOP_ON : LSDJ_KIT_LOOP_OFF;
-    instrument->automate = parseAutomate(byte);
-    
-    instrument->kit.vibratoDirection = byte & 1;
-    
-    if (version < 4)
-    {
-        switch ((byte >> 1) & 3)
-        {
-            case 0:
-                instrument->kit.plvibSpeed = LSDJ_PLVIB_FAST;
-                instrument->kit.vibShape = LSDJ_VIB_TRIANGLE;
-                break;
-            case 1:
-                instrument->kit.plvibSpeed = LSDJ_PLVIB_TICK;
-                instrument->kit.vibShape = LSDJ_VIB_TRIANGLE;
-                break;
-            case 2:
-                instrument->kit.plvibSpeed = LSDJ_PLVIB_STEP;
-                instrument->kit.vibShape = LSDJ_VIB_TRIANGLE;
-                break;
-        }
-    } else {
-        if (byte & 0x80)
-            instrument->kit.plvibSpeed = LSDJ_PLVIB_STEP;
-        else if (byte & 0x10)
-            instrument->kit.plvibSpeed = LSDJ_PLVIB_TICK;
-        else
-            instrument->kit.plvibSpeed = LSDJ_PLVIB_FAST;
-        
-        switch ((byte >> 1) & 3)
-        {
-            case 0: instrument->kit.vibShape = LSDJ_VIB_TRIANGLE; break;
-            case 1: instrument->kit.vibShape = LSDJ_VIB_SAWTOOTH; break;
-            case 2: instrument->kit.vibShape = LSDJ_VIB_SQUARE; break;
-        }
-    }
+        instrument->kit.loop1 = flags->loop1;
+    instrument->kit.loop2 = flags->loop2;
+    instrument->automate = flags->automate;
+    instrument->kit.vibratoDirection = flags->vibratoDirection;
+    decode_vibrato_flags(flags, &instrument->kit.plvibSpeed, &instrument->kit.vibShape);
     
-    // byte 6
-    vio->read(&byte, 1, vio->user_data);
-    instrument->table = parseTable(byte);
+    instrument->table = INSTRUMENT_TABLE_TABLE[data[6]];
+    instrument->panning = data[7] & 3;
+    instrument->kit.pitch = data[8];
     
-    // byte 7
-    vio->read(&byte, 1, vio->user_data);
-    instrument->panning = parsePanning(byte);
-    
-    // byte 8
-    vio->read(&instrument->kit.pitch, 1, vio->user_data);
-    
-    // byte 9
-    vio->read(&byte, 1, vio->user_data);
-    if ((byte >> 7) & 1)
+    if (data[9] & 0x80)
         instrument->kit.loop2 = LSDJ_KIT_LOOP_ATTACK;
-    instrument->kit.kit2 = byte & 0x3F;
-    
-    // byte 10
-    vio->read(&byte, 1, vio->user_data);
-    instrument->kit.distortion = parseKitDistortion(byte);
+    instrument->kit.kit2 = data[9] & 0x3F;
     
-    vio->read(&instrument->kit.length2, 1, vio->user_data); // byte 11
-    vio->read(&instrument->kit.offset1, 1, vio->user_data); // byte 12
-    vio->read(&instrument->kit.offset2, 1, vio->user_data); // byte 13
-    
-    vio->seek(2, SEEK_CUR, vio->user_data); // Bytes 14 and 15 are empty
+    instrument->kit.distortion = data[10];
+    instrument->kit.length2 = data[11];
+    instrument->kit.offset1 = data[12];
+    instrument->kit.offset2 = data[13];
 }
 
-void read_noise_instrument(lsdj_vio_t* vio, lsdj_instrument_t* instrument, lsdj_error_t** error)
+void decode_noise_instrument(const unsigned char* data, instrument_format format, lsdj_instrument_t* instrument)
 {
-    instrument->type = LSDJ_INSTR_NOISE;
-    vio->read(&instrument->envelope, 1, vio->user_data);
-    
-    unsigned char byte;
-    vio->read(&byte, 1, vio->user_data);
-    instrument->noise.sCommand = parseScommand(byte);
-    
-    vio->read(&byte, 1, vio->user_data);
-    instrument->noise.length = parseLength(byte);
+    // Noise instruments are laid out the same in every format
+    (void)format;
     
-    vio->read(&instrument->noise.shape, 1, vio->user_data);
-    
-    vio->read(&byte, 1, vio->user_data);
-    instrument->automate = parseAutomate(byte);
+    instrument->type = LSDJ_INSTR_NOISE;
+    instrument->envelope = data[1];
+    instrument->noise.sCommand = data[2] & 1;
+    instrument->noise.length = INSTRUMENT_LENGTH_TABLE[data[3]];
+    instrument->noise.shape = data[4];
+    instrument->automate = (data[5] >> 3) & 0x1;
+    instrument->table = INSTRUMENT_TABLE_TABLE[data[6]];
+    instrument->panning = data[7] & 3;
+}
+
+// Decoders for every instrument type, indexed by byte 0
+typedef void (*instrument_decoder_t)(const unsigned char* data, instrument_format format, lsdj_instrument_t* instrument);
+static const instrument_decoder_t INSTRUMENT_DECODERS[4] = { decode_pulse_instrument, decode_wave_instrument, decode_kit_instrument, decode_noise_instrument };
+
+// The type-specific fields some flag values leave as they are start out from these
+/*! Without this they'd keep whatever the instrument held before, which for a freshly
+    allocated one can be anything */
+typedef void (*instrument_clearer_t)(lsdj_instrument_t* instrument);
+static const instrument_clearer_t INSTRUMENT_CLEARERS[4] = { lsdj_instrument_clear_as_pulse, lsdj_instrument_clear_as_wave, lsdj_instrument_clear_as_kit, lsdj_instrument_clear_as_noise };
+
+void lsdj_instrument_decode(const unsigned char* data, unsigned char version, lsdj_instrument_t* instrument, lsdj_error_t** error)
+{
+    if (data == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
     
-    vio->read(&byte, 1, vio->user_data);
-    instrument->table = parseTable(byte);
+    if (instrument == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "instrument is NULL");
     
-    vio->read(&byte, 1, vio->user_data);
-    instrument->panning = parsePanning(byte);
+    if (data[0] >= 4)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "unknown instrument type");
     
-    vio->seek(8, SEEK_CUR, vio->user_data); // Bytes 8-15 are empty
+    INSTRUMENT_CLEARERS[data[0]](instrument);
+    INSTRUMENT_DECODERS[data[0]](data, instrument_format_for_version(version), instrument);
 }
 
 void lsdj_instrument_read(lsdj_vio_t* vio, unsigned char version, lsdj_instrument_t* instrument, lsdj_error_t** error)
 {
     if (vio->read == NULL)
-        return lsdj_error_new(error, "vio->read is NULL");
-    
-    if (vio->seek == NULL)
-        return lsdj_error_new(error, "vio->seek is NULL");
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "vio->read is NULL");
     
     if (instrument == NULL)
-        return lsdj_error_new(error, "instrument is NULL");
-    
-    unsigned char type;
-    vio->read(&type, 1, vio->user_data);
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "instrument is NULL");
     
-    const long pos = vio->tell(vio->user_data);
+    unsigned char data[LSDJ_INSTRUMENT_BYTE_COUNT];
+    if (vio->read(data, sizeof(data), vio->user_data) != sizeof(data))
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read instrument");
     
-    switch (type)
-    {
-        case 0: read_pulse_instrument(vio, version, instrument, error); break;
-        case 1: read_wave_instrument(vio, version, instrument, error); break;
-        case 2: read_kit_instrument(vio, version, instrument, error); break;
-        case 3: read_noise_instrument(vio, instrument, error); break;
-        default: return lsdj_error_new(error, "unknown instrument type");
-    }
-    
-    assert(vio->tell(vio->user_data) - pos == 15);
+    lsdj_instrument_decode(data, version, instrument, error);
 }
 
-unsigned char createWaveVolumeByte(unsigned char volume)
-{
-    return volume;
-}
-
-unsigned char createPanningByte(lsdj_panning pan)
-{
-    return pan & 3;
-}
+// --- Writing --- //
 
 unsigned char createLengthByte(unsigned char length)
 {
@@ -574,296 +474,161 @@ unsigned char createAutomateByte(unsigned char automate)
     return (automate == 0) ? 0x0 : 0x8;
 }
 
-unsigned char createDrumModeByte(char drumMode, unsigned char version)
-{
-    if (version < 3)
-        return 0;
-    else
-        return (drumMode == 1) ? 0x40 : 0x0;
-}
-
-unsigned char createTransposeByte(char transpose, unsigned char version)
-{
-    if (version < 3)
-        return 0;
-    else
-        return (transpose == 1) ? 0x0 : 0x20;
-}
-
-unsigned char createVibrationDirectionByte(lsdj_vib_direction dir)
-{
-    return dir & 1;
-}
-
-unsigned char createPulseWidthByte(lsdj_pulse_wave pw)
-{
-    return (unsigned char)((pw & 3) << 6);
-}
-
-unsigned char createPlaybackModeByte(lsdj_playback_mode play)
-{
-    return play & 3;
-}
-
-unsigned char createKitDistortionByte(lsdj_kit_distortion dist)
-{
-    return dist;
-}
-
-unsigned char createScommandByte(lsdj_scommand_type type)
-{
-    return type & 1;
-}
-
-void write_pulse_instrument(const lsdj_instrument_t* instrument, unsigned char version, lsdj_vio_t* vio)
+// Byte 5 of pulse and wave instruments
+unsigned char createMelodicFlagsByte(char drumMode, char transpose, unsigned char automate, lsdj_vib_direction direction, lsdj_plvib_speed speed, lsdj_vib_shape shape, instrument_format format)
 {
-    unsigned char byte = 0;
-    vio->write(&byte, 1, vio->user_data);
-    vio->write(&instrument->envelope, 1, vio->user_data);
-    vio->write(&instrument->pulse.pulse2tune, 1, vio->user_data);
+    unsigned char byte = createAutomateByte(automate) | (direction & 1);
+    if (format >= INSTRUMENT_FORMAT_V3)
+        byte |= (drumMode == 1 ? 0x40 : 0x0) | (transpose == 1 ? 0x0 : 0x20);
     
-    byte = createLengthByte(instrument->pulse.length);
-    vio->write(&byte, 1, vio->user_data);
-    vio->write(&instrument->pulse.sweep, 1, vio->user_data);
-    
-    byte = createDrumModeByte(instrument->pulse.drumMode, version);
-    byte |= createTransposeByte(instrument->pulse.transpose, version);
-    byte |= createAutomateByte(instrument->automate);
-    byte |= createVibrationDirectionByte(instrument->pulse.vibratoDirection);
-    
-    if (version < 4)
+    if (format < INSTRUMENT_FORMAT_V4)
     {
-        switch (instrument->pulse.vibShape)
+        switch (shape)
         {
             case LSDJ_VIB_SAWTOOTH: byte |= 2; break;
             case LSDJ_VIB_SQUARE: byte |= 6; break;
             case LSDJ_VIB_TRIANGLE:
-                if (instrument->pulse.plvibSpeed != LSDJ_PLVIB_FAST)
+                if (speed != LSDJ_PLVIB_FAST)
                     byte |= 4;
                 break;
         }
     } else {
-        byte |= (instrument->pulse.vibShape & 3) << 1;
-        if (instrument->pulse.plvibSpeed == LSDJ_PLVIB_TICK)
+        byte |= (shape & 3) << 1;
+        if (speed == LSDJ_PLVIB_TICK)
             byte |= 0x10;
-        else if (instrument->pulse.plvibSpeed == LSDJ_PLVIB_STEP)
+        else if (speed == LSDJ_PLVIB_STEP)
             byte |= 0x80;
     }
     
-    vio->write(&byte, 1, vio->user_data);
-    
-    byte = createTableByte(instrument->table);
-    vio->write(&byte, 1, vio->user_data);
-    
-    byte = (unsigned char)(createPulseWidthByte(instrument->pulse.pulseWidth) | ((instrument->pulse.fineTune & 0xF) << 2) | createPanningByte(instrument->panning));
-    vio->write(&byte, 1, vio->user_data);
-    
-    static unsigned char empty[8] = { 0, 0, 0xD0, 0, 0, 0, 0xF3, 0 };
-    vio->write(empty, sizeof(empty), vio->user_data); // Bytes 8-15 are empty
+    return byte;
 }
 
-void write_wave_instrument(const lsdj_instrument_t* instrument, unsigned char version, lsdj_vio_t* vio)
+void encode_pulse_instrument(const lsdj_instrument_t* instrument, instrument_format format, unsigned char* data)
 {
-    // Byte 0
-    unsigned char byte = 1;
-    vio->write(&byte, 1, vio->user_data);
-    
-    // Byte 1
-    byte = createWaveVolumeByte(instrument->volume);
-    vio->write(&byte, 1, vio->user_data);
-    
-    // Byte 2
-    byte = (unsigned char)((instrument->wave.synth & 0xF) << 4) | (instrument->wave.repeat & 0xF);
-    vio->write(&byte, 1, vio->user_data);
-    
-    // Byte 3 (is empty)
-    byte = 0;
-    vio->write(&byte, 1, vio->user_data);
-    
-    // Byte 4 (is empty)
-    byte = 0xFF;
-    vio->write(&byte, 1, vio->user_data);
-    
-    byte = createDrumModeByte(instrument->wave.drumMode, version);
-    byte |= createTransposeByte(instrument->wave.transpose, version);
-    byte |= createAutomateByte(instrument->automate);
-    byte |= createVibrationDirectionByte(instrument->wave.vibratoDirection);
-    if (version < 4)
-    {
-        switch (instrument->wave.vibShape)
-        {
-            case LSDJ_VIB_SAWTOOTH: byte |= 2; break;
-            case LSDJ_VIB_SQUARE: byte |= 6; break;
-            case LSDJ_VIB_TRIANGLE:
-                if (instrument->wave.plvibSpeed != LSDJ_PLVIB_FAST)
-                    byte |= 4;
-                break;
-        }
-    } else {
-        byte |= (instrument->wave.vibShape & 3) << 1;
-        if (instrument->wave.plvibSpeed == LSDJ_PLVIB_TICK)
-            byte |= 0x10;
-        else if (instrument->wave.plvibSpeed == LSDJ_PLVIB_STEP)
-            byte |= 0x80;
-    }
-    vio->write(&byte, 1, vio->user_data);
-    
-    byte = createTableByte(instrument->table);
-    vio->write(&byte, 1, vio->user_data);
-    
-    byte = createPanningByte(instrument->panning);
-    vio->write(&byte, 1, vio->user_data);
-    
-    byte = 0;
-    vio->write(&byte, 1, vio->user_data); // Byte 8 is empty
-    
-    byte = createPlaybackModeByte(instrument->wave.playback);
-    vio->write(&byte, 1, vio->user_data);
-    
-    if (version >= 7)
-    {
-        byte = 0xF - (instrument->wave.length & 0xF);
-        vio->write(&byte, 1, vio->user_data);
-        
-        byte = instrument->wave.speed - 4;
-        vio->write(&byte, 1, vio->user_data);
-    }
-    else if (version == 6)
-    {
-        byte = (instrument->wave.length & 0xF);
-        vio->write(&byte, 1, vio->user_data);
-        
-        byte = instrument->wave.speed - 1;
-        vio->write(&byte, 1, vio->user_data);
-    } else {
-        byte = 0;
-        vio->write(&byte, 1, vio->user_data); // Byte 10 is empty
-        vio->write(&byte, 1, vio->user_data); // Byte 11 is empty
-    }
-    
-    byte = 0;
-    vio->write(&byte, 1, vio->user_data); // Byte 12 is empty
-    vio->write(&byte, 1, vio->user_data); // Byte 13 is empty
-    
-    if (version < 6)
-    {
-        byte = (unsigned char)(((instrument->wave.length & 0xF) << 4) | ((instrument->wave.speed - 1) & 0xF));
-        vio->write(&byte, 1, vio->user_data);
-    } else {
-        byte = 0;
-        vio->write(&byte, 1, vio->user_data); // Byte 14 is empty
-    }
-    
-    byte = 0;
-    vio->write(&byte, 1, vio->user_data); // Byte 15 is empty
+    data[0] = 0;
+    data[1] = instrument->envelope;
+    data[2] = instrument->pulse.pulse2tune;
+    data[3] = createLengthByte(instrument->pulse.length);
+    data[4] = instrument->pulse.sweep;
+    data[5] = createMelodicFlagsByte(instrument->pulse.drumMode, instrument->pulse.transpose, instrument->automate, instrument->pulse.vibratoDirection, instrument->pulse.plvibSpeed, instrument->pulse.vibShape, format);
+    data[6] = createTableByte(instrument->table);
+    data[7] = (unsigned char)(((instrument->pulse.pulseWidth & 3) << 6) | ((instrument->pulse.fineTune & 0xF) << 2) | (instrument->panning & 3));
+    memcpy(data + 8, INSTRUMENT_UNUSED_BYTES, sizeof(INSTRUMENT_UNUSED_BYTES));
 }
 
-void write_kit_instrument(const lsdj_instrument_t* instrument, unsigned char version, lsdj_vio_t* vio)
+void encode_wave_instrument(const lsdj_instrument_t* instrument, instrument_format format, unsigned char* data)
 {
-    unsigned char byte = 2;
-    vio->write(&byte, 1, vio->user_data);
-    
-    byte = createWaveVolumeByte(instrument->volume);
-    vio->write(&byte, 1, vio->user_data);
-    
-    byte = ((instrument->kit.loop1 == LSDJ_KIT_LOOP_ATTACK) ? 0x80 : 0x0) | (instrument->kit.halfSpeed ? 0x40 : 0x0) | (instrument->kit.kit1 & 0x3F); // Keep attack 1?
-    vio->write(&byte, 1, vio->user_data);
-    
-    vio->write(&instrument->kit.length1, 1, vio->user_data);
+    data[0] = 1;
+    data[1] = instrument->volume;
+    data[2] = (unsigned char)((instrument->wave.synth & 0xF) << 4) | (instrument->wave.repeat & 0xF);
+    data[3] = 0;
+    data[4] = 0xFF;
+    data[5] = createMelodicFlagsByte(instrument->wave.drumMode, instrument->wave.transpose, instrument->automate, instrument->wave.vibratoDirection, instrument->wave.plvibSpeed, instrument->wave.vibShape, format);
+    data[6] = createTableByte(instrument->table);
+    data[7] = instrument->panning & 3;
+    data[8] = 0;
+    data[9] = instrument->wave.playback & 3;
     
-    byte = 0xFF;
-    vio->write(&byte, 1, vio->user_data); // Byte 4 is empty
-    
-    // byte 5
-    byte = ((instrument->kit.loop1 == LSDJ_KIT_LOOP_ON) ? 0x40 : 0x0) |
-           ((instrument->kit.loop2 == LSDJ_KIT_LOOP_ON) ? 0x20 : 0x0) |
-           createAutomateByte(instrument->automate);
-    
-    if (version < 4)
+    // WAVE length and speed changed in version 6 and 7
+    switch (format)
     {
-        byte |= (instrument->kit.plvibSpeed & 3) << 1;
-    } else {
-        switch (instrument->kit.plvibSpeed)
-        {
-            case LSDJ_PLVIB_FAST: break;
-            case LSDJ_PLVIB_TICK: byte |= 0x10; break;
-            case LSDJ_PLVIB_STEP: byte |= 0x80; break;
-        }
+        case INSTRUMENT_FORMAT_V7:
+            data[10] = 0xF - (instrument->wave.length & 0xF);
+            data[11] = (unsigned char)(instrument->wave.speed - 4);
+            break;
+        case INSTRUMENT_FORMAT_V6:
+            data[10] = instrument->wave.length & 0xF;
+            data[11] = (unsigned char)(instrument->wave.speed - 1);
+            break;
+        default:
+            data[10] = 0;
+            data[11] = 0;
+            break;
     }
-    vio->write(&byte, 1, vio->user_data);
-    
-    byte = createTableByte(instrument->table);
-    vio->write(&byte, 1, vio->user_data);
     
-    byte = createPanningByte(instrument->panning);
-    vio->write(&byte, 1, vio->user_data);
-    
-    vio->write(&instrument->kit.pitch, 1, vio->user_data);
-    
-    byte = ((instrument->kit.loop2 == LSDJ_KIT_LOOP_ATTACK) ? 0x80 : 0x0) | (instrument->kit.kit2 & 0x3F);
-    vio->write(&byte, 1, vio->user_data);
-    
-    byte = createKitDistortionByte(instrument->kit.distortion);
-    vio->write(&byte, 1, vio->user_data);
-    
-    vio->write(&instrument->kit.length2, 1, vio->user_data);
-    vio->write(&instrument->kit.offset1, 1, vio->user_data);
-    vio->write(&instrument->kit.offset2, 1, vio->user_data);
-    
-    byte = 0xF3;
-    vio->write(&byte, 1, vio->user_data); // Byte 14 is empty
-    
-    byte = 0;
-    vio->write(&byte, 1, vio->user_data); // Byte 15 is empty
+    data[12] = 0;
+    data[13] = 0;
+    data[14] = format < INSTRUMENT_FORMAT_V6 ? (unsigned char)(((instrument->wave.length & 0xF) << 4) | ((instrument->wave.speed - 1) & 0xF)) : 0;
+    data[15] = 0;
 }
 
-void write_noise_instrument(const lsdj_instrument_t* instrument, lsdj_vio_t* vio)
+void encode_kit_instrument(const lsdj_instrument_t* instrument, instrument_format format, unsigned char* data)
 {
-    unsigned char byte = 3;
-    vio->write(&byte, 1, vio->user_data);
-    
-    vio->write(&instrument->envelope, 1, vio->user_data);
+    data[0] = 2;
+    data[1] = instrument->volume;
+    data[2] = ((instrument->kit.loop1 == LSDJ_KIT_LOOP_ATTACK) ? 0x80 : 0x0) | (instrument->kit.halfSpeed ? 0x40 : 0x0) | (instrument->kit.kit1 & 0x3F);
+    data[3] = instrument->kit.length1;
+    data[4] = 0xFF;
     
-    byte = createScommandByte(instrument->noise.sCommand);
-    vio->write(&byte, 1, vio->user_data);
-    
-    byte = createLengthByte(instrument->noise.length);
-    vio->write(&byte, 1, vio->user_data);
-    
-    vio->write(&instrument->noise.shape, 1, vio->user_data);
-    
-    byte = createAutomateByte(instrument->automate);
-    vio->write(&byte, 1, vio->user_data);
+    unsigned char byte = ((instrument->kit.loop1 == LSDJ_KIT_LOOP_ON) ? 0x40 : 0x0) |
+                         ((instrument->kit.loop2 == LSDJ_KIT_LOOP_ON) ? 0x20 : 0x0) |
+                         createAutomateByte(instrument->automate);
+    if (format < INSTRUMENT_FORMAT_V4)
+        byte |= (instrument->kit.plvibSpeed & 3) << 1;
+    else if (instrument->kit.plvibSpeed == LSDJ_PLVIB_TICK)
+        byte |= 0x10;
+    else if (instrument->kit.plvibSpeed == LSDJ_PLVIB_STEP)
+        byte |= 0x80;
+    data[5] = byte;
+    
+    data[6] = createTableByte(instrument->table);
+    data[7] = instrument->panning & 3;
+    data[8] = instrument->kit.pitch;
+    data[9] = ((instrument->kit.loop2 == LSDJ_KIT_LOOP_ATTACK) ? 0x80 : 0x0) | (instrument->kit.kit2 & 0x3F);
+    data[10] = instrument->kit.distortion;
+    data[11] = instrument->kit.length2;
+    data[12] = instrument->kit.offset1;
+    data[13] = instrument->kit.offset2;
+    data[14] = 0xF3;
+    data[15] = 0;
+}
+
+void encode_noise_instrument(const lsdj_instrument_t* instrument, instrument_format format, unsigned char* data)
+{
+    // Noise instruments are laid out the same in every format
+    (void)format;
+    
+    data[0] = 3;
+    data[1] = instrument->envelope;
+    data[2] = instrument->noise.sCommand & 1;
+    data[3] = createLengthByte(instrument->noise.length);
+    data[4] = instrument->noise.shape;
+    data[5] = createAutomateByte(instrument->automate);
+    data[6] = createTableByte(instrument->table);
+    data[7] = instrument->panning & 3;
+    memcpy(data + 8, INSTRUMENT_UNUSED_BYTES, sizeof(INSTRUMENT_UNUSED_BYTES));
+}
+
+// Encoders for every instrument type
+typedef void (*instrument_encoder_t)(const lsdj_instrument_t* instrument, instrument_format format, unsigned char* data);
+static const instrument_encoder_t INSTRUMENT_ENCODERS[4] = { encode_pulse_instrument, encode_wave_instrument, encode_kit_instrument, encode_noise_instrument };
+
+void lsdj_instrument_encode(const lsdj_instrument_t* instrument, unsigned char version, unsigned char* data, lsdj_error_t** error)
+{
+    if (instrument == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "instrument is NULL");
     
-    byte = createTableByte(instrument->table);
-    vio->write(&byte, 1, vio->user_data);
+    if (data == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
     
-    byte = createPanningByte(instrument->panning);
-    vio->write(&byte, 1, vio->user_data);
+    if ((unsigned int)instrument->type >= 4)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "unknown instrument type");
     
-    static unsigned char empty[8] = { 0, 0, 0xD0, 0, 0, 0, 0xF3, 0 };
-    vio->write(empty, sizeof(empty), vio->user_data); // Bytes 8-15 are empty
+    INSTRUMENT_ENCODERS[instrument->type](instrument, instrument_format_for_version(version), data);
 }
 
 void lsdj_instrument_write(const lsdj_instrument_t* instrument, unsigned char version, lsdj_vio_t* vio, lsdj_error_t** error)
 {
     if (vio->write == NULL)
-        return lsdj_error_new(error, "write is NULL");
-    
-    if (instrument == NULL)
-        return lsdj_error_new(error, "instrument is NULL");
-    
-    const long pos = vio->tell(vio->user_data);
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "write is NULL");
     
-    switch (instrument->type)
-    {
-        case LSDJ_INSTR_PULSE: write_pulse_instrument(instrument, version, vio); break;
-        case LSDJ_INSTR_WAVE: write_wave_instrument(instrument, version, vio); break;
-        case LSDJ_INSTR_KIT: write_kit_instrument(instrument, version, vio); break;
-        case LSDJ_INSTR_NOISE: write_noise_instrument(instrument, vio); break;
-    }
+    unsigned char data[LSDJ_INSTRUMENT_BYTE_COUNT];
+    lsdj_instrument_encode(instrument, version, data, error);
+    if (error && *error)
+        return;
     
-    assert(vio->tell(vio->user_data) - pos == 16);
+    if (vio->write(data, sizeof(data), vio->user_data) != sizeof(data))
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write instrument");
 }
 
 void lsdj_instrument_set_name(lsdj_instrument_t* instrument, const char* data, size_t size)
@@ -888,3 +653,8 @@ lsdj_panning lsdj_instrument_get_panning(const lsdj_instrument_t* instrument)
 {
     return instrument->panning;
 }
+
+unsigned char lsdj_instrument_get_table(const lsdj_instrument_t* instrument)
+{
+    return instrument->table;
+}
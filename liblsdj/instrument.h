@@ -40,6 +40,7 @@
 extern "C" {
 #endif
 
+#include "arena.h"
 #include "error.h"
 #include "instrument_kit.h"
 #include "instrument_noise.h"
@@ -51,6 +52,9 @@ extern "C" {
 // The default constant length of an instrument name
 #define LSDJ_INSTRUMENT_NAME_LENGTH (5)
 
+// The amount of bytes an instrument takes up in a song
+#define LSDJ_INSTRUMENT_BYTE_COUNT (16)
+
 #define LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH (16)
 static const unsigned char LSDJ_DEFAULT_INSTRUMENT[LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH] = { 0, 0xA8, 0, 0, 0xFF, 0, 0, 3, 0, 0, 0xD0, 0, 0, 0, 0xF3, 0 };
 
@@ -72,6 +76,14 @@ typedef struct lsdj_instrument_t lsdj_instrument_t;
 lsdj_instrument_t* lsdj_instrument_new();
 lsdj_instrument_t* lsdj_instrument_copy(const lsdj_instrument_t* instrument);
 void lsdj_instrument_free(lsdj_instrument_t* instrument);
+
+// Create/copy an instrument inside of an arena
+/*! Returns NULL if the arena is full. Don't lsdj_instrument_free() these, free the arena. */
+lsdj_instrument_t* lsdj_instrument_new_in_arena(lsdj_arena_t* arena);
+lsdj_instrument_t* lsdj_instrument_copy_in_arena(const lsdj_instrument_t* instrument, lsdj_arena_t* arena);
+
+// The amount of memory one instrument takes up
+size_t lsdj_instrument_size(void);
     
 // Clear all instrument data to factory settings
 void lsdj_instrument_clear(lsdj_instrument_t* instrument);
@@ -84,11 +96,26 @@ void lsdj_instrument_clear_as_noise(lsdj_instrument_t* instrument);
 void lsdj_instrument_read(lsdj_vio_t* vio, unsigned char version, lsdj_instrument_t* instrument, lsdj_error_t** error);
 void lsdj_instrument_write(const lsdj_instrument_t* instrument, unsigned char version, lsdj_vio_t* vio, lsdj_error_t** error);
 
+// Decode/encode the LSDJ_INSTRUMENT_BYTE_COUNT bytes of an instrument in one go
+/*! The bytes are looked up in tables generated for every format version at compile time,
+    so there's a single dispatch on the instrument type per record.
+ 
+    Decoding clears the instrument as its type first, so fields a record doesn't set never
+    hold what was in memory before. Kits before format version 4 keep their speed bits as
+    they are, which means their plvibSpeed can be 3. That value has no LSDJ_PLVIB_ constant
+    and doesn't stand for a speed LSDJ has, it's only there so the kit is encoded back the
+    way it was read. */
+void lsdj_instrument_decode(const unsigned char* data, unsigned char version, lsdj_instrument_t* instrument, lsdj_error_t** error);
+void lsdj_instrument_encode(const lsdj_instrument_t* instrument, unsigned char version, unsigned char* data, lsdj_error_t** error);
+
 void lsdj_instrument_set_name(lsdj_instrument_t* instrument, const char* data, size_t size);
 void lsdj_instrument_get_name(const lsdj_instrument_t* instrument, char* data, size_t size);
 
 void lsdj_instrument_set_panning(lsdj_instrument_t* instrument, lsdj_panning panning);
 lsdj_panning lsdj_instrument_get_panning(const lsdj_instrument_t* instrument);
+
+// The table the instrument plays, LSDJ_NO_TABLE or higher if none
+unsigned char lsdj_instrument_get_table(const lsdj_instrument_t* instrument);
     
 #ifdef __cplusplus
 }
@@ -36,11 +36,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "phrase.h"
 
 lsdj_phrase_t* lsdj_phrase_copy(const lsdj_phrase_t* phrase)
 {
-    lsdj_phrase_t* newPhrase = malloc(sizeof(lsdj_phrase_t));
+    lsdj_phrase_t* newPhrase = lsdj_malloc(sizeof(lsdj_phrase_t));
     memcpy(newPhrase, phrase, sizeof(lsdj_phrase_t));
     return newPhrase;
 }
@@ -34,12 +34,16 @@
  */
 
 #include <assert.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
+#include "codec.h"
 #include "compression.h"
 #include "project.h"
+#include "thread.h"
 
 struct lsdj_project_t
 {
@@ -50,16 +54,22 @@ struct lsdj_project_t
     unsigned char version;
     
     // The song belonging to this project
-    /*! If this is NULL, the project isn't in use */
+    /*! If this is NULL and there are no compressed blocks either, the project isn't in use */
     lsdj_song_t* song;
+    
+    // The compressed song this project was read from
+    /*! The blocks are numbered consecutively from 1. They're kept after decompression, so
+        that the song can be written back as-is when it hasn't been changed since. */
+    unsigned char* compressedBlocks;
+    unsigned int compressedBlockCount;
 };
 
 lsdj_project_t* alloc_project(lsdj_error_t** error)
 {
-    lsdj_project_t* project = (lsdj_project_t*)calloc(sizeof(lsdj_project_t), 1);
+    lsdj_project_t* project = (lsdj_project_t*)lsdj_calloc(sizeof(lsdj_project_t), 1);
     if (project == NULL)
     {
-        lsdj_error_new(error, "could not allocate project");
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate project");
         return NULL;
     }
     
@@ -81,87 +91,141 @@ lsdj_project_t* lsdj_project_new(lsdj_error_t** error)
 
 void lsdj_project_free(lsdj_project_t* project)
 {
-    free(project);
+    if (project)
+    {
+        lsdj_song_free(project->song);
+        lsdj_free(project->compressedBlocks);
+    }
+    
+    lsdj_free(project);
 }
 
-lsdj_project_t* lsdj_project_read_lsdsng(lsdj_vio_t* vio, lsdj_error_t** error)
+// The song of a project, if it has been decompressed yet
+/*! Lazily read projects get their song from lsdj_project_load_song(), which might be
+    running on another thread, so it's loaded atomically */
+lsdj_song_t* loaded_song(const lsdj_project_t* project)
+{
+    return (lsdj_song_t*)lsdj_atomic_load_pointer((void* const*)&project->song);
+}
+
+lsdj_project_t* lsdj_project_copy(const lsdj_project_t* project, lsdj_error_t** error)
+{
+    lsdj_project_t* copy = lsdj_project_new(error);
+    if (copy == NULL)
+        return NULL;
+    
+    memcpy(copy->name, project->name, sizeof(project->name));
+    copy->version = project->version;
+    
+    unsigned int blockCount = 0;
+    const unsigned char* blocks = lsdj_project_get_compressed_song(project, &blockCount);
+    if (blocks)
+        lsdj_project_set_compressed_song(copy, blocks, blockCount, error);
+    else if (loaded_song(project))
+        copy->song = lsdj_song_copy_shallow(loaded_song(project), error);
+    
+    if (error && *error)
+    {
+        lsdj_project_free(copy);
+        return NULL;
+    }
+    
+    return copy;
+}
+
+void free_compressed_blocks(lsdj_project_t* project)
+{
+    lsdj_free(project->compressedBlocks);
+    project->compressedBlocks = NULL;
+    project->compressedBlockCount = 0;
+}
+
+lsdj_project_t* read_lsdsng(lsdj_vio_t* vio, bool lazy, lsdj_error_t** error)
 {
+    // The blocks of an lsdsng follow each other in order, so sources that can't seek
+    // are read forward-only
+    lsdj_forward_data_t forward;
+    lsdj_vio_t forwardVio;
+    if (vio->seek == NULL || vio->tell == NULL)
+    {
+        lsdj_forward_init_vio(&forward, vio, &forwardVio);
+        vio = &forwardVio;
+    }
+    
     lsdj_project_t* project = alloc_project(error);
+    if (project == NULL)
+        return NULL;
     
     if (vio->read(project->name, LSDJ_PROJECT_NAME_LENGTH, vio->user_data) != LSDJ_PROJECT_NAME_LENGTH)
     {
-        lsdj_error_new(error, "could not read project name");
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read project name");
         lsdj_project_free(project);
         return NULL;
     }
     
     if (vio->read(&project->version, 1, vio->user_data) != 1)
     {
-        lsdj_error_new(error, "could not read project version");
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read project version");
         lsdj_project_free(project);
         return NULL;
     }
-
-    // Decompress the data
-    unsigned char decompressed[LSDJ_SONG_DECOMPRESSED_SIZE];
-    memset(decompressed, 0, sizeof(decompressed));
     
-    lsdj_memory_data_t mem;
-    mem.begin = mem.cur = decompressed;
-    mem.size = sizeof(decompressed);
+    // Keep the compressed blocks around as they are, so that writing the project into
+    // a sav (or back to an lsdsng) doesn't have to compress the song again
+    unsigned char* blocks = (unsigned char*)lsdj_malloc(BLOCK_COUNT * BLOCK_SIZE);
+    if (blocks == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate compressed block buffer");
+        lsdj_project_free(project);
+        return NULL;
+    }
     
-    lsdj_vio_t wvio;
-    wvio.write = lsdj_mwrite;
-    wvio.tell = lsdj_mtell;
-    wvio.seek = lsdj_mseek;
-    wvio.user_data = &mem;
+    const unsigned int blockCount = lsdj_copy_compressed_blocks(vio, NULL, BLOCK_SIZE, 1, blocks, BLOCK_COUNT, error);
+    if (!(error && *error))
+        lsdj_project_set_compressed_song(project, blocks, blockCount, error);
+    
+    lsdj_free(blocks);
+    
+    // Decompress and read in the song, unless that should wait until it's needed
+    if (!(error && *error) && !lazy)
+        lsdj_project_load_song(project, error);
     
-    lsdj_decompress(vio, &wvio, NULL, BLOCK_SIZE, error);
     if (error && *error)
+    {
+        lsdj_project_free(project);
         return NULL;
-    
-    // Read in the song
-    if (project->song == NULL)
-        project->song = lsdj_song_read_from_memory(decompressed, sizeof(decompressed), error);
+    }
     
     return project;
 }
 
-lsdj_project_t* lsdj_project_read_lsdsng_from_file(const char* path, lsdj_error_t** error)
+lsdj_project_t* read_lsdsng_from_file(const char* path, bool lazy, lsdj_error_t** error)
 {
     if (path == NULL)
     {
-        lsdj_error_new(error, "path is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
         return NULL;
     }
     
-    FILE* file = fopen(path, "rb");
+    lsdj_buffered_file_t* file = lsdj_buffered_file_open(path, "rb", LSDJ_BUFFERED_FILE_DEFAULT_SIZE, error);
     if (file == NULL)
-    {
-        char message[512];
-        snprintf(message, 512, "could not open %s for reading", path);
-        lsdj_error_new(error, message);
         return NULL;
-    }
     
     lsdj_vio_t vio;
-    vio.read = lsdj_fread;
-    vio.tell = lsdj_ftell;
-    vio.seek = lsdj_fseek;
-    vio.user_data = file;
+    lsdj_buffered_file_init_vio(file, &vio);
     
-    lsdj_project_t* project = lsdj_project_read_lsdsng(&vio, error);
+    lsdj_project_t* project = read_lsdsng(&vio, lazy, error);
     
-    fclose(file);
+    lsdj_buffered_file_close(file, error);
     
     return project;
 }
 
-lsdj_project_t* lsdj_project_read_lsdsng_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error)
+lsdj_project_t* read_lsdsng_from_memory(const unsigned char* data, size_t size, bool lazy, lsdj_error_t** error)
 {
     if (data == NULL)
     {
-        lsdj_error_new(error, "data is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
         return NULL;
     }
     
@@ -176,21 +240,74 @@ lsdj_project_t* lsdj_project_read_lsdsng_from_memory(const unsigned char* data,
     vio.seek = lsdj_mseek;
     vio.user_data = &mem;
     
-    return lsdj_project_read_lsdsng(&vio, error);
+    return read_lsdsng(&vio, lazy, error);
+}
+
+lsdj_project_t* lsdj_project_read_lsdsng(lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    return read_lsdsng(vio, false, error);
+}
+
+lsdj_project_t* lsdj_project_read_lsdsng_from_file(const char* path, lsdj_error_t** error)
+{
+    return read_lsdsng_from_file(path, false, error);
+}
+
+lsdj_project_t* lsdj_project_read_lsdsng_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    return read_lsdsng_from_memory(data, size, false, error);
+}
+
+lsdj_project_t* lsdj_project_read_lsdsng_lazy(lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    return read_lsdsng(vio, true, error);
+}
+
+lsdj_project_t* lsdj_project_read_lsdsng_lazy_from_file(const char* path, lsdj_error_t** error)
+{
+    return read_lsdsng_from_file(path, true, error);
+}
+
+lsdj_project_t* lsdj_project_read_lsdsng_lazy_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    return read_lsdsng_from_memory(data, size, true, error);
+}
+
+lsdj_project_t* lsdj_project_read_lsdsng_from_mapped_file(const char* path, lsdj_error_t** error)
+{
+    lsdj_mapped_file_t* file = lsdj_mapped_file_open(path, error);
+    if (file == NULL)
+        return NULL;
+    
+    lsdj_vio_t vio;
+    lsdj_mapped_file_init_vio(file, &vio);
+    
+    lsdj_project_t* project = lsdj_project_read_lsdsng(&vio, error);
+    
+    lsdj_mapped_file_close(file);
+    return project;
 }
 
 int lsdj_project_is_likely_valid_lsdsng(lsdj_vio_t* vio, lsdj_error_t** error)
 {
+    return lsdj_project_is_likely_valid_lsdsng_with_context(vio, NULL, error);
+}
+
+int lsdj_project_is_likely_valid_lsdsng_with_context(lsdj_vio_t* vio, const lsdj_codec_context_t* context, lsdj_error_t** error)
+{
+    // Without messages, rejecting the data never allocates
+    const int messages = lsdj_codec_context_get_error_messages(context);
+    
     // Check for incorrect input
     if (vio->tell == NULL)
     {
-        lsdj_error_new(error, "vio->tell is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, messages ? "vio->tell is NULL" : NULL);
         return 0;
     }
     
     if (vio->seek == NULL)
     {
-        lsdj_error_new(error, "vio->seek is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, messages ? "vio->seek is NULL" : NULL);
         return 0;
     }
     
@@ -200,7 +317,7 @@ int lsdj_project_is_likely_valid_lsdsng(lsdj_vio_t* vio, lsdj_error_t** error)
     const long size = vio->tell(vio->user_data) - begin;
     if ((size - LSDJ_PROJECT_NAME_LENGTH - 1) % 0x200 != 0)
     {
-        lsdj_error_new(error, "data length does not correspond to that of a valid lsdsng");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, messages ? "data length does not correspond to that of a valid lsdsng" : NULL);
         return 0;
     }
     
@@ -211,36 +328,33 @@ int lsdj_project_is_likely_valid_lsdsng_file(const char* path, lsdj_error_t** er
 {
     if (path == NULL)
     {
-        lsdj_error_new(error, "path is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
         return 0;
     }
     
-    FILE* file = fopen(path, "rb");
+    lsdj_buffered_file_t* file = lsdj_buffered_file_open(path, "rb", LSDJ_BUFFERED_FILE_DEFAULT_SIZE, error);
     if (file == NULL)
-    {
-        char message[512];
-        snprintf(message, 512, "could not open %s for reading", path);
-        lsdj_error_new(error, message);
         return 0;
-    }
     
     lsdj_vio_t vio;
-    vio.read = lsdj_fread;
-    vio.tell = lsdj_ftell;
-    vio.seek = lsdj_fseek;
-    vio.user_data = file;
+    lsdj_buffered_file_init_vio(file, &vio);
     
     int result = lsdj_project_is_likely_valid_lsdsng(&vio, error);
     
-    fclose(file);
+    lsdj_buffered_file_close(file, error);
     return result;
 }
 
 int lsdj_project_is_likely_valid_lsdsng_memory(const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    return lsdj_project_is_likely_valid_lsdsng_memory_with_context(data, size, NULL, error);
+}
+
+int lsdj_project_is_likely_valid_lsdsng_memory_with_context(const unsigned char* data, size_t size, const lsdj_codec_context_t* context, lsdj_error_t** error)
 {
     if (data == NULL)
     {
-        lsdj_error_new(error, "data is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, lsdj_codec_context_get_error_messages(context) ? "data is NULL" : NULL);
         return 0;
     }
     
@@ -255,95 +369,151 @@ int lsdj_project_is_likely_valid_lsdsng_memory(const unsigned char* data, size_t
     vio.seek = lsdj_mseek;
     vio.user_data = &mem;
     
-    return lsdj_project_is_likely_valid_lsdsng(&vio, error);
+    return lsdj_project_is_likely_valid_lsdsng_with_context(&vio, context, error);
 }
 
 size_t lsdj_project_write_lsdsng(const lsdj_project_t* project, lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    return lsdj_project_write_lsdsng_with_context(project, vio, NULL, error);
+}
+
+size_t lsdj_project_write_lsdsng_with_context(const lsdj_project_t* project, lsdj_vio_t* vio, lsdj_codec_context_t* context, lsdj_error_t** error)
 {
     size_t write_size = 0;
+    
+    // If the song hasn't changed since it was read, its compressed blocks can be written
+    // out as they are, without decompressing or compressing anything
+    unsigned int compressedBlockCount = 0;
+    const unsigned char* compressedBlocks = lsdj_project_get_compressed_song(project, &compressedBlockCount);
 
-    if (project->song == NULL)
+    const lsdj_song_t* song = NULL;
+    if (compressedBlocks == NULL)
     {
-        lsdj_error_new(error, "project does not contain a song");
-        return write_size;
+        song = lsdj_project_load_song_with_context(project, context, error);
+        if (error && *error)
+            return write_size;
+        
+        if (song == NULL)
+        {
+            lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "project does not contain a song");
+            return write_size;
+        }
     }
     
     write_size += vio->write(project->name, LSDJ_PROJECT_NAME_LENGTH, vio->user_data);
     if (write_size != LSDJ_PROJECT_NAME_LENGTH)
     {
-        lsdj_error_new(error, "could not write project name for lsdsng");
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write project name for lsdsng");
         return write_size;
     }
     
     if (vio->write(&project->version, 1, vio->user_data) != 1)
     {
-        lsdj_error_new(error, "could not write project version for lsdsng");
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write project version for lsdsng");
         return write_size;
     }
     write_size += 1;
     
+    if (compressedBlocks)
+    {
+        const size_t size = compressedBlockCount * BLOCK_SIZE;
+        if (vio->write(compressedBlocks, size, vio->user_data) != size)
+        {
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write compressed song data");
+            return write_size;
+        }
+        
+        return write_size + size;
+    }
+    
     // Write the song to memory
-    unsigned char decompressed[LSDJ_SONG_DECOMPRESSED_SIZE];
-    memset(decompressed, 0x34, LSDJ_SONG_DECOMPRESSED_SIZE);
-    lsdj_song_write_to_memory(project->song, decompressed, LSDJ_SONG_DECOMPRESSED_SIZE, error);
+    /*! Writing a song fills all of the buffer, so it doesn't need clearing first */
+    unsigned char* decompressed = lsdj_codec_context_borrow_song_buffer(context, error);
+    if (decompressed == NULL)
+        return write_size;
+    
+    lsdj_song_write_to_memory(song, decompressed, LSDJ_SONG_DECOMPRESSED_SIZE, error);
     if (error && *error)
+    {
+        lsdj_codec_context_return_buffer(context, decompressed);
         return write_size;
+    }
     
     // Compress the song
-    const size_t block_count = lsdj_compress(decompressed, BLOCK_SIZE, 1, BLOCK_COUNT, vio, error);
+    const size_t block_count = lsdj_compress_with_mode(decompressed, BLOCK_SIZE, 1, BLOCK_COUNT, vio, lsdj_codec_context_get_compression_mode(context), error);
     write_size += block_count * BLOCK_SIZE;
+    
+    lsdj_codec_context_return_buffer(context, decompressed);
 
     assert(write_size <= LSDSNG_MAX_SIZE);
     return write_size;
 }
 
 size_t lsdj_project_write_lsdsng_to_file(const lsdj_project_t* project, const char* path, lsdj_error_t** error)
+{
+    return lsdj_project_write_lsdsng_to_file_with_context(project, path, NULL, error);
+}
+
+size_t lsdj_project_write_lsdsng_to_file_with_context(const lsdj_project_t* project, const char* path, lsdj_codec_context_t* context, lsdj_error_t** error)
 {
     if (path == NULL)
     {
-        lsdj_error_new(error, "path is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
         return 0;
     }
     
     if (project == NULL)
     {
-        lsdj_error_new(error, "project is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "project is NULL");
         return 0;
     }
     
-    FILE* file = fopen(path, "wb");
-    if (file == NULL)
+    // Assemble the whole lsdsng in memory, so it reaches the file in a single atomic write
+    const size_t capacity = LSDJ_PROJECT_NAME_LENGTH + 1 + BLOCK_COUNT * BLOCK_SIZE;
+    unsigned char* data = (unsigned char*)lsdj_malloc(capacity);
+    if (data == NULL)
     {
-        char message[512];
-        snprintf(message, 512, "could not open %s for writing", path);
-        lsdj_error_new(error, message);
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate lsdsng image");
         return 0;
     }
     
-    lsdj_vio_t vio;
-    vio.write = lsdj_fwrite;
-    vio.tell = lsdj_ftell;
-    vio.seek = lsdj_fseek;
-    vio.user_data = file;
+    lsdj_error_t* writeError = NULL;
+    const size_t write_size = lsdj_project_write_lsdsng_to_memory_with_context(project, data, capacity, context, &writeError);
+    if (writeError == NULL && lsdj_codec_context_get_skip_identical_files(context))
+        lsdj_atomic_file_update(path, data, write_size, &writeError);
+    else if (writeError == NULL)
+        lsdj_atomic_file_write(path, data, write_size, &writeError);
     
-    const size_t write_size = lsdj_project_write_lsdsng(project, &vio, error);
+    lsdj_free(data);
     
-    fclose(file);
+    if (writeError)
+    {
+        if (error)
+            *error = writeError;
+        else
+            lsdj_error_free(writeError);
+        return 0;
+    }
 
     return write_size;
 }
 
 size_t lsdj_project_write_lsdsng_to_memory(const lsdj_project_t* project, unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    return lsdj_project_write_lsdsng_to_memory_with_context(project, data, size, NULL, error);
+}
+
+size_t lsdj_project_write_lsdsng_to_memory_with_context(const lsdj_project_t* project, unsigned char* data, size_t size, lsdj_codec_context_t* context, lsdj_error_t** error)
 {
     if (project == NULL)
     {
-        lsdj_error_new(error, "project is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "project is NULL");
         return 0;
     }
     
     if (data == NULL)
     {
-        lsdj_error_new(error, "data is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
         return 0;
     }
     
@@ -358,7 +528,7 @@ size_t lsdj_project_write_lsdsng_to_memory(const lsdj_project_t* project, unsign
     vio.seek = lsdj_mseek;
     vio.user_data = &mem;
     
-    return lsdj_project_write_lsdsng(project, &vio, error);
+    return lsdj_project_write_lsdsng_with_context(project, &vio, context, error);
 }
 
 void lsdj_clear_project(lsdj_project_t* project)
@@ -371,6 +541,8 @@ void lsdj_clear_project(lsdj_project_t* project)
         lsdj_song_free(project->song);
         project->song = NULL;
     }
+    
+    free_compressed_blocks(project);
 }
 
 void lsdj_project_set_name(lsdj_project_t* project, const char* data, size_t size)
@@ -402,9 +574,134 @@ void lsdj_project_set_song(lsdj_project_t* project, lsdj_song_t* song)
         lsdj_song_free(project->song);
     
     project->song = song;
+    free_compressed_blocks(project);
 }
 
 lsdj_song_t* lsdj_project_get_song(const lsdj_project_t* project)
 {
-    return project->song;
+    return lsdj_project_load_song(project, NULL);
+}
+
+const lsdj_song_t* lsdj_project_get_song_const(const lsdj_project_t* project)
+{
+    return lsdj_project_load_song(project, NULL);
+}
+
+void lsdj_project_set_compressed_song(lsdj_project_t* project, const unsigned char* blocks, unsigned int blockCount, lsdj_error_t** error)
+{
+    unsigned char* copy = (unsigned char*)lsdj_malloc(blockCount * BLOCK_SIZE);
+    if (copy == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate compressed song blocks");
+    
+    memcpy(copy, blocks, blockCount * BLOCK_SIZE);
+    
+    if (project->song)
+    {
+        lsdj_song_free(project->song);
+        project->song = NULL;
+    }
+    
+    free_compressed_blocks(project);
+    project->compressedBlocks = copy;
+    project->compressedBlockCount = blockCount;
+}
+
+void lsdj_project_memory_usage(const lsdj_project_t* project, lsdj_project_memory_usage_t* usage)
+{
+    memset(usage, 0, sizeof(lsdj_project_memory_usage_t));
+    
+    usage->projectBytes = sizeof(lsdj_project_t);
+    usage->compressedBlockCount = project->compressedBlocks ? project->compressedBlockCount : 0;
+    usage->compressedBytes = (size_t)usage->compressedBlockCount * BLOCK_SIZE;
+    
+    const lsdj_song_t* song = loaded_song(project);
+    if (song)
+        lsdj_song_memory_usage(song, &usage->song);
+    
+    usage->totalBytes = usage->projectBytes + usage->compressedBytes + usage->song.totalBytes;
+}
+
+int lsdj_project_has_song(const lsdj_project_t* project)
+{
+    return loaded_song(project) != NULL || project->compressedBlocks != NULL;
+}
+
+lsdj_song_t* lsdj_project_load_song(const lsdj_project_t* project, lsdj_error_t** error)
+{
+    return lsdj_project_load_song_with_context(project, NULL, error);
+}
+
+lsdj_song_t* lsdj_project_load_song_with_context(const lsdj_project_t* project, lsdj_codec_context_t* context, lsdj_error_t** error)
+{
+    lsdj_song_t* loaded = loaded_song(project);
+    if (loaded || project->compressedBlocks == NULL)
+        return loaded;
+    
+    // Decompressing doesn't change the contents of the project, only its representation
+    lsdj_project_t* mutableProject = (lsdj_project_t*)project;
+    
+    // Decompression fails unless it fills all of the buffer, so it doesn't need clearing first
+    unsigned char* decompressed = lsdj_codec_context_borrow_song_buffer(context, error);
+    if (decompressed == NULL)
+        return NULL;
+    
+    lsdj_memory_data_t rmem;
+    rmem.begin = rmem.cur = project->compressedBlocks;
+    rmem.size = project->compressedBlockCount * BLOCK_SIZE;
+    
+    lsdj_vio_t rvio;
+    rvio.read = lsdj_mread;
+    rvio.tell = lsdj_mtell;
+    rvio.seek = lsdj_mseek;
+    rvio.user_data = &rmem;
+    
+    lsdj_memory_data_t wmem;
+    wmem.begin = wmem.cur = decompressed;
+    wmem.size = LSDJ_SONG_DECOMPRESSED_SIZE;
+    
+    lsdj_vio_t wvio;
+    wvio.write = lsdj_mwrite;
+    wvio.tell = lsdj_mtell;
+    wvio.seek = lsdj_mseek;
+    wvio.user_data = &wmem;
+    
+    lsdj_error_t* decompressError = NULL;
+    lsdj_decompress(&rvio, &wvio, NULL, BLOCK_SIZE, &decompressError);
+    if (decompressError)
+    {
+        lsdj_codec_context_return_buffer(context, decompressed);
+        if (error)
+            *error = decompressError;
+        else
+            lsdj_error_free(decompressError);
+        return NULL;
+    }
+    
+    lsdj_song_t* song = lsdj_song_read_from_memory(decompressed, LSDJ_SONG_DECOMPRESSED_SIZE, error);
+    lsdj_codec_context_return_buffer(context, decompressed);
+    if (song == NULL)
+        return NULL;
+    
+    // Other threads reading the same project might have been decompressing it as well,
+    // keep whichever song got there first so that they all hand out the same one
+    loaded = (lsdj_song_t*)lsdj_atomic_publish_pointer((void**)&mutableProject->song, song);
+    if (loaded != song)
+        lsdj_song_free(song);
+    
+    return loaded;
+}
+
+const unsigned char* lsdj_project_get_compressed_song(const lsdj_project_t* project, unsigned int* blockCount)
+{
+    if (project->compressedBlocks == NULL)
+        return NULL;
+    
+    const lsdj_song_t* song = loaded_song(project);
+    if (song && lsdj_song_get_dirty_flag(song))
+        return NULL;
+    
+    if (blockCount)
+        *blockCount = project->compressedBlockCount;
+    
+    return project->compressedBlocks;
 }
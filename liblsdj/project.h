@@ -42,6 +42,7 @@ extern "C" {
 
 #include <stddef.h>
 
+#include "codec.h"
 #include "error.h"
 #include "song.h"
 #include "vio.h"
@@ -57,11 +58,27 @@ typedef struct lsdj_project_t lsdj_project_t;
 // Create/free projects
 lsdj_project_t* lsdj_project_new(lsdj_error_t** error);
 void lsdj_project_free(lsdj_project_t* project);
+
+// Copy a project
+/*! A song that hasn't changed since it was read only has its compressed blocks copied, so
+    it's neither decompressed nor compressed again. Otherwise the song is copied shallowly
+    (see lsdj_song_copy_shallow()). */
+lsdj_project_t* lsdj_project_copy(const lsdj_project_t* project, lsdj_error_t** error);
     
 // Deserialize a project from LSDSNG
+/*! The vio only needs to read, without seek and tell it's read forward-only */
 lsdj_project_t* lsdj_project_read_lsdsng(lsdj_vio_t* vio, lsdj_error_t** error);
 lsdj_project_t* lsdj_project_read_lsdsng_from_file(const char* path, lsdj_error_t** error);
 lsdj_project_t* lsdj_project_read_lsdsng_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error);
+lsdj_project_t* lsdj_project_read_lsdsng_from_mapped_file(const char* path, lsdj_error_t** error);
+
+// Deserialize a project from LSDSNG, but only decompress its song once it's needed
+/*! The compressed blocks are stored as they are, so a project that is put into a sav
+    without being changed is copied over byte for byte, without compressing it again.
+    Only the block structure is checked; a corrupt song is only noticed when loaded. */
+lsdj_project_t* lsdj_project_read_lsdsng_lazy(lsdj_vio_t* vio, lsdj_error_t** error);
+lsdj_project_t* lsdj_project_read_lsdsng_lazy_from_file(const char* path, lsdj_error_t** error);
+lsdj_project_t* lsdj_project_read_lsdsng_lazy_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error);
     
 // Find out whether given data is likely a valid lsdsng
 // Note: this is not a 100% guarantee that the data will load, we're just checking
@@ -72,20 +89,74 @@ lsdj_project_t* lsdj_project_read_lsdsng_from_memory(const unsigned char* data,
 int lsdj_project_is_likely_valid_lsdsng(lsdj_vio_t* vio, lsdj_error_t** error);
 int lsdj_project_is_likely_valid_lsdsng_file(const char* path, lsdj_error_t** error);
 int lsdj_project_is_likely_valid_lsdsng_memory(const unsigned char* data, size_t size, lsdj_error_t** error);
+
+// Find out whether given data is likely a valid lsdsng, with the settings of a codec context
+/*! See lsdj_codec_context_set_error_messages() to reject data without allocating */
+int lsdj_project_is_likely_valid_lsdsng_with_context(lsdj_vio_t* vio, const lsdj_codec_context_t* context, lsdj_error_t** error);
+int lsdj_project_is_likely_valid_lsdsng_memory_with_context(const unsigned char* data, size_t size, const lsdj_codec_context_t* context, lsdj_error_t** error);
     
 // Write a project to an lsdsng file
 // Returns the number of bytes written
+/*! Songs that haven't changed since they were read have their compressed blocks written
+    out as they are, byte for byte (see lsdj_project_get_compressed_song()) */
 size_t lsdj_project_write_lsdsng(const lsdj_project_t* project, lsdj_vio_t* vio, lsdj_error_t** error);
 size_t lsdj_project_write_lsdsng_to_file(const lsdj_project_t* project, const char* path, lsdj_error_t** error);
 size_t lsdj_project_write_lsdsng_to_memory(const lsdj_project_t* project, unsigned char* data, size_t size, lsdj_error_t** error);
 
+// Write a project to an lsdsng file, compressing the song in the scratch memory of a codec context
+/*! The song is compressed the way the context's compression mode says */
+size_t lsdj_project_write_lsdsng_with_context(const lsdj_project_t* project, lsdj_vio_t* vio, lsdj_codec_context_t* context, lsdj_error_t** error);
+size_t lsdj_project_write_lsdsng_to_file_with_context(const lsdj_project_t* project, const char* path, lsdj_codec_context_t* context, lsdj_error_t** error);
+size_t lsdj_project_write_lsdsng_to_memory_with_context(const lsdj_project_t* project, unsigned char* data, size_t size, lsdj_codec_context_t* context, lsdj_error_t** error);
+
 // Change data in a project
 void lsdj_project_set_name(lsdj_project_t* project, const char* data, size_t size);
 void lsdj_project_get_name(const lsdj_project_t* project, char* data, size_t size);
 void lsdj_project_set_version(lsdj_project_t* project, unsigned char version);
 unsigned char lsdj_project_get_version(const lsdj_project_t* project);
 void lsdj_project_set_song(lsdj_project_t* project, lsdj_song_t* song);
+
+// Retrieve the song, or NULL for an empty project
+/*! A project read lazily only decompresses its song here, and a song that fails to do so
+    comes back as NULL as well. Use lsdj_project_load_song() for those to tell the two apart. */
 lsdj_song_t* lsdj_project_get_song(const lsdj_project_t* project);
+const lsdj_song_t* lsdj_project_get_song_const(const lsdj_project_t* project);
+
+// Hand the project a song in compressed form, to be decompressed when it's first needed
+/*! The blocks are copied, and should count up from 1 in order (as they do in an lsdsng) */
+void lsdj_project_set_compressed_song(lsdj_project_t* project, const unsigned char* blocks, unsigned int blockCount, lsdj_error_t** error);
+
+// Find out whether the project contains a song, without decompressing it
+int lsdj_project_has_song(const lsdj_project_t* project);
+
+// Retrieve the song, decompressing it first if that hasn't happened yet
+/*! Returns NULL without an error for an empty project. Multiple threads can load the song
+    of the same project at once, they all get the same one. */
+lsdj_song_t* lsdj_project_load_song(const lsdj_project_t* project, lsdj_error_t** error);
+
+// Retrieve the song, decompressing it in the scratch memory of a codec context
+lsdj_song_t* lsdj_project_load_song_with_context(const lsdj_project_t* project, lsdj_codec_context_t* context, lsdj_error_t** error);
+
+// Retrieve the compressed blocks the song was read from
+/*! Returns NULL if there are none, or if the song has been changed since (see
+    lsdj_song_get_dirty_flag()). The blocks count up from 1, and stay owned by the project. */
+const unsigned char* lsdj_project_get_compressed_song(const lsdj_project_t* project, unsigned int* blockCount);
+
+// How much heap memory a project takes, and what for
+/*! song only covers a song that has been loaded already, finding this out never decompresses */
+typedef struct
+{
+    size_t projectBytes;
+    size_t compressedBytes;
+    unsigned int compressedBlockCount;
+    
+    lsdj_song_memory_usage_t song;
+    
+    size_t totalBytes;
+} lsdj_project_memory_usage_t;
+
+// Find out how much memory a project takes
+void lsdj_project_memory_usage(const lsdj_project_t* project, lsdj_project_memory_usage_t* usage);
     
 #ifdef __cplusplus
 }
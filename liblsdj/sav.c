@@ -39,10 +39,13 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "alloc.h"
+#include "codec.h"
 #include "compression.h"
 #include "sav.h"
+#include "thread.h"
+#include "trace.h"
 
-#define LSDJ_SAV_PROJECT_COUNT 32
 #define HEADER_START LSDJ_SONG_DECOMPRESSED_SIZE
 
 // Representation of an entire LSDJ save file
@@ -73,10 +76,10 @@ typedef struct
 
 lsdj_sav_t* lsdj_sav_alloc(lsdj_error_t** error)
 {
-    lsdj_sav_t* sav = (lsdj_sav_t*)calloc(sizeof(lsdj_sav_t), 1);
+    lsdj_sav_t* sav = (lsdj_sav_t*)lsdj_calloc(sizeof(lsdj_sav_t), 1);
     if (sav == NULL)
     {
-        lsdj_error_new(error, "could not allocate sav");
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate sav");
         return NULL;
     }
     
@@ -120,7 +123,7 @@ void lsdj_sav_free(lsdj_sav_t* sav)
         
         lsdj_song_free(sav->song);
         
-        free(sav);
+        lsdj_free(sav);
     }
 }
 
@@ -138,13 +141,21 @@ lsdj_song_t* lsdj_sav_get_working_memory_song(const lsdj_sav_t* sav)
     return sav->song;
 }
 
+const lsdj_song_t* lsdj_sav_get_working_memory_song_const(const lsdj_sav_t* sav)
+{
+    return sav->song;
+}
+
 void lsdj_sav_set_working_memory_song_from_project(lsdj_sav_t* sav, unsigned char index, lsdj_error_t** error)
 {
-    lsdj_song_t* song = lsdj_project_get_song(sav->projects[index]);
+    lsdj_song_t* song = lsdj_project_load_song(sav->projects[index], error);
+    if (error && *error)
+        return;
+    
     if (song == NULL)
-        return lsdj_error_new(error, "no song at given index");
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "no song at given index");
     
-    lsdj_song_t* copy = lsdj_song_copy(song, error);
+    lsdj_song_t* copy = lsdj_song_copy_shallow(song, error);
     if (*error)
         return;
     
@@ -165,7 +176,7 @@ lsdj_project_t* lsdj_project_new_from_working_memory_song(const lsdj_sav_t* sav,
 {
     // Try and copy the song
     lsdj_song_t* song = lsdj_sav_get_working_memory_song(sav);
-    lsdj_song_t* copy = lsdj_song_copy(song, error);
+    lsdj_song_t* copy = lsdj_song_copy_shallow(song, error);
     if (error && *error)
         return NULL;
     
@@ -203,7 +214,7 @@ unsigned int lsdj_sav_get_project_count(const lsdj_sav_t* sav)
 void lsdj_sav_set_project(lsdj_sav_t* sav, unsigned char index, lsdj_project_t* project, lsdj_error_t** error)
 {
     if (project == NULL)
-        return lsdj_error_new(error, "project is NULL");
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "project is NULL");
     
     lsdj_project_free(sav->projects[index]);
     sav->projects[index] = project;
@@ -220,16 +231,49 @@ lsdj_project_t* lsdj_sav_get_project(const lsdj_sav_t* sav, unsigned char projec
     return sav->projects[project];
 }
 
+const lsdj_project_t* lsdj_sav_get_project_const(const lsdj_sav_t* sav, unsigned char project)
+{
+    return sav->projects[project];
+}
+
+void lsdj_sav_memory_usage(const lsdj_sav_t* sav, lsdj_sav_memory_usage_t* usage)
+{
+    memset(usage, 0, sizeof(lsdj_sav_memory_usage_t));
+    
+    usage->savBytes = sizeof(lsdj_sav_t);
+    usage->totalBytes = usage->savBytes;
+    
+    if (sav->song)
+    {
+        lsdj_song_memory_usage(sav->song, &usage->workingMemorySong);
+        usage->totalBytes += usage->workingMemorySong.totalBytes;
+    }
+    
+    for (int i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
+    {
+        if (sav->projects[i] == NULL)
+            continue;
+        
+        lsdj_project_memory_usage(sav->projects[i], &usage->projects[i]);
+        usage->totalBytes += usage->projects[i].totalBytes;
+    }
+}
+
 // Read compressed project data from memory sav file
-void read_compressed_blocks(lsdj_vio_t* vio, lsdj_project_t** projects, lsdj_error_t** error)
+/*! Every project keeps a copy of its compressed blocks. When lazy is set, decompressing
+    them is left until the song is requested. */
+void read_compressed_blocks(lsdj_vio_t* vio, lsdj_project_t** projects, bool lazy, lsdj_codec_context_t* context, lsdj_error_t** error)
 {
     // Read the block allocation table
     unsigned char blocks_alloc_table[BLOCK_COUNT];
     if (vio->read(blocks_alloc_table, sizeof(blocks_alloc_table), vio->user_data) != sizeof(blocks_alloc_table))
-        return lsdj_error_new(error, "could not read block allocation table");
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read block allocation table");
+    
+    // Scratch memory for the compressed blocks of one project
+    unsigned char* blocks = lsdj_codec_context_borrow_block_buffer(context, error);
+    if (blocks == NULL)
+        return;
     
-    // Pointers for storing decompressed song data
-    // Handle decompression
     for (int i = 0; i < BLOCK_COUNT; ++i)
     {
         unsigned char p = blocks_alloc_table[i];
@@ -237,62 +281,216 @@ void read_compressed_blocks(lsdj_vio_t* vio, lsdj_project_t** projects, lsdj_err
             continue;
         
         lsdj_project_t* project = projects[p];
-        if (lsdj_project_get_song(project) != NULL)
+        if (lsdj_project_has_song(project))
             continue;
         
-        unsigned char data[LSDJ_SONG_DECOMPRESSED_SIZE];
-        memset(data, 0x00, sizeof(data));
-        
         vio->seek(HEADER_START + (i + 1) * BLOCK_SIZE, SEEK_SET, vio->user_data);
-                
-        lsdj_memory_data_t mem;
-        mem.cur = mem.begin = data;
-        mem.size = sizeof(data);
         
         long block1position = HEADER_START + BLOCK_SIZE;
-        
-        lsdj_vio_t wvio;
-        wvio.write = lsdj_mwrite;
-        wvio.tell = lsdj_mtell;
-        wvio.seek = lsdj_mseek;
-        wvio.user_data = &mem;
-        lsdj_decompress(vio, &wvio, &block1position, BLOCK_SIZE, error);
+        const unsigned int blockCount = lsdj_copy_compressed_blocks(vio, &block1position, BLOCK_SIZE, 1, blocks, BLOCK_COUNT, error);
         if (error && *error)
-            return;
+            break;
         
-        // Read the song from memory
-        lsdj_song_t* song = lsdj_song_read_from_memory(data, sizeof(data), error);
+        lsdj_project_set_compressed_song(project, blocks, blockCount, error);
         if (error && *error)
+            break;
+        
+        if (!lazy)
         {
-            lsdj_song_free(song);
-            return;
+            lsdj_project_load_song_with_context(project, context, error);
+            if (error && *error)
+                break;
         }
-        
-        lsdj_project_set_song(project, song);
     }
+    
+    lsdj_codec_context_return_buffer(context, blocks);
 }
 
-lsdj_sav_t* lsdj_sav_read(lsdj_vio_t* vio, lsdj_error_t** error)
+// Read a sav from a source that can't seek, such as a pipe or socket
+/*! Everything is read in the order it's stored. The working memory song is parsed first,
+    and every project is decoded as soon as its last block has come in, so decoding overlaps
+    with reading the rest of the input. */
+lsdj_sav_t* read_sav_forward(lsdj_vio_t* vio, bool lazy, lsdj_codec_context_t* context, lsdj_error_t** error)
 {
-    // Check for incorrect input
-    if (vio->read == NULL)
+    lsdj_sav_t* sav = lsdj_sav_alloc(error);
+    if (sav == NULL)
+        return NULL;
+    
+    // Read the working song, which comes first
+    unsigned char* song_data = lsdj_codec_context_borrow_song_buffer(context, error);
+    if (song_data == NULL)
     {
-        lsdj_error_new(error, "vio->read is NULL");
+        lsdj_sav_free(sav);
         return NULL;
     }
     
-    if (vio->seek == NULL)
+    if (vio->read(song_data, LSDJ_SONG_DECOMPRESSED_SIZE, vio->user_data) != LSDJ_SONG_DECOMPRESSED_SIZE)
     {
-        lsdj_error_new(error, "vio->seek is NULL");
+        lsdj_codec_context_return_buffer(context, song_data);
+        lsdj_sav_free(sav);
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read working memory song");
         return NULL;
     }
     
-    if (vio->tell == NULL)
+    sav->song = lsdj_song_read_from_memory(song_data, LSDJ_SONG_DECOMPRESSED_SIZE, error);
+    lsdj_codec_context_return_buffer(context, song_data);
+    if (error && *error)
+    {
+        lsdj_sav_free(sav);
+        return NULL;
+    }
+    
+    // Read the header block and the block allocation table that follows it
+    header_t header;
+    unsigned char blocks_alloc_table[BLOCK_COUNT];
+    if (vio->read(&header, sizeof(header), vio->user_data) != sizeof(header) ||
+        vio->read(blocks_alloc_table, sizeof(blocks_alloc_table), vio->user_data) != sizeof(blocks_alloc_table))
+    {
+        lsdj_sav_free(sav);
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read sav header");
+        return NULL;
+    }
+    
+    if (header.init[0] != 'j' || header.init[1] != 'k')
+    {
+        lsdj_sav_free(sav);
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "SRAM initialization check wasn't 'jk'");
+        return NULL;
+    }
+    
+    for (int i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
+    {
+        lsdj_project_t* project = lsdj_project_new(error);
+        if (error && *error)
+        {
+            lsdj_sav_free(sav);
+            return NULL;
+        }
+        
+        lsdj_project_set_name(project, &header.project_names[i * 8], 8);
+        lsdj_project_set_version(project, header.versions[i]);
+        
+        sav->projects[i] = project;
+    }
+    
+    sav->activeProject = header.active_project;
+    memcpy(sav->reserved8120, header.empty, sizeof(sav->reserved8120));
+    
+    // Find the first and last block of every project, so each one can be decoded as soon
+    // as all of its blocks have been received
+    int firstBlock[LSDJ_SAV_PROJECT_COUNT];
+    int lastBlock[LSDJ_SAV_PROJECT_COUNT];
+    int blockTotal = 0;
+    for (int i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
+        firstBlock[i] = lastBlock[i] = -1;
+    
+    for (int i = 0; i < BLOCK_COUNT; ++i)
+    {
+        const unsigned char p = blocks_alloc_table[i];
+        if (p >= LSDJ_SAV_PROJECT_COUNT)
+            continue;
+        
+        if (firstBlock[p] == -1)
+            firstBlock[p] = i;
+        lastBlock[p] = i;
+        blockTotal = i + 1;
+    }
+    
+    // The received blocks, and scratch memory for the compressed blocks of one project
+    unsigned char* received = lsdj_codec_context_borrow_block_buffer(context, error);
+    if (received == NULL)
+    {
+        lsdj_sav_free(sav);
+        return NULL;
+    }
+    
+    unsigned char* blocks = lsdj_codec_context_borrow_block_buffer(context, error);
+    if (blocks == NULL)
+    {
+        lsdj_codec_context_return_buffer(context, received);
+        lsdj_sav_free(sav);
+        return NULL;
+    }
+    
+    for (int i = 0; i < blockTotal; ++i)
+    {
+        if (vio->read(received + i * BLOCK_SIZE, BLOCK_SIZE, vio->user_data) != BLOCK_SIZE)
+        {
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read sav block");
+            break;
+        }
+        
+        const unsigned char p = blocks_alloc_table[i];
+        if (p >= LSDJ_SAV_PROJECT_COUNT || lastBlock[p] != i)
+            continue;
+        
+        // Every block this project could jump to is in by now
+        lsdj_memory_data_t mem;
+        mem.begin = received;
+        mem.cur = received + firstBlock[p] * BLOCK_SIZE;
+        mem.size = (size_t)(i + 1) * BLOCK_SIZE;
+        
+        lsdj_vio_t rvio;
+        rvio.read = lsdj_mread;
+        rvio.write = NULL;
+        rvio.tell = lsdj_mtell;
+        rvio.seek = lsdj_mseek;
+        rvio.user_data = &mem;
+        
+        long block1position = 0;
+        const unsigned int blockCount = lsdj_copy_compressed_blocks(&rvio, &block1position, BLOCK_SIZE, 1, blocks, BLOCK_COUNT, error);
+        if (error && *error)
+            break;
+        
+        lsdj_project_t* project = sav->projects[p];
+        lsdj_project_set_compressed_song(project, blocks, blockCount, error);
+        if (error && *error)
+            break;
+        
+        if (!lazy)
+        {
+            lsdj_project_load_song_with_context(project, context, error);
+            if (error && *error)
+                break;
+        }
+    }
+    
+    lsdj_codec_context_return_buffer(context, blocks);
+    lsdj_codec_context_return_buffer(context, received);
+    
+    if (error && *error)
+    {
+        lsdj_sav_free(sav);
+        return NULL;
+    }
+    
+    // Consume the free blocks at the end, so the source ends up past the sav
+    unsigned char skipped[BLOCK_SIZE];
+    for (int i = blockTotal; i < BLOCK_COUNT; ++i)
     {
-        lsdj_error_new(error, "vio->tell is NULL");
+        if (vio->read(skipped, BLOCK_SIZE, vio->user_data) != BLOCK_SIZE)
+        {
+            lsdj_sav_free(sav);
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read sav block");
+            return NULL;
+        }
+    }
+    
+    return sav;
+}
+
+lsdj_sav_t* read_sav(lsdj_vio_t* vio, bool lazy, lsdj_codec_context_t* context, lsdj_error_t** error)
+{
+    // Check for incorrect input
+    if (vio->read == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "vio->read is NULL");
         return NULL;
     }
     
+    if (vio->seek == NULL || vio->tell == NULL)
+        return read_sav_forward(vio, lazy, context, error);
+    
     lsdj_sav_t* sav = lsdj_sav_alloc(error);
     if (sav == NULL)
         return NULL;
@@ -301,7 +499,7 @@ lsdj_sav_t* lsdj_sav_read(lsdj_vio_t* vio, lsdj_error_t** error)
     const long begin = vio->tell(vio->user_data);
     if (begin == -1L)
     {
-        lsdj_error_new(error, "could not tell begin of sav read");
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not tell begin of sav read");
         lsdj_sav_free(sav);
         return NULL;
     }
@@ -316,7 +514,7 @@ lsdj_sav_t* lsdj_sav_read(lsdj_vio_t* vio, lsdj_error_t** error)
     if (header.init[0] != 'j' || header.init[1] != 'k')
     {
         lsdj_sav_free(sav);
-        lsdj_error_new(error, "SRAM initialization check wasn't 'jk'");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "SRAM initialization check wasn't 'jk'");
         return NULL;
     }
     
@@ -344,7 +542,7 @@ lsdj_sav_t* lsdj_sav_read(lsdj_vio_t* vio, lsdj_error_t** error)
     memcpy(sav->reserved8120, header.empty, sizeof(sav->reserved8120));
     
     // Read the compressed projects
-    read_compressed_blocks(vio, sav->projects, error);
+    read_compressed_blocks(vio, sav->projects, lazy, context, error);
     if (error && *error)
     {
         lsdj_sav_free(sav);
@@ -355,68 +553,66 @@ lsdj_sav_t* lsdj_sav_read(lsdj_vio_t* vio, lsdj_error_t** error)
     const long end = vio->tell(vio->user_data);
     if (end == -1L)
     {
-        lsdj_error_new(error, "could not tell end of sav read");
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not tell end of sav read");
         lsdj_sav_free(sav);
         return NULL;
     }
     
     vio->seek(begin, SEEK_SET, vio->user_data);
-    unsigned char song_data[LSDJ_SONG_DECOMPRESSED_SIZE];
-    if (vio->read(song_data, sizeof(song_data), vio->user_data) != sizeof(song_data))
+    unsigned char* song_data = lsdj_codec_context_borrow_song_buffer(context, error);
+    if (song_data == NULL)
     {
         lsdj_sav_free(sav);
-        lsdj_error_new(error, "could not read compressed song data");
         return NULL;
     }
     
-    sav->song = lsdj_song_new(error);
-    if (error && *error)
+    if (vio->read(song_data, LSDJ_SONG_DECOMPRESSED_SIZE, vio->user_data) != LSDJ_SONG_DECOMPRESSED_SIZE)
     {
+        lsdj_codec_context_return_buffer(context, song_data);
         lsdj_sav_free(sav);
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read compressed song data");
         return NULL;
     }
     
-    sav->song = lsdj_song_read_from_memory(song_data, sizeof(song_data), error);
+    sav->song = lsdj_song_read_from_memory(song_data, LSDJ_SONG_DECOMPRESSED_SIZE, error);
+    lsdj_codec_context_return_buffer(context, song_data);
+    if (error && *error)
+    {
+        lsdj_sav_free(sav);
+        return NULL;
+    }
     
     vio->seek(end, SEEK_SET, vio->user_data);
     
     return sav;
 }
 
-lsdj_sav_t* lsdj_sav_read_from_file(const char* path, lsdj_error_t** error)
+lsdj_sav_t* read_sav_from_file(const char* path, bool lazy, lsdj_error_t** error)
 {
     if (path == NULL)
     {
-        lsdj_error_new(error, "path is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
         return NULL;
     }
         
-    FILE* file = fopen(path, "rb");
+    lsdj_buffered_file_t* file = lsdj_buffered_file_open(path, "rb", LSDJ_BUFFERED_FILE_DEFAULT_SIZE, error);
     if (file == NULL)
-    {
-        char message[512];
-        snprintf(message, 512, "could not open %s for reading", path);
-        lsdj_error_new(error, message);
         return NULL;
-    }
     
     lsdj_vio_t vio;
-    vio.read = lsdj_fread;
-    vio.tell = lsdj_ftell;
-    vio.seek = lsdj_fseek;
-    vio.user_data = file;
+    lsdj_buffered_file_init_vio(file, &vio);
 
-    lsdj_sav_t* sav = lsdj_sav_read(&vio, error);
+    lsdj_sav_t* sav = read_sav(&vio, lazy, NULL, error);
     
-    fclose(file);
+    lsdj_buffered_file_close(file, error);
     return sav;
 }
 
-lsdj_sav_t* lsdj_sav_read_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error)
+lsdj_sav_t* read_sav_from_memory(const unsigned char* data, size_t size, bool lazy, lsdj_error_t** error)
 {
     if (data == NULL)
     {
-        lsdj_error_new(error, "data is NULL");
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
         return NULL;
     }
 
@@ -431,76 +627,168 @@ lsdj_sav_t* lsdj_sav_read_from_memory(const unsigned char* data, size_t size, ls
     vio.seek = lsdj_mseek;
     vio.user_data = &mem;
     
-    return lsdj_sav_read(&vio, error);
+    return read_sav(&vio, lazy, NULL, error);
 }
 
-int lsdj_sav_is_likely_valid(lsdj_vio_t* vio, lsdj_error_t** error)
+lsdj_sav_t* lsdj_sav_read(lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    return read_sav(vio, false, NULL, error);
+}
+
+lsdj_sav_t* lsdj_sav_read_from_file(const char* path, lsdj_error_t** error)
+{
+    return read_sav_from_file(path, false, error);
+}
+
+lsdj_sav_t* lsdj_sav_read_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    return read_sav_from_memory(data, size, false, error);
+}
+
+lsdj_sav_t* lsdj_sav_read_with_context(lsdj_vio_t* vio, lsdj_codec_context_t* context, lsdj_error_t** error)
+{
+    return read_sav(vio, false, context, error);
+}
+
+lsdj_sav_t* lsdj_sav_read_lazy(lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    return read_sav(vio, true, NULL, error);
+}
+
+lsdj_sav_t* lsdj_sav_read_lazy_from_file(const char* path, lsdj_error_t** error)
+{
+    return read_sav_from_file(path, true, error);
+}
+
+lsdj_sav_t* lsdj_sav_read_lazy_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    return read_sav_from_memory(data, size, true, error);
+}
+
+// Read a single byte of the working memory song
+unsigned char read_working_memory_byte(lsdj_vio_t* vio, long begin, long address)
+{
+    unsigned char byte = 0;
+    vio->seek(begin + address, SEEK_SET, vio->user_data);
+    vio->read(&byte, 1, vio->user_data);
+    return byte;
+}
+
+void lsdj_sav_read_catalog(lsdj_vio_t* vio, lsdj_sav_catalog_t* catalog, lsdj_error_t** error)
 {
     // Check for incorrect input
     if (vio->read == NULL)
-    {
-        lsdj_error_new(error, "vio->read is NULL");
-        return 0;
-    }
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "vio->read is NULL");
     
     if (vio->seek == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "vio->seek is NULL");
+    
+    if (vio->tell == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "vio->tell is NULL");
+    
+    memset(catalog, 0, sizeof(lsdj_sav_catalog_t));
+    
+    const long begin = vio->tell(vio->user_data);
+    if (begin == -1L)
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not tell begin of sav read");
+    
+    // The working memory song is stored uncompressed, so we can just pick out the bytes
+    catalog->workingMemoryTempo = read_working_memory_byte(vio, begin, LSDJ_SONG_TEMPO_ADDRESS);
+    catalog->workingMemoryFileChangedFlag = read_working_memory_byte(vio, begin, LSDJ_SONG_FILE_CHANGED_FLAG_ADDRESS);
+    catalog->workingMemoryFormatVersion = read_working_memory_byte(vio, begin, LSDJ_SONG_FORMAT_VERSION_ADDRESS);
+    
+    // Read the header block
+    vio->seek(begin + HEADER_START, SEEK_SET, vio->user_data);
+    
+    header_t header;
+    if (vio->read(&header, sizeof(header), vio->user_data) != sizeof(header))
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read header");
+    
+    if (header.init[0] != 'j' || header.init[1] != 'k')
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "SRAM initialization check wasn't 'jk'");
+    
+    catalog->activeProject = header.active_project;
+    
+    for (int i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
     {
-        lsdj_error_new(error, "vio->seek is NULL");
-        return 0;
+        const char* name = &header.project_names[i * LSDJ_PROJECT_NAME_LENGTH];
+        memcpy(catalog->projects[i].name, name, strnlen(name, LSDJ_PROJECT_NAME_LENGTH));
+        catalog->projects[i].version = header.versions[i];
     }
     
-    // Move to the initialization bytes
-    vio->seek(HEADER_START + 0x13E, SEEK_CUR, vio->user_data);
+    // Read the block allocation table, and all of the blocks in one go
+    unsigned char blocks_alloc_table[BLOCK_COUNT];
+    if (vio->read(blocks_alloc_table, sizeof(blocks_alloc_table), vio->user_data) != sizeof(blocks_alloc_table))
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read block allocation table");
     
-    // Ensure these bytes are 'jk', that's what LSDJ sets them to on RAM init
-    char buffer[2];
-    vio->read(buffer, sizeof(buffer), vio->user_data);
+    unsigned char* blocks = (unsigned char*)lsdj_malloc(BLOCK_COUNT * BLOCK_SIZE);
+    if (blocks == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate compressed block buffer");
     
-    if (buffer[0] != 'j' || buffer[1] != 'k')
+    vio->seek(begin + HEADER_START + BLOCK_SIZE, SEEK_SET, vio->user_data);
+    if (vio->read(blocks, BLOCK_COUNT * BLOCK_SIZE, vio->user_data) != BLOCK_COUNT * BLOCK_SIZE)
     {
-        lsdj_error_new(error, "Memory 0x813E isn't 'jk'");
-        return 0;
+        lsdj_free(blocks);
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read compressed blocks");
     }
     
-    return 1;
+    for (int i = 0; i < BLOCK_COUNT; ++i)
+    {
+        const unsigned char p = blocks_alloc_table[i];
+        if (p >= LSDJ_SAV_PROJECT_COUNT)
+            continue;
+        
+        // Only the first block of each project is where its song starts
+        lsdj_sav_catalog_project_t* project = &catalog->projects[p];
+        if (project->blockCount++ > 0)
+            continue;
+        
+        lsdj_memory_data_t mem;
+        mem.begin = blocks;
+        mem.cur = blocks + i * BLOCK_SIZE;
+        mem.size = BLOCK_COUNT * BLOCK_SIZE;
+        
+        lsdj_vio_t rvio;
+        rvio.read = lsdj_mread;
+        rvio.tell = lsdj_mtell;
+        rvio.seek = lsdj_mseek;
+        rvio.user_data = &mem;
+        
+        // Everything from the tempo up until the format version at the very end
+        unsigned char range[LSDJ_SONG_FORMAT_VERSION_ADDRESS - LSDJ_SONG_TEMPO_ADDRESS + 1];
+        long block1position = 0;
+        lsdj_decompress_range(&rvio, &block1position, BLOCK_SIZE, LSDJ_SONG_TEMPO_ADDRESS, range, sizeof(range), error);
+        if (error && *error)
+            break;
+        
+        project->tempo = range[0];
+        project->formatVersion = range[sizeof(range) - 1];
+    }
+    
+    lsdj_free(blocks);
 }
 
-int lsdj_sav_is_likely_valid_file(const char* path, lsdj_error_t** error)
+void lsdj_sav_read_catalog_from_file(const char* path, lsdj_sav_catalog_t* catalog, lsdj_error_t** error)
 {
     if (path == NULL)
-    {
-        lsdj_error_new(error, "path is NULL");
-        return 0;
-    }
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
     
-    FILE* file = fopen(path, "rb");
+    lsdj_buffered_file_t* file = lsdj_buffered_file_open(path, "rb", LSDJ_BUFFERED_FILE_DEFAULT_SIZE, error);
     if (file == NULL)
-    {
-        char message[512];
-        snprintf(message, 512, "could not open %s for reading", path);
-        lsdj_error_new(error, message);
-        return 0;
-    }
+        return;
     
     lsdj_vio_t vio;
-    vio.read = lsdj_fread;
-    vio.tell = lsdj_ftell;
-    vio.seek = lsdj_fseek;
-    vio.user_data = file;
+    lsdj_buffered_file_init_vio(file, &vio);
     
-    int result = lsdj_sav_is_likely_valid(&vio, error);
+    lsdj_sav_read_catalog(&vio, catalog, error);
     
-    fclose(file);
-    return result;
+    lsdj_buffered_file_close(file, error);
 }
 
-int lsdj_sav_is_likely_valid_memory(const unsigned char* data, size_t size, lsdj_error_t** error)
+void lsdj_sav_read_catalog_from_memory(const unsigned char* data, size_t size, lsdj_sav_catalog_t* catalog, lsdj_error_t** error)
 {
     if (data == NULL)
-    {
-        lsdj_error_new(error, "data is NULL");
-        return 0;
-    }
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
     
     lsdj_memory_data_t mem;
     mem.begin = (unsigned char*)data;
@@ -513,35 +801,644 @@ int lsdj_sav_is_likely_valid_memory(const unsigned char* data, size_t size, lsdj
     vio.seek = lsdj_mseek;
     vio.user_data = &mem;
     
-    return lsdj_sav_is_likely_valid(&vio, error);
+    lsdj_sav_read_catalog(&vio, catalog, error);
 }
 
-void lsdj_sav_write(const lsdj_sav_t* sav, lsdj_vio_t* vio, lsdj_error_t** error)
+lsdj_project_t* lsdj_sav_read_project(lsdj_vio_t* vio, unsigned char index, lsdj_error_t** error)
 {
-    // Write the working project
-    unsigned char song_data[LSDJ_SONG_DECOMPRESSED_SIZE];
-    lsdj_song_write_to_memory(sav->song, song_data, LSDJ_SONG_DECOMPRESSED_SIZE, error);
-    if (vio->write(song_data, sizeof(song_data), vio->user_data) != sizeof(song_data))
-        return lsdj_error_new(error, "could not write compressed song data");
-
-    // Create the header for writing
-    header_t header;
-    memset(&header, 0, sizeof(header));
-    header.init[0] = 'j';
-    header.init[1] = 'k';
-    header.active_project = sav->activeProject;
-    memcpy(header.empty, sav->reserved8120, sizeof(sav->reserved8120));
-
-    // Create the block allocation table for writing
-    unsigned char block_alloc_table[BLOCK_COUNT];
-    memset(&block_alloc_table, 0xFF, sizeof(block_alloc_table));
+    // Check for incorrect input
+    if (vio->read == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "vio->read is NULL");
+        return NULL;
+    }
+    
+    if (vio->seek == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "vio->seek is NULL");
+        return NULL;
+    }
+    
+    if (vio->tell == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "vio->tell is NULL");
+        return NULL;
+    }
+    
+    if (index >= LSDJ_SAV_PROJECT_COUNT && index != LSDJ_NO_ACTIVE_PROJECT)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "index is out of range");
+        return NULL;
+    }
+    
+    const long begin = vio->tell(vio->user_data);
+    if (begin == -1L)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not tell begin of sav read");
+        return NULL;
+    }
+    
+    // Read the header block and the block allocation table that follows it
+    vio->seek(begin + HEADER_START, SEEK_SET, vio->user_data);
+    
+    header_t header;
+    unsigned char blocks_alloc_table[BLOCK_COUNT];
+    if (vio->read(&header, sizeof(header), vio->user_data) != sizeof(header) ||
+        vio->read(blocks_alloc_table, sizeof(blocks_alloc_table), vio->user_data) != sizeof(blocks_alloc_table))
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read sav header");
+        return NULL;
+    }
+    
+    if (header.init[0] != 'j' || header.init[1] != 'k')
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "SRAM initialization check wasn't 'jk'");
+        return NULL;
+    }
+    
+    lsdj_project_t* project = lsdj_project_new(error);
+    if (project == NULL)
+        return NULL;
+    
+    // The working memory song takes the name of the project it represents
+    const unsigned char named = index == LSDJ_NO_ACTIVE_PROJECT ? header.active_project : index;
+    if (named < LSDJ_SAV_PROJECT_COUNT)
+    {
+        lsdj_project_set_name(project, &header.project_names[named * LSDJ_PROJECT_NAME_LENGTH], LSDJ_PROJECT_NAME_LENGTH);
+        lsdj_project_set_version(project, header.versions[named]);
+    }
+    
+    if (index == LSDJ_NO_ACTIVE_PROJECT)
+    {
+        vio->seek(begin, SEEK_SET, vio->user_data);
+        lsdj_song_t* song = lsdj_song_read(vio, error);
+        if (error && *error)
+        {
+            lsdj_project_free(project);
+            return NULL;
+        }
+        
+        lsdj_project_set_song(project, song);
+        return project;
+    }
+    
+    // The song starts at the first block allocated to the project
+    const unsigned char* first = (const unsigned char*)memchr(blocks_alloc_table, index, BLOCK_COUNT);
+    if (first == NULL)
+        return project;
+    
+    unsigned char* blocks = lsdj_codec_context_borrow_block_buffer(NULL, error);
+    if (blocks == NULL)
+    {
+        lsdj_project_free(project);
+        return NULL;
+    }
+    
+    vio->seek(begin + HEADER_START + (first - blocks_alloc_table + 1) * BLOCK_SIZE, SEEK_SET, vio->user_data);
+    
+    long block1position = begin + HEADER_START + BLOCK_SIZE;
+    const unsigned int blockCount = lsdj_copy_compressed_blocks(vio, &block1position, BLOCK_SIZE, 1, blocks, BLOCK_COUNT, error);
+    if (!(error && *error))
+        lsdj_project_set_compressed_song(project, blocks, blockCount, error);
+    
+    lsdj_codec_context_return_buffer(NULL, blocks);
+    
+    if (error && *error)
+    {
+        lsdj_project_free(project);
+        return NULL;
+    }
+    
+    return project;
+}
+
+lsdj_project_t* lsdj_sav_read_project_from_file(const char* path, unsigned char index, lsdj_error_t** error)
+{
+    if (path == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
+        return NULL;
+    }
+    
+    lsdj_buffered_file_t* file = lsdj_buffered_file_open(path, "rb", LSDJ_BUFFERED_FILE_DEFAULT_SIZE, error);
+    if (file == NULL)
+        return NULL;
+    
+    lsdj_vio_t vio;
+    lsdj_buffered_file_init_vio(file, &vio);
+    
+    lsdj_project_t* project = lsdj_sav_read_project(&vio, index, error);
+    
+    lsdj_buffered_file_close(file, error);
+    return project;
+}
+
+lsdj_project_t* lsdj_sav_read_project_from_memory(const unsigned char* data, size_t size, unsigned char index, lsdj_error_t** error)
+{
+    if (data == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
+        return NULL;
+    }
+    
+    lsdj_memory_data_t mem;
+    mem.begin = (unsigned char*)data;
+    mem.cur = mem.begin;
+    mem.size = size;
+    
+    lsdj_vio_t vio;
+    vio.read = lsdj_mread;
+    vio.tell = lsdj_mtell;
+    vio.seek = lsdj_mseek;
+    vio.user_data = &mem;
+    
+    return lsdj_sav_read_project(&vio, index, error);
+}
+
+// The projects of a lazily read sav, and the errors their decompression ran into
+typedef struct
+{
+    lsdj_project_t** projects;
+    lsdj_error_t* errors[LSDJ_SAV_PROJECT_COUNT];
+} parallel_load_t;
+
+void load_project_song(unsigned int index, unsigned int worker, void* user_data)
+{
+    (void)worker;
+    
+    parallel_load_t* load = (parallel_load_t*)user_data;
+    lsdj_project_load_song(load->projects[index], &load->errors[index]);
+}
+
+// Decompress the songs of all projects in a lazily read sav, over multiple threads
+lsdj_sav_t* load_sav_parallel(lsdj_sav_t* sav, unsigned int threadCount, lsdj_error_t** error)
+{
+    if (sav == NULL)
+        return NULL;
+    
+    parallel_load_t load;
+    load.projects = sav->projects;
+    memset(load.errors, 0, sizeof(load.errors));
+    
+    lsdj_parallel_for(LSDJ_SAV_PROJECT_COUNT, threadCount, load_project_song, &load, error);
+    
+    // Report the first error we came across, and drop the rest
+    for (int i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
+    {
+        if (load.errors[i] == NULL)
+            continue;
+        
+        if (error && *error == NULL)
+            *error = load.errors[i];
+        else
+            lsdj_error_free(load.errors[i]);
+    }
+    
+    if (error && *error)
+    {
+        lsdj_sav_free(sav);
+        return NULL;
+    }
+    
+    return sav;
+}
+
+lsdj_sav_t* lsdj_sav_read_parallel(lsdj_vio_t* vio, unsigned int threadCount, lsdj_error_t** error)
+{
+    return load_sav_parallel(read_sav(vio, true, NULL, error), threadCount, error);
+}
+
+lsdj_sav_t* lsdj_sav_read_parallel_from_file(const char* path, unsigned int threadCount, lsdj_error_t** error)
+{
+    return load_sav_parallel(read_sav_from_file(path, true, error), threadCount, error);
+}
+
+lsdj_sav_t* lsdj_sav_read_parallel_from_memory(const unsigned char* data, size_t size, unsigned int threadCount, lsdj_error_t** error)
+{
+    return load_sav_parallel(read_sav_from_memory(data, size, true, error), threadCount, error);
+}
+
+void lsdj_sav_read_options_init(lsdj_sav_read_options_t* options)
+{
+    options->threadCount = 1;
+    options->lazy = 0;
+}
+
+// The state shared by the workers of lsdj_sav_read_many()
+typedef struct
+{
+    const lsdj_sav_input_t* inputs;
+    lsdj_sav_read_result_t* results;
+    
+    // One codec context per worker
+    lsdj_codec_context_t** contexts;
+    
+    // The errors of every project decompressed, LSDJ_SAV_PROJECT_COUNT per input
+    lsdj_error_t** projectErrors;
+} read_many_t;
+
+// Clamp a thread count the way lsdj_parallel_for() does, to find out how many workers there are
+unsigned int clamp_thread_count(unsigned int threadCount, unsigned int count)
+{
+    if (threadCount > count)
+        threadCount = count;
+    
+    return threadCount ? threadCount : 1;
+}
+
+void read_many_sav(unsigned int index, unsigned int worker, void* user_data)
+{
+    read_many_t* many = (read_many_t*)user_data;
+    const lsdj_sav_input_t* input = &many->inputs[index];
+    lsdj_sav_read_result_t* result = &many->results[index];
+    lsdj_codec_context_t* context = many->contexts[worker];
+    
+    if (input->path)
+    {
+        lsdj_buffered_file_t* file = lsdj_buffered_file_open(input->path, "rb", LSDJ_BUFFERED_FILE_DEFAULT_SIZE, &result->error);
+        if (file == NULL)
+            return;
+        
+        lsdj_vio_t vio;
+        lsdj_buffered_file_init_vio(file, &vio);
+        
+        result->sav = read_sav(&vio, true, context, &result->error);
+        
+        lsdj_buffered_file_close(file, result->sav ? &result->error : NULL);
+    } else if (input->data) {
+        lsdj_memory_data_t mem;
+        mem.begin = (unsigned char*)input->data;
+        mem.cur = mem.begin;
+        mem.size = input->size;
+        
+        lsdj_vio_t vio;
+        vio.read = lsdj_mread;
+        vio.write = NULL;
+        vio.tell = lsdj_mtell;
+        vio.seek = lsdj_mseek;
+        vio.user_data = &mem;
+        
+        result->sav = read_sav(&vio, true, context, &result->error);
+    } else {
+        lsdj_error_new_code(&result->error, LSDJ_ERROR_INVALID_ARGUMENT, "input has neither a path nor data");
+    }
+    
+    if (result->error)
+        result->sav = (lsdj_sav_free(result->sav), NULL);
+}
+
+void read_many_project(unsigned int index, unsigned int worker, void* user_data)
+{
+    read_many_t* many = (read_many_t*)user_data;
+    const lsdj_sav_t* sav = many->results[index / LSDJ_SAV_PROJECT_COUNT].sav;
+    if (sav == NULL)
+        return;
+    
+    lsdj_codec_context_t* context = many->contexts[worker];
+    lsdj_project_load_song_with_context(sav->projects[index % LSDJ_SAV_PROJECT_COUNT], context, &many->projectErrors[index]);
+}
+
+unsigned int lsdj_sav_read_many(const lsdj_sav_input_t* inputs, unsigned int count, const lsdj_sav_read_options_t* options, lsdj_sav_read_result_t* results, lsdj_error_t** error)
+{
+    if (inputs == NULL && count > 0)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "inputs is NULL");
+        return 0;
+    }
+    
+    if (results == NULL && count > 0)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "results is NULL");
+        return 0;
+    }
+    
+    lsdj_sav_read_options_t defaults;
+    if (options == NULL)
+    {
+        lsdj_sav_read_options_init(&defaults);
+        options = &defaults;
+    }
+    
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        results[i].sav = NULL;
+        results[i].error = NULL;
+    }
+    
+    // Every worker gets its own scratch memory, which it keeps for the whole batch
+    const unsigned int projectCount = count * LSDJ_SAV_PROJECT_COUNT;
+    const unsigned int contextCount = clamp_thread_count(options->threadCount, options->lazy ? count : projectCount);
+    
+    read_many_t many;
+    many.inputs = inputs;
+    many.results = results;
+    many.contexts = (lsdj_codec_context_t**)lsdj_calloc(contextCount, sizeof(lsdj_codec_context_t*));
+    many.projectErrors = NULL;
+    if (many.contexts == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate codec contexts");
+        return 0;
+    }
+    
+    for (unsigned int t = 0; t < contextCount && (error == NULL || *error == NULL); ++t)
+        many.contexts[t] = lsdj_codec_context_new(error);
+    
+    // Read all the savs with their projects still compressed
+    if (error == NULL || *error == NULL)
+    {
+        lsdj_parallel_for(count, options->threadCount, read_many_sav, &many, error);
+    }
+    
+    // Then decompress the projects of all of them as one batch
+    if (!options->lazy && count > 0 && (error == NULL || *error == NULL))
+    {
+        many.projectErrors = (lsdj_error_t**)lsdj_calloc(projectCount, sizeof(lsdj_error_t*));
+        if (many.projectErrors == NULL)
+        {
+            lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate project errors");
+        } else {
+            lsdj_parallel_for(projectCount, options->threadCount, read_many_project, &many, error);
+        }
+    }
+    
+    // A sav with a project that failed fails as a whole, reporting the first of its errors
+    unsigned int readCount = 0;
+    for (unsigned int i = 0; i < count; ++i)
+    {
+        for (unsigned int p = 0; many.projectErrors && p < LSDJ_SAV_PROJECT_COUNT; ++p)
+        {
+            lsdj_error_t* projectError = many.projectErrors[i * LSDJ_SAV_PROJECT_COUNT + p];
+            if (projectError && results[i].error == NULL)
+                results[i].error = projectError;
+            else
+                lsdj_error_free(projectError);
+        }
+        
+        // When the batch itself failed, nothing is handed out
+        if (results[i].error || (error && *error))
+            results[i].sav = (lsdj_sav_free(results[i].sav), NULL);
+        
+        readCount += results[i].sav != NULL;
+    }
+    
+    lsdj_free(many.projectErrors);
+    for (unsigned int t = 0; t < contextCount; ++t)
+        lsdj_codec_context_free(many.contexts[t]);
+    lsdj_free(many.contexts);
+    
+    return readCount;
+}
+
+lsdj_sav_t* lsdj_sav_read_from_mapped_file(const char* path, lsdj_error_t** error)
+{
+    lsdj_mapped_file_t* file = lsdj_mapped_file_open(path, error);
+    if (file == NULL)
+        return NULL;
+    
+    lsdj_vio_t vio;
+    lsdj_mapped_file_init_vio(file, &vio);
+    
+    lsdj_sav_t* sav = lsdj_sav_read(&vio, error);
+    
+    lsdj_mapped_file_close(file);
+    return sav;
+}
+
+int lsdj_sav_is_likely_valid(lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    return lsdj_sav_is_likely_valid_with_context(vio, NULL, error);
+}
+
+int lsdj_sav_is_likely_valid_with_context(lsdj_vio_t* vio, const lsdj_codec_context_t* context, lsdj_error_t** error)
+{
+    // Without messages, rejecting the data never allocates
+    const int messages = lsdj_codec_context_get_error_messages(context);
+    
+    // Check for incorrect input
+    if (vio->read == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, messages ? "vio->read is NULL" : NULL);
+        return 0;
+    }
+    
+    if (vio->seek == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, messages ? "vio->seek is NULL" : NULL);
+        return 0;
+    }
+    
+    // Move to the initialization bytes
+    vio->seek(HEADER_START + 0x13E, SEEK_CUR, vio->user_data);
+    
+    // Ensure these bytes are 'jk', that's what LSDJ sets them to on RAM init
+    char buffer[2];
+    vio->read(buffer, sizeof(buffer), vio->user_data);
+    
+    if (buffer[0] != 'j' || buffer[1] != 'k')
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, messages ? "Memory 0x813E isn't 'jk'" : NULL);
+        return 0;
+    }
+    
+    return 1;
+}
+
+int lsdj_sav_is_likely_valid_file(const char* path, lsdj_error_t** error)
+{
+    if (path == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
+        return 0;
+    }
+    
+    lsdj_buffered_file_t* file = lsdj_buffered_file_open(path, "rb", LSDJ_BUFFERED_FILE_DEFAULT_SIZE, error);
+    if (file == NULL)
+        return 0;
+    
+    lsdj_vio_t vio;
+    lsdj_buffered_file_init_vio(file, &vio);
+    
+    int result = lsdj_sav_is_likely_valid(&vio, error);
+    
+    lsdj_buffered_file_close(file, error);
+    return result;
+}
+
+int lsdj_sav_is_likely_valid_memory(const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    return lsdj_sav_is_likely_valid_memory_with_context(data, size, NULL, error);
+}
+
+int lsdj_sav_is_likely_valid_memory_with_context(const unsigned char* data, size_t size, const lsdj_codec_context_t* context, lsdj_error_t** error)
+{
+    if (data == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, lsdj_codec_context_get_error_messages(context) ? "data is NULL" : NULL);
+        return 0;
+    }
+    
+    lsdj_memory_data_t mem;
+    mem.begin = (unsigned char*)data;
+    mem.cur = mem.begin;
+    mem.size = size;
+    
+    lsdj_vio_t vio;
+    vio.read = lsdj_mread;
+    vio.tell = lsdj_mtell;
+    vio.seek = lsdj_mseek;
+    vio.user_data = &mem;
+    
+    return lsdj_sav_is_likely_valid_with_context(&vio, context, error);
+}
+
+// A project that was compressed on its own, before being packed into the sav
+typedef struct
+{
+    // Whether the project contained a song at all
+    bool hasSong;
+    
+    // The compressed blocks, numbered consecutively from 1
+    unsigned char* blocks;
+    unsigned int blockCount;
+    
+    lsdj_error_t* error;
+} compressed_project_t;
+
+typedef struct
+{
+    const lsdj_sav_t* sav;
+    lsdj_compression_mode_t mode;
+    compressed_project_t projects[LSDJ_SAV_PROJECT_COUNT];
+} parallel_compress_t;
+
+void compress_project(unsigned int index, unsigned int worker, void* user_data)
+{
+    (void)worker;
+    
+    parallel_compress_t* compress = (parallel_compress_t*)user_data;
+    compressed_project_t* compressed = &compress->projects[index];
+    
+    // Unchanged projects are copied over as they are, no need to compress those
+    const lsdj_project_t* project = compress->sav->projects[index];
+    if (lsdj_project_get_compressed_song(project, NULL))
+        return;
+    
+    const lsdj_song_t* song = lsdj_project_load_song(project, &compressed->error);
+    if (compressed->error || song == NULL)
+        return;
+    
+    compressed->hasSong = true;
+    
+    unsigned char song_data[LSDJ_SONG_DECOMPRESSED_SIZE];
+    lsdj_song_write_to_memory(song, song_data, LSDJ_SONG_DECOMPRESSED_SIZE, &compressed->error);
+    if (compressed->error)
+        return;
+    
+    compressed->blocks = (unsigned char*)lsdj_calloc(BLOCK_COUNT, BLOCK_SIZE);
+    if (compressed->blocks == NULL)
+        return lsdj_error_new_code(&compressed->error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate compression buffer");
+    
+    lsdj_memory_data_t mem;
+    mem.cur = mem.begin = compressed->blocks;
+    mem.size = BLOCK_COUNT * BLOCK_SIZE;
+    
+    lsdj_vio_t wvio;
+    wvio.write = lsdj_mwrite;
+    wvio.seek = lsdj_mseek;
+    wvio.tell = lsdj_mtell;
+    wvio.user_data = &mem;
+    
+    compressed->blockCount = lsdj_compress_with_mode(song_data, BLOCK_SIZE, 1, BLOCK_COUNT, &wvio, compress->mode, &compressed->error);
+}
+
+// Compress every project in the sav on its own, over multiple threads
+void compress_projects_parallel(const lsdj_sav_t* sav, unsigned int threadCount, lsdj_compression_mode_t mode, parallel_compress_t* compress, lsdj_error_t** error)
+{
+    memset(compress, 0, sizeof(parallel_compress_t));
+    compress->sav = sav;
+    compress->mode = mode;
+    
+    lsdj_parallel_for(LSDJ_SAV_PROJECT_COUNT, threadCount, compress_project, compress, error);
+    
+    // Report the first error we came across, and drop the rest
+    for (int i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
+    {
+        lsdj_error_t* projectError = compress->projects[i].error;
+        compress->projects[i].error = NULL;
+        
+        if (projectError == NULL)
+            continue;
+        
+        if (error && *error == NULL)
+            *error = projectError;
+        else
+            lsdj_error_free(projectError);
+    }
+}
+
+void free_compressed_projects(parallel_compress_t* compress)
+{
+    for (int i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
+        lsdj_free(compress->projects[i].blocks);
+}
+
+// Report a project that doesn't fit in the blocks that are left
+void not_enough_space(const char* name, unsigned int freeBlockCount, lsdj_error_t** error)
+{
+    if (error)
+    {
+        char message[128];
+        snprintf(message, sizeof(message), "not enough space for project %.8s, only %u blocks are left", name, freeBlockCount);
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_SPACE, message);
+    }
+}
+
+// Write a sav, compressing the projects over threadCount threads the way mode says
+/*! With multiple threads, every project is first compressed into its own buffer. Those are
+    then packed together, renumbering the next block commands to their final position.
+    blocksUsed is set to the amount of blocks filled with songs. song_data and blocks are
+    scratch memory for a decompressed song and every block in the sav. */
+void pack_sav(const lsdj_sav_t* sav, lsdj_vio_t* vio, unsigned int threadCount, lsdj_compression_mode_t mode, unsigned char* song_data, unsigned char* blocks, unsigned int* blocksUsed, lsdj_error_t** error)
+{
+    // Write the working project
+    lsdj_song_write_to_memory(sav->song, song_data, LSDJ_SONG_DECOMPRESSED_SIZE, error);
+    if (vio->write(song_data, LSDJ_SONG_DECOMPRESSED_SIZE, vio->user_data) != LSDJ_SONG_DECOMPRESSED_SIZE)
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write compressed song data");
+
+    // Create the header for writing
+    header_t header;
+    memset(&header, 0, sizeof(header));
+    header.init[0] = 'j';
+    header.init[1] = 'k';
+    header.active_project = sav->activeProject;
+    memcpy(header.empty, sav->reserved8120, sizeof(sav->reserved8120));
+
+    // Create the block allocation table for writing
+    unsigned char block_alloc_table[BLOCK_COUNT];
+    memset(&block_alloc_table, 0xFF, sizeof(block_alloc_table));
     unsigned char* table_ptr = block_alloc_table;
 
     // Write project specific data
-    unsigned char blocks[BLOCK_COUNT][BLOCK_SIZE];
-    
+    /*! Every block gets filled up to BLOCK_SIZE as songs are packed, so only the ones
+        that are left over need clearing at the end */
     unsigned char current_block = 1;
-    memset(blocks, 0, sizeof(blocks));
+    
+    // Phase one of parallel writing, compress every project separately
+    parallel_compress_t* compress = NULL;
+    if (threadCount > 1)
+    {
+        compress = (parallel_compress_t*)lsdj_malloc(sizeof(parallel_compress_t));
+        if (compress == NULL)
+            return lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate parallel compression data");
+        
+        compress_projects_parallel(sav, threadCount, mode, compress, error);
+        if (error && *error)
+        {
+            free_compressed_projects(compress);
+            lsdj_free(compress);
+            return;
+        }
+    }
     
     for (int i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
     {
@@ -555,16 +1452,67 @@ void lsdj_sav_write(const lsdj_sav_t* sav, lsdj_vio_t* vio, lsdj_error_t** error
         // Write project version
         header.versions[i] = lsdj_project_get_version(project);
         
-        lsdj_song_t* song = lsdj_project_get_song(project);
+        // Projects that haven't changed since they were read are copied over as they are
+        // Otherwise, with parallel writing, this is phase two: packing the compressed projects
+        unsigned int blockCount = 0;
+        const unsigned char* compressedBlocks = lsdj_project_get_compressed_song(project, &blockCount);
+        bool hasSong = compressedBlocks != NULL;
+        if (!hasSong && compress)
+        {
+            hasSong = compress->projects[i].hasSong;
+            compressedBlocks = compress->projects[i].blocks;
+            blockCount = compress->projects[i].blockCount;
+        }
+        
+        if (hasSong && compressedBlocks)
+        {
+            if (blockCount == 0 || current_block + blockCount - 1 > BLOCK_COUNT)
+            {
+                not_enough_space(name, BLOCK_COUNT + 1u - current_block, error);
+                break;
+            }
+            
+            lsdj_memory_data_t mem;
+            mem.cur = mem.begin = (unsigned char*)compressedBlocks;
+            mem.size = blockCount * BLOCK_SIZE;
+            
+            lsdj_vio_t rvio;
+            rvio.read = lsdj_mread;
+            rvio.seek = lsdj_mseek;
+            rvio.tell = lsdj_mtell;
+            rvio.user_data = &mem;
+            
+            const unsigned int written_block_count = lsdj_copy_compressed_blocks(&rvio, NULL, BLOCK_SIZE, current_block, blocks + (current_block - 1) * BLOCK_SIZE, blockCount, error);
+            if (error && *error)
+                break;
+            
+            // The space check above keeps this within BLOCK_COUNT + 1
+            current_block = (unsigned char)(current_block + written_block_count);
+            for (unsigned int j = 0; j < written_block_count; ++j)
+                *table_ptr++ = (unsigned char)i;
+            
+            continue;
+        } else if (compress) {
+            if (hasSong)
+            {
+                not_enough_space(name, BLOCK_COUNT + 1u - current_block, error);
+                break;
+            }
+            continue;
+        }
+        
+        const lsdj_song_t* song = lsdj_project_load_song(project, error);
+        if (error && *error)
+            return;
+        
         if (song)
         {
             // Compress the song to memory
-            unsigned char song_data[LSDJ_SONG_DECOMPRESSED_SIZE];
             lsdj_song_write_to_memory(song, song_data, LSDJ_SONG_DECOMPRESSED_SIZE, error);
             
             lsdj_memory_data_t mem;
-            mem.cur = mem.begin = blocks[current_block - 1];
-            mem.size = sizeof(blocks);
+            mem.cur = mem.begin = blocks + (current_block - 1) * BLOCK_SIZE;
+            mem.size = (BLOCK_COUNT + 1u - current_block) * BLOCK_SIZE;
             
             lsdj_vio_t wvio;
             wvio.write = lsdj_mwrite;
@@ -572,12 +1520,15 @@ void lsdj_sav_write(const lsdj_sav_t* sav, lsdj_vio_t* vio, lsdj_error_t** error
             wvio.tell = lsdj_mtell;
             wvio.user_data = &mem;
             
-            unsigned int written_block_count = lsdj_compress(song_data, BLOCK_SIZE, current_block, BLOCK_COUNT, &wvio, error);
+            unsigned int written_block_count = lsdj_compress_with_mode(song_data, BLOCK_SIZE, current_block, BLOCK_COUNT, &wvio, mode, error);
             if (error && *error)
                 return;
             
             if (written_block_count == 0)
-                printf("not enough space for compressing %s\n", name);
+            {
+                not_enough_space(name, BLOCK_COUNT + 1u - current_block, error);
+                return;
+            }
             
             current_block += written_block_count;
             for (int j = 0; j < written_block_count; ++j)
@@ -585,49 +1536,73 @@ void lsdj_sav_write(const lsdj_sav_t* sav, lsdj_vio_t* vio, lsdj_error_t** error
         }
     }
     
+    if (compress)
+    {
+        free_compressed_projects(compress);
+        lsdj_free(compress);
+    }
+    
+    if (error && *error)
+        return;
+    
+    *blocksUsed = current_block - 1u;
+    memset(blocks + *blocksUsed * BLOCK_SIZE, 0, (BLOCK_COUNT - *blocksUsed) * BLOCK_SIZE);
+    
     // Write the header and blocks
     if (vio->write(&header, sizeof(header), vio->user_data) != sizeof(header))
-        return lsdj_error_new(error, "could not write header");
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write header");
     if (vio->write(&block_alloc_table, sizeof(block_alloc_table), vio->user_data) != sizeof(block_alloc_table))
-        return lsdj_error_new(error, "could not write block allocation table");
-    if (vio->write(blocks, sizeof(blocks), vio->user_data) != sizeof(blocks))
-        return lsdj_error_new(error, "could not write blocks");
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write block allocation table");
+    if (vio->write(blocks, BLOCK_COUNT * BLOCK_SIZE, vio->user_data) != BLOCK_COUNT * BLOCK_SIZE)
+        return lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write blocks");
 }
 
-void lsdj_sav_write_to_file(const lsdj_sav_t* sav, const char* path, lsdj_error_t** error)
+void write_sav(const lsdj_sav_t* sav, lsdj_vio_t* vio, unsigned int threadCount, lsdj_codec_context_t* context, lsdj_error_t** error)
 {
-    if (path == NULL)
-        return lsdj_error_new(error, "path is NULL");
-    
-    if (sav == NULL)
-        return lsdj_error_new(error, "sav is NULL");
+    unsigned char* song_data = lsdj_codec_context_borrow_song_buffer(context, error);
+    unsigned char* blocks = song_data ? lsdj_codec_context_borrow_block_buffer(context, error) : NULL;
+    if (blocks == NULL)
+        return lsdj_codec_context_return_buffer(context, song_data);
     
-    FILE* file = fopen(path, "wb");
-    if (file == NULL)
-    {
-        char message[512];
-        snprintf(message, 512, "could not open %s for writing", path);
-        return lsdj_error_new(error, message);
-    }
+    LSDJ_TRACE_BEGIN(LSDJ_TRACE_SAV_WRITE);
     
-    lsdj_vio_t vio;
-    vio.write = lsdj_fwrite;
-    vio.tell = lsdj_ftell;
-    vio.seek = lsdj_fseek;
-    vio.user_data = file;
+    unsigned int blocksUsed = 0;
+    pack_sav(sav, vio, threadCount, lsdj_codec_context_get_compression_mode(context), song_data, blocks, &blocksUsed, error);
     
-    lsdj_sav_write(sav, &vio, error);
+    LSDJ_TRACE_COUNT(LSDJ_TRACE_SAV_WRITE, LSDJ_TRACE_BYTES_OUT, blocksUsed * BLOCK_SIZE);
+    LSDJ_TRACE_COUNT(LSDJ_TRACE_SAV_WRITE, LSDJ_TRACE_BLOCKS, blocksUsed);
+    LSDJ_TRACE_END(LSDJ_TRACE_SAV_WRITE);
     
-    fclose(file);
+    lsdj_codec_context_return_buffer(context, blocks);
+    lsdj_codec_context_return_buffer(context, song_data);
 }
 
-void lsdj_sav_write_to_memory(const lsdj_sav_t* sav, unsigned char* data, size_t size, lsdj_error_t** error)
+void lsdj_sav_write(const lsdj_sav_t* sav, lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    write_sav(sav, vio, 1, NULL, error);
+}
+
+void lsdj_sav_write_options_init(lsdj_sav_write_options_t* options)
+{
+    options->threadCount = 1;
+    options->context = NULL;
+}
+
+void lsdj_sav_write_with_options(const lsdj_sav_t* sav, lsdj_vio_t* vio, const lsdj_sav_write_options_t* options, lsdj_error_t** error)
+{
+    if (options)
+        write_sav(sav, vio, options->threadCount, options->context, error);
+    else
+        write_sav(sav, vio, 1, NULL, error);
+}
+
+void write_sav_to_memory(const lsdj_sav_t* sav, unsigned char* data, size_t size, unsigned int threadCount, lsdj_codec_context_t* context, lsdj_error_t** error)
 {
     if (sav == NULL)
-        return lsdj_error_new(error, "sav is NULL");
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "sav is NULL");
     
     if (data == NULL)
-        return lsdj_error_new(error, "data is NULL");
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
     
     lsdj_memory_data_t mem;
     mem.begin = data;
@@ -640,5 +1615,155 @@ void lsdj_sav_write_to_memory(const lsdj_sav_t* sav, unsigned char* data, size_t
     vio.seek = lsdj_mseek;
     vio.user_data = &mem;
     
-    lsdj_sav_write(sav, &vio, error);
+    write_sav(sav, &vio, threadCount, context, error);
+}
+
+void write_sav_to_file(const lsdj_sav_t* sav, const char* path, unsigned int threadCount, lsdj_codec_context_t* context, lsdj_error_t** error)
+{
+    if (path == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
+    
+    if (sav == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "sav is NULL");
+    
+    // Assemble the whole sav in memory, so it reaches the file in a single atomic write
+    unsigned char* data = (unsigned char*)lsdj_malloc(LSDJ_SAV_SIZE);
+    if (data == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate sav image");
+    
+    lsdj_error_t* writeError = NULL;
+    write_sav_to_memory(sav, data, LSDJ_SAV_SIZE, threadCount, context, &writeError);
+    if (writeError == NULL && lsdj_codec_context_get_skip_identical_files(context))
+        lsdj_atomic_file_update(path, data, LSDJ_SAV_SIZE, error);
+    else if (writeError == NULL)
+        lsdj_atomic_file_write(path, data, LSDJ_SAV_SIZE, error);
+    else if (error)
+        *error = writeError;
+    else
+        lsdj_error_free(writeError);
+    
+    lsdj_free(data);
+}
+
+void lsdj_sav_write_to_file(const lsdj_sav_t* sav, const char* path, lsdj_error_t** error)
+{
+    write_sav_to_file(sav, path, 1, NULL, error);
+}
+
+void lsdj_sav_write_to_memory(const lsdj_sav_t* sav, unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    write_sav_to_memory(sav, data, size, 1, NULL, error);
+}
+
+void lsdj_sav_write_to_file_with_options(const lsdj_sav_t* sav, const char* path, const lsdj_sav_write_options_t* options, lsdj_error_t** error)
+{
+    if (options)
+        write_sav_to_file(sav, path, options->threadCount, options->context, error);
+    else
+        write_sav_to_file(sav, path, 1, NULL, error);
+}
+
+void lsdj_sav_write_to_memory_with_options(const lsdj_sav_t* sav, unsigned char* data, size_t size, const lsdj_sav_write_options_t* options, lsdj_error_t** error)
+{
+    if (options)
+        write_sav_to_memory(sav, data, size, options->threadCount, options->context, error);
+    else
+        write_sav_to_memory(sav, data, size, 1, NULL, error);
+}
+
+// Find out how many blocks the song of a project takes, compressing it if it changed
+unsigned int count_project_blocks(const lsdj_project_t* project, lsdj_compression_mode_t mode, lsdj_error_t** error)
+{
+    unsigned int blockCount = 0;
+    if (lsdj_project_get_compressed_song(project, &blockCount))
+        return blockCount;
+    
+    const lsdj_song_t* song = lsdj_project_load_song(project, error);
+    if (song == NULL)
+        return 0;
+    
+    return lsdj_song_compressed_block_count(song, mode, error);
+}
+
+void lsdj_sav_get_block_usage(const lsdj_sav_t* sav, lsdj_sav_block_usage_t* usage, lsdj_error_t** error)
+{
+    lsdj_sav_get_block_usage_with_context(sav, usage, NULL, error);
+}
+
+void lsdj_sav_get_block_usage_with_context(const lsdj_sav_t* sav, lsdj_sav_block_usage_t* usage, const lsdj_codec_context_t* context, lsdj_error_t** error)
+{
+    const lsdj_compression_mode_t mode = lsdj_codec_context_get_compression_mode(context);
+    
+    memset(usage, 0, sizeof(lsdj_sav_block_usage_t));
+    
+    // Projects are packed in slot order, skipping the ones that don't fit
+    unsigned int used = 0;
+    for (int i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
+    {
+        const unsigned int blockCount = count_project_blocks(sav->projects[i], mode, error);
+        if (error && *error)
+            return;
+        
+        usage->projectBlockCounts[i] = blockCount;
+        if (blockCount > 0 && used + blockCount <= BLOCK_COUNT)
+        {
+            usage->fits[i] = 1;
+            used += blockCount;
+        }
+    }
+    
+    usage->usedBlockCount = used;
+    usage->freeBlockCount = BLOCK_COUNT - used;
+}
+
+unsigned int lsdj_sav_plan_packing(const lsdj_sav_block_usage_t* usage, unsigned char* keep)
+{
+    memset(keep, 0, LSDJ_SAV_PROJECT_COUNT);
+    
+    // Taking the smallest projects first fits the most of them
+    unsigned int freeBlockCount = BLOCK_COUNT;
+    unsigned int count = 0;
+    while (1)
+    {
+        int smallest = -1;
+        for (int i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
+        {
+            const unsigned int blockCount = usage->projectBlockCounts[i];
+            if (keep[i] || blockCount == 0 || blockCount > freeBlockCount)
+                continue;
+            
+            if (smallest == -1 || blockCount < usage->projectBlockCounts[smallest])
+                smallest = i;
+        }
+        
+        if (smallest == -1)
+            return count;
+        
+        keep[smallest] = 1;
+        freeBlockCount -= usage->projectBlockCounts[smallest];
+        ++count;
+    }
+}
+
+void lsdj_sav_compact(lsdj_sav_t* sav)
+{
+    unsigned char next = 0;
+    for (unsigned char i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
+    {
+        if (!lsdj_project_has_song(sav->projects[i]))
+            continue;
+        
+        // Swap the project with the empty slot in front of it
+        if (i != next)
+        {
+            lsdj_project_t* empty = sav->projects[next];
+            sav->projects[next] = sav->projects[i];
+            sav->projects[i] = empty;
+            
+            if (sav->activeProject == i)
+                sav->activeProject = next;
+        }
+        
+        ++next;
+    }
 }
@@ -40,23 +40,156 @@
 extern "C" {
 #endif	/* __cplusplus */
 
+#include "codec.h"
 #include "error.h"
 #include "project.h"
 #include "song.h"
 #include "vio.h"
     
 #define LSDJ_NO_ACTIVE_PROJECT (0xFF)
+#define LSDJ_SAV_PROJECT_COUNT (32)
+#define LSDJ_SAV_SIZE (0x20000)
     
+// A sav, holding the working memory song and LSDJ_SAV_PROJECT_COUNT projects
+/*! Every function taking a const sav, project or song only reads from it, so any number of
+    threads can share one sav through those without locking. That includes savs that were
+    read lazily: their projects decompress on first use, atomically, and every thread gets
+    the same song. Changing a sav (or anything in it) while others read it is not safe. */
 typedef struct lsdj_sav_t lsdj_sav_t;
 
+// A summary of one project in a sav, read without decompressing its song
+typedef struct
+{
+    // The name of the project, null-terminated
+    char name[LSDJ_PROJECT_NAME_LENGTH + 1];
+    unsigned char version;
+    
+    // The amount of blocks the compressed song takes up, 0 if the project is empty
+    unsigned int blockCount;
+    
+    // Properties of the song, only valid if blockCount > 0
+    unsigned char formatVersion;
+    unsigned char tempo;
+} lsdj_sav_catalog_project_t;
+
+// A summary of an entire sav, for when only a listing is needed
+typedef struct
+{
+    lsdj_sav_catalog_project_t projects[LSDJ_SAV_PROJECT_COUNT];
+    
+    // Index of the project that is currently being edited, or LSDJ_NO_ACTIVE_PROJECT
+    unsigned char activeProject;
+    
+    // Properties of the working memory song
+    unsigned char workingMemoryFormatVersion;
+    unsigned char workingMemoryTempo;
+    unsigned char workingMemoryFileChangedFlag;
+} lsdj_sav_catalog_t;
+
 // Create/free saves
 lsdj_sav_t* lsdj_sav_new(lsdj_error_t** error);
 void lsdj_sav_free(lsdj_sav_t* sav);
     
 // Deserialize a sav
+/*! The vio only needs to read. Without seek and tell the sav is read forward-only, which
+    works for pipes and sockets, each project being decoded as soon as its blocks are in. */
 lsdj_sav_t* lsdj_sav_read(lsdj_vio_t* vio, lsdj_error_t** error);
 lsdj_sav_t* lsdj_sav_read_from_file(const char* path, lsdj_error_t** error);
 lsdj_sav_t* lsdj_sav_read_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error);
+
+// Deserialize a sav, decompressing its projects in the scratch memory of a codec context
+lsdj_sav_t* lsdj_sav_read_with_context(lsdj_vio_t* vio, lsdj_codec_context_t* context, lsdj_error_t** error);
+
+// Deserialize a sav, but leave the projects compressed until their songs are requested
+/*! This makes loading a lot cheaper when only a few of the projects are needed */
+lsdj_sav_t* lsdj_sav_read_lazy(lsdj_vio_t* vio, lsdj_error_t** error);
+lsdj_sav_t* lsdj_sav_read_lazy_from_file(const char* path, lsdj_error_t** error);
+lsdj_sav_t* lsdj_sav_read_lazy_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error);
+    
+// Deserialize a sav, decompressing its projects on multiple threads at once
+/*! A threadCount of 0 or 1 decompresses everything on the calling thread */
+lsdj_sav_t* lsdj_sav_read_parallel(lsdj_vio_t* vio, unsigned int threadCount, lsdj_error_t** error);
+lsdj_sav_t* lsdj_sav_read_parallel_from_file(const char* path, unsigned int threadCount, lsdj_error_t** error);
+lsdj_sav_t* lsdj_sav_read_parallel_from_memory(const unsigned char* data, size_t size, unsigned int threadCount, lsdj_error_t** error);
+    
+// One of the savs for lsdj_sav_read_many() to read, either from a file or from memory
+typedef struct
+{
+    // The path of the file, or NULL to read from data instead
+    const char* path;
+    
+    const unsigned char* data;
+    size_t size;
+} lsdj_sav_input_t;
+
+// How lsdj_sav_read_many() should read its inputs
+typedef struct
+{
+    // The amount of threads to read and decompress with, 0 or 1 does everything on the calling thread
+    unsigned int threadCount;
+    
+    // Leave the projects compressed until their songs are requested, like lsdj_sav_read_lazy()
+    int lazy;
+} lsdj_sav_read_options_t;
+
+// What lsdj_sav_read_many() made of one of its inputs
+typedef struct
+{
+    // The sav that was read, or NULL if reading it failed
+    lsdj_sav_t* sav;
+    
+    // Why reading the sav failed, which the caller should free
+    lsdj_error_t* error;
+} lsdj_sav_read_result_t;
+
+// Reset read options to their defaults: a single thread, decompressing everything
+void lsdj_sav_read_options_init(lsdj_sav_read_options_t* options);
+
+// Deserialize a batch of savs at once
+/*! The threads and their codec scratch memory are shared by the whole batch. All savs are read
+    first, after which the songs of all their projects are spread over the threads as one pool of
+    work, so a few big savs keep every thread as busy as many small ones. results should hold count
+    entries, one for every input. A failing input doesn't stop the others. Returns the amount of
+    savs that were read. error is only set when the batch itself couldn't be set up. */
+unsigned int lsdj_sav_read_many(const lsdj_sav_input_t* inputs, unsigned int count, const lsdj_sav_read_options_t* options, lsdj_sav_read_result_t* results, lsdj_error_t** error);
+    
+// How the blocks of a sav are divided over its projects
+typedef struct
+{
+    // The amount of blocks the song of each project takes compressed, 0 for empty slots
+    /*! This can be more than fit in a sav, for songs that don't fit even in an empty one */
+    unsigned int projectBlockCounts[LSDJ_SAV_PROJECT_COUNT];
+    
+    // Whether each project fits, when they're packed in slot order leaving out the ones that don't
+    /*! Writes are all-or-nothing: lsdj_sav_write() doesn't leave anything out, it fails as soon as
+        one project doesn't fit, even when later ones would. Erase the projects that don't fit
+        first to write a sav with exactly the ones marked here. */
+    unsigned char fits[LSDJ_SAV_PROJECT_COUNT];
+    
+    // The blocks taken by the projects that fit, and the amount that is still free
+    unsigned int usedBlockCount;
+    unsigned int freeBlockCount;
+} lsdj_sav_block_usage_t;
+
+// Read the catalog of a sav: the project names and versions, and their tempo and format version
+/*! This doesn't allocate any songs. The compressed projects are only walked to find the bytes
+    needed, rather than decompressed in full. */
+void lsdj_sav_read_catalog(lsdj_vio_t* vio, lsdj_sav_catalog_t* catalog, lsdj_error_t** error);
+void lsdj_sav_read_catalog_from_file(const char* path, lsdj_sav_catalog_t* catalog, lsdj_error_t** error);
+void lsdj_sav_read_catalog_from_memory(const unsigned char* data, size_t size, lsdj_sav_catalog_t* catalog, lsdj_error_t** error);
+
+// Read a single project from a sav, without reading any of the others
+/*! Only the header and the blocks of the project are read, and its song is left compressed
+    (like lsdj_sav_read_lazy() does). An index of LSDJ_NO_ACTIVE_PROJECT reads the working
+    memory song instead, named after the active project (see
+    lsdj_project_new_from_working_memory_song()). Empty slots give a project without a song. */
+lsdj_project_t* lsdj_sav_read_project(lsdj_vio_t* vio, unsigned char index, lsdj_error_t** error);
+lsdj_project_t* lsdj_sav_read_project_from_file(const char* path, unsigned char index, lsdj_error_t** error);
+lsdj_project_t* lsdj_sav_read_project_from_memory(const unsigned char* data, size_t size, unsigned char index, lsdj_error_t** error);
+    
+// Deserialize a sav by mapping the file into memory instead of reading it through stdio
+/*! The mapping is released before this function returns, the sav doesn't reference it */
+lsdj_sav_t* lsdj_sav_read_from_mapped_file(const char* path, lsdj_error_t** error);
     
 // Find out whether given data is likely a valid save
 // Note: this is not a 100% guarantee that the data will load, we're just checking
@@ -67,11 +200,57 @@ lsdj_sav_t* lsdj_sav_read_from_memory(const unsigned char* data, size_t size, ls
 int lsdj_sav_is_likely_valid(lsdj_vio_t* vio, lsdj_error_t** error);
 int lsdj_sav_is_likely_valid_file(const char* path, lsdj_error_t** error);
 int lsdj_sav_is_likely_valid_memory(const unsigned char* data, size_t size, lsdj_error_t** error);
+
+// Find out whether given data is likely a valid save, with the settings of a codec context
+/*! See lsdj_codec_context_set_error_messages() to reject data without allocating */
+int lsdj_sav_is_likely_valid_with_context(lsdj_vio_t* vio, const lsdj_codec_context_t* context, lsdj_error_t** error);
+int lsdj_sav_is_likely_valid_memory_with_context(const unsigned char* data, size_t size, const lsdj_codec_context_t* context, lsdj_error_t** error);
     
 // Serialize a sav
+/*! Fails with LSDJ_ERROR_OUT_OF_SPACE if the projects don't all fit in the sav's blocks, see
+    lsdj_sav_get_block_usage() to find out which ones don't beforehand */
 void lsdj_sav_write(const lsdj_sav_t* sav, lsdj_vio_t* vio, lsdj_error_t** error);
 void lsdj_sav_write_to_file(const lsdj_sav_t* sav, const char* path, lsdj_error_t** error);
 void lsdj_sav_write_to_memory(const lsdj_sav_t* sav, unsigned char* data, size_t size, lsdj_error_t** error);
+
+// How lsdj_sav_write_with_options() should write a sav
+typedef struct
+{
+    // The amount of threads to compress with, 0 or 1 does everything on the calling thread
+    /*! The result is identical for every thread count */
+    unsigned int threadCount;
+    
+    // The codec context whose settings and scratch memory to use, or NULL for the defaults
+    /*! Its compression mode says how the songs are compressed, and for files whether to skip
+        writing identical ones */
+    lsdj_codec_context_t* context;
+} lsdj_sav_write_options_t;
+
+// Reset write options to their defaults: a single thread, without a codec context
+void lsdj_sav_write_options_init(lsdj_sav_write_options_t* options);
+
+// Serialize a sav the way the options say, NULL options being the defaults
+void lsdj_sav_write_with_options(const lsdj_sav_t* sav, lsdj_vio_t* vio, const lsdj_sav_write_options_t* options, lsdj_error_t** error);
+void lsdj_sav_write_to_file_with_options(const lsdj_sav_t* sav, const char* path, const lsdj_sav_write_options_t* options, lsdj_error_t** error);
+void lsdj_sav_write_to_memory_with_options(const lsdj_sav_t* sav, unsigned char* data, size_t size, const lsdj_sav_write_options_t* options, lsdj_error_t** error);
+    
+// Find out how many blocks every project takes, and which ones fit
+/*! Projects that were read compressed report the blocks they were read with. The others
+    are counted with lsdj_song_compressed_block_count(), which doesn't compress or write
+    anything, for songs compressed greedily or, with a context, the way its compression mode
+    says. */
+void lsdj_sav_get_block_usage(const lsdj_sav_t* sav, lsdj_sav_block_usage_t* usage, lsdj_error_t** error);
+void lsdj_sav_get_block_usage_with_context(const lsdj_sav_t* sav, lsdj_sav_block_usage_t* usage, const lsdj_codec_context_t* context, lsdj_error_t** error);
+
+// Choose the projects to keep so that as many of them as possible fit
+/*! keep should hold LSDJ_SAV_PROJECT_COUNT entries, which are set to 1 for the projects to
+    keep and 0 for the rest. Returns the amount of projects kept. */
+unsigned int lsdj_sav_plan_packing(const lsdj_sav_block_usage_t* usage, unsigned char* keep);
+
+// Move every project with a song to the front, closing the empty slots in between
+/*! The order of the projects is kept, and the active project follows its song. The blocks
+    themselves never need defragmenting: lsdj_sav_write() always stores them contiguously. */
+void lsdj_sav_compact(lsdj_sav_t* sav);
     
 // Set the working memory song of a sav
 // The sav takes ownership of the given song, so make sure you copy it first if need be!
@@ -79,6 +258,7 @@ void lsdj_sav_set_working_memory_song(lsdj_sav_t* sav, lsdj_song_t* song, unsign
     
 // Retrieve the working memory song from a sav
 lsdj_song_t* lsdj_sav_get_working_memory_song(const lsdj_sav_t* sav);
+const lsdj_song_t* lsdj_sav_get_working_memory_song_const(const lsdj_sav_t* sav);
     
 // Change the working memory song by copying from one of the projects
 void lsdj_sav_set_working_memory_song_from_project(lsdj_sav_t* sav, unsigned char index, lsdj_error_t** error);
@@ -105,6 +285,22 @@ void lsdj_sav_erase_project(lsdj_sav_t* sav, unsigned char index, lsdj_error_t**
     
 // Retrieve one of the projects
 lsdj_project_t* lsdj_sav_get_project(const lsdj_sav_t* sav, unsigned char project);
+const lsdj_project_t* lsdj_sav_get_project_const(const lsdj_sav_t* sav, unsigned char project);
+
+// How much heap memory a sav takes, and what for
+/*! Songs that share an arena (see lsdj_song_copy_shallow()) each count it in full */
+typedef struct
+{
+    size_t savBytes;
+    
+    lsdj_song_memory_usage_t workingMemorySong;
+    lsdj_project_memory_usage_t projects[LSDJ_SAV_PROJECT_COUNT];
+    
+    size_t totalBytes;
+} lsdj_sav_memory_usage_t;
+
+// Find out how much memory a sav, its working memory song and its projects take
+void lsdj_sav_memory_usage(const lsdj_sav_t* sav, lsdj_sav_memory_usage_t* usage);
 
 #ifdef __cplusplus
 }
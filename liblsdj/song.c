@@ -36,15 +36,21 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
+#include "arena.h"
 #include "chain.h"
+#include "columns.h"
+#include "compression.h"
 #include "error.h"
 #include "groove.h"
 #include "instrument.h"
 #include "phrase.h"
 #include "row.h"
 #include "song.h"
+#include "song_layout.h"
 #include "synth.h"
 #include "table.h"
+#include "trace.h"
 #include "vio.h"
 #include "wave.h"
 #include "word.h"
@@ -67,6 +73,15 @@ static unsigned char LSDJ_PHRASE_LENGTH_FF[LSDJ_PHRASE_LENGTH] = { 0xFF, 0xFF, 0
 
 struct lsdj_song_t
 {
+    // Which banks of the song have (possibly) been changed since it was read
+    /*! Set by every setter, and by getters that hand out non-const access (LSDJ_SONG_BANK_ bits) */
+    unsigned char dirty;
+    
+    // The arena the chains, phrases, instruments and tables live in
+    /*! NULL as long as the song doesn't contain any of those. Only freed along with the song if owned. */
+    lsdj_arena_t* arena;
+    unsigned char ownsArena;
+    
     unsigned char formatVersion;
     unsigned char tempo;
     unsigned char transposition;
@@ -152,10 +167,10 @@ struct lsdj_song_t
 
 lsdj_song_t* lsdj_song_alloc(lsdj_error_t** error)
 {
-    lsdj_song_t* song = (lsdj_song_t*)calloc(sizeof(lsdj_song_t), 1);
+    lsdj_song_t* song = (lsdj_song_t*)lsdj_calloc(sizeof(lsdj_song_t), 1);
     if (song == NULL)
     {
-        lsdj_error_new(error, "could not allocate song");
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate song");
         return NULL;
     }
     
@@ -214,46 +229,116 @@ lsdj_song_t* lsdj_song_new(lsdj_error_t** error)
     return song;
 }
 
-lsdj_song_t* lsdj_song_copy(const lsdj_song_t* rhs, lsdj_error_t** error)
+size_t arena_size_for(unsigned int chainCount, unsigned int phraseCount, unsigned int instrumentCount, unsigned int tableCount)
 {
-    lsdj_song_t* song = lsdj_song_new(error);
-    if (*error)
-        return NULL;
+    return lsdj_arena_align(sizeof(lsdj_chain_t)) * chainCount +
+           lsdj_arena_align(sizeof(lsdj_phrase_t)) * phraseCount +
+           lsdj_arena_align(lsdj_instrument_size()) * instrumentCount +
+           lsdj_arena_align(lsdj_table_size()) * tableCount;
+}
+
+size_t lsdj_song_get_max_arena_size(void)
+{
+    return arena_size_for(LSDJ_CHAIN_COUNT, LSDJ_PHRASE_COUNT, LSDJ_INSTRUMENT_COUNT, LSDJ_TABLE_COUNT);
+}
+
+int copy_sub_objects(lsdj_song_t* song, const lsdj_song_t* rhs, lsdj_error_t** error)
+{
+    // Size a fresh arena to fit exactly what the other song contains
+    unsigned int chainCount = 0;
+    unsigned int phraseCount = 0;
+    unsigned int instrumentCount = 0;
+    unsigned int tableCount = 0;
     
-    song->formatVersion = rhs->formatVersion;
-    song->tempo = rhs->tempo;
-    song->transposition = rhs->transposition;
-    song->drumMax = rhs->drumMax;
+    for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
+        chainCount += rhs->chains[i] ? 1 : 0;
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+        phraseCount += rhs->phrases[i] ? 1 : 0;
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+        instrumentCount += rhs->instruments[i] ? 1 : 0;
+    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+        tableCount += rhs->tables[i] ? 1 : 0;
     
-    memcpy(song->rows, rhs->rows, sizeof(rhs->rows));
+    lsdj_arena_t* arena = lsdj_arena_new(arena_size_for(chainCount, phraseCount, instrumentCount, tableCount), error);
+    if (arena == NULL)
+        return 0;
     
+    // The arena fits everything, so none of these allocations can fail
+    /*! rhs can be song itself, so each pointer is only replaced after its copy is made */
     for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
     {
         if (rhs->chains[i])
-            song->chains[i] = lsdj_chain_copy(rhs->chains[i]);
+        {
+            lsdj_chain_t* chain = (lsdj_chain_t*)lsdj_arena_alloc(arena, sizeof(lsdj_chain_t));
+            memcpy(chain, rhs->chains[i], sizeof(lsdj_chain_t));
+            song->chains[i] = chain;
+        }
     }
     
     for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
     {
         if (rhs->phrases[i])
-            song->phrases[i] = lsdj_phrase_copy(rhs->phrases[i]);
+        {
+            lsdj_phrase_t* phrase = (lsdj_phrase_t*)lsdj_arena_alloc(arena, sizeof(lsdj_phrase_t));
+            memcpy(phrase, rhs->phrases[i], sizeof(lsdj_phrase_t));
+            song->phrases[i] = phrase;
+        }
     }
     
     for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
     {
         if (rhs->instruments[i])
-            song->instruments[i] = lsdj_instrument_copy(rhs->instruments[i]);
+            song->instruments[i] = lsdj_instrument_copy_in_arena(rhs->instruments[i], arena);
     }
     
-    memcpy(song->synths, rhs->synths, sizeof(rhs->synths));
-    memcpy(song->waves, rhs->waves, sizeof(rhs->waves));
-
     for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
     {
         if (rhs->tables[i])
-            song->tables[i] = lsdj_copy_table(rhs->tables[i]);
+            song->tables[i] = lsdj_copy_table_in_arena(rhs->tables[i], arena);
+    }
+    
+    if (song->ownsArena)
+        lsdj_arena_release(song->arena);
+    
+    song->arena = arena;
+    song->ownsArena = 1;
+    
+    return 1;
+}
+
+lsdj_song_t* copy_song(const lsdj_song_t* rhs, int shallow, lsdj_error_t** error)
+{
+    lsdj_song_t* song = lsdj_song_new(error);
+    if (song == NULL)
+        return NULL;
+    
+    song->formatVersion = rhs->formatVersion;
+    song->tempo = rhs->tempo;
+    song->transposition = rhs->transposition;
+    song->drumMax = rhs->drumMax;
+    
+    memcpy(song->rows, rhs->rows, sizeof(rhs->rows));
+    
+    // Only arenas we own are reference counted, so only those can be shared
+    if (shallow && rhs->ownsArena)
+    {
+        memcpy(song->chains, rhs->chains, sizeof(rhs->chains));
+        memcpy(song->phrases, rhs->phrases, sizeof(rhs->phrases));
+        memcpy(song->instruments, rhs->instruments, sizeof(rhs->instruments));
+        memcpy(song->tables, rhs->tables, sizeof(rhs->tables));
+        
+        lsdj_arena_retain(rhs->arena);
+        song->arena = rhs->arena;
+        song->ownsArena = 1;
+    }
+    else if (!copy_sub_objects(song, rhs, error))
+    {
+        lsdj_song_free(song);
+        return NULL;
     }
     
+    memcpy(song->synths, rhs->synths, sizeof(rhs->synths));
+    memcpy(song->waves, rhs->waves, sizeof(rhs->waves));
     memcpy(song->grooves, rhs->grooves, sizeof(rhs->grooves));
     memcpy(song->words, rhs->words, sizeof(rhs->words));
     memcpy(song->wordNames, rhs->wordNames, sizeof(rhs->wordNames));
@@ -274,36 +359,39 @@ lsdj_song_t* lsdj_song_copy(const lsdj_song_t* rhs, lsdj_error_t** error)
     return song;
 }
 
+lsdj_song_t* lsdj_song_copy(const lsdj_song_t* rhs, lsdj_error_t** error)
+{
+    return copy_song(rhs, 0, error);
+}
+
+lsdj_song_t* lsdj_song_copy_shallow(const lsdj_song_t* rhs, lsdj_error_t** error)
+{
+    return copy_song(rhs, 1, error);
+}
+
+int lsdj_song_is_shared(const lsdj_song_t* song)
+{
+    return song->ownsArena && lsdj_arena_get_reference_count(song->arena) > 1;
+}
+
+int unshare_song(lsdj_song_t* song)
+{
+    if (!lsdj_song_is_shared(song))
+        return 1;
+    
+    return copy_sub_objects(song, song, NULL);
+}
+
 void lsdj_song_free(lsdj_song_t* song)
 {
     if (song == NULL)
         return;
     
-    for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
-    {
-        if (song->chains[i])
-            free(song->chains[i]);
-    }
-    
-    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
-    {
-        if (song->phrases[i])
-            free(song->phrases[i]);
-    }
-    
-    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
-    {
-        if (song->instruments[i])
-            lsdj_instrument_free(song->instruments[i]);
-    }
-    
-    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
-    {
-        if (song->tables[i])
-            lsdj_table_free(song->tables[i]);
-    }
+    // The chains, phrases, instruments and tables all go in one go
+    if (song->ownsArena)
+        lsdj_arena_release(song->arena);
     
-    free(song);
+    lsdj_free(song);
 }
 
 void read_bank0(lsdj_vio_t* vio, lsdj_song_t* song)
@@ -835,270 +923,1459 @@ void write_bank3(const lsdj_song_t* song, lsdj_vio_t* vio)
     vio->write(&song->formatVersion, 1, vio->user_data);
 }
 
-int check_rb(lsdj_vio_t* vio, long position)
+void read_soft_synth_parameters_from_memory(const unsigned char* data, lsdj_synth_t* synth)
 {
-    char data[2];
-    
-    vio->seek(position, SEEK_SET, vio->user_data);
-    vio->read(data, 2, vio->user_data);
+    synth->waveform = data[0];
+    synth->filter = data[1];
+    synth->resonanceStart = (data[2] & 0xF0) >> 4;
+    synth->resonanceEnd = data[2] & 0x0F;
+    synth->distortion = data[3];
+    synth->phase = data[4];
+    synth->volumeStart = data[5];
+    synth->cutOffStart = data[6];
+    synth->phaseStart = data[7];
+    synth->vshiftStart = data[8];
+    synth->volumeEnd = data[9];
+    synth->cutOffEnd = data[10];
+    synth->phaseEnd = data[11];
+    synth->vshiftEnd = data[12];
+    
+    const unsigned char byte = 0xFF - data[13];
+    synth->limitStart = (byte >> 4) & 0xF;
+    synth->limitEnd = byte & 0xF;
     
-    return (data[0] == 'r' && data[1] == 'b') ? 0 : 1;
+    memcpy(synth->reserved, data + 14, 2);
 }
 
-lsdj_song_t* lsdj_song_read(lsdj_vio_t* vio, lsdj_error_t** error)
+void write_soft_synth_parameters_to_memory(const lsdj_synth_t* synth, unsigned char* data)
 {
-    // Check for incorrect input
-    if (vio->read == NULL)
+    data[0] = synth->waveform;
+    data[1] = synth->filter;
+    data[2] = (unsigned char)((synth->resonanceStart & 0x0F) << 4) | (synth->resonanceEnd & 0x0F);
+    data[3] = synth->distortion;
+    data[4] = synth->phase;
+    data[5] = synth->volumeStart;
+    data[6] = synth->cutOffStart;
+    data[7] = synth->phaseStart;
+    data[8] = synth->vshiftStart;
+    data[9] = synth->volumeEnd;
+    data[10] = synth->cutOffEnd;
+    data[11] = synth->phaseEnd;
+    data[12] = synth->vshiftEnd;
+    data[13] = 0xFF - (unsigned char)((synth->limitStart << 4) | synth->limitEnd);
+    memcpy(data + 14, synth->reserved, 2);
+}
+
+// Read a full song image straight from memory, with the same result as read_bank0() through read_bank3()
+/*! The allocation tables have already been applied, only the allocated objects are filled in */
+void read_song_from_memory(const unsigned char* data, lsdj_song_t* song, lsdj_error_t** error)
+{
+    // Bank 0
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
     {
-        lsdj_error_new(error, "vio->read is NULL");
-        return NULL;
+        if (song->phrases[i])
+            memcpy(song->phrases[i]->notes, data + SONG_PHRASE_NOTES_ADDRESS + i * LSDJ_PHRASE_LENGTH, LSDJ_PHRASE_LENGTH);
     }
     
-    if (vio->tell == NULL)
-    {
-        lsdj_error_new(error, "tell is NULL");
-        return NULL;
-    }
+    memcpy(&song->bookmarks, data + SONG_BOOKMARKS_ADDRESS, sizeof(song->bookmarks));
+    memcpy(song->reserved1030, data + SONG_RESERVED_1030_ADDRESS, sizeof(song->reserved1030));
+    memcpy(song->grooves, data + SONG_GROOVES_ADDRESS, sizeof(song->grooves));
+    memcpy(song->rows, data + SONG_ROWS_ADDRESS, sizeof(song->rows));
     
-    if (vio->seek == NULL)
+    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
     {
-        lsdj_error_new(error, "vio->seek is NULL");
-        return NULL;
+        if (song->tables[i])
+            lsdj_table_set_volumes(song->tables[i], (unsigned char*)data + SONG_TABLE_VOLUMES_ADDRESS + i * LSDJ_TABLE_LENGTH);
     }
     
-    const long begin = vio->tell(vio->user_data);
-    
-    // Check if the 'rb' flags have been set correctly
-    if (check_rb(vio, begin + 0x1E78) != 0) { lsdj_error_new(error, "memory flag 'rb' not found at 0x1E78"); return NULL; }
-    if (check_rb(vio, begin + 0x3E80) != 0) { lsdj_error_new(error, "memory flag 'rb' not found at 0x3E80"); return NULL; }
-    if (check_rb(vio, begin + 0x7FF0) != 0) { lsdj_error_new(error, "memory flag 'rb' not found at 0x7FF0"); return NULL; }
-    
-    // We passed the 'rb' check, and can create a song now for reading
-    lsdj_song_t* song = lsdj_song_alloc(error);
-    if (error && *error)
-        return NULL;
+    memcpy(song->words, data + SONG_WORDS_ADDRESS, sizeof(song->words));
+    memcpy(song->wordNames, data + SONG_WORD_NAMES_ADDRESS, sizeof(song->wordNames));
     
-    // Read the version number
-    vio->seek(begin + 0x7FFF, SEEK_SET, vio->user_data);
-    vio->read(&song->formatVersion, 1, vio->user_data);
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+    {
+        if (song->instruments[i])
+            lsdj_instrument_set_name(song->instruments[i], (const char*)data + SONG_INSTRUMENT_NAMES_ADDRESS + i * LSDJ_INSTRUMENT_NAME_LENGTH, LSDJ_INSTRUMENT_NAME_LENGTH);
+    }
     
-    // Read the allocation tables
-    unsigned char instrAllocTable[INSTR_ALLOC_TABLE_SIZE];
-    unsigned char tableAllocTable[TABLE_ALLOC_TABLE_SIZE];
-    unsigned char chainAllocTable[CHAIN_ALLOC_TABLE_SIZE];
-    unsigned char phraseAllocTable[PHRASE_ALLOC_TABLE_SIZE];
+    memcpy(song->reserved1fba, data + SONG_RESERVED_1FBA_ADDRESS, sizeof(song->reserved1fba));
     
-    vio->seek(begin + 0x2020, SEEK_SET, vio->user_data);
-    vio->read(tableAllocTable, TABLE_ALLOC_TABLE_SIZE, vio->user_data);
-    vio->read(instrAllocTable, INSTR_ALLOC_TABLE_SIZE, vio->user_data);
+    // Bank 1
+    memcpy(song->reserved2000, data + SONG_RESERVED_2000_ADDRESS, sizeof(song->reserved2000));
     
-    vio->seek(begin + 0x3E82, SEEK_SET, vio->user_data);
-    vio->read(phraseAllocTable, PHRASE_ALLOC_TABLE_SIZE, vio->user_data);
-    vio->read(chainAllocTable, CHAIN_ALLOC_TABLE_SIZE, vio->user_data);
-
-    for (int i = 0; i < TABLE_ALLOC_TABLE_SIZE; ++i)
+    for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
     {
-        if (tableAllocTable[i])
-            song->tables[i] = lsdj_table_new();
+        if (song->chains[i])
+        {
+            memcpy(song->chains[i]->phrases, data + SONG_CHAIN_PHRASES_ADDRESS + i * LSDJ_CHAIN_LENGTH, LSDJ_CHAIN_LENGTH);
+            memcpy(song->chains[i]->transpositions, data + SONG_CHAIN_TRANSPOSITIONS_ADDRESS + i * LSDJ_CHAIN_LENGTH, LSDJ_CHAIN_LENGTH);
+        }
     }
     
     for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
     {
-        if (instrAllocTable[i])
-            song->instruments[i] = lsdj_instrument_new();
+        if (song->instruments[i])
+        {
+            lsdj_instrument_decode(data + SONG_INSTRUMENTS_ADDRESS + i * SONG_INSTRUMENT_BYTE_COUNT, song->formatVersion, song->instruments[i], error);
+            if (error && *error)
+                return;
+        }
     }
     
-    for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
+    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
     {
-        if ((chainAllocTable[i / 8] >> (i % 8)) & 1)
-            song->chains[i] = (lsdj_chain_t*)malloc(sizeof(lsdj_chain_t));
+        lsdj_table_t* table = song->tables[i];
+        if (table == NULL)
+            continue;
+        
+        const size_t offset = (size_t)i * LSDJ_TABLE_LENGTH;
+        lsdj_table_set_transpositions(table, (unsigned char*)data + SONG_TABLE_TRANSPOSITIONS_ADDRESS + offset);
+        
+        for (size_t j = 0; j < LSDJ_TABLE_LENGTH; ++j)
+        {
+            lsdj_command_t* command1 = lsdj_table_get_command1(table, j);
+            command1->command = data[SONG_TABLE_COMMAND1_ADDRESS + offset + j];
+            command1->value = data[SONG_TABLE_VALUE1_ADDRESS + offset + j];
+            
+            lsdj_command_t* command2 = lsdj_table_get_command2(table, j);
+            command2->command = data[SONG_TABLE_COMMAND2_ADDRESS + offset + j];
+            command2->value = data[SONG_TABLE_VALUE2_ADDRESS + offset + j];
+        }
     }
     
+    for (int i = 0; i < LSDJ_SYNTH_COUNT; ++i)
+        read_soft_synth_parameters_from_memory(data + SONG_SYNTHS_ADDRESS + i * SONG_SYNTH_BYTE_COUNT, &song->synths[i]);
+    
+    memcpy(&song->meta.workTime, data + SONG_WORK_TIME_ADDRESS, 2);
+    song->tempo = data[LSDJ_SONG_TEMPO_ADDRESS];
+    song->transposition = data[SONG_TRANSPOSITION_ADDRESS];
+    memcpy(&song->meta.totalTime, data + SONG_TOTAL_TIME_ADDRESS, 3);
+    
+    const unsigned char* meta = data + SONG_META_ADDRESS;
+    song->reserved3fb9 = meta[0];
+    song->meta.keyDelay = meta[1];
+    song->meta.keyRepeat = meta[2];
+    song->meta.font = meta[3];
+    song->meta.sync = meta[4];
+    song->meta.colorSet = meta[5];
+    song->reserved3fbf = meta[6];
+    song->meta.clone = meta[7];
+    song->meta.fileChangedFlag = meta[8];
+    song->meta.powerSave = meta[9];
+    song->meta.preListen = meta[10];
+    
+    const unsigned char* waveSynthOverwriteLocks = data + SONG_WAVE_SYNTH_LOCKS_ADDRESS;
+    for (int i = 0; i < LSDJ_SYNTH_COUNT; ++i)
+        song->synths[i].overwritten = ((waveSynthOverwriteLocks[1 - (i / 8)] >> (i % 8)) & 1);
+    
+    memcpy(song->reserved3fc6, data + SONG_RESERVED_3FC6_ADDRESS, sizeof(song->reserved3fc6));
+    song->drumMax = data[SONG_DRUM_MAX_ADDRESS];
+    memcpy(song->reserved3fd1, data + SONG_RESERVED_3FD1_ADDRESS, sizeof(song->reserved3fd1));
+    
+    // Bank 2
     for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
     {
-        if ((phraseAllocTable[i / 8] >> (i % 8)) & 1)
-            song->phrases[i] = (lsdj_phrase_t*)malloc(sizeof(lsdj_phrase_t));
+        lsdj_phrase_t* phrase = song->phrases[i];
+        if (phrase == NULL)
+            continue;
+        
+        const size_t offset = (size_t)i * LSDJ_PHRASE_LENGTH;
+        for (size_t j = 0; j < LSDJ_PHRASE_LENGTH; ++j)
+        {
+            phrase->commands[j].command = data[SONG_PHRASE_COMMANDS_ADDRESS + offset + j];
+            phrase->commands[j].value = data[SONG_PHRASE_VALUES_ADDRESS + offset + j];
+        }
     }
     
-    // Read the banks
-    vio->seek(begin, SEEK_SET, vio->user_data);
-    read_bank0(vio, song);
-    read_bank1(vio, song, error);
-    if (error && *error)
+    memcpy(song->reserved5fe0, data + SONG_RESERVED_5FE0_ADDRESS, sizeof(song->reserved5fe0));
+    
+    // Bank 3
+    memcpy(song->waves, data + SONG_WAVES_ADDRESS, sizeof(song->waves));
+    
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
     {
-        lsdj_song_free(song);
-        return NULL;
+        if (song->phrases[i])
+            memcpy(song->phrases[i]->instruments, data + SONG_PHRASE_INSTRUMENTS_ADDRESS + i * LSDJ_PHRASE_LENGTH, LSDJ_PHRASE_LENGTH);
     }
     
-    read_bank2(vio, song);
-    read_bank3(vio, song);
-    
-    return song;
+    memcpy(song->reserved7ff2, data + SONG_RESERVED_7FF2_ADDRESS, sizeof(song->reserved7ff2));
 }
 
-lsdj_song_t* lsdj_song_read_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error)
+// Write the banks of a song image straight to memory, with the same result as write_bank0() through write_bank3()
+/*! data always points at the start of the full image, not the bank */
+void write_bank0_to_memory(const lsdj_song_t* song, unsigned char* data)
 {
-    if (data == NULL)
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
     {
-        lsdj_error_new(error, "data is NULL");
-        return NULL;
+        unsigned char* notes = data + SONG_PHRASE_NOTES_ADDRESS + i * LSDJ_PHRASE_LENGTH;
+        if (song->phrases[i])
+            memcpy(notes, song->phrases[i]->notes, LSDJ_PHRASE_LENGTH);
+        else
+            memset(notes, 0, LSDJ_PHRASE_LENGTH);
     }
     
-    lsdj_memory_data_t mem;
-    mem.cur = mem.begin = (unsigned char*)data;
-    mem.size = size;
+    memcpy(data + SONG_BOOKMARKS_ADDRESS, &song->bookmarks, sizeof(song->bookmarks));
+    memcpy(data + SONG_RESERVED_1030_ADDRESS, song->reserved1030, sizeof(song->reserved1030));
+    memcpy(data + SONG_GROOVES_ADDRESS, song->grooves, sizeof(song->grooves));
+    memcpy(data + SONG_ROWS_ADDRESS, song->rows, sizeof(song->rows));
     
-    lsdj_vio_t vio;
-    vio.read = lsdj_mread;
-    vio.seek = lsdj_mseek;
-    vio.tell = lsdj_mtell;
-    vio.user_data = &mem;
+    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+    {
+        unsigned char* volumes = data + SONG_TABLE_VOLUMES_ADDRESS + i * LSDJ_TABLE_LENGTH;
+        for (size_t j = 0; j < LSDJ_TABLE_LENGTH; ++j)
+            volumes[j] = song->tables[i] ? lsdj_table_get_volume(song->tables[i], j) : 0;
+    }
     
-    return lsdj_song_read(&vio, error);
-}
-
-void lsdj_song_write(const lsdj_song_t* song, lsdj_vio_t* vio, lsdj_error_t** error)
-{
-    write_bank0(song, vio);
-    write_bank1(song, vio, error);
-    write_bank2(song, vio);
-    write_bank3(song, vio);
+    memcpy(data + SONG_WORDS_ADDRESS, song->words, sizeof(song->words));
+    memcpy(data + SONG_WORD_NAMES_ADDRESS, song->wordNames, sizeof(song->wordNames));
+    memcpy(data + SONG_RB0_ADDRESS, "rb", 2);
+    
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+    {
+        char* name = (char*)data + SONG_INSTRUMENT_NAMES_ADDRESS + i * LSDJ_INSTRUMENT_NAME_LENGTH;
+        if (song->instruments[i])
+            lsdj_instrument_get_name(song->instruments[i], name, LSDJ_INSTRUMENT_NAME_LENGTH);
+        else
+            memset(name, 0, LSDJ_INSTRUMENT_NAME_LENGTH);
+    }
+    
+    memcpy(data + SONG_RESERVED_1FBA_ADDRESS, song->reserved1fba, sizeof(song->reserved1fba));
 }
 
-void lsdj_song_write_to_memory(const lsdj_song_t* song, unsigned char* data, size_t size, lsdj_error_t** error)
+void write_bank1_to_memory(const lsdj_song_t* song, unsigned char* data, lsdj_error_t** error)
 {
-    if (song == NULL)
-        return lsdj_error_new(error, "song is NULL");
+    memcpy(data + SONG_RESERVED_2000_ADDRESS, song->reserved2000, sizeof(song->reserved2000));
     
-    if (data == NULL)
-        return lsdj_error_new(error, "data is NULL");
+    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+        data[SONG_TABLE_ALLOC_TABLE_ADDRESS + i] = (song->tables[i] == NULL) ? 0 : 1;
     
-    if (size < LSDJ_SONG_DECOMPRESSED_SIZE)
-        return lsdj_error_new(error, "memory is not big enough to store song");
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+        data[SONG_INSTR_ALLOC_TABLE_ADDRESS + i] = (song->instruments[i] == NULL) ? 0 : 1;
     
-    lsdj_memory_data_t mem;
-    mem.begin = data;
-    mem.cur = mem.begin;
-    mem.size = size;
+    for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
+    {
+        unsigned char* phrases = data + SONG_CHAIN_PHRASES_ADDRESS + i * LSDJ_CHAIN_LENGTH;
+        unsigned char* transpositions = data + SONG_CHAIN_TRANSPOSITIONS_ADDRESS + i * LSDJ_CHAIN_LENGTH;
+        if (song->chains[i])
+        {
+            memcpy(phrases, song->chains[i]->phrases, LSDJ_CHAIN_LENGTH);
+            memcpy(transpositions, song->chains[i]->transpositions, LSDJ_CHAIN_LENGTH);
+        } else {
+            memset(phrases, 0xFF, LSDJ_CHAIN_LENGTH);
+            memset(transpositions, 0, LSDJ_CHAIN_LENGTH);
+        }
+    }
     
-    lsdj_vio_t vio;
-    vio.write = lsdj_mwrite;
-    vio.seek = lsdj_mseek;
-    vio.tell = lsdj_mtell;
-    vio.user_data = &mem;
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+    {
+        if (song->instruments[i])
+        {
+            lsdj_instrument_encode(song->instruments[i], song->formatVersion, data + SONG_INSTRUMENTS_ADDRESS + i * SONG_INSTRUMENT_BYTE_COUNT, error);
+            if (error && *error)
+                return;
+        } else {
+            memcpy(data + SONG_INSTRUMENTS_ADDRESS + i * SONG_INSTRUMENT_BYTE_COUNT, LSDJ_DEFAULT_INSTRUMENT, sizeof(LSDJ_DEFAULT_INSTRUMENT));
+        }
+    }
     
-    lsdj_song_write(song, &vio, error);
-}
-
-void lsdj_song_set_format_version(lsdj_song_t* song, unsigned char version)
-{
-    song->formatVersion = version;
-}
-
-unsigned char lsdj_song_get_format_version(const lsdj_song_t* song)
-{
-    return song->formatVersion;
-}
-
-void lsdj_song_set_tempo(lsdj_song_t* song, unsigned char tempo)
-{
-    song->tempo = tempo;
+    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+    {
+        lsdj_table_t* table = song->tables[i];
+        const size_t offset = (size_t)i * LSDJ_TABLE_LENGTH;
+        
+        for (size_t j = 0; j < LSDJ_TABLE_LENGTH; ++j)
+        {
+            if (table)
+            {
+                const lsdj_command_t* command1 = lsdj_table_get_command1(table, j);
+                const lsdj_command_t* command2 = lsdj_table_get_command2(table, j);
+                data[SONG_TABLE_TRANSPOSITIONS_ADDRESS + offset + j] = lsdj_table_get_transposition(table, j);
+                data[SONG_TABLE_COMMAND1_ADDRESS + offset + j] = command1->command;
+                data[SONG_TABLE_VALUE1_ADDRESS + offset + j] = command1->value;
+                data[SONG_TABLE_COMMAND2_ADDRESS + offset + j] = command2->command;
+                data[SONG_TABLE_VALUE2_ADDRESS + offset + j] = command2->value;
+            } else {
+                data[SONG_TABLE_TRANSPOSITIONS_ADDRESS + offset + j] = 0;
+                data[SONG_TABLE_COMMAND1_ADDRESS + offset + j] = 0;
+                data[SONG_TABLE_VALUE1_ADDRESS + offset + j] = 0;
+                data[SONG_TABLE_COMMAND2_ADDRESS + offset + j] = 0;
+                data[SONG_TABLE_VALUE2_ADDRESS + offset + j] = 0;
+            }
+        }
+    }
+    
+    memcpy(data + SONG_RB1_ADDRESS, "rb", 2);
+    
+    unsigned char* phraseAllocTable = data + SONG_PHRASE_ALLOC_TABLE_ADDRESS;
+    memset(phraseAllocTable, 0, PHRASE_ALLOC_TABLE_SIZE);
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+    {
+        if (song->phrases[i])
+            phraseAllocTable[i / 8] |= (1 << (i % 8));
+    }
+    
+    unsigned char* chainAllocTable = data + SONG_CHAIN_ALLOC_TABLE_ADDRESS;
+    memset(chainAllocTable, 0, CHAIN_ALLOC_TABLE_SIZE);
+    for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
+    {
+        if (song->chains[i])
+            chainAllocTable[i / 8] |= (1 << (i % 8));
+    }
+    
+    for (int i = 0; i < LSDJ_SYNTH_COUNT; ++i)
+        write_soft_synth_parameters_to_memory(&song->synths[i], data + SONG_SYNTHS_ADDRESS + i * SONG_SYNTH_BYTE_COUNT);
+    
+    memcpy(data + SONG_WORK_TIME_ADDRESS, &song->meta.workTime, 2);
+    data[LSDJ_SONG_TEMPO_ADDRESS] = song->tempo;
+    data[SONG_TRANSPOSITION_ADDRESS] = song->transposition;
+    memcpy(data + SONG_TOTAL_TIME_ADDRESS, &song->meta.totalTime, 3);
+    
+    unsigned char* meta = data + SONG_META_ADDRESS;
+    meta[0] = song->reserved3fb9;
+    meta[1] = song->meta.keyDelay;
+    meta[2] = song->meta.keyRepeat;
+    meta[3] = song->meta.font;
+    meta[4] = song->meta.sync;
+    meta[5] = song->meta.colorSet;
+    meta[6] = song->reserved3fbf;
+    meta[7] = song->meta.clone;
+    meta[8] = song->meta.fileChangedFlag;
+    meta[9] = song->meta.powerSave;
+    meta[10] = song->meta.preListen;
+    
+    unsigned char* waveSynthOverwriteLocks = data + SONG_WAVE_SYNTH_LOCKS_ADDRESS;
+    memset(waveSynthOverwriteLocks, 0, 2);
+    for (int i = 0; i < LSDJ_SYNTH_COUNT; ++i)
+    {
+        if (song->synths[i].overwritten)
+            waveSynthOverwriteLocks[1 - (i / 8)] |= (1 << (i % 8));
+    }
+    
+    memcpy(data + SONG_RESERVED_3FC6_ADDRESS, song->reserved3fc6, sizeof(song->reserved3fc6));
+    data[SONG_DRUM_MAX_ADDRESS] = song->drumMax;
+    memcpy(data + SONG_RESERVED_3FD1_ADDRESS, song->reserved3fd1, sizeof(song->reserved3fd1));
+}
+
+void write_bank2_to_memory(const lsdj_song_t* song, unsigned char* data)
+{
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+    {
+        const lsdj_phrase_t* phrase = song->phrases[i];
+        const size_t offset = (size_t)i * LSDJ_PHRASE_LENGTH;
+        
+        for (size_t j = 0; j < LSDJ_PHRASE_LENGTH; ++j)
+        {
+            data[SONG_PHRASE_COMMANDS_ADDRESS + offset + j] = phrase ? phrase->commands[j].command : 0;
+            data[SONG_PHRASE_VALUES_ADDRESS + offset + j] = phrase ? phrase->commands[j].value : 0;
+        }
+    }
+    
+    memcpy(data + SONG_RESERVED_5FE0_ADDRESS, song->reserved5fe0, sizeof(song->reserved5fe0));
+}
+
+void write_bank3_to_memory(const lsdj_song_t* song, unsigned char* data)
+{
+    memcpy(data + SONG_WAVES_ADDRESS, song->waves, sizeof(song->waves));
+    
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+    {
+        unsigned char* instruments = data + SONG_PHRASE_INSTRUMENTS_ADDRESS + i * LSDJ_PHRASE_LENGTH;
+        if (song->phrases[i])
+            memcpy(instruments, song->phrases[i]->instruments, LSDJ_PHRASE_LENGTH);
+        else
+            memset(instruments, 0xFF, LSDJ_PHRASE_LENGTH);
+    }
+    
+    memcpy(data + SONG_RB2_ADDRESS, "rb", 2);
+    memcpy(data + SONG_RESERVED_7FF2_ADDRESS, song->reserved7ff2, sizeof(song->reserved7ff2));
+    data[LSDJ_SONG_FORMAT_VERSION_ADDRESS] = song->formatVersion;
+}
+
+void write_song_to_memory(const lsdj_song_t* song, unsigned char* data, lsdj_error_t** error)
+{
+    write_bank0_to_memory(song, data);
+    write_bank1_to_memory(song, data, error);
+    if (error && *error)
+        return;
+    
+    write_bank2_to_memory(song, data);
+    write_bank3_to_memory(song, data);
+}
+
+// Whether a vio reads from/writes to memory, with at least a full song left from its current position
+lsdj_memory_data_t* get_song_memory(const lsdj_vio_t* vio, int writing)
+{
+    if ((writing ? vio->write != lsdj_mwrite : vio->read != lsdj_mread) || vio->seek != lsdj_mseek || vio->tell != lsdj_mtell)
+        return NULL;
+    
+    lsdj_memory_data_t* memory = (lsdj_memory_data_t*)vio->user_data;
+    if ((size_t)(memory->cur - memory->begin) + LSDJ_SONG_DECOMPRESSED_SIZE > memory->size)
+        return NULL;
+    
+    return memory;
+}
+
+int check_rb(lsdj_vio_t* vio, long position)
+{
+    char data[2];
+    
+    vio->seek(position, SEEK_SET, vio->user_data);
+    vio->read(data, 2, vio->user_data);
+    
+    return (data[0] == 'r' && data[1] == 'b') ? 0 : 1;
+}
+
+lsdj_song_t* read_song_banks(lsdj_vio_t* vio, lsdj_arena_t* arena, lsdj_error_t** error)
+{
+    // Check for incorrect input
+    if (vio->read == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "vio->read is NULL");
+        return NULL;
+    }
+    
+    if (vio->tell == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "tell is NULL");
+        return NULL;
+    }
+    
+    if (vio->seek == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "vio->seek is NULL");
+        return NULL;
+    }
+    
+    const long begin = vio->tell(vio->user_data);
+    
+    // Check if the 'rb' flags have been set correctly
+    if (check_rb(vio, begin + 0x1E78) != 0) { lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "memory flag 'rb' not found at 0x1E78"); return NULL; }
+    if (check_rb(vio, begin + 0x3E80) != 0) { lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "memory flag 'rb' not found at 0x3E80"); return NULL; }
+    if (check_rb(vio, begin + 0x7FF0) != 0) { lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "memory flag 'rb' not found at 0x7FF0"); return NULL; }
+    
+    // We passed the 'rb' check, and can create a song now for reading
+    lsdj_song_t* song = lsdj_song_alloc(error);
+    if (error && *error)
+        return NULL;
+    
+    // Read the version number
+    vio->seek(begin + 0x7FFF, SEEK_SET, vio->user_data);
+    vio->read(&song->formatVersion, 1, vio->user_data);
+    
+    // Read the allocation tables
+    unsigned char instrAllocTable[INSTR_ALLOC_TABLE_SIZE];
+    unsigned char tableAllocTable[TABLE_ALLOC_TABLE_SIZE];
+    unsigned char chainAllocTable[CHAIN_ALLOC_TABLE_SIZE];
+    unsigned char phraseAllocTable[PHRASE_ALLOC_TABLE_SIZE];
+    
+    vio->seek(begin + 0x2020, SEEK_SET, vio->user_data);
+    vio->read(tableAllocTable, TABLE_ALLOC_TABLE_SIZE, vio->user_data);
+    vio->read(instrAllocTable, INSTR_ALLOC_TABLE_SIZE, vio->user_data);
+    
+    vio->seek(begin + 0x3E82, SEEK_SET, vio->user_data);
+    vio->read(phraseAllocTable, PHRASE_ALLOC_TABLE_SIZE, vio->user_data);
+    vio->read(chainAllocTable, CHAIN_ALLOC_TABLE_SIZE, vio->user_data);
+    
+    // Without an arena from the caller, create one that fits exactly what's allocated
+    if (arena == NULL)
+    {
+        unsigned int chainCount = 0;
+        unsigned int phraseCount = 0;
+        unsigned int instrumentCount = 0;
+        unsigned int tableCount = 0;
+        
+        for (int i = 0; i < TABLE_ALLOC_TABLE_SIZE; ++i)
+            tableCount += tableAllocTable[i] ? 1 : 0;
+        for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+            instrumentCount += instrAllocTable[i] ? 1 : 0;
+        for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
+            chainCount += (chainAllocTable[i / 8] >> (i % 8)) & 1;
+        for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+            phraseCount += (phraseAllocTable[i / 8] >> (i % 8)) & 1;
+        
+        arena = lsdj_arena_new(arena_size_for(chainCount, phraseCount, instrumentCount, tableCount), error);
+        if (arena == NULL)
+        {
+            lsdj_song_free(song);
+            return NULL;
+        }
+        song->ownsArena = 1;
+    }
+    song->arena = arena;
+    
+    int outOfMemory = 0;
+
+    for (int i = 0; i < TABLE_ALLOC_TABLE_SIZE; ++i)
+    {
+        if (tableAllocTable[i])
+            outOfMemory |= (song->tables[i] = lsdj_table_new_in_arena(arena)) == NULL;
+    }
+    
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+    {
+        if (instrAllocTable[i])
+            outOfMemory |= (song->instruments[i] = lsdj_instrument_new_in_arena(arena)) == NULL;
+    }
+    
+    for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
+    {
+        if ((chainAllocTable[i / 8] >> (i % 8)) & 1)
+            outOfMemory |= (song->chains[i] = (lsdj_chain_t*)lsdj_arena_alloc(arena, sizeof(lsdj_chain_t))) == NULL;
+    }
+    
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+    {
+        if ((phraseAllocTable[i / 8] >> (i % 8)) & 1)
+            outOfMemory |= (song->phrases[i] = (lsdj_phrase_t*)lsdj_arena_alloc(arena, sizeof(lsdj_phrase_t))) == NULL;
+    }
+    
+    if (outOfMemory)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "song arena is out of memory");
+        lsdj_song_free(song);
+        return NULL;
+    }
+    
+    // Read the banks, straight from memory if possible
+    vio->seek(begin, SEEK_SET, vio->user_data);
+    lsdj_memory_data_t* memory = get_song_memory(vio, 0);
+    if (memory)
+    {
+        read_song_from_memory(memory->cur, song, error);
+        if (error && *error)
+        {
+            lsdj_song_free(song);
+            return NULL;
+        }
+        
+        memory->cur += LSDJ_SONG_DECOMPRESSED_SIZE;
+        return song;
+    }
+    
+    read_bank0(vio, song);
+    read_bank1(vio, song, error);
+    if (error && *error)
+    {
+        lsdj_song_free(song);
+        return NULL;
+    }
+    
+    read_bank2(vio, song);
+    read_bank3(vio, song);
+    
+    return song;
+}
+
+lsdj_song_t* read_song(lsdj_vio_t* vio, lsdj_arena_t* arena, lsdj_error_t** error)
+{
+    LSDJ_TRACE_BEGIN(LSDJ_TRACE_SONG_READ);
+    
+    lsdj_song_t* song = read_song_banks(vio, arena, error);
+    
+    LSDJ_TRACE_COUNT(LSDJ_TRACE_SONG_READ, LSDJ_TRACE_BYTES_IN, song ? LSDJ_SONG_DECOMPRESSED_SIZE : 0);
+    LSDJ_TRACE_END(LSDJ_TRACE_SONG_READ);
+    
+    return song;
+}
+
+lsdj_song_t* lsdj_song_read(lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    return read_song(vio, NULL, error);
+}
+
+lsdj_song_t* lsdj_song_read_in_arena(lsdj_vio_t* vio, lsdj_arena_t* arena, lsdj_error_t** error)
+{
+    if (arena == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "arena is NULL");
+        return NULL;
+    }
+    
+    return read_song(vio, arena, error);
+}
+
+lsdj_song_t* lsdj_song_read_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    if (data == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
+        return NULL;
+    }
+    
+    lsdj_memory_data_t mem;
+    mem.cur = mem.begin = (unsigned char*)data;
+    mem.size = size;
+    
+    lsdj_vio_t vio;
+    vio.read = lsdj_mread;
+    vio.seek = lsdj_mseek;
+    vio.tell = lsdj_mtell;
+    vio.user_data = &mem;
+    
+    return lsdj_song_read(&vio, error);
+}
+
+void lsdj_song_write(const lsdj_song_t* song, lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    lsdj_memory_data_t* memory = get_song_memory(vio, 1);
+    if (memory)
+    {
+        write_song_to_memory(song, memory->cur, error);
+        memory->cur += LSDJ_SONG_DECOMPRESSED_SIZE;
+        return;
+    }
+    
+    write_bank0(song, vio);
+    write_bank1(song, vio, error);
+    write_bank2(song, vio);
+    write_bank3(song, vio);
+}
+
+void lsdj_song_write_to_memory(const lsdj_song_t* song, unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    if (song == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "song is NULL");
+    
+    if (data == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
+    
+    if (size < LSDJ_SONG_DECOMPRESSED_SIZE)
+        return lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_SPACE, "memory is not big enough to store song");
+    
+    lsdj_memory_data_t mem;
+    mem.begin = data;
+    mem.cur = mem.begin;
+    mem.size = size;
+    
+    lsdj_vio_t vio;
+    vio.write = lsdj_mwrite;
+    vio.seek = lsdj_mseek;
+    vio.tell = lsdj_mtell;
+    vio.user_data = &mem;
+    
+    lsdj_song_write(song, &vio, error);
+}
+
+void lsdj_song_write_dirty_banks_to_memory(const lsdj_song_t* song, unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    if (song == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "song is NULL");
+    
+    if (data == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
+    
+    if (size < LSDJ_SONG_DECOMPRESSED_SIZE)
+        return lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_SPACE, "memory is not big enough to store song");
+    
+    if (song->dirty & LSDJ_SONG_BANK_0)
+        write_bank0_to_memory(song, data);
+    
+    if (song->dirty & LSDJ_SONG_BANK_1)
+    {
+        write_bank1_to_memory(song, data, error);
+        if (error && *error)
+            return;
+    }
+    
+    if (song->dirty & LSDJ_SONG_BANK_2)
+        write_bank2_to_memory(song, data);
+    
+    if (song->dirty & LSDJ_SONG_BANK_3)
+        write_bank3_to_memory(song, data);
+}
+
+unsigned int lsdj_song_compressed_block_count(const lsdj_song_t* song, lsdj_compression_mode_t mode, lsdj_error_t** error)
+{
+    unsigned char data[LSDJ_SONG_DECOMPRESSED_SIZE];
+    lsdj_song_write_to_memory(song, data, LSDJ_SONG_DECOMPRESSED_SIZE, error);
+    if (error && *error)
+        return 0;
+    
+    unsigned int blockCount = 0;
+    if (lsdj_compress_size(data, BLOCK_SIZE, mode, &blockCount, error) == 0)
+        return 0;
+    
+    return blockCount;
+}
+
+void lsdj_song_set_format_version(lsdj_song_t* song, unsigned char version)
+{
+    // Instruments are encoded differently depending on the version
+    song->dirty |= LSDJ_SONG_BANK_1 | LSDJ_SONG_BANK_3;
+    song->formatVersion = version;
+}
+
+unsigned char lsdj_song_get_format_version(const lsdj_song_t* song)
+{
+    return song->formatVersion;
+}
+
+void lsdj_song_set_tempo(lsdj_song_t* song, unsigned char tempo)
+{
+    song->dirty |= LSDJ_SONG_BANK_1;
+    song->tempo = tempo;
+}
+
+unsigned char lsdj_song_get_tempo(const lsdj_song_t* song)
+{
+    return song->tempo;
+}
+
+void lsdj_song_set_transposition(lsdj_song_t* song, unsigned char transposition)
+{
+    song->dirty |= LSDJ_SONG_BANK_1;
+    song->transposition = transposition;
+}
+
+unsigned char lsdj_song_get_transposition(const lsdj_song_t* song)
+{
+    return song->transposition;
+}
+
+unsigned char lsdj_song_get_file_changed_flag(const lsdj_song_t* song)
+{
+    return song->meta.fileChangedFlag;
+}
+
+void lsdj_song_set_dirty_flag(lsdj_song_t* song, unsigned char dirty)
+{
+    song->dirty = dirty ? LSDJ_SONG_ALL_BANKS : 0;
+}
+
+unsigned char lsdj_song_get_dirty_flag(const lsdj_song_t* song)
+{
+    return song->dirty != 0;
+}
+
+unsigned char lsdj_song_get_dirty_banks(const lsdj_song_t* song)
+{
+    return song->dirty;
+}
+
+void lsdj_song_set_drum_max(lsdj_song_t* song, unsigned char drumMax)
+{
+    song->dirty |= LSDJ_SONG_BANK_1;
+    song->drumMax = drumMax;
+}
+
+unsigned char lsdj_song_get_drum_max(const lsdj_song_t* song)
+{
+    return song->drumMax;
+}
+
+lsdj_row_t* lsdj_song_get_row(lsdj_song_t* song, size_t index)
+{
+    song->dirty |= LSDJ_SONG_BANK_0;
+    return &song->rows[index];
+}
+
+lsdj_chain_t* lsdj_song_get_chain(lsdj_song_t* song, size_t index)
+{
+    if (!unshare_song(song))
+        return NULL;
+    
+    song->dirty |= LSDJ_SONG_BANK_1;
+    return song->chains[index];
+}
+
+lsdj_phrase_t* lsdj_song_get_phrase(lsdj_song_t* song, size_t index)
+{
+    if (!unshare_song(song))
+        return NULL;
+    
+    song->dirty |= LSDJ_SONG_BANK_0 | LSDJ_SONG_BANK_2 | LSDJ_SONG_BANK_3;
+    return song->phrases[index];
+}
+
+lsdj_instrument_t* lsdj_song_get_instrument(lsdj_song_t* song, size_t index)
+{
+    if (!unshare_song(song))
+        return NULL;
+    
+    song->dirty |= LSDJ_SONG_BANK_0 | LSDJ_SONG_BANK_1;
+    return song->instruments[index];
+}
+
+lsdj_synth_t* lsdj_song_get_synth(lsdj_song_t* song, size_t index)
+{
+    song->dirty |= LSDJ_SONG_BANK_1;
+    return &song->synths[index];
+}
+
+lsdj_wave_t* lsdj_song_get_wave(lsdj_song_t* song, size_t index)
+{
+    song->dirty |= LSDJ_SONG_BANK_3;
+    return &song->waves[index];
+}
+
+lsdj_table_t* lsdj_song_get_table(lsdj_song_t* song, size_t index)
+{
+    if (!unshare_song(song))
+        return NULL;
+    
+    song->dirty |= LSDJ_SONG_BANK_0 | LSDJ_SONG_BANK_1;
+    return song->tables[index];
+}
+
+lsdj_groove_t* lsdj_song_get_groove(lsdj_song_t* song, size_t index)
+{
+    song->dirty |= LSDJ_SONG_BANK_0;
+    return &song->grooves[index];
+}
+
+lsdj_word_t* lsdj_song_get_word(lsdj_song_t* song, size_t index)
+{
+    song->dirty |= LSDJ_SONG_BANK_0;
+    return &song->words[index];
+}
+
+void lsdj_song_set_word_name(lsdj_song_t* song, size_t index, const char* data, size_t size)
+{
+    song->dirty |= LSDJ_SONG_BANK_0;
+    strncpy(song->wordNames[index], data, size < LSDJ_WORD_NAME_LENGTH ? size : LSDJ_WORD_NAME_LENGTH);
+}
+
+void lsdj_song_get_word_name(const lsdj_song_t* song, size_t index, char* data, size_t size)
+{
+    const size_t len = strnlen(song->wordNames[index], LSDJ_WORD_NAME_LENGTH);
+    strncpy(data, song->wordNames[index], len);
+    for (size_t i = len; i < LSDJ_WORD_LENGTH; i += 1)
+        data[i] = '\0';
+}
+
+void lsdj_song_set_bookmark(lsdj_song_t* song, lsdj_channel_t channel, size_t position, unsigned char bookmark)
+{
+    song->dirty |= LSDJ_SONG_BANK_0;
+    song->bookmarks.channels[channel][position] = bookmark;
+}
+
+unsigned char lsdj_song_get_bookmark(const lsdj_song_t* song, lsdj_channel_t channel, size_t position)
+{
+    return song->bookmarks.channels[channel][position];
+}
+
+const lsdj_row_t* lsdj_song_get_row_const(const lsdj_song_t* song, size_t index)
+{
+    return &song->rows[index];
+}
+
+const lsdj_chain_t* lsdj_song_get_chain_const(const lsdj_song_t* song, size_t index)
+{
+    return song->chains[index];
+}
+
+const lsdj_phrase_t* lsdj_song_get_phrase_const(const lsdj_song_t* song, size_t index)
+{
+    return song->phrases[index];
+}
+
+const lsdj_instrument_t* lsdj_song_get_instrument_const(const lsdj_song_t* song, size_t index)
+{
+    return song->instruments[index];
+}
+
+const lsdj_synth_t* lsdj_song_get_synth_const(const lsdj_song_t* song, size_t index)
+{
+    return &song->synths[index];
+}
+
+const lsdj_wave_t* lsdj_song_get_wave_const(const lsdj_song_t* song, size_t index)
+{
+    return &song->waves[index];
+}
+
+const lsdj_table_t* lsdj_song_get_table_const(const lsdj_song_t* song, size_t index)
+{
+    return song->tables[index];
 }
 
-unsigned char lsdj_song_get_tempo(const lsdj_song_t* song)
+const lsdj_groove_t* lsdj_song_get_groove_const(const lsdj_song_t* song, size_t index)
 {
-    return song->tempo;
+    return &song->grooves[index];
 }
 
-void lsdj_song_set_transposition(lsdj_song_t* song, unsigned char transposition)
+const lsdj_word_t* lsdj_song_get_word_const(const lsdj_song_t* song, size_t index)
 {
-    song->transposition = transposition;
+    return &song->words[index];
 }
 
-unsigned char lsdj_song_get_transposition(const lsdj_song_t* song)
+void lsdj_song_get_columns(const lsdj_song_t* song, lsdj_song_columns_t* columns)
 {
-    return song->transposition;
+    memset(columns, 0, sizeof(lsdj_song_columns_t));
+    
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+    {
+        const lsdj_phrase_t* phrase = song->phrases[i];
+        if (phrase == NULL)
+            continue;
+        
+        columns->phraseAllocated[i] = 1;
+        memcpy(columns->phraseNotes[i], phrase->notes, LSDJ_PHRASE_LENGTH);
+        memcpy(columns->phraseInstruments[i], phrase->instruments, LSDJ_PHRASE_LENGTH);
+        for (int j = 0; j < LSDJ_PHRASE_LENGTH; ++j)
+        {
+            columns->phraseCommands[i][j] = phrase->commands[j].command;
+            columns->phraseValues[i][j] = phrase->commands[j].value;
+        }
+    }
+    
+    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+    {
+        lsdj_table_t* table = song->tables[i];
+        if (table == NULL)
+            continue;
+        
+        columns->tableAllocated[i] = 1;
+        for (size_t j = 0; j < LSDJ_TABLE_LENGTH; ++j)
+        {
+            columns->tableVolumes[i][j] = lsdj_table_get_volume(table, j);
+            columns->tableTranspositions[i][j] = lsdj_table_get_transposition(table, j);
+            
+            const lsdj_command_t* command1 = lsdj_table_get_command1(table, j);
+            columns->tableCommands1[i][j] = command1->command;
+            columns->tableValues1[i][j] = command1->value;
+            
+            const lsdj_command_t* command2 = lsdj_table_get_command2(table, j);
+            columns->tableCommands2[i][j] = command2->command;
+            columns->tableValues2[i][j] = command2->value;
+        }
+    }
 }
 
-unsigned char lsdj_song_get_file_changed_flag(const lsdj_song_t* song)
+void lsdj_song_set_columns(lsdj_song_t* song, const lsdj_song_columns_t* columns)
 {
-    return song->meta.fileChangedFlag;
+    if (!unshare_song(song))
+        return;
+    
+    song->dirty |= LSDJ_SONG_BANK_0 | LSDJ_SONG_BANK_1 | LSDJ_SONG_BANK_2 | LSDJ_SONG_BANK_3;
+    
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+    {
+        lsdj_phrase_t* phrase = song->phrases[i];
+        if (phrase == NULL)
+            continue;
+        
+        memcpy(phrase->notes, columns->phraseNotes[i], LSDJ_PHRASE_LENGTH);
+        memcpy(phrase->instruments, columns->phraseInstruments[i], LSDJ_PHRASE_LENGTH);
+        for (int j = 0; j < LSDJ_PHRASE_LENGTH; ++j)
+        {
+            phrase->commands[j].command = columns->phraseCommands[i][j];
+            phrase->commands[j].value = columns->phraseValues[i][j];
+        }
+    }
+    
+    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+    {
+        lsdj_table_t* table = song->tables[i];
+        if (table == NULL)
+            continue;
+        
+        lsdj_table_set_volumes(table, (unsigned char*)columns->tableVolumes[i]);
+        lsdj_table_set_transpositions(table, (unsigned char*)columns->tableTranspositions[i]);
+        for (size_t j = 0; j < LSDJ_TABLE_LENGTH; ++j)
+        {
+            lsdj_command_t* command1 = lsdj_table_get_command1(table, j);
+            command1->command = columns->tableCommands1[i][j];
+            command1->value = columns->tableValues1[i][j];
+            
+            lsdj_command_t* command2 = lsdj_table_get_command2(table, j);
+            command2->command = columns->tableCommands2[i][j];
+            command2->value = columns->tableValues2[i][j];
+        }
+    }
 }
 
-void lsdj_song_set_drum_max(lsdj_song_t* song, unsigned char drumMax)
+size_t lsdj_song_count_mapped_commands(const lsdj_song_t* song, unsigned int filter, const lsdj_command_map_t* map)
 {
-    song->drumMax = drumMax;
+    size_t count = 0;
+    
+    if (filter & LSDJ_MAP_PHRASE_COMMANDS)
+    {
+        for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+        {
+            if (song->phrases[i])
+                count += lsdj_command_map_count(map, song->phrases[i]->commands, LSDJ_PHRASE_LENGTH);
+        }
+    }
+    
+    if (filter & LSDJ_MAP_TABLE_COMMANDS)
+    {
+        for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+        {
+            if (song->tables[i])
+                count += lsdj_table_count_mapped_commands(song->tables[i], map);
+        }
+    }
+    
+    return count;
 }
 
-unsigned char lsdj_song_get_drum_max(const lsdj_song_t* song)
+size_t lsdj_song_map_commands(lsdj_song_t* song, unsigned int filter, const lsdj_command_map_t* map)
 {
-    return song->drumMax;
+    // Leave songs that wouldn't change alone, so they don't get copied or need recompressing
+    if (lsdj_song_count_mapped_commands(song, filter, map) == 0)
+        return 0;
+    
+    if (!unshare_song(song))
+        return 0;
+    
+    size_t count = 0;
+    
+    if (filter & LSDJ_MAP_PHRASE_COMMANDS)
+    {
+        size_t phraseCount = 0;
+        for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+        {
+            if (song->phrases[i])
+                phraseCount += lsdj_command_map_apply(map, song->phrases[i]->commands, LSDJ_PHRASE_LENGTH);
+        }
+        
+        if (phraseCount)
+            song->dirty |= LSDJ_SONG_BANK_2;
+        count += phraseCount;
+    }
+    
+    if (filter & LSDJ_MAP_TABLE_COMMANDS)
+    {
+        size_t tableCount = 0;
+        for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+        {
+            if (song->tables[i])
+                tableCount += lsdj_table_map_commands(song->tables[i], map);
+        }
+        
+        if (tableCount)
+            song->dirty |= LSDJ_SONG_BANK_1;
+        count += tableCount;
+    }
+    
+    return count;
 }
 
-lsdj_row_t* lsdj_song_get_row(lsdj_song_t* song, size_t index)
+size_t lsdj_song_count_mapped_instrument_panning(const lsdj_song_t* song, const lsdj_panning mapping[4])
 {
-    return &song->rows[index];
+    size_t count = 0;
+    
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+    {
+        const lsdj_instrument_t* instrument = song->instruments[i];
+        if (instrument)
+        {
+            const lsdj_panning panning = lsdj_instrument_get_panning(instrument);
+            count += mapping[panning & 3] != panning;
+        }
+    }
+    
+    return count;
 }
 
-lsdj_chain_t* lsdj_song_get_chain(lsdj_song_t* song, size_t index)
+size_t lsdj_song_map_instrument_panning(lsdj_song_t* song, const lsdj_panning mapping[4])
 {
-    return song->chains[index];
+    if (lsdj_song_count_mapped_instrument_panning(song, mapping) == 0)
+        return 0;
+    
+    if (!unshare_song(song))
+        return 0;
+    
+    song->dirty |= LSDJ_SONG_BANK_1;
+    
+    size_t count = 0;
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+    {
+        lsdj_instrument_t* instrument = song->instruments[i];
+        if (instrument)
+        {
+            const lsdj_panning panning = lsdj_instrument_get_panning(instrument);
+            const lsdj_panning mapped = mapping[panning & 3];
+            count += mapped != panning;
+            lsdj_instrument_set_panning(instrument, mapped);
+        }
+    }
+    
+    return count;
 }
 
-lsdj_phrase_t* lsdj_song_get_phrase(lsdj_song_t* song, size_t index)
+// The parts of a song that the lsdj_song_foreach_ functions should visit
+typedef struct
 {
-    return song->phrases[index];
+    unsigned char chains[LSDJ_CHAIN_COUNT];
+    unsigned char phrases[LSDJ_PHRASE_COUNT];
+    unsigned char instruments[LSDJ_INSTRUMENT_COUNT];
+    unsigned char tables[LSDJ_TABLE_COUNT];
+} song_visit_set_t;
+
+// Mark the table an A command plays, returns whether it wasn't marked yet
+int mark_command_table(const lsdj_song_t* song, const lsdj_command_t* command, song_visit_set_t* set)
+{
+    if (command->command != LSDJ_COMMAND_A || command->value >= LSDJ_TABLE_COUNT || song->tables[command->value] == NULL || set->tables[command->value])
+        return 0;
+    
+    set->tables[command->value] = 1;
+    return 1;
 }
 
-lsdj_instrument_t* lsdj_song_get_instrument(lsdj_song_t* song, size_t index)
+// Find out what to visit. Only what's allocated is marked, so visiting doesn't need to check.
+void find_visit_set(const lsdj_song_t* song, unsigned int flags, song_visit_set_t* set)
 {
-    return song->instruments[index];
+    if ((flags & LSDJ_FOREACH_REACHABLE) == 0)
+    {
+        for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
+            set->chains[i] = song->chains[i] != NULL;
+        for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+            set->phrases[i] = song->phrases[i] != NULL;
+        for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+            set->instruments[i] = song->instruments[i] != NULL;
+        for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+            set->tables[i] = song->tables[i] != NULL;
+        return;
+    }
+    
+    memset(set, 0, sizeof(song_visit_set_t));
+    
+    for (int i = 0; i < LSDJ_ROW_COUNT; ++i)
+    {
+        for (int c = 0; c < LSDJ_CHANNEL_COUNT; ++c)
+        {
+            const unsigned char chain = song->rows[i].channels[c];
+            if (chain < LSDJ_CHAIN_COUNT && song->chains[chain])
+                set->chains[chain] = 1;
+        }
+    }
+    
+    for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
+    {
+        if (!set->chains[i])
+            continue;
+        
+        for (int row = 0; row < LSDJ_CHAIN_LENGTH; ++row)
+        {
+            const unsigned char phrase = song->chains[i]->phrases[row];
+            if (phrase < LSDJ_PHRASE_COUNT && song->phrases[phrase])
+                set->phrases[phrase] = 1;
+        }
+    }
+    
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+    {
+        if (!set->phrases[i])
+            continue;
+        
+        const lsdj_phrase_t* phrase = song->phrases[i];
+        for (int row = 0; row < LSDJ_PHRASE_LENGTH; ++row)
+        {
+            const unsigned char instrument = phrase->instruments[row];
+            if (instrument < LSDJ_INSTRUMENT_COUNT && song->instruments[instrument])
+                set->instruments[instrument] = 1;
+            
+            mark_command_table(song, &phrase->commands[row], set);
+        }
+    }
+    
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+    {
+        const unsigned char table = set->instruments[i] ? lsdj_instrument_get_table(song->instruments[i]) : LSDJ_NO_TABLE;
+        if (table < LSDJ_TABLE_COUNT && song->tables[table])
+            set->tables[table] = 1;
+    }
+    
+    // Tables can play other tables, so keep going until no new ones turn up
+    int found = 1;
+    while (found)
+    {
+        found = 0;
+        for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+        {
+            if (!set->tables[i])
+                continue;
+            
+            for (int row = 0; row < LSDJ_TABLE_LENGTH; ++row)
+            {
+                found |= mark_command_table(song, lsdj_table_get_command1_const(song->tables[i], (size_t)row), set);
+                found |= mark_command_table(song, lsdj_table_get_command2_const(song->tables[i], (size_t)row), set);
+            }
+        }
+    }
 }
 
-lsdj_synth_t* lsdj_song_get_synth(lsdj_song_t* song, size_t index)
+size_t lsdj_song_foreach_chain(const lsdj_song_t* song, unsigned int flags, lsdj_song_chain_visitor_t visitor, void* user_data)
 {
-    return &song->synths[index];
+    song_visit_set_t set;
+    find_visit_set(song, flags, &set);
+    
+    size_t count = 0;
+    for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
+    {
+        if (!set.chains[i])
+            continue;
+        
+        ++count;
+        if (visitor((size_t)i, song->chains[i], user_data))
+            break;
+    }
+    
+    return count;
 }
 
-lsdj_wave_t* lsdj_song_get_wave(lsdj_song_t* song, size_t index)
+size_t lsdj_song_foreach_phrase(const lsdj_song_t* song, unsigned int flags, lsdj_song_phrase_visitor_t visitor, void* user_data)
 {
-    return &song->waves[index];
+    song_visit_set_t set;
+    find_visit_set(song, flags, &set);
+    
+    size_t count = 0;
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+    {
+        if (!set.phrases[i])
+            continue;
+        
+        ++count;
+        if (visitor((size_t)i, song->phrases[i], user_data))
+            break;
+    }
+    
+    return count;
 }
 
-lsdj_table_t* lsdj_song_get_table(lsdj_song_t* song, size_t index)
+size_t lsdj_song_foreach_instrument(const lsdj_song_t* song, unsigned int flags, lsdj_song_instrument_visitor_t visitor, void* user_data)
 {
-    return song->tables[index];
+    song_visit_set_t set;
+    find_visit_set(song, flags, &set);
+    
+    size_t count = 0;
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+    {
+        if (!set.instruments[i])
+            continue;
+        
+        ++count;
+        if (visitor((size_t)i, song->instruments[i], user_data))
+            break;
+    }
+    
+    return count;
 }
 
-lsdj_groove_t* lsdj_song_get_groove(lsdj_song_t* song, size_t index)
+size_t lsdj_song_foreach_table(const lsdj_song_t* song, unsigned int flags, lsdj_song_table_visitor_t visitor, void* user_data)
 {
-    return &song->grooves[index];
+    song_visit_set_t set;
+    find_visit_set(song, flags, &set);
+    
+    size_t count = 0;
+    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+    {
+        if (!set.tables[i])
+            continue;
+        
+        ++count;
+        if (visitor((size_t)i, song->tables[i], user_data))
+            break;
+    }
+    
+    return count;
 }
 
-lsdj_word_t* lsdj_song_get_word(lsdj_song_t* song, size_t index)
+size_t lsdj_song_foreach_phrase_command(const lsdj_song_t* song, unsigned int flags, lsdj_song_command_visitor_t visitor, void* user_data)
 {
-    return &song->words[index];
+    song_visit_set_t set;
+    find_visit_set(song, flags, &set);
+    
+    size_t count = 0;
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+    {
+        if (!set.phrases[i])
+            continue;
+        
+        const lsdj_command_t* commands = song->phrases[i]->commands;
+        for (int row = 0; row < LSDJ_PHRASE_LENGTH; ++row)
+        {
+            if (commands[row].command == LSDJ_COMMAND_NONE)
+                continue;
+            
+            ++count;
+            if (visitor((size_t)i, (size_t)row, &commands[row], user_data))
+                return count;
+        }
+    }
+    
+    return count;
 }
 
-void lsdj_song_set_word_name(lsdj_song_t* song, size_t index, const char* data, size_t size)
+size_t lsdj_song_foreach_table_command(const lsdj_song_t* song, unsigned int flags, lsdj_song_command_visitor_t visitor, void* user_data)
 {
-    strncpy(song->wordNames[index], data, size < LSDJ_WORD_NAME_LENGTH ? size : LSDJ_WORD_NAME_LENGTH);
+    song_visit_set_t set;
+    find_visit_set(song, flags, &set);
+    
+    size_t count = 0;
+    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+    {
+        if (!set.tables[i])
+            continue;
+        
+        for (int row = 0; row < LSDJ_TABLE_LENGTH; ++row)
+        {
+            const lsdj_command_t* commands[2] = { lsdj_table_get_command1_const(song->tables[i], (size_t)row), lsdj_table_get_command2_const(song->tables[i], (size_t)row) };
+            for (int column = 0; column < 2; ++column)
+            {
+                if (commands[column]->command == LSDJ_COMMAND_NONE)
+                    continue;
+                
+                ++count;
+                if (visitor((size_t)i, (size_t)row, commands[column], user_data))
+                    return count;
+            }
+        }
+    }
+    
+    return count;
 }
 
-void lsdj_song_get_word_name(lsdj_song_t* song, size_t index, char* data, size_t size)
+void lsdj_song_memory_usage(const lsdj_song_t* song, lsdj_song_memory_usage_t* usage)
 {
-    const size_t len = strnlen(song->wordNames[index], LSDJ_WORD_NAME_LENGTH);
-    strncpy(data, song->wordNames[index], len);
-    for (size_t i = len; i < LSDJ_WORD_LENGTH; i += 1)
-        data[i] = '\0';
+    memset(usage, 0, sizeof(lsdj_song_memory_usage_t));
+    
+    for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
+        usage->chainCount += song->chains[i] ? 1 : 0;
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+        usage->phraseCount += song->phrases[i] ? 1 : 0;
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+        usage->instrumentCount += song->instruments[i] ? 1 : 0;
+    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+        usage->tableCount += song->tables[i] ? 1 : 0;
+    
+    usage->chainBytes = arena_size_for(usage->chainCount, 0, 0, 0);
+    usage->phraseBytes = arena_size_for(0, usage->phraseCount, 0, 0);
+    usage->instrumentBytes = arena_size_for(0, 0, usage->instrumentCount, 0);
+    usage->tableBytes = arena_size_for(0, 0, 0, usage->tableCount);
+    
+    usage->songBytes = sizeof(lsdj_song_t);
+    if (song->arena && song->ownsArena)
+    {
+        usage->arenaBytes = lsdj_arena_get_memory_usage(song->arena);
+        usage->arenaReferenceCount = lsdj_arena_get_reference_count(song->arena);
+    }
+    
+    usage->totalBytes = usage->songBytes + usage->arenaBytes;
 }
 
-void lsdj_song_set_bookmark(lsdj_song_t* song, lsdj_channel_t channel, size_t position, unsigned char bookmark)
+// Whether a chain, phrase, instrument or table holds the same as an unallocated one is written as
+int is_default_chain(const lsdj_chain_t* chain)
 {
-    song->bookmarks.channels[channel][position] = bookmark;
+    lsdj_chain_t empty;
+    lsdj_chain_clear(&empty);
+    return memcmp(chain, &empty, sizeof(lsdj_chain_t)) == 0;
 }
 
-unsigned char lsdj_song_get_bookmark(lsdj_song_t* song, lsdj_channel_t channel, size_t position)
+int is_default_phrase(const lsdj_phrase_t* phrase)
 {
-    return song->bookmarks.channels[channel][position];
+    lsdj_phrase_t empty;
+    lsdj_phrase_clear(&empty);
+    return memcmp(phrase, &empty, sizeof(lsdj_phrase_t)) == 0;
+}
+
+int is_default_instrument(const lsdj_instrument_t* instrument, unsigned char formatVersion)
+{
+    char name[LSDJ_INSTRUMENT_NAME_LENGTH];
+    lsdj_instrument_get_name(instrument, name, LSDJ_INSTRUMENT_NAME_LENGTH);
+    for (int i = 0; i < LSDJ_INSTRUMENT_NAME_LENGTH; ++i)
+    {
+        if (name[i] != 0)
+            return 0;
+    }
+    
+    // Instruments that can't be encoded are kept, they're clearly not default
+    lsdj_error_t* error = NULL;
+    unsigned char data[LSDJ_LSDJ_DEFAULT_INSTRUMENT_LENGTH];
+    lsdj_instrument_encode(instrument, formatVersion, data, &error);
+    if (error)
+    {
+        lsdj_error_free(error);
+        return 0;
+    }
+    
+    return memcmp(data, LSDJ_DEFAULT_INSTRUMENT, sizeof(data)) == 0;
+}
+
+int is_default_table(const lsdj_table_t* table)
+{
+    for (size_t i = 0; i < LSDJ_TABLE_LENGTH; ++i)
+    {
+        const lsdj_command_t* command1 = lsdj_table_get_command1_const(table, i);
+        const lsdj_command_t* command2 = lsdj_table_get_command2_const(table, i);
+        
+        if (lsdj_table_get_volume(table, i) != 0 || lsdj_table_get_transposition(table, i) != 0 ||
+            command1->command != 0 || command1->value != 0 || command2->command != 0 || command2->value != 0)
+            return 0;
+    }
+    
+    return 1;
+}
+
+size_t lsdj_song_shrink(lsdj_song_t* song, unsigned int flags, lsdj_error_t** error)
+{
+    // What the song has to keep. Without LSDJ_SONG_SHRINK_UNREACHABLE that's everything allocated.
+    song_visit_set_t keep;
+    find_visit_set(song, (flags & LSDJ_SONG_SHRINK_UNREACHABLE) ? LSDJ_FOREACH_REACHABLE : LSDJ_FOREACH_ALLOCATED, &keep);
+    
+    if (flags & LSDJ_SONG_SHRINK_DEFAULT)
+    {
+        for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
+            keep.chains[i] = keep.chains[i] && !is_default_chain(song->chains[i]);
+        for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+            keep.phrases[i] = keep.phrases[i] && !is_default_phrase(song->phrases[i]);
+        for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+            keep.instruments[i] = keep.instruments[i] && !is_default_instrument(song->instruments[i], song->formatVersion);
+        for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+            keep.tables[i] = keep.tables[i] && !is_default_table(song->tables[i]);
+    }
+    
+    // The old arena is only given back to the heap if nobody else holds on to it
+    size_t before = 0;
+    if (song->arena && song->ownsArena && lsdj_arena_get_reference_count(song->arena) == 1)
+        before = lsdj_arena_get_memory_usage(song->arena);
+    
+    // Unallocate what isn't kept, then repack the rest into a new arena
+    /*! The song's pointers are its own even when the arena is shared, and the old arena
+        is only let go of once everything has been copied out of it */
+    unsigned char dirty = 0;
+    for (int i = 0; i < LSDJ_CHAIN_COUNT; ++i)
+    {
+        if (song->chains[i] && !keep.chains[i])
+        {
+            song->chains[i] = NULL;
+            dirty |= LSDJ_SONG_BANK_1;
+        }
+    }
+    
+    for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
+    {
+        if (song->phrases[i] && !keep.phrases[i])
+        {
+            song->phrases[i] = NULL;
+            dirty |= LSDJ_SONG_ALL_BANKS;
+        }
+    }
+    
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+    {
+        if (song->instruments[i] && !keep.instruments[i])
+        {
+            song->instruments[i] = NULL;
+            dirty |= LSDJ_SONG_BANK_0 | LSDJ_SONG_BANK_1;
+        }
+    }
+    
+    for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
+    {
+        if (song->tables[i] && !keep.tables[i])
+        {
+            song->tables[i] = NULL;
+            dirty |= LSDJ_SONG_BANK_0 | LSDJ_SONG_BANK_1;
+        }
+    }
+    
+    song->dirty |= dirty;
+    
+    if (!copy_sub_objects(song, song, error))
+        return 0;
+    
+    const size_t after = lsdj_arena_get_memory_usage(song->arena);
+    return before > after ? before - after : 0;
 }
@@ -40,7 +40,9 @@
 extern "C" {
 #endif
 
+#include "arena.h"
 #include "chain.h"
+#include "compression.h"
 #include "groove.h"
 #include "instrument.h"
 #include "phrase.h"
@@ -67,6 +69,19 @@ extern "C" {
 #define LSDJ_CLONE_DEEP (0)
 #define LSDJ_CLONE_SLIM (1)
 
+// Addresses of song properties within the decompressed song data
+#define LSDJ_SONG_TEMPO_ADDRESS (0x3FB4)
+#define LSDJ_SONG_FILE_CHANGED_FLAG_ADDRESS (0x3FC1)
+#define LSDJ_SONG_FORMAT_VERSION_ADDRESS (0x7FFF)
+
+// The song image is split into four banks, these are the bits for each in a bank mask
+#define LSDJ_SONG_BANK_SIZE (0x2000)
+#define LSDJ_SONG_BANK_0 (1 << 0)
+#define LSDJ_SONG_BANK_1 (1 << 1)
+#define LSDJ_SONG_BANK_2 (1 << 2)
+#define LSDJ_SONG_BANK_3 (1 << 3)
+#define LSDJ_SONG_ALL_BANKS (LSDJ_SONG_BANK_0 | LSDJ_SONG_BANK_1 | LSDJ_SONG_BANK_2 | LSDJ_SONG_BANK_3)
+
 // An LSDJ song
 typedef struct lsdj_song_t lsdj_song_t;
 
@@ -75,14 +90,42 @@ lsdj_song_t* lsdj_song_new(lsdj_error_t** error);
 lsdj_song_t* lsdj_song_copy(const lsdj_song_t* song, lsdj_error_t** error);
 void lsdj_song_free(lsdj_song_t* song);
 
+// Copy a song, sharing the chains, phrases, instruments and tables with the original
+/*! Whichever song first asks for one of those through lsdj_song_get_chain(), _phrase(),
+    _instrument() or _table() gets its own copy of them at that point. This makes copies
+    that are mostly read from cheap. Those getters return NULL if making the copy fails. */
+lsdj_song_t* lsdj_song_copy_shallow(const lsdj_song_t* song, lsdj_error_t** error);
+
+// Whether a song still shares its chains, phrases, instruments and tables with another
+int lsdj_song_is_shared(const lsdj_song_t* song);
+
 // Deserialize a song
 lsdj_song_t* lsdj_song_read(lsdj_vio_t* vio, lsdj_error_t** error);
 lsdj_song_t* lsdj_song_read_from_memory(const unsigned char* data, size_t size, lsdj_error_t** error);
+
+// Deserialize a song, taking its chains, phrases, instruments and tables from an arena you own
+/*! The arena needs to outlive the song. Once it's full, reading fails. Use
+    lsdj_song_get_max_arena_size() to be sure any song fits. Arenas can be
+    reset and reused once every song read into them has been freed. */
+lsdj_song_t* lsdj_song_read_in_arena(lsdj_vio_t* vio, lsdj_arena_t* arena, lsdj_error_t** error);
+
+// The arena size that fits the chains, phrases, instruments and tables of any song
+size_t lsdj_song_get_max_arena_size(void);
     
 // Serialize a song
 void lsdj_song_write(const lsdj_song_t* song, lsdj_vio_t* vio, lsdj_error_t** error);
 void lsdj_song_write_to_memory(const lsdj_song_t* song, unsigned char* data, size_t size, lsdj_error_t** error);
 
+// Patch only the banks of a song that changed since it was read into an existing image
+/*! data should hold the image the song was read from (or an earlier write of it). Banks
+    that weren't touched are left alone. This doesn't clear the dirty banks. */
+void lsdj_song_write_dirty_banks_to_memory(const lsdj_song_t* song, unsigned char* data, size_t size, lsdj_error_t** error);
+
+// The amount of blocks the song would take when compressed into a sav
+/*! Counts the blocks for songs compressed the given way, without compressing anything.
+    This can be more than fit in a sav. Returns 0 on error. */
+unsigned int lsdj_song_compressed_block_count(const lsdj_song_t* song, lsdj_compression_mode_t mode, lsdj_error_t** error);
+
 // Change data in a song
 void lsdj_song_set_format_version(lsdj_song_t* song, unsigned char version);
 unsigned char lsdj_song_get_format_version(const lsdj_song_t* song);
@@ -104,9 +147,123 @@ lsdj_table_t* lsdj_song_get_table(lsdj_song_t* song, size_t index);
 lsdj_groove_t* lsdj_song_get_groove(lsdj_song_t* song, size_t index);
 lsdj_word_t* lsdj_song_get_word(lsdj_song_t* song, size_t index);
 void lsdj_song_set_word_name(lsdj_song_t* song, size_t index, const char* data, size_t size);
-void lsdj_song_get_word_name(lsdj_song_t* song, size_t index, char* data, size_t size);
+void lsdj_song_get_word_name(const lsdj_song_t* song, size_t index, char* data, size_t size);
 void lsdj_song_set_bookmark(lsdj_song_t* song, lsdj_channel_t channel, size_t position, unsigned char bookmark);
-unsigned char lsdj_song_get_bookmark(lsdj_song_t* song, lsdj_channel_t channel, size_t position);
+unsigned char lsdj_song_get_bookmark(const lsdj_song_t* song, lsdj_channel_t channel, size_t position);
+
+// Read-only access to the data in a song
+/*! Unlike the getters above these don't mark the song dirty, nor unshare its arena, so
+    they never change the song. Any number of threads can use them (and every other
+    function taking a const song) on the same song at once, as long as nobody changes it
+    in the meantime. Chains, phrases, instruments and tables are NULL when unallocated. */
+const lsdj_row_t* lsdj_song_get_row_const(const lsdj_song_t* song, size_t index);
+const lsdj_chain_t* lsdj_song_get_chain_const(const lsdj_song_t* song, size_t index);
+const lsdj_phrase_t* lsdj_song_get_phrase_const(const lsdj_song_t* song, size_t index);
+const lsdj_instrument_t* lsdj_song_get_instrument_const(const lsdj_song_t* song, size_t index);
+const lsdj_synth_t* lsdj_song_get_synth_const(const lsdj_song_t* song, size_t index);
+const lsdj_wave_t* lsdj_song_get_wave_const(const lsdj_song_t* song, size_t index);
+const lsdj_table_t* lsdj_song_get_table_const(const lsdj_song_t* song, size_t index);
+const lsdj_groove_t* lsdj_song_get_groove_const(const lsdj_song_t* song, size_t index);
+const lsdj_word_t* lsdj_song_get_word_const(const lsdj_song_t* song, size_t index);
+
+// What lsdj_song_map_commands() rewrites
+#define LSDJ_MAP_PHRASE_COMMANDS (1 << 0)
+#define LSDJ_MAP_TABLE_COMMANDS (1 << 1)
+
+// Rewrite the commands in every phrase and/or table of the song through a command map
+/*! filter is a combination of the LSDJ_MAP_ flags above. Returns the amount of command
+    values that were changed. If that's none, the song isn't touched or marked dirty. */
+size_t lsdj_song_map_commands(lsdj_song_t* song, unsigned int filter, const lsdj_command_map_t* map);
+
+// Count the command values that lsdj_song_map_commands() would change, without changing them
+size_t lsdj_song_count_mapped_commands(const lsdj_song_t* song, unsigned int filter, const lsdj_command_map_t* map);
+
+// Change the panning of every instrument in the song, mapping[panning] being the new panning
+/*! Returns the amount of instruments that were changed. If that's none, the song isn't
+    touched or marked dirty. */
+size_t lsdj_song_map_instrument_panning(lsdj_song_t* song, const lsdj_panning mapping[4]);
+
+// Count the instruments that lsdj_song_map_instrument_panning() would change
+size_t lsdj_song_count_mapped_instrument_panning(const lsdj_song_t* song, const lsdj_panning mapping[4]);
+    
+// Which parts of a song the lsdj_song_foreach_ functions visit
+/*! By default that's everything that is allocated. LSDJ_FOREACH_REACHABLE limits it to what
+    the song rows can reach: their chains, the phrases in those, the instruments played in
+    those phrases, and the tables of those instruments or of A commands (in tables, too). */
+#define LSDJ_FOREACH_ALLOCATED (0)
+#define LSDJ_FOREACH_REACHABLE (1 << 0)
+
+// Callbacks for the lsdj_song_foreach_ functions, return non-zero to stop visiting
+typedef int (*lsdj_song_chain_visitor_t)(size_t index, const lsdj_chain_t* chain, void* user_data);
+typedef int (*lsdj_song_phrase_visitor_t)(size_t index, const lsdj_phrase_t* phrase, void* user_data);
+typedef int (*lsdj_song_instrument_visitor_t)(size_t index, const lsdj_instrument_t* instrument, void* user_data);
+typedef int (*lsdj_song_table_visitor_t)(size_t index, const lsdj_table_t* table, void* user_data);
+typedef int (*lsdj_song_command_visitor_t)(size_t index, size_t row, const lsdj_command_t* command, void* user_data);
+
+// Visit the chains, phrases, instruments or tables of a song in index order
+/*! Unallocated entries are skipped without calling back. flags is LSDJ_FOREACH_ALLOCATED or
+    LSDJ_FOREACH_REACHABLE. Returns the amount of entries that were visited. */
+size_t lsdj_song_foreach_chain(const lsdj_song_t* song, unsigned int flags, lsdj_song_chain_visitor_t visitor, void* user_data);
+size_t lsdj_song_foreach_phrase(const lsdj_song_t* song, unsigned int flags, lsdj_song_phrase_visitor_t visitor, void* user_data);
+size_t lsdj_song_foreach_instrument(const lsdj_song_t* song, unsigned int flags, lsdj_song_instrument_visitor_t visitor, void* user_data);
+size_t lsdj_song_foreach_table(const lsdj_song_t* song, unsigned int flags, lsdj_song_table_visitor_t visitor, void* user_data);
+
+// Visit the commands in the phrases or tables of a song, skipping empty ones
+/*! index is that of the phrase or table. Table rows have two commands, which are visited
+    in column order. Returns the amount of commands that were visited. */
+size_t lsdj_song_foreach_phrase_command(const lsdj_song_t* song, unsigned int flags, lsdj_song_command_visitor_t visitor, void* user_data);
+size_t lsdj_song_foreach_table_command(const lsdj_song_t* song, unsigned int flags, lsdj_song_command_visitor_t visitor, void* user_data);
+
+// How much heap memory a song takes, and what for
+/*! The object bytes are the part of the arena taken up by each kind of object. An arena
+    shared with shallow copies is counted in full for every song sharing it, check
+    arenaReferenceCount to tell. Arenas passed to lsdj_song_read_in_arena() belong to the
+    caller, so they aren't counted in arenaBytes or totalBytes. */
+typedef struct
+{
+    size_t songBytes;
+    size_t arenaBytes;
+    size_t totalBytes;
+    
+    size_t chainBytes;
+    size_t phraseBytes;
+    size_t instrumentBytes;
+    size_t tableBytes;
+    
+    unsigned int chainCount;
+    unsigned int phraseCount;
+    unsigned int instrumentCount;
+    unsigned int tableCount;
+    
+    unsigned int arenaReferenceCount;
+} lsdj_song_memory_usage_t;
+
+// Find out how much memory a song takes
+void lsdj_song_memory_usage(const lsdj_song_t* song, lsdj_song_memory_usage_t* usage);
+
+// What lsdj_song_shrink() drops
+/*! Unreachable is everything LSDJ_FOREACH_REACHABLE wouldn't visit. Default objects are the
+    ones that hold nothing but what an unallocated slot is written out as. */
+#define LSDJ_SONG_SHRINK_UNREACHABLE (1 << 0)
+#define LSDJ_SONG_SHRINK_DEFAULT (1 << 1)
+
+// Free the chains, phrases, instruments and tables a song doesn't need
+/*! flags is a combination of the LSDJ_SONG_SHRINK_ flags above. Whatever is left is moved
+    into an arena of its own that fits it exactly, so this also stops sharing with shallow
+    copies. Returns the amount of heap bytes that were freed, which can be 0 when the old
+    arena was shared or not owned by the song. If the new arena can't be made, the dropped
+    objects stay unallocated but nothing is freed. */
+size_t lsdj_song_shrink(lsdj_song_t* song, unsigned int flags, lsdj_error_t** error);
+
+// Whether the song might have been changed since it was read
+/*! Every setter (and getter handing out non-const access) raises this flag. Projects use it
+    to find out whether the compressed blocks they were read from are still up to date. */
+void lsdj_song_set_dirty_flag(lsdj_song_t* song, unsigned char dirty);
+unsigned char lsdj_song_get_dirty_flag(const lsdj_song_t* song);
+
+// Which of the 8KB banks of the song image might have changed since it was read
+/*! A combination of the LSDJ_SONG_BANK_ bits. Setting the dirty flag marks every bank. */
+unsigned char lsdj_song_get_dirty_banks(const lsdj_song_t* song);
     
 #ifdef __cplusplus
 }
@@ -0,0 +1,91 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_SONG_LAYOUT_H
+#define LSDJ_SONG_LAYOUT_H
+
+// Where everything lives in a decompressed song image
+/*! These follow the order in which read_bank0() through read_bank3() walk the image */
+#define SONG_PHRASE_NOTES_ADDRESS (0x0000)
+#define SONG_BOOKMARKS_ADDRESS (0x0FF0)
+#define SONG_RESERVED_1030_ADDRESS (0x1030)
+#define SONG_GROOVES_ADDRESS (0x1090)
+#define SONG_ROWS_ADDRESS (0x1290)
+#define SONG_TABLE_VOLUMES_ADDRESS (0x1690)
+#define SONG_WORDS_ADDRESS (0x1890)
+#define SONG_WORD_NAMES_ADDRESS (0x1DD0)
+#define SONG_RB0_ADDRESS (0x1E78)
+#define SONG_INSTRUMENT_NAMES_ADDRESS (0x1E7A)
+#define SONG_RESERVED_1FBA_ADDRESS (0x1FBA)
+
+#define SONG_RESERVED_2000_ADDRESS (0x2000)
+#define SONG_TABLE_ALLOC_TABLE_ADDRESS (0x2020)
+#define SONG_INSTR_ALLOC_TABLE_ADDRESS (0x2040)
+#define SONG_CHAIN_PHRASES_ADDRESS (0x2080)
+#define SONG_CHAIN_TRANSPOSITIONS_ADDRESS (0x2880)
+#define SONG_INSTRUMENTS_ADDRESS (0x3080)
+#define SONG_TABLE_TRANSPOSITIONS_ADDRESS (0x3480)
+#define SONG_TABLE_COMMAND1_ADDRESS (0x3680)
+#define SONG_TABLE_VALUE1_ADDRESS (0x3880)
+#define SONG_TABLE_COMMAND2_ADDRESS (0x3A80)
+#define SONG_TABLE_VALUE2_ADDRESS (0x3C80)
+#define SONG_RB1_ADDRESS (0x3E80)
+#define SONG_PHRASE_ALLOC_TABLE_ADDRESS (0x3E82)
+#define SONG_CHAIN_ALLOC_TABLE_ADDRESS (0x3EA2)
+#define SONG_SYNTHS_ADDRESS (0x3EB2)
+#define SONG_WORK_TIME_ADDRESS (0x3FB2)
+#define SONG_TRANSPOSITION_ADDRESS (0x3FB5)
+#define SONG_TOTAL_TIME_ADDRESS (0x3FB6)
+#define SONG_META_ADDRESS (0x3FB9)
+#define SONG_WAVE_SYNTH_LOCKS_ADDRESS (0x3FC4)
+#define SONG_RESERVED_3FC6_ADDRESS (0x3FC6)
+#define SONG_DRUM_MAX_ADDRESS (0x3FD0)
+#define SONG_RESERVED_3FD1_ADDRESS (0x3FD1)
+
+#define SONG_PHRASE_COMMANDS_ADDRESS (0x4000)
+#define SONG_PHRASE_VALUES_ADDRESS (0x4FF0)
+#define SONG_RESERVED_5FE0_ADDRESS (0x5FE0)
+
+#define SONG_WAVES_ADDRESS (0x6000)
+#define SONG_PHRASE_INSTRUMENTS_ADDRESS (0x7000)
+#define SONG_RB2_ADDRESS (0x7FF0)
+#define SONG_RESERVED_7FF2_ADDRESS (0x7FF2)
+
+// The amount of bytes a single instrument and soft synth take up in the image
+#define SONG_INSTRUMENT_BYTE_COUNT (16)
+#define SONG_SYNTH_BYTE_COUNT (16)
+
+#endif
@@ -0,0 +1,324 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "song_layout.h"
+#include "song_view.h"
+#include "vio.h"
+
+struct lsdj_song_view_t
+{
+    // The decompressed song image
+    const unsigned char* data;
+    
+    // The file the image was mapped from, if the view owns it
+    lsdj_mapped_file_t* file;
+};
+
+lsdj_song_view_t* create_view(const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    if (data == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
+        return NULL;
+    }
+    
+    if (size < LSDJ_SONG_DECOMPRESSED_SIZE)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_SPACE, "memory is not big enough to store song");
+        return NULL;
+    }
+    
+    // Check if the 'rb' flags have been set correctly
+    if (memcmp(data + 0x1E78, "rb", 2) != 0) { lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "memory flag 'rb' not found at 0x1E78"); return NULL; }
+    if (memcmp(data + 0x3E80, "rb", 2) != 0) { lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "memory flag 'rb' not found at 0x3E80"); return NULL; }
+    if (memcmp(data + 0x7FF0, "rb", 2) != 0) { lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "memory flag 'rb' not found at 0x7FF0"); return NULL; }
+    
+    lsdj_song_view_t* view = (lsdj_song_view_t*)lsdj_malloc(sizeof(lsdj_song_view_t));
+    if (view == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate song view");
+        return NULL;
+    }
+    
+    view->data = data;
+    view->file = NULL;
+    
+    return view;
+}
+
+lsdj_song_view_t* lsdj_song_view_new(const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    return create_view(data, size, error);
+}
+
+lsdj_song_view_t* lsdj_song_view_open(const char* path, size_t offset, lsdj_error_t** error)
+{
+    lsdj_mapped_file_t* file = lsdj_mapped_file_open(path, error);
+    if (file == NULL)
+        return NULL;
+    
+    const size_t size = lsdj_mapped_file_get_size(file);
+    if (offset > size)
+    {
+        lsdj_mapped_file_close(file);
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "song offset lies beyond the end of the file");
+        return NULL;
+    }
+    
+    lsdj_song_view_t* view = create_view(lsdj_mapped_file_get_data(file) + offset, size - offset, error);
+    if (view == NULL)
+    {
+        lsdj_mapped_file_close(file);
+        return NULL;
+    }
+    
+    view->file = file;
+    
+    return view;
+}
+
+void lsdj_song_view_free(lsdj_song_view_t* view)
+{
+    if (view == NULL)
+        return;
+    
+    if (view->file)
+        lsdj_mapped_file_close(view->file);
+    
+    lsdj_free(view);
+}
+
+const unsigned char* lsdj_song_view_get_data(const lsdj_song_view_t* view)
+{
+    return view->data;
+}
+
+unsigned char lsdj_song_view_get_format_version(const lsdj_song_view_t* view)
+{
+    return view->data[LSDJ_SONG_FORMAT_VERSION_ADDRESS];
+}
+
+unsigned char lsdj_song_view_get_tempo(const lsdj_song_view_t* view)
+{
+    return view->data[LSDJ_SONG_TEMPO_ADDRESS];
+}
+
+unsigned char lsdj_song_view_get_transposition(const lsdj_song_view_t* view)
+{
+    return view->data[SONG_TRANSPOSITION_ADDRESS];
+}
+
+unsigned char lsdj_song_view_get_file_changed_flag(const lsdj_song_view_t* view)
+{
+    return view->data[LSDJ_SONG_FILE_CHANGED_FLAG_ADDRESS];
+}
+
+unsigned char lsdj_song_view_get_drum_max(const lsdj_song_view_t* view)
+{
+    return view->data[SONG_DRUM_MAX_ADDRESS];
+}
+
+const lsdj_row_t* lsdj_song_view_get_row(const lsdj_song_view_t* view, size_t index)
+{
+    return (const lsdj_row_t*)(view->data + SONG_ROWS_ADDRESS + index * sizeof(lsdj_row_t));
+}
+
+const lsdj_wave_t* lsdj_song_view_get_wave(const lsdj_song_view_t* view, size_t index)
+{
+    return (const lsdj_wave_t*)(view->data + SONG_WAVES_ADDRESS + index * sizeof(lsdj_wave_t));
+}
+
+const lsdj_groove_t* lsdj_song_view_get_groove(const lsdj_song_view_t* view, size_t index)
+{
+    return (const lsdj_groove_t*)(view->data + SONG_GROOVES_ADDRESS + index * sizeof(lsdj_groove_t));
+}
+
+const lsdj_word_t* lsdj_song_view_get_word(const lsdj_song_view_t* view, size_t index)
+{
+    return (const lsdj_word_t*)(view->data + SONG_WORDS_ADDRESS + index * sizeof(lsdj_word_t));
+}
+
+void copy_name(const unsigned char* name, size_t length, char* data, size_t size)
+{
+    const size_t len = strnlen((const char*)name, length < size ? length : size);
+    memcpy(data, name, len);
+    memset(data + len, '\0', size - len);
+}
+
+void lsdj_song_view_get_word_name(const lsdj_song_view_t* view, size_t index, char* data, size_t size)
+{
+    copy_name(view->data + SONG_WORD_NAMES_ADDRESS + index * LSDJ_WORD_NAME_LENGTH, LSDJ_WORD_NAME_LENGTH, data, size);
+}
+
+unsigned char lsdj_song_view_get_bookmark(const lsdj_song_view_t* view, lsdj_channel_t channel, size_t position)
+{
+    // Indexed the same way as lsdj_song_get_bookmark()
+    return view->data[SONG_BOOKMARKS_ADDRESS + channel * LSDJ_CHANNEL_COUNT + position];
+}
+
+int lsdj_song_view_has_chain(const lsdj_song_view_t* view, size_t chain)
+{
+    return (view->data[SONG_CHAIN_ALLOC_TABLE_ADDRESS + chain / 8] >> (chain % 8)) & 1;
+}
+
+unsigned char lsdj_song_view_get_chain_phrase(const lsdj_song_view_t* view, size_t chain, size_t row)
+{
+    return view->data[SONG_CHAIN_PHRASES_ADDRESS + chain * LSDJ_CHAIN_LENGTH + row];
+}
+
+unsigned char lsdj_song_view_get_chain_transposition(const lsdj_song_view_t* view, size_t chain, size_t row)
+{
+    return view->data[SONG_CHAIN_TRANSPOSITIONS_ADDRESS + chain * LSDJ_CHAIN_LENGTH + row];
+}
+
+int lsdj_song_view_has_phrase(const lsdj_song_view_t* view, size_t phrase)
+{
+    return (view->data[SONG_PHRASE_ALLOC_TABLE_ADDRESS + phrase / 8] >> (phrase % 8)) & 1;
+}
+
+unsigned char lsdj_song_view_get_phrase_note(const lsdj_song_view_t* view, size_t phrase, size_t row)
+{
+    return view->data[SONG_PHRASE_NOTES_ADDRESS + phrase * LSDJ_PHRASE_LENGTH + row];
+}
+
+unsigned char lsdj_song_view_get_phrase_instrument(const lsdj_song_view_t* view, size_t phrase, size_t row)
+{
+    return view->data[SONG_PHRASE_INSTRUMENTS_ADDRESS + phrase * LSDJ_PHRASE_LENGTH + row];
+}
+
+lsdj_command_t lsdj_song_view_get_phrase_command(const lsdj_song_view_t* view, size_t phrase, size_t row)
+{
+    const size_t offset = phrase * LSDJ_PHRASE_LENGTH + row;
+    
+    lsdj_command_t command;
+    command.command = view->data[SONG_PHRASE_COMMANDS_ADDRESS + offset];
+    command.value = view->data[SONG_PHRASE_VALUES_ADDRESS + offset];
+    
+    return command;
+}
+
+int lsdj_song_view_has_table(const lsdj_song_view_t* view, size_t table)
+{
+    return view->data[SONG_TABLE_ALLOC_TABLE_ADDRESS + table] != 0;
+}
+
+unsigned char lsdj_song_view_get_table_volume(const lsdj_song_view_t* view, size_t table, size_t row)
+{
+    return view->data[SONG_TABLE_VOLUMES_ADDRESS + table * LSDJ_TABLE_LENGTH + row];
+}
+
+unsigned char lsdj_song_view_get_table_transposition(const lsdj_song_view_t* view, size_t table, size_t row)
+{
+    return view->data[SONG_TABLE_TRANSPOSITIONS_ADDRESS + table * LSDJ_TABLE_LENGTH + row];
+}
+
+lsdj_command_t lsdj_song_view_get_table_command1(const lsdj_song_view_t* view, size_t table, size_t row)
+{
+    const size_t offset = table * LSDJ_TABLE_LENGTH + row;
+    
+    lsdj_command_t command;
+    command.command = view->data[SONG_TABLE_COMMAND1_ADDRESS + offset];
+    command.value = view->data[SONG_TABLE_VALUE1_ADDRESS + offset];
+    
+    return command;
+}
+
+lsdj_command_t lsdj_song_view_get_table_command2(const lsdj_song_view_t* view, size_t table, size_t row)
+{
+    const size_t offset = table * LSDJ_TABLE_LENGTH + row;
+    
+    lsdj_command_t command;
+    command.command = view->data[SONG_TABLE_COMMAND2_ADDRESS + offset];
+    command.value = view->data[SONG_TABLE_VALUE2_ADDRESS + offset];
+    
+    return command;
+}
+
+int lsdj_song_view_has_instrument(const lsdj_song_view_t* view, size_t instrument)
+{
+    return view->data[SONG_INSTR_ALLOC_TABLE_ADDRESS + instrument] != 0;
+}
+
+instrument_type lsdj_song_view_get_instrument_type(const lsdj_song_view_t* view, size_t instrument)
+{
+    return (instrument_type)view->data[SONG_INSTRUMENTS_ADDRESS + instrument * SONG_INSTRUMENT_BYTE_COUNT];
+}
+
+void lsdj_song_view_get_instrument_name(const lsdj_song_view_t* view, size_t instrument, char* data, size_t size)
+{
+    copy_name(view->data + SONG_INSTRUMENT_NAMES_ADDRESS + instrument * LSDJ_INSTRUMENT_NAME_LENGTH, LSDJ_INSTRUMENT_NAME_LENGTH, data, size);
+}
+
+lsdj_instrument_t* lsdj_song_view_read_instrument(const lsdj_song_view_t* view, size_t instrument, lsdj_error_t** error)
+{
+    if (!lsdj_song_view_has_instrument(view, instrument))
+        return NULL;
+    
+    lsdj_instrument_t* result = lsdj_instrument_new();
+    if (result == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate instrument");
+        return NULL;
+    }
+    
+    // Only the 16 bytes of this one instrument are parsed
+    lsdj_memory_data_t memory;
+    memory.begin = (unsigned char*)view->data + SONG_INSTRUMENTS_ADDRESS + instrument * SONG_INSTRUMENT_BYTE_COUNT;
+    memory.cur = memory.begin;
+    memory.size = SONG_INSTRUMENT_BYTE_COUNT;
+    
+    lsdj_vio_t vio;
+    vio.read = lsdj_mread;
+    vio.write = NULL;
+    vio.tell = lsdj_mtell;
+    vio.seek = lsdj_mseek;
+    vio.user_data = &memory;
+    
+    lsdj_instrument_read(&vio, lsdj_song_view_get_format_version(view), result, error);
+    if (error && *error)
+    {
+        lsdj_instrument_free(result);
+        return NULL;
+    }
+    
+    lsdj_instrument_set_name(result, (const char*)view->data + SONG_INSTRUMENT_NAMES_ADDRESS + instrument * LSDJ_INSTRUMENT_NAME_LENGTH, LSDJ_INSTRUMENT_NAME_LENGTH);
+    
+    return result;
+}
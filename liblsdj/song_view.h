@@ -0,0 +1,119 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_SONG_VIEW_H
+#define LSDJ_SONG_VIEW_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "command.h"
+#include "error.h"
+#include "groove.h"
+#include "instrument.h"
+#include "row.h"
+#include "song.h"
+#include "wave.h"
+#include "word.h"
+
+// A read-only view of a decompressed song, straight on top of its raw bytes
+/*! Nothing is parsed up front, every getter reads from the song image itself. This is
+    much cheaper than lsdj_song_read() when only a handful of fields are needed. */
+typedef struct lsdj_song_view_t lsdj_song_view_t;
+
+// Create a view on top of a decompressed song image
+/*! The view only borrows the data, which should stay alive as long as the view */
+lsdj_song_view_t* lsdj_song_view_new(const unsigned char* data, size_t size, lsdj_error_t** error);
+
+// Create a view on top of a memory mapped file
+/*! The song image starts at offset, which is 0 for the working memory song of a sav */
+lsdj_song_view_t* lsdj_song_view_open(const char* path, size_t offset, lsdj_error_t** error);
+
+void lsdj_song_view_free(lsdj_song_view_t* view);
+
+// Retrieve the raw song image underneath the view
+const unsigned char* lsdj_song_view_get_data(const lsdj_song_view_t* view);
+
+// Retrieve song properties
+unsigned char lsdj_song_view_get_format_version(const lsdj_song_view_t* view);
+unsigned char lsdj_song_view_get_tempo(const lsdj_song_view_t* view);
+unsigned char lsdj_song_view_get_transposition(const lsdj_song_view_t* view);
+unsigned char lsdj_song_view_get_file_changed_flag(const lsdj_song_view_t* view);
+unsigned char lsdj_song_view_get_drum_max(const lsdj_song_view_t* view);
+
+// Retrieve the sequence rows, waves, grooves and words, which are laid out in the image as-is
+const lsdj_row_t* lsdj_song_view_get_row(const lsdj_song_view_t* view, size_t index);
+const lsdj_wave_t* lsdj_song_view_get_wave(const lsdj_song_view_t* view, size_t index);
+const lsdj_groove_t* lsdj_song_view_get_groove(const lsdj_song_view_t* view, size_t index);
+const lsdj_word_t* lsdj_song_view_get_word(const lsdj_song_view_t* view, size_t index);
+void lsdj_song_view_get_word_name(const lsdj_song_view_t* view, size_t index, char* data, size_t size);
+unsigned char lsdj_song_view_get_bookmark(const lsdj_song_view_t* view, lsdj_channel_t channel, size_t position);
+
+// Retrieve chain data
+/*! The chain itself should be allocated, or the values are meaningless */
+int lsdj_song_view_has_chain(const lsdj_song_view_t* view, size_t chain);
+unsigned char lsdj_song_view_get_chain_phrase(const lsdj_song_view_t* view, size_t chain, size_t row);
+unsigned char lsdj_song_view_get_chain_transposition(const lsdj_song_view_t* view, size_t chain, size_t row);
+
+// Retrieve phrase data
+/*! The phrase itself should be allocated, or the values are meaningless */
+int lsdj_song_view_has_phrase(const lsdj_song_view_t* view, size_t phrase);
+unsigned char lsdj_song_view_get_phrase_note(const lsdj_song_view_t* view, size_t phrase, size_t row);
+unsigned char lsdj_song_view_get_phrase_instrument(const lsdj_song_view_t* view, size_t phrase, size_t row);
+lsdj_command_t lsdj_song_view_get_phrase_command(const lsdj_song_view_t* view, size_t phrase, size_t row);
+
+// Retrieve table data
+/*! The table itself should be allocated, or the values are meaningless */
+int lsdj_song_view_has_table(const lsdj_song_view_t* view, size_t table);
+unsigned char lsdj_song_view_get_table_volume(const lsdj_song_view_t* view, size_t table, size_t row);
+unsigned char lsdj_song_view_get_table_transposition(const lsdj_song_view_t* view, size_t table, size_t row);
+lsdj_command_t lsdj_song_view_get_table_command1(const lsdj_song_view_t* view, size_t table, size_t row);
+lsdj_command_t lsdj_song_view_get_table_command2(const lsdj_song_view_t* view, size_t table, size_t row);
+
+// Retrieve instrument data
+/*! Instruments are packed into bit fields that depend on their type, so the full instrument
+    is only available by reading it. That returns NULL for unallocated instruments. */
+int lsdj_song_view_has_instrument(const lsdj_song_view_t* view, size_t instrument);
+instrument_type lsdj_song_view_get_instrument_type(const lsdj_song_view_t* view, size_t instrument);
+void lsdj_song_view_get_instrument_name(const lsdj_song_view_t* view, size_t instrument, char* data, size_t size);
+lsdj_instrument_t* lsdj_song_view_read_instrument(const lsdj_song_view_t* view, size_t instrument, lsdj_error_t** error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
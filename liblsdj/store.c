@@ -0,0 +1,862 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "codec.h"
+#include "compression.h"
+#include "hash.h"
+#include "song_layout.h"
+#include "song_view.h"
+#include "store.h"
+
+#define STORE_MAGIC "LSDJSTOR"
+#define STORE_MAGIC_LENGTH (8)
+#define STORE_VERSION (1)
+
+// The sizes of the records that are deduplicated
+#define STORE_WAVE_SIZE (LSDJ_WAVE_LENGTH)
+#define STORE_INSTRUMENT_SIZE (SONG_INSTRUMENT_BYTE_COUNT + LSDJ_INSTRUMENT_NAME_LENGTH)
+#define STORE_TABLE_COLUMN_COUNT (6)
+#define STORE_TABLE_SIZE (STORE_TABLE_COLUMN_COUNT * LSDJ_TABLE_LENGTH)
+
+// The amount of references a song holds, and with that its size on disk
+#define STORE_REFERENCE_COUNT (LSDJ_WAVE_COUNT + LSDJ_INSTRUMENT_COUNT + LSDJ_TABLE_COUNT)
+
+// The columns a table consists of, which are spread out over the song image
+static const size_t STORE_TABLE_COLUMNS[STORE_TABLE_COLUMN_COUNT] =
+{
+    SONG_TABLE_VOLUMES_ADDRESS,
+    SONG_TABLE_TRANSPOSITIONS_ADDRESS,
+    SONG_TABLE_COMMAND1_ADDRESS,
+    SONG_TABLE_VALUE1_ADDRESS,
+    SONG_TABLE_COMMAND2_ADDRESS,
+    SONG_TABLE_VALUE2_ADDRESS
+};
+
+// A set of unique records of the same size, looked up by their hash
+typedef struct
+{
+    size_t recordSize;
+    
+    unsigned char* records;
+    uint64_t* hashes;
+    uint32_t count;
+    uint32_t capacity;
+    
+    // Open addressing table of record indices plus one, 0 means empty
+    uint32_t* slots;
+    uint32_t slotCount;
+} store_pool_t;
+
+// A song in the store, referring to its waves, instruments and tables
+typedef struct
+{
+    uint32_t waves[LSDJ_WAVE_COUNT];
+    uint32_t instruments[LSDJ_INSTRUMENT_COUNT];
+    uint32_t tables[LSDJ_TABLE_COUNT];
+    
+    // One bit for every instrument that is allocated
+    uint64_t allocatedInstruments;
+    unsigned char formatVersion;
+    
+    // The rest of the song image, compressed, with the records taken out
+    unsigned char* blocks;
+    unsigned int blockCount;
+} store_song_t;
+
+struct lsdj_store_t
+{
+    store_pool_t waves;
+    store_pool_t instruments;
+    store_pool_t tables;
+    
+    store_song_t** songs;
+    size_t songCount;
+    size_t songCapacity;
+    
+    // Scratch memory for compressing songs that are added
+    lsdj_codec_context_t* context;
+};
+
+
+// --- Pools --- //
+
+void store_pool_init(store_pool_t* pool, size_t recordSize)
+{
+    memset(pool, 0, sizeof(store_pool_t));
+    pool->recordSize = recordSize;
+}
+
+void store_pool_free(store_pool_t* pool)
+{
+    lsdj_free(pool->records);
+    lsdj_free(pool->hashes);
+    lsdj_free(pool->slots);
+}
+
+const unsigned char* store_pool_get(const store_pool_t* pool, uint32_t index)
+{
+    assert(index < pool->count);
+    return pool->records + (size_t)index * pool->recordSize;
+}
+
+void store_pool_insert_slot(uint32_t* slots, uint32_t slotCount, uint64_t hash, uint32_t index)
+{
+    uint32_t slot = (uint32_t)(hash & (slotCount - 1));
+    while (slots[slot] != 0)
+        slot = (slot + 1) & (slotCount - 1);
+    
+    slots[slot] = index + 1;
+}
+
+// Make room for one more record, keeping the table at most half full
+int store_pool_reserve(store_pool_t* pool, lsdj_error_t** error)
+{
+    if (pool->count == UINT32_MAX - 1)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_SPACE, "too many unique records for a store");
+        return 0;
+    }
+    
+    if (pool->count == pool->capacity)
+    {
+        const uint32_t capacity = pool->capacity ? pool->capacity * 2 : 256;
+        unsigned char* records = (unsigned char*)lsdj_malloc((size_t)capacity * pool->recordSize);
+        uint64_t* hashes = (uint64_t*)lsdj_malloc((size_t)capacity * sizeof(uint64_t));
+        if (records == NULL || hashes == NULL)
+        {
+            lsdj_free(records);
+            lsdj_free(hashes);
+            lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not grow store records");
+            return 0;
+        }
+        
+        if (pool->count)
+        {
+            memcpy(records, pool->records, (size_t)pool->count * pool->recordSize);
+            memcpy(hashes, pool->hashes, (size_t)pool->count * sizeof(uint64_t));
+        }
+        
+        lsdj_free(pool->records);
+        lsdj_free(pool->hashes);
+        pool->records = records;
+        pool->hashes = hashes;
+        pool->capacity = capacity;
+    }
+    
+    if ((pool->count + 1) * 2 > pool->slotCount)
+    {
+        const uint32_t slotCount = pool->slotCount ? pool->slotCount * 2 : 512;
+        uint32_t* slots = (uint32_t*)lsdj_calloc(slotCount, sizeof(uint32_t));
+        if (slots == NULL)
+        {
+            lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not grow store lookup");
+            return 0;
+        }
+        
+        for (uint32_t i = 0; i < pool->count; ++i)
+            store_pool_insert_slot(slots, slotCount, pool->hashes[i], i);
+        
+        lsdj_free(pool->slots);
+        pool->slots = slots;
+        pool->slotCount = slotCount;
+    }
+    
+    return 1;
+}
+
+// Find a record in the pool, adding it if it isn't there yet
+/*! Returns the index of the record, and whether it was added (if added isn't NULL) */
+uint32_t store_pool_intern(store_pool_t* pool, const unsigned char* record, int* added, lsdj_error_t** error)
+{
+    const uint64_t hash = lsdj_hash(record, pool->recordSize, 0);
+    
+    if (pool->slotCount)
+    {
+        uint32_t slot = (uint32_t)(hash & (pool->slotCount - 1));
+        for (; pool->slots[slot] != 0; slot = (slot + 1) & (pool->slotCount - 1))
+        {
+            const uint32_t index = pool->slots[slot] - 1;
+            if (pool->hashes[index] == hash && memcmp(store_pool_get(pool, index), record, pool->recordSize) == 0)
+            {
+                if (added)
+                    *added = 0;
+                return index;
+            }
+        }
+    }
+    
+    if (!store_pool_reserve(pool, error))
+        return 0;
+    
+    const uint32_t index = pool->count++;
+    memcpy(pool->records + (size_t)index * pool->recordSize, record, pool->recordSize);
+    pool->hashes[index] = hash;
+    store_pool_insert_slot(pool->slots, pool->slotCount, hash, index);
+    
+    if (added)
+        *added = 1;
+    return index;
+}
+
+size_t store_pool_byte_count(const store_pool_t* pool)
+{
+    return (size_t)pool->capacity * (pool->recordSize + sizeof(uint64_t)) + (size_t)pool->slotCount * sizeof(uint32_t);
+}
+
+
+// --- Songs --- //
+
+lsdj_store_t* lsdj_store_new(lsdj_error_t** error)
+{
+    lsdj_store_t* store = (lsdj_store_t*)lsdj_calloc(1, sizeof(lsdj_store_t));
+    if (store == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate store");
+        return NULL;
+    }
+    
+    store_pool_init(&store->waves, STORE_WAVE_SIZE);
+    store_pool_init(&store->instruments, STORE_INSTRUMENT_SIZE);
+    store_pool_init(&store->tables, STORE_TABLE_SIZE);
+    
+    store->context = lsdj_codec_context_new(error);
+    if (store->context == NULL)
+    {
+        lsdj_store_free(store);
+        return NULL;
+    }
+    
+    return store;
+}
+
+void store_song_free(store_song_t* song)
+{
+    if (song == NULL)
+        return;
+    
+    lsdj_free(song->blocks);
+    lsdj_free(song);
+}
+
+void lsdj_store_free(lsdj_store_t* store)
+{
+    if (store == NULL)
+        return;
+    
+    for (size_t i = 0; i < store->songCount; ++i)
+        store_song_free(store->songs[i]);
+    lsdj_free(store->songs);
+    
+    store_pool_free(&store->waves);
+    store_pool_free(&store->instruments);
+    store_pool_free(&store->tables);
+    
+    lsdj_codec_context_free(store->context);
+    lsdj_free(store);
+}
+
+// Append a song to the store, which takes ownership of it
+void store_append_song(lsdj_store_t* store, store_song_t* song, lsdj_error_t** error)
+{
+    if (store->songCount == store->songCapacity)
+    {
+        const size_t capacity = store->songCapacity ? store->songCapacity * 2 : 64;
+        store_song_t** songs = (store_song_t**)lsdj_malloc(capacity * sizeof(store_song_t*));
+        if (songs == NULL)
+        {
+            store_song_free(song);
+            return lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not grow store songs");
+        }
+        
+        if (store->songCount)
+            memcpy(songs, store->songs, store->songCount * sizeof(store_song_t*));
+        
+        lsdj_free(store->songs);
+        store->songs = songs;
+        store->songCapacity = capacity;
+    }
+    
+    store->songs[store->songCount++] = song;
+}
+
+// Gather the bytes of an instrument (its parameters, then its name) from a song image
+void gather_instrument(const unsigned char* image, size_t instrument, unsigned char* record)
+{
+    memcpy(record, image + SONG_INSTRUMENTS_ADDRESS + instrument * SONG_INSTRUMENT_BYTE_COUNT, SONG_INSTRUMENT_BYTE_COUNT);
+    memcpy(record + SONG_INSTRUMENT_BYTE_COUNT, image + SONG_INSTRUMENT_NAMES_ADDRESS + instrument * LSDJ_INSTRUMENT_NAME_LENGTH, LSDJ_INSTRUMENT_NAME_LENGTH);
+}
+
+void scatter_instrument(const unsigned char* record, size_t instrument, unsigned char* image)
+{
+    memcpy(image + SONG_INSTRUMENTS_ADDRESS + instrument * SONG_INSTRUMENT_BYTE_COUNT, record, SONG_INSTRUMENT_BYTE_COUNT);
+    memcpy(image + SONG_INSTRUMENT_NAMES_ADDRESS + instrument * LSDJ_INSTRUMENT_NAME_LENGTH, record + SONG_INSTRUMENT_BYTE_COUNT, LSDJ_INSTRUMENT_NAME_LENGTH);
+}
+
+// Gather the columns of a table from a song image
+void gather_table(const unsigned char* image, size_t table, unsigned char* record)
+{
+    for (size_t i = 0; i < STORE_TABLE_COLUMN_COUNT; ++i)
+        memcpy(record + i * LSDJ_TABLE_LENGTH, image + STORE_TABLE_COLUMNS[i] + table * LSDJ_TABLE_LENGTH, LSDJ_TABLE_LENGTH);
+}
+
+void scatter_table(const unsigned char* record, size_t table, unsigned char* image)
+{
+    for (size_t i = 0; i < STORE_TABLE_COLUMN_COUNT; ++i)
+        memcpy(image + STORE_TABLE_COLUMNS[i] + table * LSDJ_TABLE_LENGTH, record + i * LSDJ_TABLE_LENGTH, LSDJ_TABLE_LENGTH);
+}
+
+// Take the waves, instruments and tables out of a song image, leaving zeroes
+/*! Long runs of zeroes compress to almost nothing */
+void intern_song_records(lsdj_store_t* store, store_song_t* song, unsigned char* image, lsdj_error_t** error)
+{
+    for (size_t i = 0; i < LSDJ_WAVE_COUNT; ++i)
+    {
+        unsigned char* wave = image + SONG_WAVES_ADDRESS + i * LSDJ_WAVE_LENGTH;
+        song->waves[i] = store_pool_intern(&store->waves, wave, NULL, error);
+        if (error && *error)
+            return;
+    }
+    memset(image + SONG_WAVES_ADDRESS, 0, LSDJ_WAVE_COUNT * LSDJ_WAVE_LENGTH);
+    
+    unsigned char instrument[STORE_INSTRUMENT_SIZE];
+    for (size_t i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+    {
+        gather_instrument(image, i, instrument);
+        song->instruments[i] = store_pool_intern(&store->instruments, instrument, NULL, error);
+        if (error && *error)
+            return;
+    }
+    memset(image + SONG_INSTRUMENTS_ADDRESS, 0, LSDJ_INSTRUMENT_COUNT * SONG_INSTRUMENT_BYTE_COUNT);
+    memset(image + SONG_INSTRUMENT_NAMES_ADDRESS, 0, LSDJ_INSTRUMENT_COUNT * LSDJ_INSTRUMENT_NAME_LENGTH);
+    
+    unsigned char table[STORE_TABLE_SIZE];
+    for (size_t i = 0; i < LSDJ_TABLE_COUNT; ++i)
+    {
+        gather_table(image, i, table);
+        song->tables[i] = store_pool_intern(&store->tables, table, NULL, error);
+        if (error && *error)
+            return;
+    }
+    for (size_t i = 0; i < STORE_TABLE_COLUMN_COUNT; ++i)
+        memset(image + STORE_TABLE_COLUMNS[i], 0, LSDJ_TABLE_COUNT * LSDJ_TABLE_LENGTH);
+}
+
+// Compress what's left of a song image into the blocks of a store song
+void compress_song_rest(lsdj_store_t* store, store_song_t* song, const unsigned char* image, lsdj_error_t** error)
+{
+    unsigned char* blocks = lsdj_codec_context_borrow_block_buffer(store->context, error);
+    if (blocks == NULL)
+        return;
+    
+    lsdj_memory_data_t wmem;
+    wmem.begin = wmem.cur = blocks;
+    wmem.size = BLOCK_COUNT * BLOCK_SIZE;
+    
+    lsdj_vio_t wvio;
+    wvio.write = lsdj_mwrite;
+    wvio.tell = lsdj_mtell;
+    wvio.seek = lsdj_mseek;
+    wvio.user_data = &wmem;
+    
+    song->blockCount = lsdj_compress(image, BLOCK_SIZE, 1, BLOCK_COUNT, &wvio, error);
+    if ((error == NULL || *error == NULL) && song->blockCount == 0)
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_SPACE, "song does not fit in the blocks of a sav");
+    
+    if (error == NULL || *error == NULL)
+    {
+        song->blocks = (unsigned char*)lsdj_malloc(song->blockCount * BLOCK_SIZE);
+        if (song->blocks)
+            memcpy(song->blocks, blocks, song->blockCount * BLOCK_SIZE);
+        else
+            lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate store song blocks");
+    }
+    
+    lsdj_codec_context_return_buffer(store->context, blocks);
+}
+
+size_t lsdj_store_add_song(lsdj_store_t* store, const lsdj_song_t* song, lsdj_error_t** error)
+{
+    if (song == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "song is NULL");
+        return 0;
+    }
+    
+    store_song_t* stored = (store_song_t*)lsdj_calloc(1, sizeof(store_song_t));
+    if (stored == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate store song");
+        return 0;
+    }
+    
+    unsigned char* image = lsdj_codec_context_borrow_song_buffer(store->context, error);
+    if (image == NULL)
+    {
+        store_song_free(stored);
+        return 0;
+    }
+    
+    // Errors are kept locally, so that nothing half-done ends up in the store
+    lsdj_error_t* addError = NULL;
+    lsdj_song_write_to_memory(song, image, LSDJ_SONG_DECOMPRESSED_SIZE, &addError);
+    
+    if (addError == NULL)
+    {
+        stored->formatVersion = lsdj_song_get_format_version(song);
+        for (size_t i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+        {
+            if (lsdj_song_get_instrument_const(song, i))
+                stored->allocatedInstruments |= (uint64_t)1 << i;
+        }
+        
+        intern_song_records(store, stored, image, &addError);
+    }
+    
+    if (addError == NULL)
+        compress_song_rest(store, stored, image, &addError);
+    
+    lsdj_codec_context_return_buffer(store->context, image);
+    
+    if (addError == NULL)
+        store_append_song(store, stored, &addError);
+    else
+        store_song_free(stored);
+    
+    if (addError)
+    {
+        if (error)
+            *error = addError;
+        else
+            lsdj_error_free(addError);
+        return 0;
+    }
+    
+    return store->songCount - 1;
+}
+
+size_t lsdj_store_get_song_count(const lsdj_store_t* store)
+{
+    return store->songCount;
+}
+
+lsdj_song_t* lsdj_store_read_song(const lsdj_store_t* store, size_t index, lsdj_error_t** error)
+{
+    if (index >= store->songCount)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "song index is out of range");
+        return NULL;
+    }
+    
+    const store_song_t* song = store->songs[index];
+    
+    // Without a context, so that reading from multiple threads at once is safe
+    unsigned char* image = lsdj_codec_context_borrow_song_buffer(NULL, error);
+    if (image == NULL)
+        return NULL;
+    
+    lsdj_memory_data_t rmem;
+    rmem.begin = rmem.cur = song->blocks;
+    rmem.size = song->blockCount * BLOCK_SIZE;
+    
+    lsdj_vio_t rvio;
+    rvio.read = lsdj_mread;
+    rvio.tell = lsdj_mtell;
+    rvio.seek = lsdj_mseek;
+    rvio.user_data = &rmem;
+    
+    lsdj_memory_data_t wmem;
+    wmem.begin = wmem.cur = image;
+    wmem.size = LSDJ_SONG_DECOMPRESSED_SIZE;
+    
+    lsdj_vio_t wvio;
+    wvio.write = lsdj_mwrite;
+    wvio.tell = lsdj_mtell;
+    wvio.seek = lsdj_mseek;
+    wvio.user_data = &wmem;
+    
+    lsdj_error_t* decompressError = NULL;
+    lsdj_decompress(&rvio, &wvio, NULL, BLOCK_SIZE, &decompressError);
+    if (decompressError)
+    {
+        lsdj_codec_context_return_buffer(NULL, image);
+        if (error)
+            *error = decompressError;
+        else
+            lsdj_error_free(decompressError);
+        return NULL;
+    }
+    
+    // Put the records back where they were taken from
+    for (size_t i = 0; i < LSDJ_WAVE_COUNT; ++i)
+        memcpy(image + SONG_WAVES_ADDRESS + i * LSDJ_WAVE_LENGTH, store_pool_get(&store->waves, song->waves[i]), LSDJ_WAVE_LENGTH);
+    
+    for (size_t i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+        scatter_instrument(store_pool_get(&store->instruments, song->instruments[i]), i, image);
+    
+    for (size_t i = 0; i < LSDJ_TABLE_COUNT; ++i)
+        scatter_table(store_pool_get(&store->tables, song->tables[i]), i, image);
+    
+    lsdj_song_t* result = lsdj_song_read_from_memory(image, LSDJ_SONG_DECOMPRESSED_SIZE, error);
+    lsdj_codec_context_return_buffer(NULL, image);
+    return result;
+}
+
+const lsdj_wave_t* lsdj_store_get_wave(const lsdj_store_t* store, size_t song, size_t wave)
+{
+    assert(song < store->songCount);
+    assert(wave < LSDJ_WAVE_COUNT);
+    
+    // lsdj_wave_t is laid out exactly as the raw record
+    return (const lsdj_wave_t*)store_pool_get(&store->waves, store->songs[song]->waves[wave]);
+}
+
+lsdj_instrument_t* lsdj_store_read_instrument(const lsdj_store_t* store, size_t song, size_t instrument, lsdj_error_t** error)
+{
+    assert(song < store->songCount);
+    assert(instrument < LSDJ_INSTRUMENT_COUNT);
+    
+    const store_song_t* stored = store->songs[song];
+    if ((stored->allocatedInstruments & ((uint64_t)1 << instrument)) == 0)
+        return NULL;
+    
+    lsdj_instrument_t* result = lsdj_instrument_new();
+    if (result == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate instrument");
+        return NULL;
+    }
+    
+    const unsigned char* record = store_pool_get(&store->instruments, stored->instruments[instrument]);
+    
+    lsdj_memory_data_t memory;
+    memory.begin = memory.cur = (unsigned char*)record;
+    memory.size = SONG_INSTRUMENT_BYTE_COUNT;
+    
+    lsdj_vio_t vio;
+    vio.read = lsdj_mread;
+    vio.write = NULL;
+    vio.tell = lsdj_mtell;
+    vio.seek = lsdj_mseek;
+    vio.user_data = &memory;
+    
+    lsdj_instrument_read(&vio, stored->formatVersion, result, error);
+    if (error && *error)
+    {
+        lsdj_instrument_free(result);
+        return NULL;
+    }
+    
+    lsdj_instrument_set_name(result, (const char*)record + SONG_INSTRUMENT_BYTE_COUNT, LSDJ_INSTRUMENT_NAME_LENGTH);
+    
+    return result;
+}
+
+void lsdj_store_get_usage(const lsdj_store_t* store, lsdj_store_usage_t* usage)
+{
+    memset(usage, 0, sizeof(lsdj_store_usage_t));
+    
+    usage->songCount = store->songCount;
+    usage->waveCount = store->songCount * LSDJ_WAVE_COUNT;
+    usage->uniqueWaveCount = store->waves.count;
+    usage->instrumentCount = store->songCount * LSDJ_INSTRUMENT_COUNT;
+    usage->uniqueInstrumentCount = store->instruments.count;
+    usage->tableCount = store->songCount * LSDJ_TABLE_COUNT;
+    usage->uniqueTableCount = store->tables.count;
+    
+    usage->byteCount = sizeof(lsdj_store_t) + store->songCapacity * sizeof(store_song_t*);
+    usage->byteCount += store_pool_byte_count(&store->waves);
+    usage->byteCount += store_pool_byte_count(&store->instruments);
+    usage->byteCount += store_pool_byte_count(&store->tables);
+    for (size_t i = 0; i < store->songCount; ++i)
+        usage->byteCount += sizeof(store_song_t) + store->songs[i]->blockCount * BLOCK_SIZE;
+    
+    usage->decompressedByteCount = store->songCount * LSDJ_SONG_DECOMPRESSED_SIZE;
+}
+
+
+// --- Serialization --- //
+
+void store_encode_u32(unsigned char* data, uint32_t value)
+{
+    data[0] = (unsigned char)(value & 0xFF);
+    data[1] = (unsigned char)((value >> 8) & 0xFF);
+    data[2] = (unsigned char)((value >> 16) & 0xFF);
+    data[3] = (unsigned char)((value >> 24) & 0xFF);
+}
+
+uint32_t store_decode_u32(const unsigned char* data)
+{
+    return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+}
+
+int store_vio_write(lsdj_vio_t* vio, const void* data, size_t size, lsdj_error_t** error)
+{
+    if (vio->write(data, size, vio->user_data) == size)
+        return 1;
+    
+    lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write store");
+    return 0;
+}
+
+int store_vio_read(lsdj_vio_t* vio, void* data, size_t size, lsdj_error_t** error)
+{
+    if (vio->read(data, size, vio->user_data) == size)
+        return 1;
+    
+    lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not read store");
+    return 0;
+}
+
+// The header, then the unique records of every pool, then every song
+/*! A song is its format version, instrument allocations (8 bytes), block count, references and blocks */
+#define STORE_HEADER_SIZE (STORE_MAGIC_LENGTH + 5 * 4)
+#define STORE_SONG_HEADER_SIZE (1 + 8 + 4)
+
+void lsdj_store_write(const lsdj_store_t* store, lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    if (store == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "store is NULL");
+    
+    unsigned char header[STORE_HEADER_SIZE];
+    memcpy(header, STORE_MAGIC, STORE_MAGIC_LENGTH);
+    store_encode_u32(header + STORE_MAGIC_LENGTH, STORE_VERSION);
+    store_encode_u32(header + STORE_MAGIC_LENGTH + 4, store->waves.count);
+    store_encode_u32(header + STORE_MAGIC_LENGTH + 8, store->instruments.count);
+    store_encode_u32(header + STORE_MAGIC_LENGTH + 12, store->tables.count);
+    store_encode_u32(header + STORE_MAGIC_LENGTH + 16, (uint32_t)store->songCount);
+    if (!store_vio_write(vio, header, sizeof(header), error))
+        return;
+    
+    const store_pool_t* pools[3] = { &store->waves, &store->instruments, &store->tables };
+    for (int i = 0; i < 3; ++i)
+    {
+        if (pools[i]->count && !store_vio_write(vio, pools[i]->records, (size_t)pools[i]->count * pools[i]->recordSize, error))
+            return;
+    }
+    
+    unsigned char songHeader[STORE_SONG_HEADER_SIZE];
+    unsigned char references[STORE_REFERENCE_COUNT * 4];
+    for (size_t i = 0; i < store->songCount; ++i)
+    {
+        const store_song_t* song = store->songs[i];
+        
+        songHeader[0] = song->formatVersion;
+        store_encode_u32(songHeader + 1, (uint32_t)(song->allocatedInstruments & 0xFFFFFFFF));
+        store_encode_u32(songHeader + 5, (uint32_t)(song->allocatedInstruments >> 32));
+        store_encode_u32(songHeader + 9, song->blockCount);
+        
+        unsigned char* reference = references;
+        for (size_t j = 0; j < LSDJ_WAVE_COUNT; ++j, reference += 4)
+            store_encode_u32(reference, song->waves[j]);
+        for (size_t j = 0; j < LSDJ_INSTRUMENT_COUNT; ++j, reference += 4)
+            store_encode_u32(reference, song->instruments[j]);
+        for (size_t j = 0; j < LSDJ_TABLE_COUNT; ++j, reference += 4)
+            store_encode_u32(reference, song->tables[j]);
+        
+        if (!store_vio_write(vio, songHeader, sizeof(songHeader), error) ||
+            !store_vio_write(vio, references, sizeof(references), error) ||
+            !store_vio_write(vio, song->blocks, song->blockCount * BLOCK_SIZE, error))
+            return;
+    }
+}
+
+void lsdj_store_write_to_file(const lsdj_store_t* store, const char* path, lsdj_error_t** error)
+{
+    if (path == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
+    
+    lsdj_buffered_file_t* file = lsdj_buffered_file_open(path, "wb", LSDJ_BUFFERED_FILE_DEFAULT_SIZE, error);
+    if (file == NULL)
+        return;
+    
+    lsdj_vio_t vio;
+    lsdj_buffered_file_init_vio(file, &vio);
+    
+    lsdj_store_write(store, &vio, error);
+    
+    lsdj_buffered_file_close(file, error);
+}
+
+// Read the records of a pool, which should all be unique
+void read_store_pool(store_pool_t* pool, uint32_t count, lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    unsigned char record[STORE_TABLE_SIZE];
+    assert(pool->recordSize <= sizeof(record));
+    
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        if (!store_vio_read(vio, record, pool->recordSize, error))
+            return;
+        
+        int added = 0;
+        store_pool_intern(pool, record, &added, error);
+        if (error && *error)
+            return;
+        
+        if (!added)
+            return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "store contains the same record twice");
+    }
+}
+
+// Read the references of a song, checking that they exist
+int decode_store_references(uint32_t* references, size_t count, const unsigned char* data, uint32_t poolCount)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        references[i] = store_decode_u32(data + i * 4);
+        if (references[i] >= poolCount)
+            return 0;
+    }
+    
+    return 1;
+}
+
+store_song_t* read_store_song(const lsdj_store_t* store, lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    unsigned char songHeader[STORE_SONG_HEADER_SIZE];
+    unsigned char references[STORE_REFERENCE_COUNT * 4];
+    if (!store_vio_read(vio, songHeader, sizeof(songHeader), error) ||
+        !store_vio_read(vio, references, sizeof(references), error))
+        return NULL;
+    
+    store_song_t* song = (store_song_t*)lsdj_calloc(1, sizeof(store_song_t));
+    if (song == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate store song");
+        return NULL;
+    }
+    
+    song->formatVersion = songHeader[0];
+    song->allocatedInstruments = (uint64_t)store_decode_u32(songHeader + 1) | ((uint64_t)store_decode_u32(songHeader + 5) << 32);
+    song->blockCount = store_decode_u32(songHeader + 9);
+    
+    const unsigned char* reference = references;
+    if (song->blockCount == 0 || song->blockCount > BLOCK_COUNT ||
+        !decode_store_references(song->waves, LSDJ_WAVE_COUNT, reference, store->waves.count) ||
+        !decode_store_references(song->instruments, LSDJ_INSTRUMENT_COUNT, reference + LSDJ_WAVE_COUNT * 4, store->instruments.count) ||
+        !decode_store_references(song->tables, LSDJ_TABLE_COUNT, reference + (LSDJ_WAVE_COUNT + LSDJ_INSTRUMENT_COUNT) * 4, store->tables.count))
+    {
+        store_song_free(song);
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "store song refers to records that don't exist");
+        return NULL;
+    }
+    
+    song->blocks = (unsigned char*)lsdj_malloc(song->blockCount * BLOCK_SIZE);
+    if (song->blocks == NULL)
+    {
+        store_song_free(song);
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate store song blocks");
+        return NULL;
+    }
+    
+    if (!store_vio_read(vio, song->blocks, song->blockCount * BLOCK_SIZE, error))
+    {
+        store_song_free(song);
+        return NULL;
+    }
+    
+    return song;
+}
+
+lsdj_store_t* lsdj_store_read(lsdj_vio_t* vio, lsdj_error_t** error)
+{
+    unsigned char header[STORE_HEADER_SIZE];
+    if (!store_vio_read(vio, header, sizeof(header), error))
+        return NULL;
+    
+    if (memcmp(header, STORE_MAGIC, STORE_MAGIC_LENGTH) != 0 || store_decode_u32(header + STORE_MAGIC_LENGTH) != STORE_VERSION)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_DATA, "data is not an lsdj store");
+        return NULL;
+    }
+    
+    lsdj_store_t* store = lsdj_store_new(error);
+    if (store == NULL)
+        return NULL;
+    
+    lsdj_error_t* readError = NULL;
+    read_store_pool(&store->waves, store_decode_u32(header + STORE_MAGIC_LENGTH + 4), vio, &readError);
+    if (readError == NULL)
+        read_store_pool(&store->instruments, store_decode_u32(header + STORE_MAGIC_LENGTH + 8), vio, &readError);
+    if (readError == NULL)
+        read_store_pool(&store->tables, store_decode_u32(header + STORE_MAGIC_LENGTH + 12), vio, &readError);
+    
+    const uint32_t songCount = store_decode_u32(header + STORE_MAGIC_LENGTH + 16);
+    for (uint32_t i = 0; i < songCount && readError == NULL; ++i)
+    {
+        store_song_t* song = read_store_song(store, vio, &readError);
+        if (song)
+            store_append_song(store, song, &readError);
+    }
+    
+    if (readError)
+    {
+        lsdj_store_free(store);
+        if (error)
+            *error = readError;
+        else
+            lsdj_error_free(readError);
+        return NULL;
+    }
+    
+    return store;
+}
+
+lsdj_store_t* lsdj_store_read_from_file(const char* path, lsdj_error_t** error)
+{
+    if (path == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
+        return NULL;
+    }
+    
+    lsdj_buffered_file_t* file = lsdj_buffered_file_open(path, "rb", LSDJ_BUFFERED_FILE_DEFAULT_SIZE, error);
+    if (file == NULL)
+        return NULL;
+    
+    lsdj_vio_t vio;
+    lsdj_buffered_file_init_vio(file, &vio);
+    
+    lsdj_store_t* store = lsdj_store_read(&vio, error);
+    
+    lsdj_buffered_file_close(file, error);
+    return store;
+}
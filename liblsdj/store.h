@@ -0,0 +1,115 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_STORE_H
+#define LSDJ_STORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "error.h"
+#include "instrument.h"
+#include "song.h"
+#include "vio.h"
+#include "wave.h"
+
+// A deduplicating store for large collections of songs
+/*! Waves, instruments (including their names) and tables are kept once per unique content,
+    and every song refers to them. What remains of a song is stored compressed. Songs are
+    only put back together when they're read from the store. Adding songs isn't thread-safe,
+    reading them is (as long as nothing is added at the same time). */
+typedef struct lsdj_store_t lsdj_store_t;
+
+// Create/free stores
+lsdj_store_t* lsdj_store_new(lsdj_error_t** error);
+void lsdj_store_free(lsdj_store_t* store);
+
+// Add a song to the store, returns the index it can be read back with
+/*! Fails with LSDJ_ERROR_OUT_OF_SPACE if the rest of the song doesn't compress into the
+    blocks of a sav, which never happens for songs that fit in one themselves */
+size_t lsdj_store_add_song(lsdj_store_t* store, const lsdj_song_t* song, lsdj_error_t** error);
+
+// Retrieve the amount of songs in the store
+size_t lsdj_store_get_song_count(const lsdj_store_t* store);
+
+// Put a song in the store back together
+/*! The result is a song of its own, identical to the one that was added */
+lsdj_song_t* lsdj_store_read_song(const lsdj_store_t* store, size_t song, lsdj_error_t** error);
+
+// Retrieve a wave of a song, without putting the song back together
+/*! The wave is shared by every song with the same one, and stays owned by the store */
+const lsdj_wave_t* lsdj_store_get_wave(const lsdj_store_t* store, size_t song, size_t wave);
+
+// Read an instrument of a song, without putting the song back together
+/*! Returns NULL for unallocated instruments */
+lsdj_instrument_t* lsdj_store_read_instrument(const lsdj_store_t* store, size_t song, size_t instrument, lsdj_error_t** error);
+
+// How much a store holds, and how much that saves
+typedef struct
+{
+    size_t songCount;
+    
+    // The amount of waves, instruments and tables the songs refer to, and how many of those are unique
+    size_t waveCount;
+    size_t uniqueWaveCount;
+    size_t instrumentCount;
+    size_t uniqueInstrumentCount;
+    size_t tableCount;
+    size_t uniqueTableCount;
+    
+    // The amount of bytes the store takes in memory, and what the songs would take decompressed
+    size_t byteCount;
+    size_t decompressedByteCount;
+} lsdj_store_usage_t;
+
+void lsdj_store_get_usage(const lsdj_store_t* store, lsdj_store_usage_t* usage);
+
+// Serialize a store
+void lsdj_store_write(const lsdj_store_t* store, lsdj_vio_t* vio, lsdj_error_t** error);
+void lsdj_store_write_to_file(const lsdj_store_t* store, const char* path, lsdj_error_t** error);
+
+// Deserialize a store
+lsdj_store_t* lsdj_store_read(lsdj_vio_t* vio, lsdj_error_t** error);
+lsdj_store_t* lsdj_store_read_from_file(const char* path, lsdj_error_t** error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -36,6 +36,7 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "alloc.h"
 #include "table.h"
 
 typedef struct lsdj_table_t
@@ -55,21 +56,42 @@ typedef struct lsdj_table_t
 
 lsdj_table_t* lsdj_table_new()
 {
-    lsdj_table_t* table = (lsdj_table_t*)malloc(sizeof(lsdj_table_t));
+    lsdj_table_t* table = (lsdj_table_t*)lsdj_malloc(sizeof(lsdj_table_t));
     lsdj_clear_table(table);
     return table;
 }
 
 lsdj_table_t* lsdj_copy_table(const lsdj_table_t* table)
 {
-    lsdj_table_t* newTable = malloc(sizeof(lsdj_table_t));
+    lsdj_table_t* newTable = lsdj_malloc(sizeof(lsdj_table_t));
     memcpy(newTable, table, sizeof(lsdj_table_t));
     return newTable;
 }
 
 void lsdj_table_free(lsdj_table_t* table)
 {
-    free(table);
+    lsdj_free(table);
+}
+
+lsdj_table_t* lsdj_table_new_in_arena(lsdj_arena_t* arena)
+{
+    lsdj_table_t* table = (lsdj_table_t*)lsdj_arena_alloc(arena, sizeof(lsdj_table_t));
+    if (table)
+        lsdj_clear_table(table);
+    return table;
+}
+
+lsdj_table_t* lsdj_copy_table_in_arena(const lsdj_table_t* table, lsdj_arena_t* arena)
+{
+    lsdj_table_t* newTable = (lsdj_table_t*)lsdj_arena_alloc(arena, sizeof(lsdj_table_t));
+    if (newTable)
+        memcpy(newTable, table, sizeof(lsdj_table_t));
+    return newTable;
+}
+
+size_t lsdj_table_size(void)
+{
+    return sizeof(lsdj_table_t);
 }
 
 void lsdj_clear_table(lsdj_table_t* table)
@@ -123,3 +145,25 @@ lsdj_command_t* lsdj_table_get_command2(lsdj_table_t* table, size_t index)
 {
     return &table->commands2[index];
 }
+
+const lsdj_command_t* lsdj_table_get_command1_const(const lsdj_table_t* table, size_t index)
+{
+    return &table->commands1[index];
+}
+
+const lsdj_command_t* lsdj_table_get_command2_const(const lsdj_table_t* table, size_t index)
+{
+    return &table->commands2[index];
+}
+
+size_t lsdj_table_map_commands(lsdj_table_t* table, const lsdj_command_map_t* map)
+{
+    return lsdj_command_map_apply(map, table->commands1, LSDJ_TABLE_LENGTH) +
+           lsdj_command_map_apply(map, table->commands2, LSDJ_TABLE_LENGTH);
+}
+
+size_t lsdj_table_count_mapped_commands(const lsdj_table_t* table, const lsdj_command_map_t* map)
+{
+    return lsdj_command_map_count(map, table->commands1, LSDJ_TABLE_LENGTH) +
+           lsdj_command_map_count(map, table->commands2, LSDJ_TABLE_LENGTH);
+}
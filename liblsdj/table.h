@@ -40,6 +40,7 @@
 extern "C" {
 #endif
 
+#include "arena.h"
 #include "command.h"
 
 // The default constant length of a table
@@ -50,6 +51,14 @@ typedef struct lsdj_table_t lsdj_table_t;
 lsdj_table_t* lsdj_table_new();
 lsdj_table_t* lsdj_copy_table(const lsdj_table_t* table);
 void lsdj_table_free(lsdj_table_t* table);
+
+// Create/copy a table inside of an arena
+/*! Returns NULL if the arena is full. Don't lsdj_table_free() these, free the arena. */
+lsdj_table_t* lsdj_table_new_in_arena(lsdj_arena_t* arena);
+lsdj_table_t* lsdj_copy_table_in_arena(const lsdj_table_t* table, lsdj_arena_t* arena);
+
+// The amount of memory one table takes up
+size_t lsdj_table_size(void);
     
 // Clear all table data to factory settings
 void lsdj_clear_table(lsdj_table_t* table);
@@ -64,6 +73,15 @@ unsigned char lsdj_table_get_transposition(const lsdj_table_t* table, size_t ind
 
 lsdj_command_t* lsdj_table_get_command1(lsdj_table_t* table, size_t index);
 lsdj_command_t* lsdj_table_get_command2(lsdj_table_t* table, size_t index);
+const lsdj_command_t* lsdj_table_get_command1_const(const lsdj_table_t* table, size_t index);
+const lsdj_command_t* lsdj_table_get_command2_const(const lsdj_table_t* table, size_t index);
+
+// Rewrite both command columns of the table through a command map
+/*! Returns the amount of command values that were changed */
+size_t lsdj_table_map_commands(lsdj_table_t* table, const lsdj_command_map_t* map);
+
+// Count the command values in the table that a command map would change
+size_t lsdj_table_count_mapped_commands(const lsdj_table_t* table, const lsdj_command_map_t* map);
     
 #ifdef __cplusplus
 }
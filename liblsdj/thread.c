@@ -0,0 +1,203 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <stdlib.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+#include "alloc.h"
+#include "thread.h"
+
+// The work a single thread takes on
+/*! first doubles as the id of the worker, as every worker starts at a different index */
+typedef struct
+{
+    unsigned int first;
+    unsigned int stride;
+    unsigned int count;
+    
+    lsdj_parallel_function_t function;
+    void* user_data;
+    
+    // The thread running this worker, if it could be started
+    int started;
+#ifdef _WIN32
+    HANDLE thread;
+#else
+    pthread_t thread;
+#endif
+} lsdj_parallel_worker_t;
+
+void run_parallel_worker(lsdj_parallel_worker_t* worker)
+{
+    for (unsigned int i = worker->first; i < worker->count; i += worker->stride)
+        worker->function(i, worker->first, worker->user_data);
+}
+
+#ifdef _WIN32
+DWORD WINAPI parallel_worker_entry(LPVOID data)
+{
+    run_parallel_worker((lsdj_parallel_worker_t*)data);
+    return 0;
+}
+#else
+void* parallel_worker_entry(void* data)
+{
+    run_parallel_worker((lsdj_parallel_worker_t*)data);
+    return NULL;
+}
+#endif
+
+void lsdj_parallel_for(unsigned int count, unsigned int threadCount, lsdj_parallel_function_t function, void* user_data, lsdj_error_t** error)
+{
+    if (function == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "function is NULL");
+    
+    if (threadCount > count)
+        threadCount = count;
+    
+    if (threadCount <= 1)
+    {
+        for (unsigned int i = 0; i < count; ++i)
+            function(i, 0, user_data);
+        return;
+    }
+    
+    lsdj_parallel_worker_t* workers = (lsdj_parallel_worker_t*)lsdj_calloc(threadCount, sizeof(lsdj_parallel_worker_t));
+    if (workers == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate worker threads");
+    
+    for (unsigned int t = 0; t < threadCount; ++t)
+    {
+        workers[t].first = t;
+        workers[t].stride = threadCount;
+        workers[t].count = count;
+        workers[t].function = function;
+        workers[t].user_data = user_data;
+    }
+    
+    // Spawn the extra threads. If that fails, the calling thread picks up their work.
+    for (unsigned int t = 1; t < threadCount; ++t)
+    {
+#ifdef _WIN32
+        workers[t].thread = CreateThread(NULL, 0, parallel_worker_entry, &workers[t], 0, NULL);
+        workers[t].started = workers[t].thread != NULL;
+#else
+        workers[t].started = pthread_create(&workers[t].thread, NULL, parallel_worker_entry, &workers[t]) == 0;
+#endif
+        
+        if (!workers[t].started)
+            run_parallel_worker(&workers[t]);
+    }
+    
+    run_parallel_worker(&workers[0]);
+    
+    for (unsigned int t = 1; t < threadCount; ++t)
+    {
+        if (!workers[t].started)
+            continue;
+        
+#ifdef _WIN32
+        WaitForSingleObject(workers[t].thread, INFINITE);
+        CloseHandle(workers[t].thread);
+#else
+        pthread_join(workers[t].thread, NULL);
+#endif
+    }
+    
+    lsdj_free(workers);
+}
+
+#ifdef _WIN32
+unsigned int lsdj_atomic_increment(unsigned int* value)
+{
+    return (unsigned int)InterlockedIncrement((volatile LONG*)value);
+}
+
+unsigned int lsdj_atomic_decrement(unsigned int* value)
+{
+    return (unsigned int)InterlockedDecrement((volatile LONG*)value);
+}
+
+unsigned int lsdj_atomic_load(const unsigned int* value)
+{
+    return (unsigned int)InterlockedCompareExchange((volatile LONG*)value, 0, 0);
+}
+
+void* lsdj_atomic_publish_pointer(void** pointer, void* value)
+{
+    void* previous = InterlockedCompareExchangePointer((PVOID volatile*)pointer, value, NULL);
+    return previous ? previous : value;
+}
+
+void* lsdj_atomic_load_pointer(void* const* pointer)
+{
+    return InterlockedCompareExchangePointer((PVOID volatile*)pointer, NULL, NULL);
+}
+#else
+unsigned int lsdj_atomic_increment(unsigned int* value)
+{
+    return __atomic_add_fetch(value, 1, __ATOMIC_ACQ_REL);
+}
+
+unsigned int lsdj_atomic_decrement(unsigned int* value)
+{
+    return __atomic_sub_fetch(value, 1, __ATOMIC_ACQ_REL);
+}
+
+unsigned int lsdj_atomic_load(const unsigned int* value)
+{
+    return __atomic_load_n(value, __ATOMIC_ACQUIRE);
+}
+
+void* lsdj_atomic_publish_pointer(void** pointer, void* value)
+{
+    void* expected = NULL;
+    if (__atomic_compare_exchange_n(pointer, &expected, value, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return value;
+    
+    return expected;
+}
+
+void* lsdj_atomic_load_pointer(void* const* pointer)
+{
+    return __atomic_load_n(pointer, __ATOMIC_ACQUIRE);
+}
+#endif
@@ -0,0 +1,74 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_THREAD_H
+#define LSDJ_THREAD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "error.h"
+
+// A unit of work for lsdj_parallel_for(), called once for every index
+/*! worker lies in [0, threadCount), with threadCount clamped to [1, count]. Calls with the
+    same worker never run at the same time, so it can pick per-thread scratch memory. */
+typedef void (*lsdj_parallel_function_t)(unsigned int index, unsigned int worker, void* user_data);
+
+// Call a function for every index in [0, count), spread out over a number of threads
+/*! The calling thread takes part in the work, so only threadCount - 1 threads are spawned.
+    A threadCount of 0 or 1 runs everything on the calling thread. Returns once every index
+    has been processed. Which worker gets which index is up to the implementation, use the
+    worker passed to the function rather than working it out from the index. */
+void lsdj_parallel_for(unsigned int count, unsigned int threadCount, lsdj_parallel_function_t function, void* user_data, lsdj_error_t** error);
+
+// Change a reference count that's shared between threads, returning the new count
+unsigned int lsdj_atomic_increment(unsigned int* value);
+unsigned int lsdj_atomic_decrement(unsigned int* value);
+unsigned int lsdj_atomic_load(const unsigned int* value);
+
+// Publish a pointer that other threads might be loading at the same time
+/*! Stores value if the pointer is still NULL, and returns whatever the pointer holds
+    afterwards. If that isn't value, another thread got there first. Loading a pointer
+    published this way also makes what it points to visible to the loading thread. */
+void* lsdj_atomic_publish_pointer(void** pointer, void* value);
+void* lsdj_atomic_load_pointer(void* const* pointer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
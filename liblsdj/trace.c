@@ -0,0 +1,114 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <string.h>
+
+#include "trace.h"
+
+static const char* STAGE_NAMES[LSDJ_TRACE_STAGE_COUNT] =
+{
+    "decompress",
+    "song read",
+    "compress",
+    "sav write",
+    "file read",
+    "file write"
+};
+
+static const char* COUNTER_NAMES[LSDJ_TRACE_COUNTER_COUNT] =
+{
+    "bytes in",
+    "bytes out",
+    "rle events",
+    "default wave events",
+    "default instrument events",
+    "blocks"
+};
+
+#ifdef LSDJ_ENABLE_TRACE
+static lsdj_trace_callbacks_t traceCallbacks = { NULL, NULL, NULL, NULL };
+#endif
+
+void lsdj_set_trace_callbacks(const lsdj_trace_callbacks_t* callbacks)
+{
+#ifdef LSDJ_ENABLE_TRACE
+    if (callbacks)
+        traceCallbacks = *callbacks;
+    else
+        memset(&traceCallbacks, 0, sizeof(traceCallbacks));
+#else
+    (void)callbacks;
+#endif
+}
+
+int lsdj_trace_is_enabled(void)
+{
+#ifdef LSDJ_ENABLE_TRACE
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+const char* lsdj_trace_stage_name(lsdj_trace_stage_t stage)
+{
+    return stage < LSDJ_TRACE_STAGE_COUNT ? STAGE_NAMES[stage] : "unknown";
+}
+
+const char* lsdj_trace_counter_name(lsdj_trace_counter_t counter)
+{
+    return counter < LSDJ_TRACE_COUNTER_COUNT ? COUNTER_NAMES[counter] : "unknown";
+}
+
+#ifdef LSDJ_ENABLE_TRACE
+void lsdj_trace_begin(lsdj_trace_stage_t stage)
+{
+    if (traceCallbacks.begin)
+        traceCallbacks.begin(stage, traceCallbacks.user_data);
+}
+
+void lsdj_trace_end(lsdj_trace_stage_t stage)
+{
+    if (traceCallbacks.end)
+        traceCallbacks.end(stage, traceCallbacks.user_data);
+}
+
+void lsdj_trace_count(lsdj_trace_stage_t stage, lsdj_trace_counter_t counter, size_t value)
+{
+    if (traceCallbacks.counter)
+        traceCallbacks.counter(stage, counter, value, traceCallbacks.user_data);
+}
+#endif
@@ -0,0 +1,131 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_TRACE_H
+#define LSDJ_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+// The stages of liblsdj that report trace events
+/*! Stages can nest, compressing a song while writing a sav for example */
+typedef enum
+{
+    // Decompressing the blocks of a song
+    LSDJ_TRACE_DECOMPRESS,
+    
+    // Parsing the banks of a decompressed song
+    LSDJ_TRACE_SONG_READ,
+    
+    // Compressing a song into blocks
+    LSDJ_TRACE_COMPRESS,
+    
+    // Packing the compressed songs of a sav into its blocks
+    LSDJ_TRACE_SAV_WRITE,
+    
+    // Reading from and writing to files
+    LSDJ_TRACE_FILE_READ,
+    LSDJ_TRACE_FILE_WRITE,
+    
+    LSDJ_TRACE_STAGE_COUNT
+} lsdj_trace_stage_t;
+
+// The counters reported by the stages, right before they end
+typedef enum
+{
+    // The amount of bytes consumed and produced
+    LSDJ_TRACE_BYTES_IN,
+    LSDJ_TRACE_BYTES_OUT,
+    
+    // The amount of run-length, default wave and default instrument events compressed
+    LSDJ_TRACE_RLE_EVENTS,
+    LSDJ_TRACE_DEFAULT_WAVE_EVENTS,
+    LSDJ_TRACE_DEFAULT_INSTRUMENT_EVENTS,
+    
+    // The amount of blocks used
+    LSDJ_TRACE_BLOCKS,
+    
+    LSDJ_TRACE_COUNTER_COUNT
+} lsdj_trace_counter_t;
+
+// Callbacks that receive the trace events, any of them can be NULL
+/*! Stages run on whichever thread calls into liblsdj (including the worker threads of the
+    parallel functions), so the callbacks need to be thread-safe themselves */
+typedef struct
+{
+    void (*begin)(lsdj_trace_stage_t stage, void* user_data);
+    void (*end)(lsdj_trace_stage_t stage, void* user_data);
+    void (*counter)(lsdj_trace_stage_t stage, lsdj_trace_counter_t counter, size_t value, void* user_data);
+    void* user_data;
+} lsdj_trace_callbacks_t;
+
+// Install the trace callbacks, or NULL to stop tracing
+/*! The callbacks are copied. Tracing is only compiled in when liblsdj is built with
+    LSDJ_ENABLE_TRACE, otherwise this does nothing. Don't change the callbacks while
+    other threads are using liblsdj. */
+void lsdj_set_trace_callbacks(const lsdj_trace_callbacks_t* callbacks);
+
+// Was liblsdj built with tracing?
+int lsdj_trace_is_enabled(void);
+
+// Names of the stages and counters, for printing
+const char* lsdj_trace_stage_name(lsdj_trace_stage_t stage);
+const char* lsdj_trace_counter_name(lsdj_trace_counter_t counter);
+
+// Used inside liblsdj to report the events
+/*! Without LSDJ_ENABLE_TRACE these compile away completely */
+#ifdef LSDJ_ENABLE_TRACE
+void lsdj_trace_begin(lsdj_trace_stage_t stage);
+void lsdj_trace_end(lsdj_trace_stage_t stage);
+void lsdj_trace_count(lsdj_trace_stage_t stage, lsdj_trace_counter_t counter, size_t value);
+
+#define LSDJ_TRACE_BEGIN(stage) lsdj_trace_begin(stage)
+#define LSDJ_TRACE_END(stage) lsdj_trace_end(stage)
+#define LSDJ_TRACE_COUNT(stage, counter, value) lsdj_trace_count(stage, counter, (size_t)(value))
+#else
+#define LSDJ_TRACE_BEGIN(stage) ((void)0)
+#define LSDJ_TRACE_END(stage) ((void)0)
+#define LSDJ_TRACE_COUNT(stage, counter, value) ((void)(value))
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,275 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "compression.h"
+#include "project.h"
+#include "sav.h"
+#include "song.h"
+#include "thread.h"
+#include "validate.h"
+
+#define HEADER_START LSDJ_SONG_DECOMPRESSED_SIZE
+#define HEADER_INIT_ADDRESS (HEADER_START + 0x13E)
+#define HEADER_BLOCK_ALLOC_TABLE_ADDRESS (HEADER_START + 0x141)
+
+void fail_validation(lsdj_validate_result_t* result, lsdj_error_code_t code, const char* reason)
+{
+    result->code = code;
+    result->reason = reason;
+}
+
+int has_song_flags(const unsigned char* song)
+{
+    return memcmp(song + 0x1E78, "rb", 2) == 0 &&
+           memcmp(song + 0x3E80, "rb", 2) == 0 &&
+           memcmp(song + 0x7FF0, "rb", 2) == 0;
+}
+
+// Decompress a song into scratch memory and check its flags
+/*! block1position is passed on to lsdj_decompress(), points at the start of the data */
+int validate_compressed_song(const unsigned char* data, size_t size, size_t offset, long* block1position, unsigned char* scratch, lsdj_validate_result_t* result)
+{
+    lsdj_memory_data_t rmem;
+    rmem.begin = (unsigned char*)data;
+    rmem.cur = rmem.begin + offset;
+    rmem.size = size;
+    
+    lsdj_vio_t rvio;
+    rvio.read = lsdj_mread;
+    rvio.tell = lsdj_mtell;
+    rvio.seek = lsdj_mseek;
+    rvio.user_data = &rmem;
+    
+    lsdj_memory_data_t wmem;
+    wmem.begin = scratch;
+    wmem.cur = scratch;
+    wmem.size = LSDJ_SONG_DECOMPRESSED_SIZE;
+    
+    lsdj_vio_t wvio;
+    wvio.write = lsdj_mwrite;
+    wvio.tell = lsdj_mtell;
+    wvio.seek = lsdj_mseek;
+    wvio.user_data = &wmem;
+    
+    lsdj_error_t* error = NULL;
+    lsdj_decompress(&rvio, &wvio, block1position, BLOCK_SIZE, &error);
+    if (error)
+    {
+        fail_validation(result, lsdj_error_get_code(error), "song could not be decompressed");
+        lsdj_error_free(error);
+        return 0;
+    }
+    
+    if (!has_song_flags(scratch))
+    {
+        fail_validation(result, LSDJ_ERROR_INVALID_DATA, "decompressed song is missing its 'rb' flags");
+        return 0;
+    }
+    
+    result->songCount++;
+    return 1;
+}
+
+void validate_sav(const unsigned char* data, unsigned char* scratch, lsdj_validate_result_t* result)
+{
+    result->kind = LSDJ_VALIDATE_SAV;
+    
+    if (data[HEADER_INIT_ADDRESS] != 'j' || data[HEADER_INIT_ADDRESS + 1] != 'k')
+        return fail_validation(result, LSDJ_ERROR_INVALID_DATA, "SRAM initialization check wasn't 'jk'");
+    
+    // The working memory song is stored uncompressed
+    if (!has_song_flags(data))
+        return fail_validation(result, LSDJ_ERROR_INVALID_DATA, "working memory song is missing its 'rb' flags");
+    result->songCount++;
+    
+    const unsigned char* allocTable = data + HEADER_BLOCK_ALLOC_TABLE_ADDRESS;
+    unsigned char seen[LSDJ_SAV_PROJECT_COUNT];
+    memset(seen, 0, sizeof(seen));
+    
+    for (size_t i = 0; i < BLOCK_COUNT; ++i)
+    {
+        const unsigned char p = allocTable[i];
+        if (p == 0xFF)
+            continue;
+        
+        if (p >= LSDJ_SAV_PROJECT_COUNT)
+            return fail_validation(result, LSDJ_ERROR_INVALID_DATA, "block allocation table refers to a non-existent project");
+        
+        // Only the first block of each project is where its song starts
+        if (seen[p])
+            continue;
+        seen[p] = 1;
+        
+        long block1position = HEADER_START + BLOCK_SIZE;
+        if (!validate_compressed_song(data, HEADER_START + (BLOCK_COUNT + 1) * BLOCK_SIZE, HEADER_START + (i + 1) * BLOCK_SIZE, &block1position, scratch, result))
+            return;
+    }
+}
+
+void validate_lsdsng(const unsigned char* data, size_t size, unsigned char* scratch, lsdj_validate_result_t* result)
+{
+    result->kind = LSDJ_VALIDATE_LSDSNG;
+    
+    // Blocks in an lsdsng are stored consecutively, so next block commands just move on
+    validate_compressed_song(data, size, LSDJ_PROJECT_NAME_LENGTH + 1, NULL, scratch, result);
+}
+
+void lsdj_validate_memory(const unsigned char* data, size_t size, unsigned char* scratch, lsdj_validate_result_t* result)
+{
+    memset(result, 0, sizeof(lsdj_validate_result_t));
+    
+    if (data == NULL || scratch == NULL)
+        return fail_validation(result, LSDJ_ERROR_INVALID_ARGUMENT, "data or scratch is NULL");
+    
+    const size_t lsdsngSize = size - LSDJ_PROJECT_NAME_LENGTH - 1;
+    
+    if (size >= LSDJ_SAV_SIZE)
+        validate_sav(data, scratch, result);
+    else if (size > LSDJ_PROJECT_NAME_LENGTH + 1 && lsdsngSize % BLOCK_SIZE == 0 && lsdsngSize <= BLOCK_COUNT * BLOCK_SIZE)
+        validate_lsdsng(data, size, scratch, result);
+    else
+        fail_validation(result, LSDJ_ERROR_INVALID_DATA, "size corresponds to neither a sav nor an lsdsng");
+}
+
+// Per-thread memory for the batch validators
+typedef struct
+{
+    unsigned char scratch[LSDJ_SONG_DECOMPRESSED_SIZE];
+    
+    //! Files are read in here; one byte more than a sav, so we can tell larger files apart
+    unsigned char file[LSDJ_SAV_SIZE + 1];
+} validate_worker_t;
+
+typedef struct
+{
+    const char* const* paths;
+    const unsigned char* const* data;
+    const size_t* sizes;
+    
+    lsdj_validate_result_t* results;
+    
+    validate_worker_t* workers;
+} validate_batch_t;
+
+void validate_file(unsigned int index, unsigned int workerIndex, void* user_data)
+{
+    validate_batch_t* batch = (validate_batch_t*)user_data;
+    validate_worker_t* worker = &batch->workers[workerIndex];
+    lsdj_validate_result_t* result = &batch->results[index];
+    
+    memset(result, 0, sizeof(lsdj_validate_result_t));
+    
+    const char* path = batch->paths[index];
+    if (path == NULL)
+        return fail_validation(result, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
+    
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return fail_validation(result, LSDJ_ERROR_IO, "could not open file for reading");
+    
+    const size_t size = fread(worker->file, 1, sizeof(worker->file), file);
+    const int failed = ferror(file);
+    fclose(file);
+    
+    if (failed)
+        return fail_validation(result, LSDJ_ERROR_IO, "could not read file");
+    
+    lsdj_validate_memory(worker->file, size, worker->scratch, result);
+}
+
+void validate_buffer(unsigned int index, unsigned int workerIndex, void* user_data)
+{
+    validate_batch_t* batch = (validate_batch_t*)user_data;
+    validate_worker_t* worker = &batch->workers[workerIndex];
+    
+    lsdj_validate_memory(batch->data[index], batch->sizes[index], worker->scratch, &batch->results[index]);
+}
+
+void validate_batch(validate_batch_t* batch, unsigned int count, unsigned int threadCount, lsdj_parallel_function_t function, lsdj_error_t** error)
+{
+    if (batch->results == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "results is NULL");
+    
+    if (threadCount == 0)
+        threadCount = 1;
+    if (threadCount > count)
+        threadCount = count;
+    if (count == 0)
+        return;
+    
+    batch->workers = (validate_worker_t*)lsdj_malloc(threadCount * sizeof(validate_worker_t));
+    if (batch->workers == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate validation buffers");
+    
+    lsdj_parallel_for(count, threadCount, function, batch, error);
+    
+    lsdj_free(batch->workers);
+}
+
+void lsdj_validate_files(const char* const* paths, unsigned int count, unsigned int threadCount, lsdj_validate_result_t* results, lsdj_error_t** error)
+{
+    if (paths == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "paths is NULL");
+    
+    validate_batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.paths = paths;
+    batch.results = results;
+    
+    validate_batch(&batch, count, threadCount, validate_file, error);
+}
+
+void lsdj_validate_memory_batch(const unsigned char* const* data, const size_t* sizes, unsigned int count, unsigned int threadCount, lsdj_validate_result_t* results, lsdj_error_t** error)
+{
+    if (data == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
+    
+    if (sizes == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "sizes is NULL");
+    
+    validate_batch_t batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.data = data;
+    batch.sizes = sizes;
+    batch.results = results;
+    
+    validate_batch(&batch, count, threadCount, validate_buffer, error);
+}
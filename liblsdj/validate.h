@@ -0,0 +1,95 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_VALIDATE_H
+#define LSDJ_VALIDATE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#include "error.h"
+#include "sav.h"
+
+// The kind of file an input was validated as
+typedef enum
+{
+    LSDJ_VALIDATE_UNKNOWN = 0,
+    LSDJ_VALIDATE_SAV,
+    LSDJ_VALIDATE_LSDSNG
+} lsdj_validate_kind_t;
+
+// The outcome of validating a single input
+typedef struct
+{
+    // What the input was recognised as
+    lsdj_validate_kind_t kind;
+    
+    // LSDJ_SUCCESS if the input is valid, otherwise the category of the first failed check
+    lsdj_error_code_t code;
+    
+    // A static description of the first failed check, NULL if the input is valid
+    /*! These strings are never allocated, so results don't need to be freed */
+    const char* reason;
+    
+    // The amount of songs that were decompressed and checked
+    /*! For a sav this includes the working memory song */
+    unsigned int songCount;
+} lsdj_validate_result_t;
+
+// Validate a sav or lsdsng in memory
+/*! Unlike lsdj_sav_is_likely_valid() and lsdj_project_is_likely_valid_lsdsng(), this
+    decompresses every song and checks its 'rb' flags. scratch needs to be at least
+    LSDJ_SONG_DECOMPRESSED_SIZE bytes; it is overwritten. Nothing is allocated. */
+void lsdj_validate_memory(const unsigned char* data, size_t size, unsigned char* scratch, lsdj_validate_result_t* result);
+
+// Validate a batch of files, spread out over a number of threads
+/*! Every worker thread reads its files into one reused buffer, and decompresses into one
+    scratch buffer. results needs room for count results, stored in the order of paths.
+    error is only set when the batch as a whole couldn't run; per-file problems end up in
+    the results. */
+void lsdj_validate_files(const char* const* paths, unsigned int count, unsigned int threadCount, lsdj_validate_result_t* results, lsdj_error_t** error);
+
+// Validate a batch of memory buffers, spread out over a number of threads
+void lsdj_validate_memory_batch(const unsigned char* const* data, const size_t* sizes, unsigned int count, unsigned int threadCount, lsdj_validate_result_t* results, lsdj_error_t** error);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -34,10 +34,56 @@
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
 #include <string.h>
 
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "alloc.h"
+#include "trace.h"
 #include "vio.h"
 
+struct lsdj_mapped_file_t
+{
+    // The memory vio data pointing into the mapping
+    lsdj_memory_data_t memory;
+    
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#endif
+};
+
+struct lsdj_buffered_file_t
+{
+    FILE* file;
+    int writable;
+    
+    // A window onto the file, starting at bufferStart
+    /*! The first length bytes mirror the file's contents, including writes that haven't
+        been flushed yet. The cursor is the current position within this window. */
+    unsigned char* buffer;
+    size_t capacity;
+    long bufferStart;
+    size_t length;
+    size_t cursor;
+    
+    // The part of the buffer that still needs to be written to the file
+    size_t dirtyBegin;
+    size_t dirtyEnd;
+    
+    // Set when a flush failed, so the write can be reported as failed on close
+    int failed;
+};
+
 size_t lsdj_fread(void* ptr, size_t size, void* user_data)
 {
     return fread(ptr, size, 1, (FILE*)user_data) * size;
@@ -116,3 +162,638 @@ long lsdj_mseek(long offset, int whence, void* user_data)
     
     return 0;
 }
+
+size_t lsdj_forward_read(void* ptr, size_t size, void* user_data)
+{
+    lsdj_forward_data_t* data = (lsdj_forward_data_t*)user_data;
+    
+    const size_t result = data->source->read(ptr, size, data->source->user_data);
+    data->position += (long)result;
+    
+    return result;
+}
+
+long lsdj_forward_tell(void* user_data)
+{
+    return ((const lsdj_forward_data_t*)user_data)->position;
+}
+
+long lsdj_forward_seek(long offset, int whence, void* user_data)
+{
+    lsdj_forward_data_t* data = (lsdj_forward_data_t*)user_data;
+    
+    // The end of a stream isn't known up front
+    long target = 0;
+    switch (whence)
+    {
+        case SEEK_SET: target = offset; break;
+        case SEEK_CUR: target = data->position + offset; break;
+        default: return 1;
+    }
+    
+    if (target < data->position)
+        return 1;
+    
+    unsigned char skipped[256];
+    while (data->position < target)
+    {
+        const size_t size = (size_t)(target - data->position) < sizeof(skipped) ? (size_t)(target - data->position) : sizeof(skipped);
+        if (lsdj_forward_read(skipped, size, data) != size)
+            return 1;
+    }
+    
+    return 0;
+}
+
+void lsdj_forward_init_vio(lsdj_forward_data_t* data, lsdj_vio_t* source, lsdj_vio_t* vio)
+{
+    data->source = source;
+    data->position = 0;
+    
+    vio->read = lsdj_forward_read;
+    vio->write = NULL;
+    vio->tell = lsdj_forward_tell;
+    vio->seek = lsdj_forward_seek;
+    vio->user_data = data;
+}
+
+lsdj_mapped_file_t* lsdj_mapped_file_open(const char* path, lsdj_error_t** error)
+{
+    if (path == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
+        return NULL;
+    }
+    
+    lsdj_mapped_file_t* file = (lsdj_mapped_file_t*)lsdj_calloc(sizeof(lsdj_mapped_file_t), 1);
+    if (file == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate mapped file");
+        return NULL;
+    }
+    
+#ifdef _WIN32
+    file->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file->file == INVALID_HANDLE_VALUE)
+    {
+        if (error)
+        {
+            char message[512];
+            snprintf(message, 512, "could not open %s for reading", path);
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, message);
+        }
+        lsdj_free(file);
+        return NULL;
+    }
+    
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file->file, &size))
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not retrieve the size of the file to map");
+        lsdj_mapped_file_close(file);
+        return NULL;
+    }
+    
+    // Empty files can't be mapped, but they're not an error either
+    if (size.QuadPart > 0)
+    {
+        file->mapping = CreateFileMappingA(file->file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (file->mapping == NULL)
+        {
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not create file mapping");
+            lsdj_mapped_file_close(file);
+            return NULL;
+        }
+        
+        file->memory.begin = (unsigned char*)MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+        if (file->memory.begin == NULL)
+        {
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not map file into memory");
+            lsdj_mapped_file_close(file);
+            return NULL;
+        }
+    }
+    
+    file->memory.size = (size_t)size.QuadPart;
+#else
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1)
+    {
+        if (error)
+        {
+            char message[512];
+            snprintf(message, 512, "could not open %s for reading", path);
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, message);
+        }
+        lsdj_free(file);
+        return NULL;
+    }
+    
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not retrieve the size of the file to map");
+        close(fd);
+        lsdj_free(file);
+        return NULL;
+    }
+    
+    // Empty files can't be mapped, but they're not an error either
+    if (info.st_size > 0)
+    {
+        void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not map file into memory");
+            close(fd);
+            lsdj_free(file);
+            return NULL;
+        }
+        
+        file->memory.begin = (unsigned char*)data;
+    }
+    
+    // The mapping stays valid after closing the descriptor
+    close(fd);
+    
+    file->memory.size = (size_t)info.st_size;
+#endif
+    
+    file->memory.cur = file->memory.begin;
+    
+    return file;
+}
+
+void lsdj_mapped_file_close(lsdj_mapped_file_t* file)
+{
+    if (file == NULL)
+        return;
+    
+#ifdef _WIN32
+    if (file->memory.begin)
+        UnmapViewOfFile(file->memory.begin);
+    if (file->mapping)
+        CloseHandle(file->mapping);
+    if (file->file != INVALID_HANDLE_VALUE)
+        CloseHandle(file->file);
+#else
+    if (file->memory.begin)
+        munmap(file->memory.begin, file->memory.size);
+#endif
+    
+    lsdj_free(file);
+}
+
+const unsigned char* lsdj_mapped_file_get_data(const lsdj_mapped_file_t* file)
+{
+    return file->memory.begin;
+}
+
+size_t lsdj_mapped_file_get_size(const lsdj_mapped_file_t* file)
+{
+    return file->memory.size;
+}
+
+void lsdj_mapped_file_init_vio(lsdj_mapped_file_t* file, lsdj_vio_t* vio)
+{
+    file->memory.cur = file->memory.begin;
+    
+    vio->read = lsdj_mread;
+    vio->write = NULL;
+    vio->tell = lsdj_mtell;
+    vio->seek = lsdj_mseek;
+    vio->user_data = &file->memory;
+}
+
+lsdj_buffered_file_t* lsdj_buffered_file_open(const char* path, const char* mode, size_t bufferSize, lsdj_error_t** error)
+{
+    if (path == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
+        return NULL;
+    }
+    
+    if (mode == NULL)
+    {
+        lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "mode is NULL");
+        return NULL;
+    }
+    
+    const int writable = strchr(mode, 'w') != NULL || strchr(mode, 'a') != NULL || strchr(mode, '+') != NULL;
+    
+    FILE* handle = fopen(path, mode);
+    if (handle == NULL)
+    {
+        if (error)
+        {
+            char message[512];
+            snprintf(message, 512, "could not open %s for %s", path, strchr(mode, 'r') && !strchr(mode, '+') ? "reading" : "writing");
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, message);
+        }
+        return NULL;
+    }
+    
+    lsdj_buffered_file_t* file = (lsdj_buffered_file_t*)lsdj_calloc(sizeof(lsdj_buffered_file_t), 1);
+    if (bufferSize == 0)
+        bufferSize = LSDJ_BUFFERED_FILE_DEFAULT_SIZE;
+    unsigned char* buffer = file ? (unsigned char*)lsdj_malloc(bufferSize) : NULL;
+    if (buffer == NULL)
+    {
+        lsdj_free(file);
+        fclose(handle);
+        lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate file buffer");
+        return NULL;
+    }
+    
+    file->file = handle;
+    file->writable = writable;
+    file->buffer = buffer;
+    file->capacity = bufferSize;
+    file->bufferStart = ftell(handle);
+    if (file->bufferStart == -1L)
+        file->bufferStart = 0;
+    
+    return file;
+}
+
+// Write the dirty part of the buffer to the file
+/*! Returns 0 on success */
+int flush_buffered_file(lsdj_buffered_file_t* file)
+{
+    if (file->dirtyBegin == file->dirtyEnd)
+        return 0;
+    
+    LSDJ_TRACE_BEGIN(LSDJ_TRACE_FILE_WRITE);
+    
+    const size_t count = file->dirtyEnd - file->dirtyBegin;
+    const int failed = fseek(file->file, file->bufferStart + (long)file->dirtyBegin, SEEK_SET) != 0 ||
+        fwrite(file->buffer + file->dirtyBegin, 1, count, file->file) != count;
+    
+    LSDJ_TRACE_COUNT(LSDJ_TRACE_FILE_WRITE, LSDJ_TRACE_BYTES_OUT, failed ? 0 : count);
+    LSDJ_TRACE_END(LSDJ_TRACE_FILE_WRITE);
+    
+    if (failed)
+    {
+        file->failed = 1;
+        return 1;
+    }
+    
+    file->dirtyBegin = file->dirtyEnd = 0;
+    return 0;
+}
+
+// Move the buffer window so it starts at the current position
+/*! Returns 0 on success */
+int recenter_buffered_file(lsdj_buffered_file_t* file)
+{
+    if (flush_buffered_file(file) != 0)
+        return 1;
+    
+    file->bufferStart += (long)file->cursor;
+    file->length = 0;
+    file->cursor = 0;
+    
+    return 0;
+}
+
+void lsdj_buffered_file_close(lsdj_buffered_file_t* file, lsdj_error_t** error)
+{
+    if (file == NULL)
+        return;
+    
+    const int failed = flush_buffered_file(file) != 0 || file->failed || fclose(file->file) != 0;
+    if (failed && file->writable && (error == NULL || *error == NULL))
+        lsdj_error_new_code(error, LSDJ_ERROR_IO, "could not write buffered data to file");
+    
+    lsdj_free(file->buffer);
+    lsdj_free(file);
+}
+
+size_t lsdj_bread(void* ptr, size_t size, void* user_data)
+{
+    lsdj_buffered_file_t* file = (lsdj_buffered_file_t*)user_data;
+    unsigned char* out = (unsigned char*)ptr;
+    
+    size_t total = 0;
+    while (total < size)
+    {
+        // Serve what we can from the buffer
+        if (file->cursor < file->length)
+        {
+            const size_t available = file->length - file->cursor;
+            const size_t count = size - total < available ? size - total : available;
+            memcpy(out + total, file->buffer + file->cursor, count);
+            file->cursor += count;
+            total += count;
+            continue;
+        }
+        
+        // Read ahead a whole buffer's worth from the file
+        if (recenter_buffered_file(file) != 0)
+            break;
+        
+        if (fseek(file->file, file->bufferStart, SEEK_SET) != 0)
+            break;
+        
+        LSDJ_TRACE_BEGIN(LSDJ_TRACE_FILE_READ);
+        file->length = fread(file->buffer, 1, file->capacity, file->file);
+        LSDJ_TRACE_COUNT(LSDJ_TRACE_FILE_READ, LSDJ_TRACE_BYTES_IN, file->length);
+        LSDJ_TRACE_END(LSDJ_TRACE_FILE_READ);
+        
+        if (file->length == 0)
+            break;
+    }
+    
+    return total;
+}
+
+size_t lsdj_bwrite(const void* ptr, size_t size, void* user_data)
+{
+    lsdj_buffered_file_t* file = (lsdj_buffered_file_t*)user_data;
+    if (!file->writable)
+        return 0;
+    
+    const unsigned char* in = (const unsigned char*)ptr;
+    
+    size_t total = 0;
+    while (total < size)
+    {
+        // Once the buffer is full, write it behind and start a new one
+        if (file->cursor == file->capacity && recenter_buffered_file(file) != 0)
+            break;
+        
+        const size_t available = file->capacity - file->cursor;
+        const size_t count = size - total < available ? size - total : available;
+        memcpy(file->buffer + file->cursor, in + total, count);
+        
+        if (file->dirtyBegin == file->dirtyEnd)
+        {
+            file->dirtyBegin = file->cursor;
+            file->dirtyEnd = file->cursor + count;
+        } else {
+            if (file->cursor < file->dirtyBegin)
+                file->dirtyBegin = file->cursor;
+            if (file->cursor + count > file->dirtyEnd)
+                file->dirtyEnd = file->cursor + count;
+        }
+        
+        file->cursor += count;
+        if (file->cursor > file->length)
+            file->length = file->cursor;
+        
+        total += count;
+    }
+    
+    return total;
+}
+
+long lsdj_btell(void* user_data)
+{
+    const lsdj_buffered_file_t* file = (const lsdj_buffered_file_t*)user_data;
+    return file->bufferStart + (long)file->cursor;
+}
+
+long lsdj_bseek(long offset, int whence, void* user_data)
+{
+    lsdj_buffered_file_t* file = (lsdj_buffered_file_t*)user_data;
+    
+    long target = 0;
+    switch (whence)
+    {
+        case SEEK_SET:
+            target = offset;
+            break;
+        case SEEK_CUR:
+            target = file->bufferStart + (long)file->cursor + offset;
+            break;
+        case SEEK_END:
+        {
+            // Pending writes may have grown the file, so flush those first
+            if (flush_buffered_file(file) != 0 || fseek(file->file, 0, SEEK_END) != 0)
+                return 1;
+            
+            long end = ftell(file->file);
+            if (end == -1L)
+                return 1;
+            
+            const long bufferEnd = file->bufferStart + (long)file->length;
+            target = (end > bufferEnd ? end : bufferEnd) + offset;
+            break;
+        }
+        default:
+            return 1;
+    }
+    
+    if (target < 0)
+        return 1;
+    
+    // Stay within the buffer if we can
+    if (target >= file->bufferStart && target <= file->bufferStart + (long)file->length)
+    {
+        file->cursor = (size_t)(target - file->bufferStart);
+        return 0;
+    }
+    
+    if (flush_buffered_file(file) != 0)
+        return 1;
+    
+    file->bufferStart = target;
+    file->length = 0;
+    file->cursor = 0;
+    
+    return 0;
+}
+
+void lsdj_buffered_file_init_vio(lsdj_buffered_file_t* file, lsdj_vio_t* vio)
+{
+    vio->read = lsdj_bread;
+    vio->write = lsdj_bwrite;
+    vio->tell = lsdj_btell;
+    vio->seek = lsdj_bseek;
+    vio->user_data = file;
+}
+
+// Check whether a file exists and contains exactly the given data
+int file_has_contents(const char* path, const unsigned char* data, size_t size)
+{
+    FILE* file = fopen(path, "rb");
+    if (file == NULL)
+        return 0;
+    
+    unsigned char buffer[0x1000];
+    size_t offset = 0;
+    int identical = 1;
+    while (identical)
+    {
+        const size_t count = fread(buffer, 1, sizeof(buffer), file);
+        if (count == 0)
+            break;
+        
+        identical = offset + count <= size && memcmp(buffer, data + offset, count) == 0;
+        offset += count;
+    }
+    
+    identical = identical && offset == size && !ferror(file);
+    fclose(file);
+    
+    return identical;
+}
+
+void write_file_atomically(const char* path, const unsigned char* data, size_t size, int skipIdentical, lsdj_error_t** error)
+{
+    if (path == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "path is NULL");
+    
+    if (data == NULL && size > 0)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "data is NULL");
+    
+    if (skipIdentical && file_has_contents(path, data, size))
+        return;
+    
+    const size_t tempSize = strlen(path) + 32;
+    char* tempPath = (char*)lsdj_malloc(tempSize);
+    if (tempPath == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate temporary file path");
+    
+#ifdef _WIN32
+    snprintf(tempPath, tempSize, "%s.%lu.tmp", path, (unsigned long)GetCurrentProcessId());
+    
+    HANDLE file = CreateFileA(tempPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        if (error)
+        {
+            char message[512];
+            snprintf(message, 512, "could not open %s for writing", tempPath);
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, message);
+        }
+        lsdj_free(tempPath);
+        return;
+    }
+    
+    int failed = 0;
+    for (size_t offset = 0; offset < size && !failed; )
+    {
+        const DWORD chunk = size - offset > 0x40000000 ? 0x40000000 : (DWORD)(size - offset);
+        DWORD written = 0;
+        failed = !WriteFile(file, data + offset, chunk, &written, NULL) || written == 0;
+        offset += written;
+    }
+    
+    failed = !FlushFileBuffers(file) || failed;
+    failed = !CloseHandle(file) || failed;
+    failed = failed || !MoveFileExA(tempPath, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    
+    if (failed)
+        DeleteFileA(tempPath);
+#else
+    // Take the first temporary file name that isn't in use yet
+    int fd = -1;
+    for (int attempt = 0; attempt < 100 && fd == -1; ++attempt)
+    {
+        snprintf(tempPath, tempSize, "%s.%ld.%d.tmp", path, (long)getpid(), attempt);
+        fd = open(tempPath, O_WRONLY | O_CREAT | O_EXCL, 0666);
+        if (fd == -1 && errno != EEXIST)
+            break;
+    }
+    
+    if (fd == -1)
+    {
+        if (error)
+        {
+            char message[512];
+            snprintf(message, 512, "could not open a temporary file for writing %s", path);
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, message);
+        }
+        lsdj_free(tempPath);
+        return;
+    }
+    
+    // Keep the permissions of the file being replaced
+    struct stat info;
+    if (stat(path, &info) == 0)
+        fchmod(fd, info.st_mode & 07777);
+    
+    int failed = 0;
+    for (size_t offset = 0; offset < size && !failed; )
+    {
+        const ssize_t written = write(fd, data + offset, size - offset);
+        if (written > 0)
+            offset += (size_t)written;
+        else if (written == -1 && errno == EINTR)
+            continue;
+        else
+            failed = 1;
+    }
+    
+    failed = fsync(fd) != 0 || failed;
+    failed = close(fd) != 0 || failed;
+    failed = failed || rename(tempPath, path) != 0;
+    
+    if (failed)
+    {
+        unlink(tempPath);
+    } else {
+        // Make sure the rename itself survives a crash too, on a best-effort basis
+        const char* slash = strrchr(path, '/');
+        if (slash == path)
+        {
+            strcpy(tempPath, "/");
+        } else if (slash) {
+            memcpy(tempPath, path, (size_t)(slash - path));
+            tempPath[slash - path] = '\0';
+        } else {
+            strcpy(tempPath, ".");
+        }
+        
+        const int dir = open(tempPath, O_RDONLY);
+        if (dir != -1)
+        {
+            fsync(dir);
+            close(dir);
+        }
+    }
+#endif
+    
+    if (failed)
+    {
+        if (error)
+        {
+            char message[512];
+            snprintf(message, 512, "could not write %s", path);
+            lsdj_error_new_code(error, LSDJ_ERROR_IO, message);
+        }
+    }
+    
+    lsdj_free(tempPath);
+}
+
+// Write a file atomically and trace it, leaving files that already contain data alone if asked to
+void write_file_traced(const char* path, const unsigned char* data, size_t size, int skipIdentical, lsdj_error_t** error)
+{
+    LSDJ_TRACE_BEGIN(LSDJ_TRACE_FILE_WRITE);
+    
+    lsdj_error_t* writeError = NULL;
+    write_file_atomically(path, data, size, skipIdentical, &writeError);
+    
+    LSDJ_TRACE_COUNT(LSDJ_TRACE_FILE_WRITE, LSDJ_TRACE_BYTES_OUT, writeError ? 0 : size);
+    LSDJ_TRACE_END(LSDJ_TRACE_FILE_WRITE);
+    
+    if (writeError)
+    {
+        if (error)
+            *error = writeError;
+        else
+            lsdj_error_free(writeError);
+    }
+}
+
+void lsdj_atomic_file_write(const char* path, const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    write_file_traced(path, data, size, 0, error);
+}
+
+void lsdj_atomic_file_update(const char* path, const unsigned char* data, size_t size, lsdj_error_t** error)
+{
+    write_file_traced(path, data, size, 1, error);
+}
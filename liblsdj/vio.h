@@ -43,6 +43,8 @@ extern "C" {
 #include <stddef.h>
 #include <stdio.h>
 
+#include "error.h"
+
 // Function pointer types used for virtual I/O
 typedef size_t (*lsdj_vio_read_t)(void* ptr, size_t size, void* user_data);
 typedef size_t (*lsdj_vio_write_t)(const void* ptr, size_t size, void* user_data);
@@ -80,6 +82,71 @@ size_t lsdj_mwrite(const void* ptr, size_t size, void* user_data);
 long lsdj_mtell(void* user_data);
 long lsdj_mseek(long offset, int whence, void* user_data);
     
+// A read-only memory mapping of an entire file
+typedef struct lsdj_mapped_file_t lsdj_mapped_file_t;
+    
+// Map/unmap a file into memory
+lsdj_mapped_file_t* lsdj_mapped_file_open(const char* path, lsdj_error_t** error);
+void lsdj_mapped_file_close(lsdj_mapped_file_t* file);
+    
+// Retrieve the mapped bytes of a file
+const unsigned char* lsdj_mapped_file_get_data(const lsdj_mapped_file_t* file);
+size_t lsdj_mapped_file_get_size(const lsdj_mapped_file_t* file);
+    
+// Set up a vio that reads straight from the mapping, without copying it first
+/*! The vio is backed by the memory functions above, and stays valid as long as the
+    mapping does. Every vio shares the same cursor, so don't read through two at once. */
+void lsdj_mapped_file_init_vio(lsdj_mapped_file_t* file, lsdj_vio_t* vio);
+
+// A vio that only reads forward, on top of one that can't seek or tell (a pipe, socket or HTTP body)
+/*! Positions count from where the source was when this was set up. Seeking forward reads
+    and drops the bytes in between, seeking backward fails. */
+typedef struct
+{
+    lsdj_vio_t* source;
+    long position;
+} lsdj_forward_data_t;
+    
+// Functions for virtual I/O that only goes forward
+size_t lsdj_forward_read(void* ptr, size_t size, void* user_data);
+long lsdj_forward_tell(void* user_data);
+long lsdj_forward_seek(long offset, int whence, void* user_data);
+    
+// Set up a forward-only vio around a source that can only read
+void lsdj_forward_init_vio(lsdj_forward_data_t* data, lsdj_vio_t* source, lsdj_vio_t* vio);
+    
+// The default buffer size for buffered files
+#define LSDJ_BUFFERED_FILE_DEFAULT_SIZE (0x10000)
+    
+// A file accessed through a buffer of its own, so small reads and writes don't each reach stdio
+typedef struct lsdj_buffered_file_t lsdj_buffered_file_t;
+    
+// Open/close a buffered file
+/*! The mode is the same as that of fopen(). Closing flushes pending writes, and reports an
+    error if that fails (unless error already contains one). */
+lsdj_buffered_file_t* lsdj_buffered_file_open(const char* path, const char* mode, size_t bufferSize, lsdj_error_t** error);
+void lsdj_buffered_file_close(lsdj_buffered_file_t* file, lsdj_error_t** error);
+    
+// Functions for virtual I/O into buffered files
+size_t lsdj_bread(void* ptr, size_t size, void* user_data);
+size_t lsdj_bwrite(const void* ptr, size_t size, void* user_data);
+long lsdj_btell(void* user_data);
+long lsdj_bseek(long offset, int whence, void* user_data);
+    
+// Set up a vio that reads from and writes to a buffered file
+void lsdj_buffered_file_init_vio(lsdj_buffered_file_t* file, lsdj_vio_t* vio);
+    
+// Write an entire file in one go, replacing whatever was at path
+/*! The data goes to a temporary file next to path first, which is flushed to disk and then
+    renamed over path. A crash halfway leaves either the old file or the new one, never a
+    truncated one. The permissions of a file that is replaced are kept. */
+void lsdj_atomic_file_write(const char* path, const unsigned char* data, size_t size, lsdj_error_t** error);
+
+// Write an entire file in one go like lsdj_atomic_file_write(), unless nothing would change
+/*! A file that already contains exactly the bytes to be written is left alone, which means
+    it's read first */
+void lsdj_atomic_file_update(const char* path, const unsigned char* data, size_t size, lsdj_error_t** error);
+    
 #ifdef __cplusplus
 }
 #endif
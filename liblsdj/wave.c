@@ -35,9 +35,98 @@
 
 #include <string.h>
 
+#include "alloc.h"
 #include "wave.h"
 
 void lsdj_wave_clear(lsdj_wave_t* wave)
 {
     memcpy(wave->data, LSDJ_DEFAULT_WAVE, LSDJ_WAVE_LENGTH);
 }
+
+void resample_wave_cycle(const float* cycle, size_t cycleLength, float* output)
+{
+    const double step = (double)cycleLength / LSDJ_WAVE_SAMPLE_COUNT;
+    
+    for (size_t i = 0; i < LSDJ_WAVE_SAMPLE_COUNT; ++i)
+    {
+        if (cycleLength < LSDJ_WAVE_SAMPLE_COUNT)
+        {
+            // Upsampling, interpolate between the two nearest samples (the cycle wraps around)
+            double position = ((double)i + 0.5) * step - 0.5;
+            if (position < 0)
+                position += (double)cycleLength;
+            
+            const size_t index = (size_t)position;
+            const float fraction = (float)(position - (double)index);
+            const float next = cycle[(index + 1) % cycleLength];
+            output[i] = cycle[index] + (next - cycle[index]) * fraction;
+        } else {
+            // Downsampling, average the source samples this output sample covers
+            const double begin = (double)i * step;
+            const double end = begin + step;
+            const size_t first = (size_t)begin;
+            size_t last = (size_t)end;
+            if ((double)last == end || last >= cycleLength)
+                last -= 1;
+            
+            double sum = 0;
+            if (first == last)
+            {
+                sum = cycle[first] * (end - begin);
+            } else {
+                for (size_t j = first + 1; j < last; ++j)
+                    sum += cycle[j];
+                sum += cycle[first] * ((double)(first + 1) - begin);
+                sum += cycle[last] * (end - (double)last);
+            }
+            
+            output[i] = (float)(sum / step);
+        }
+    }
+}
+
+void lsdj_wave_from_samples(const float* samples, size_t cycleLength, size_t frameCount, lsdj_wave_t* waves, lsdj_error_t** error)
+{
+    if (frameCount == 0)
+        return;
+    
+    if (samples == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "samples is NULL");
+    
+    if (waves == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "waves is NULL");
+    
+    if (cycleLength == 0)
+        return lsdj_error_new_code(error, LSDJ_ERROR_INVALID_ARGUMENT, "cycleLength is 0");
+    
+    const size_t count = frameCount * LSDJ_WAVE_SAMPLE_COUNT;
+    float* resampled = (float*)lsdj_malloc(count * sizeof(float));
+    if (resampled == NULL)
+        return lsdj_error_new_code(error, LSDJ_ERROR_OUT_OF_MEMORY, "could not allocate resampled waves");
+    
+    for (size_t frame = 0; frame < frameCount; ++frame)
+        resample_wave_cycle(samples + frame * cycleLength, cycleLength, resampled + frame * LSDJ_WAVE_SAMPLE_COUNT);
+    
+    // Normalize over the whole set, so frames keep their loudness relative to each other
+    float peak = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float magnitude = resampled[i] < 0 ? -resampled[i] : resampled[i];
+        peak = magnitude > peak ? magnitude : peak;
+    }
+    
+    const float scale = peak > 0 ? 7.5f / peak : 0;
+    
+    // Quantize to 4 bits, the first sample of a pair goes in the high nibble
+    for (size_t i = 0; i < count; i += 2)
+    {
+        float high = resampled[i] * scale + 8.0f;
+        float low = resampled[i + 1] * scale + 8.0f;
+        high = high < 0 ? 0 : (high > 15 ? 15 : high);
+        low = low < 0 ? 0 : (low > 15 ? 15 : low);
+        
+        waves[i / LSDJ_WAVE_SAMPLE_COUNT].data[(i % LSDJ_WAVE_SAMPLE_COUNT) / 2] = (unsigned char)(((unsigned char)high << 4) | (unsigned char)low);
+    }
+    
+    lsdj_free(resampled);
+}
@@ -40,10 +40,16 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
 #include "command.h"
+#include "error.h"
 
 // The default length of wave data
 #define LSDJ_WAVE_LENGTH (16)
+
+// The amount of 4-bit samples packed into a single wave
+#define LSDJ_WAVE_SAMPLE_COUNT (LSDJ_WAVE_LENGTH * 2)
 static const unsigned char LSDJ_DEFAULT_WAVE[LSDJ_WAVE_LENGTH] = { 0x8E, 0xCD, 0xCC, 0xBB, 0xAA, 0xA9, 0x99, 0x88, 0x87, 0x76, 0x66, 0x55, 0x54, 0x43, 0x32, 0x31 };
     
 // Structure represening a wave for the wave synthesizer
@@ -54,6 +60,13 @@ typedef struct
     
 // Clear all wave data to factory settings
 void lsdj_wave_clear(lsdj_wave_t* wave);
+
+// Convert audio samples into waves
+/*! The samples are frameCount consecutive cycles of cycleLength samples each, in the
+    range -1 to 1. Every cycle is resampled to LSDJ_WAVE_SAMPLE_COUNT samples, the
+    whole set is normalized to its loudest peak and then quantized to 4 bits.
+    waves should point to at least frameCount waves. */
+void lsdj_wave_from_samples(const float* samples, size_t cycleLength, size_t frameCount, lsdj_wave_t* waves, lsdj_error_t** error);
     
 #ifdef __cplusplus
 }
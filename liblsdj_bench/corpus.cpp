@@ -0,0 +1,461 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "../liblsdj/codec.h"
+#include "../liblsdj/compression.h"
+#include "../liblsdj/project.h"
+#include "../liblsdj/sav.h"
+#include "../liblsdj/song.h"
+
+using Image = std::vector<unsigned char>;
+using Clock = std::chrono::steady_clock;
+
+void printHelp(const boost::program_options::options_description& desc)
+{
+    std::cout << "liblsdj_corpus folder|mymusic.sav|song.lsdsng... [-o results.json] [-b baseline.json] [--optimal]\n\n"
+              << desc;
+}
+
+void check(lsdj_error_t* error)
+{
+    if (error == nullptr)
+        return;
+    
+    const std::string message = lsdj_error_get_c_str(error);
+    lsdj_error_free(error);
+    throw std::runtime_error(message);
+}
+
+double millisecondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+}
+
+lsdj_vio_t memoryVio(lsdj_memory_data_t& memory, unsigned char* data, std::size_t size)
+{
+    memory.begin = memory.cur = data;
+    memory.size = size;
+    
+    lsdj_vio_t vio;
+    vio.read = lsdj_mread;
+    vio.write = lsdj_mwrite;
+    vio.tell = lsdj_mtell;
+    vio.seek = lsdj_mseek;
+    vio.user_data = &memory;
+    return vio;
+}
+
+// The outcome of compressing a single song again from scratch
+struct Recompression
+{
+    unsigned int blocks = 0;
+    bool lossless = false;
+    double milliseconds = 0;
+};
+
+// Compress a song the way the context says, and make sure it decompresses to the same bytes
+Recompression recompress(const lsdj_song_t* song, lsdj_codec_context_t* context)
+{
+    Image image(LSDJ_SONG_DECOMPRESSED_SIZE);
+    lsdj_error_t* error = nullptr;
+    lsdj_song_write_to_memory(song, image.data(), image.size(), &error);
+    check(error);
+    
+    Recompression result;
+    
+    Image blocks(BLOCK_COUNT * BLOCK_SIZE);
+    lsdj_memory_data_t wmemory;
+    auto wvio = memoryVio(wmemory, blocks.data(), blocks.size());
+    
+    const auto start = Clock::now();
+    result.blocks = lsdj_compress_with_mode(image.data(), BLOCK_SIZE, 1, BLOCK_COUNT, &wvio, lsdj_codec_context_get_compression_mode(context), &error);
+    result.milliseconds = millisecondsSince(start);
+    check(error);
+    
+    // Zero blocks means the song didn't fit at all
+    if (result.blocks == 0)
+        return result;
+    
+    Image decompressed(LSDJ_SONG_DECOMPRESSED_SIZE);
+    lsdj_memory_data_t rmemory;
+    auto rvio = memoryVio(rmemory, blocks.data(), result.blocks * BLOCK_SIZE);
+    lsdj_memory_data_t dmemory;
+    auto dvio = memoryVio(dmemory, decompressed.data(), decompressed.size());
+    
+    lsdj_decompress(&rvio, &dvio, nullptr, BLOCK_SIZE, &error);
+    result.lossless = error == nullptr && decompressed == image;
+    lsdj_error_free(error);
+    
+    return result;
+}
+
+// Describe a song: its original and new block counts, and whether it survived recompression
+boost::property_tree::ptree measureSong(const std::string& name, const lsdj_project_t* project, lsdj_codec_context_t* context, double& compressMilliseconds, bool& lossless)
+{
+    unsigned int originalBlocks = 0;
+    lsdj_project_get_compressed_song(project, &originalBlocks);
+    
+    lsdj_error_t* error = nullptr;
+    const lsdj_song_t* song = lsdj_project_load_song(project, &error);
+    check(error);
+    
+    const auto result = recompress(song, context);
+    compressMilliseconds += result.milliseconds;
+    lossless = lossless && result.lossless;
+    
+    boost::property_tree::ptree tree;
+    tree.put("name", name);
+    tree.put("original_blocks", originalBlocks);
+    tree.put("blocks", result.blocks);
+    tree.put("lossless", result.lossless);
+    return tree;
+}
+
+std::string projectName(const lsdj_project_t* project)
+{
+    char name[LSDJ_PROJECT_NAME_LENGTH + 1] = { 0 };
+    lsdj_project_get_name(project, name, LSDJ_PROJECT_NAME_LENGTH);
+    return name;
+}
+
+boost::property_tree::ptree measureSav(const Image& image, lsdj_codec_context_t* context)
+{
+    boost::property_tree::ptree tree;
+    tree.put("kind", "sav");
+    
+    // Timing a full read decompresses every song
+    lsdj_error_t* error = nullptr;
+    auto start = Clock::now();
+    lsdj_sav_t* sav = lsdj_sav_read_from_memory(image.data(), image.size(), &error);
+    tree.put("read_ms", millisecondsSince(start));
+    check(error);
+    lsdj_sav_free(sav);
+    
+    // The songs are measured on a lazily read sav, which still has the original blocks
+    sav = lsdj_sav_read_lazy_from_memory(image.data(), image.size(), &error);
+    check(error);
+    
+    Image output(LSDJ_SAV_SIZE);
+    lsdj_sav_write_to_memory(sav, output.data(), output.size(), &error);
+    tree.put("identical", error == nullptr && output == image);
+    lsdj_error_free(error);
+    error = nullptr;
+    
+    boost::property_tree::ptree songs;
+    unsigned int originalBlocks = 0;
+    unsigned int blocks = 0;
+    double compressMilliseconds = 0;
+    bool lossless = true;
+    for (unsigned int i = 0; i < lsdj_sav_get_project_count(sav); ++i)
+    {
+        const lsdj_project_t* project = lsdj_sav_get_project(sav, static_cast<unsigned char>(i));
+        if (!lsdj_project_has_song(project))
+            continue;
+        
+        auto song = measureSong(projectName(project), project, context, compressMilliseconds, lossless);
+        song.put("index", i);
+        originalBlocks += song.get<unsigned int>("original_blocks");
+        blocks += song.get<unsigned int>("blocks");
+        songs.push_back({"", song});
+    }
+    
+    // Writing with every song marked as changed compresses all of them again
+    for (unsigned int i = 0; i < lsdj_sav_get_project_count(sav); ++i)
+    {
+        lsdj_song_t* song = lsdj_project_get_song(lsdj_sav_get_project(sav, static_cast<unsigned char>(i)));
+        if (song)
+            lsdj_song_set_dirty_flag(song, 1);
+    }
+    
+    lsdj_sav_write_options_t options;
+    lsdj_sav_write_options_init(&options);
+    options.context = context;
+    
+    start = Clock::now();
+    lsdj_sav_write_to_memory_with_options(sav, output.data(), output.size(), &options, &error);
+    tree.put("write_ms", millisecondsSince(start));
+    lsdj_sav_free(sav);
+    check(error);
+    
+    tree.put("compress_ms", compressMilliseconds);
+    tree.put("original_blocks", originalBlocks);
+    tree.put("blocks", blocks);
+    tree.put("lossless", lossless);
+    tree.add_child("songs", songs);
+    return tree;
+}
+
+boost::property_tree::ptree measureLsdsng(const Image& image, lsdj_codec_context_t* context)
+{
+    boost::property_tree::ptree tree;
+    tree.put("kind", "lsdsng");
+    
+    lsdj_error_t* error = nullptr;
+    auto start = Clock::now();
+    lsdj_project_t* project = lsdj_project_read_lsdsng_from_memory(image.data(), image.size(), &error);
+    tree.put("read_ms", millisecondsSince(start));
+    check(error);
+    lsdj_project_free(project);
+    
+    project = lsdj_project_read_lsdsng_lazy_from_memory(image.data(), image.size(), &error);
+    check(error);
+    
+    Image output(image.size() + BLOCK_COUNT * BLOCK_SIZE);
+    const auto size = lsdj_project_write_lsdsng_to_memory(project, output.data(), output.size(), &error);
+    tree.put("identical", error == nullptr && size == image.size() && std::equal(image.begin(), image.end(), output.begin()));
+    lsdj_error_free(error);
+    error = nullptr;
+    
+    double compressMilliseconds = 0;
+    bool lossless = true;
+    auto song = measureSong(projectName(project), project, context, compressMilliseconds, lossless);
+    
+    lsdj_song_set_dirty_flag(lsdj_project_get_song(project), 1);
+    start = Clock::now();
+    lsdj_project_write_lsdsng_to_memory_with_context(project, output.data(), output.size(), context, &error);
+    tree.put("write_ms", millisecondsSince(start));
+    lsdj_project_free(project);
+    check(error);
+    
+    tree.put("compress_ms", compressMilliseconds);
+    tree.put("original_blocks", song.get<unsigned int>("original_blocks"));
+    tree.put("blocks", song.get<unsigned int>("blocks"));
+    tree.put("lossless", lossless);
+    
+    boost::property_tree::ptree songs;
+    songs.push_back({"", song});
+    tree.add_child("songs", songs);
+    return tree;
+}
+
+Image readFile(const boost::filesystem::path& path)
+{
+    std::ifstream stream(path.string(), std::ios_base::binary);
+    if (!stream.is_open())
+        throw std::runtime_error("could not open " + path.string());
+    
+    return Image((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+}
+
+// Recursively find every .sav and .lsdsng in the inputs, in a stable order
+void collect(const boost::filesystem::path& path, std::vector<boost::filesystem::path>& paths)
+{
+    if (boost::filesystem::is_directory(path))
+    {
+        std::vector<boost::filesystem::path> contents;
+        for (auto it = boost::filesystem::directory_iterator(path); it != boost::filesystem::directory_iterator(); ++it)
+            contents.emplace_back(it->path());
+        
+        std::sort(contents.begin(), contents.end());
+        for (const auto& content : contents)
+        {
+            if (boost::filesystem::is_directory(content) || content.extension() == ".sav" || content.extension() == ".lsdsng")
+                collect(content, paths);
+        }
+    } else {
+        paths.emplace_back(path);
+    }
+}
+
+// Compare the results to a baseline, returns the amount of regressions
+/*! Growing block counts and round-trips that stopped working count as regressions, timing
+    differences are only reported */
+unsigned int compare(const boost::property_tree::ptree& results, const boost::property_tree::ptree& baseline)
+{
+    std::map<std::string, const boost::property_tree::ptree*> baselineFiles;
+    for (const auto& file : baseline.get_child("files"))
+        baselineFiles[file.second.get<std::string>("path")] = &file.second;
+    
+    unsigned int regressions = 0;
+    double time = 0;
+    double baselineTime = 0;
+    for (const auto& file : results.get_child("files"))
+    {
+        const auto path = file.second.get<std::string>("path");
+        const auto it = baselineFiles.find(path);
+        if (it == baselineFiles.end())
+        {
+            std::cout << "new\t" << path << std::endl;
+            continue;
+        }
+        
+        const auto& before = *it->second;
+        
+        // Only files that weren't already broken can regress
+        if (!file.second.count("error") && !before.count("error"))
+        {
+            for (const auto& key : { "identical", "lossless" })
+            {
+                if (before.get<bool>(key) && !file.second.get<bool>(key))
+                {
+                    std::cout << "regression\t" << path << "\tno longer " << key << std::endl;
+                    ++regressions;
+                }
+            }
+            
+            const auto blocks = file.second.get<unsigned int>("blocks");
+            const auto baselineBlocks = before.get<unsigned int>("blocks");
+            if (blocks > baselineBlocks)
+            {
+                std::cout << "regression\t" << path << "\tblocks " << baselineBlocks << " -> " << blocks << std::endl;
+                ++regressions;
+            } else if (blocks < baselineBlocks) {
+                std::cout << "improvement\t" << path << "\tblocks " << baselineBlocks << " -> " << blocks << std::endl;
+            }
+            
+            for (const auto& key : { "read_ms", "write_ms", "compress_ms" })
+            {
+                time += file.second.get<double>(key);
+                baselineTime += before.get<double>(key);
+            }
+        } else if (!before.count("error")) {
+            std::cout << "regression\t" << path << "\t" << file.second.get<std::string>("error") << std::endl;
+            ++regressions;
+        }
+    }
+    
+    if (baselineTime > 0)
+        std::cout << "time\t" << baselineTime << " ms -> " << time << " ms (" << (time / baselineTime * 100.0) << "%)" << std::endl;
+    
+    return regressions;
+}
+
+int main(int argc, char* argv[])
+{
+    boost::program_options::options_description hidden{"Hidden"};
+    hidden.add_options()
+        ("file", boost::program_options::value<std::vector<std::string>>(), ".sav or .lsdsng file(s) or folders");
+    
+    boost::program_options::options_description cmd{"Options"};
+    cmd.add_options()
+        ("help,h", "Help screen")
+        ("output,o", boost::program_options::value<std::string>(), "Write the results to a JSON file, instead of stdout")
+        ("baseline,b", boost::program_options::value<std::string>(), "Compare the results to the JSON results of an earlier run")
+        ("optimal", "Measure the optimal compression mode, instead of the default one");
+    
+    boost::program_options::options_description options;
+    options.add(cmd).add(hidden);
+    
+    boost::program_options::positional_options_description positionalOptions;
+    positionalOptions.add("file", -1);
+    
+    try
+    {
+        boost::program_options::variables_map vm;
+        boost::program_options::command_line_parser parser(argc, argv);
+        parser = parser.options(options);
+        parser = parser.positional(positionalOptions);
+        boost::program_options::store(parser.run(), vm);
+        boost::program_options::notify(vm);
+        
+        if (vm.count("help") || !vm.count("file"))
+        {
+            printHelp(cmd);
+            return 0;
+        }
+        
+        // One context measures every file, the compression mode is set on it
+        lsdj_error_t* error = nullptr;
+        std::unique_ptr<lsdj_codec_context_t, void(*)(lsdj_codec_context_t*)> context(lsdj_codec_context_new(&error), lsdj_codec_context_free);
+        check(error);
+        
+        if (vm.count("optimal"))
+            lsdj_codec_context_set_compression_mode(context.get(), LSDJ_COMPRESSION_OPTIMAL);
+        
+        std::vector<boost::filesystem::path> paths;
+        for (const auto& input : vm["file"].as<std::vector<std::string>>())
+            collect(input, paths);
+        
+        // Measure every file, failures are recorded rather than stopping the run
+        boost::property_tree::ptree files;
+        for (const auto& path : paths)
+        {
+            boost::property_tree::ptree file;
+            try
+            {
+                const auto image = readFile(path);
+                file = path.extension() == ".lsdsng" ? measureLsdsng(image, context.get()) : measureSav(image, context.get());
+            } catch (const std::exception& e) {
+                file.clear();
+                file.put("error", e.what());
+            }
+            
+            file.put("path", path.generic_string());
+            files.push_back({"", file});
+        }
+        
+        boost::property_tree::ptree results;
+        results.add_child("files", files);
+        
+        if (vm.count("output"))
+            boost::property_tree::write_json(vm["output"].as<std::string>(), results);
+        else if (!vm.count("baseline"))
+            boost::property_tree::write_json(std::cout, results);
+        
+        if (vm.count("baseline"))
+        {
+            boost::property_tree::ptree baseline;
+            boost::property_tree::read_json(vm["baseline"].as<std::string>(), baseline);
+            return compare(results, baseline) == 0 ? 0 : 1;
+        }
+        
+        return 0;
+    } catch (const boost::program_options::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+}
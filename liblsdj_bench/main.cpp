@@ -0,0 +1,410 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "../liblsdj/compression.h"
+#include "../liblsdj/instrument.h"
+#include "../liblsdj/sav.h"
+#include "../liblsdj/song.h"
+#include "../liblsdj/song_layout.h"
+#include "../liblsdj/wave.h"
+
+using Image = std::vector<unsigned char>;
+
+// A song (or sav) image that every stage is measured on
+struct Input
+{
+    std::string name;
+    Image image;
+    bool isSav;
+};
+
+void check(lsdj_error_t* error)
+{
+    if (error == nullptr)
+        return;
+    
+    const std::string message = lsdj_error_get_c_str(error);
+    lsdj_error_free(error);
+    throw std::runtime_error(message);
+}
+
+lsdj_vio_t memoryVio(lsdj_memory_data_t& memory, unsigned char* data, std::size_t size)
+{
+    memory.begin = memory.cur = data;
+    memory.size = size;
+    
+    lsdj_vio_t vio;
+    vio.read = lsdj_mread;
+    vio.write = lsdj_mwrite;
+    vio.tell = lsdj_mtell;
+    vio.seek = lsdj_mseek;
+    vio.user_data = &memory;
+    return vio;
+}
+
+// A freshly created song, which compresses almost entirely into default runs
+Image emptySong()
+{
+    lsdj_error_t* error = nullptr;
+    lsdj_song_t* song = lsdj_song_new(&error);
+    check(error);
+    
+    Image image(LSDJ_SONG_DECOMPRESSED_SIZE);
+    lsdj_song_write_to_memory(song, image.data(), image.size(), &error);
+    lsdj_song_free(song);
+    check(error);
+    
+    return image;
+}
+
+// Every instrument in use with default settings, and every wave the default one
+Image defaultWaveSong()
+{
+    auto image = emptySong();
+    
+    for (std::size_t i = 0; i < 64; ++i)
+    {
+        image[SONG_INSTR_ALLOC_TABLE_ADDRESS + i] = 1;
+        std::memcpy(&image[SONG_INSTRUMENTS_ADDRESS + i * SONG_INSTRUMENT_BYTE_COUNT], LSDJ_DEFAULT_INSTRUMENT, SONG_INSTRUMENT_BYTE_COUNT);
+    }
+    
+    for (std::size_t i = 0; i < LSDJ_WAVE_COUNT; ++i)
+        std::memcpy(&image[SONG_WAVES_ADDRESS + i * LSDJ_WAVE_LENGTH], LSDJ_DEFAULT_WAVE, LSDJ_WAVE_LENGTH);
+    
+    return image;
+}
+
+// Every phrase and chain in use and filled with pseudo-random notes and commands
+Image densePhraseSong()
+{
+    auto image = emptySong();
+    
+    unsigned int seed = 0x12345678;
+    const auto random = [&seed](unsigned int range)
+    {
+        seed = seed * 1103515245 + 12345;
+        return static_cast<unsigned char>((seed >> 16) % range);
+    };
+    
+    std::memset(&image[SONG_PHRASE_ALLOC_TABLE_ADDRESS], 0xFF, 32);
+    std::memset(&image[SONG_CHAIN_ALLOC_TABLE_ADDRESS], 0xFF, 16);
+    
+    for (std::size_t i = 0; i < 0xFF * 16; ++i)
+    {
+        image[SONG_PHRASE_NOTES_ADDRESS + i] = random(0x60);
+        image[SONG_PHRASE_INSTRUMENTS_ADDRESS + i] = random(4) ? random(0x40) : 0xFF;
+        image[SONG_PHRASE_COMMANDS_ADDRESS + i] = random(3) ? 0 : random(0x13);
+        image[SONG_PHRASE_VALUES_ADDRESS + i] = random(0x100);
+    }
+    
+    for (std::size_t i = 0; i < 0x80 * 16; ++i)
+    {
+        image[SONG_CHAIN_PHRASES_ADDRESS + i] = random(0xFF);
+        image[SONG_CHAIN_TRANSPOSITIONS_ADDRESS + i] = random(4) ? 0 : random(0x10);
+    }
+    
+    for (std::size_t i = 0; i < 0x100 * 4; ++i)
+        image[SONG_ROWS_ADDRESS + i] = random(0x80);
+    
+    return image;
+}
+
+// A sav with the synthetic songs as its projects, and the dense one in working memory
+Image syntheticSav(const std::vector<Input>& songs)
+{
+    lsdj_error_t* error = nullptr;
+    lsdj_sav_t* sav = lsdj_sav_new(&error);
+    check(error);
+    
+    for (std::size_t i = 0; i < songs.size(); ++i)
+    {
+        lsdj_project_t* project = lsdj_project_new(&error);
+        check(error);
+        
+        lsdj_project_set_name(project, songs[i].name.c_str(), songs[i].name.size());
+        lsdj_project_set_song(project, lsdj_song_read_from_memory(songs[i].image.data(), songs[i].image.size(), &error));
+        check(error);
+        
+        lsdj_sav_set_project(sav, static_cast<unsigned char>(i), project, &error);
+        check(error);
+    }
+    
+    lsdj_sav_set_working_memory_song(sav, lsdj_song_read_from_memory(songs.back().image.data(), songs.back().image.size(), &error), 0);
+    check(error);
+    
+    Image image(LSDJ_SAV_SIZE);
+    lsdj_sav_write_to_memory(sav, image.data(), image.size(), &error);
+    lsdj_sav_free(sav);
+    check(error);
+    
+    return image;
+}
+
+// Report throughput in bytes and songs per iteration
+void setCounters(benchmark::State& state, std::size_t bytes, std::size_t songs)
+{
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * bytes));
+    state.counters["time/song"] = benchmark::Counter(static_cast<double>(songs), benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+void benchCompress(benchmark::State& state, const Image& image)
+{
+    Image blocks(BLOCK_COUNT * BLOCK_SIZE);
+    for (auto _ : state)
+    {
+        lsdj_memory_data_t memory;
+        auto vio = memoryVio(memory, blocks.data(), blocks.size());
+        
+        lsdj_error_t* error = nullptr;
+        benchmark::DoNotOptimize(lsdj_compress(image.data(), BLOCK_SIZE, 1, BLOCK_COUNT, &vio, &error));
+        check(error);
+    }
+    
+    setCounters(state, image.size(), 1);
+}
+
+void benchDecompress(benchmark::State& state, const Image& image)
+{
+    Image blocks(BLOCK_COUNT * BLOCK_SIZE);
+    {
+        lsdj_memory_data_t memory;
+        auto vio = memoryVio(memory, blocks.data(), blocks.size());
+        
+        lsdj_error_t* error = nullptr;
+        lsdj_compress(image.data(), BLOCK_SIZE, 1, BLOCK_COUNT, &vio, &error);
+        check(error);
+    }
+    
+    Image decompressed(LSDJ_SONG_DECOMPRESSED_SIZE);
+    for (auto _ : state)
+    {
+        lsdj_memory_data_t rmemory;
+        auto rvio = memoryVio(rmemory, blocks.data(), blocks.size());
+        lsdj_memory_data_t wmemory;
+        auto wvio = memoryVio(wmemory, decompressed.data(), decompressed.size());
+        
+        lsdj_error_t* error = nullptr;
+        lsdj_decompress(&rvio, &wvio, nullptr, BLOCK_SIZE, &error);
+        check(error);
+        benchmark::DoNotOptimize(decompressed.data());
+    }
+    
+    setCounters(state, image.size(), 1);
+}
+
+void benchSongRead(benchmark::State& state, const Image& image)
+{
+    for (auto _ : state)
+    {
+        lsdj_error_t* error = nullptr;
+        lsdj_song_t* song = lsdj_song_read_from_memory(image.data(), image.size(), &error);
+        check(error);
+        lsdj_song_free(song);
+    }
+    
+    setCounters(state, image.size(), 1);
+}
+
+void benchSongWrite(benchmark::State& state, const Image& image)
+{
+    lsdj_error_t* error = nullptr;
+    lsdj_song_t* song = lsdj_song_read_from_memory(image.data(), image.size(), &error);
+    check(error);
+    
+    Image output(LSDJ_SONG_DECOMPRESSED_SIZE);
+    for (auto _ : state)
+    {
+        lsdj_song_write_to_memory(song, output.data(), output.size(), &error);
+        check(error);
+        benchmark::DoNotOptimize(output.data());
+    }
+    
+    lsdj_song_free(song);
+    setCounters(state, image.size(), 1);
+}
+
+// The amount of songs in a sav, counting the working memory one
+std::size_t countSongs(const lsdj_sav_t* sav)
+{
+    std::size_t count = 1;
+    for (unsigned int i = 0; i < lsdj_sav_get_project_count(sav); ++i)
+        count += lsdj_project_has_song(lsdj_sav_get_project(sav, static_cast<unsigned char>(i))) ? 1 : 0;
+    return count;
+}
+
+void benchSavRead(benchmark::State& state, const Image& image)
+{
+    lsdj_error_t* error = nullptr;
+    lsdj_sav_t* sav = lsdj_sav_read_from_memory(image.data(), image.size(), &error);
+    check(error);
+    const auto songs = countSongs(sav);
+    lsdj_sav_free(sav);
+    
+    for (auto _ : state)
+    {
+        sav = lsdj_sav_read_from_memory(image.data(), image.size(), &error);
+        check(error);
+        lsdj_sav_free(sav);
+    }
+    
+    setCounters(state, image.size(), songs);
+}
+
+// Write a sav whose songs are all marked as changed, so every one of them is compressed
+void benchSavWrite(benchmark::State& state, const Image& image)
+{
+    lsdj_error_t* error = nullptr;
+    lsdj_sav_t* sav = lsdj_sav_read_from_memory(image.data(), image.size(), &error);
+    check(error);
+    const auto songs = countSongs(sav);
+    
+    Image output(LSDJ_SAV_SIZE);
+    for (auto _ : state)
+    {
+        state.PauseTiming();
+        for (unsigned int i = 0; i < lsdj_sav_get_project_count(sav); ++i)
+        {
+            lsdj_song_t* song = lsdj_project_get_song(lsdj_sav_get_project(sav, static_cast<unsigned char>(i)));
+            if (song)
+                lsdj_song_set_dirty_flag(song, 1);
+        }
+        state.ResumeTiming();
+        
+        lsdj_sav_write_to_memory(sav, output.data(), output.size(), &error);
+        check(error);
+        benchmark::DoNotOptimize(output.data());
+    }
+    
+    lsdj_sav_free(sav);
+    setCounters(state, output.size(), songs);
+}
+
+// Take the working memory song out of a sav, to measure the song stages on
+Input workingMemorySong(const Input& sav)
+{
+    lsdj_error_t* error = nullptr;
+    lsdj_sav_t* parsed = lsdj_sav_read_from_memory(sav.image.data(), sav.image.size(), &error);
+    check(error);
+    
+    Image image(LSDJ_SONG_DECOMPRESSED_SIZE);
+    lsdj_song_write_to_memory(lsdj_sav_get_working_memory_song(parsed), image.data(), image.size(), &error);
+    lsdj_sav_free(parsed);
+    check(error);
+    
+    return { sav.name + "/wm", image, false };
+}
+
+Image readFile(const std::string& path)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr)
+        throw std::runtime_error("could not open " + path);
+    
+    Image image(LSDJ_SAV_SIZE + 1);
+    image.resize(fread(image.data(), 1, image.size(), file));
+    fclose(file);
+    
+    if (image.size() != LSDJ_SAV_SIZE)
+        throw std::runtime_error(path + " is not a sav");
+    
+    return image;
+}
+
+int main(int argc, char* argv[])
+{
+    benchmark::Initialize(&argc, argv);
+    
+    try
+    {
+        // The synthetic songs, and a sav containing them
+        std::vector<Input> songs = {
+            { "empty", emptySong(), false },
+            { "waves", defaultWaveSong(), false },
+            { "dense", densePhraseSong(), false }
+        };
+        
+        std::vector<Input> savs = { { "synthetic", syntheticSav(songs), true } };
+        
+        // Any remaining arguments are savs from a corpus to measure on as well
+        for (int i = 1; i < argc; ++i)
+        {
+            const std::string path = argv[i];
+            savs.push_back({ path.substr(path.find_last_of("/\\") + 1), readFile(path), true });
+            songs.emplace_back(workingMemorySong(savs.back()));
+        }
+        
+        using Stage = void(*)(benchmark::State&, const Image&);
+        const std::vector<std::pair<const char*, Stage>> songStages = {
+            { "compress", benchCompress },
+            { "decompress", benchDecompress },
+            { "song_read", benchSongRead },
+            { "song_write", benchSongWrite }
+        };
+        const std::vector<std::pair<const char*, Stage>> savStages = {
+            { "sav_read", benchSavRead },
+            { "sav_write", benchSavWrite }
+        };
+        
+        for (const auto& stage : songStages)
+        {
+            for (const auto& input : songs)
+                benchmark::RegisterBenchmark((std::string(stage.first) + "/" + input.name).c_str(), stage.second, input.image);
+        }
+        
+        for (const auto& stage : savStages)
+        {
+            for (const auto& input : savs)
+                benchmark::RegisterBenchmark((std::string(stage.first) + "/" + input.name).c_str(), stage.second, input.image);
+        }
+        
+        benchmark::RunSpecifiedBenchmarks();
+        benchmark::Shutdown();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    
+    return 0;
+}
@@ -0,0 +1,137 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../liblsdj/alloc.h"
+#include "../liblsdj/carve.h"
+#include "../liblsdj/sav.h"
+#include "../liblsdj/song.h"
+
+// Count the allocations liblsdj hasn't given back yet
+void* counting_allocate(size_t size, void* user_data)
+{
+    void* ptr = malloc(size);
+    if (ptr)
+        *(size_t*)user_data += 1;
+    
+    return ptr;
+}
+
+void counting_deallocate(void* ptr, void* user_data)
+{
+    *(size_t*)user_data -= 1;
+    free(ptr);
+}
+
+int count_visitor(const lsdj_carve_result_t* result, void* user_data)
+{
+    if (result->project && lsdj_project_get_song_const(result->project))
+        *(size_t*)user_data += 1;
+    
+    return 0;
+}
+
+// Write a sav with one project, followed by a loose song
+/*! Returns 0 on failure */
+int build_dump(unsigned char* dump)
+{
+    lsdj_error_t* error = NULL;
+    lsdj_sav_t* sav = lsdj_sav_new(&error);
+    lsdj_song_t* song = error ? NULL : lsdj_song_new(&error);
+    if (song)
+        lsdj_project_set_song(lsdj_sav_get_project(sav, 0), song);
+    if (error == NULL)
+        lsdj_sav_write_to_memory(sav, dump, LSDJ_SAV_SIZE, &error);
+    lsdj_sav_free(sav);
+    
+    song = error ? NULL : lsdj_song_new(&error);
+    if (error == NULL)
+        lsdj_song_write_to_memory(song, dump + LSDJ_SAV_SIZE, LSDJ_SONG_DECOMPRESSED_SIZE, &error);
+    lsdj_song_free(song);
+    
+    if (error)
+    {
+        fprintf(stderr, "could not build the dump: %s\n", lsdj_error_get_c_str(error));
+        lsdj_error_free(error);
+        return 0;
+    }
+    
+    return 1;
+}
+
+int main(void)
+{
+    static unsigned char dump[LSDJ_SAV_SIZE + LSDJ_SONG_DECOMPRESSED_SIZE];
+    if (!build_dump(dump))
+        return 1;
+    
+    size_t outstanding = 0;
+    lsdj_allocator_t allocator = { counting_allocate, counting_deallocate, &outstanding };
+    lsdj_set_allocator(&allocator);
+    
+    lsdj_error_t* error = NULL;
+    size_t visited = 0;
+    const size_t found = lsdj_carve_memory(dump, sizeof(dump), count_visitor, &visited, &error);
+    
+    lsdj_set_allocator(NULL);
+    
+    if (error)
+    {
+        fprintf(stderr, "carving failed: %s\n", lsdj_error_get_c_str(error));
+        lsdj_error_free(error);
+        return 1;
+    }
+    
+    int failures = 0;
+    
+    // The project, the working memory song and the loose song
+    if (found != 3 || visited != 3)
+    {
+        fprintf(stderr, "found %zu projects and visited %zu with a song, expected 3\n", found, visited);
+        ++failures;
+    }
+    
+    if (outstanding != 0)
+    {
+        fprintf(stderr, "%zu allocations leaked while carving\n", outstanding);
+        ++failures;
+    }
+    
+    return failures ? 1 : 0;
+}
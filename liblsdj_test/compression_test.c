@@ -0,0 +1,384 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../liblsdj/codec.h"
+#include "../liblsdj/compression.h"
+#include "../liblsdj/sav.h"
+#include "../liblsdj/song.h"
+#include "../liblsdj/song_layout.h"
+
+// The amount of songs generated, each with more of its phrase notes mixed up than the last
+#define SONG_COUNT (LSDJ_SAV_PROJECT_COUNT / 4)
+#define MIXED_SIZE_STEP (0x200)
+
+// Generate a song whose first phrases hold a deterministic mix of runs and noise
+/*! data receives the song as it's written, which is what the tests compress. Returns NULL
+    on failure. */
+lsdj_song_t* generate_song(unsigned int seed, size_t mixedSize, unsigned char* data)
+{
+    lsdj_error_t* error = NULL;
+    lsdj_song_t* song = lsdj_song_new(&error);
+    if (song)
+        lsdj_song_write_to_memory(song, data, LSDJ_SONG_DECOMPRESSED_SIZE, &error);
+    lsdj_song_free(song);
+    song = NULL;
+    
+    unsigned int state = seed;
+    for (size_t i = 0; i < mixedSize; )
+    {
+        state = state * 1103515245u + 12345u;
+        const unsigned char value = (unsigned char)(state >> 16);
+        const size_t run = (state & 0x100) ? 1 : 2 + ((state >> 24) & 0x7);
+        for (size_t j = 0; j < run && i < mixedSize; ++j)
+            data[SONG_PHRASE_NOTES_ADDRESS + i++] = value;
+    }
+    
+    // Unallocated phrases are written as empty ones, so allocate the ones that were mixed up
+    for (size_t phrase = 0; phrase * LSDJ_PHRASE_LENGTH < mixedSize; ++phrase)
+        data[SONG_PHRASE_ALLOC_TABLE_ADDRESS + phrase / 8] |= (unsigned char)(1 << (phrase % 8));
+    
+    if (error == NULL)
+        song = lsdj_song_read_from_memory(data, LSDJ_SONG_DECOMPRESSED_SIZE, &error);
+    if (error == NULL)
+        lsdj_song_write_to_memory(song, data, LSDJ_SONG_DECOMPRESSED_SIZE, &error);
+    
+    if (error)
+    {
+        fprintf(stderr, "could not generate song %u: %s\n", seed, lsdj_error_get_c_str(error));
+        lsdj_error_free(error);
+        lsdj_song_free(song);
+        return NULL;
+    }
+    
+    return song;
+}
+
+// Check that the size estimates of a song match the blocks its compression writes
+/*! Returns the amount of mismatches */
+int check_song_size(const lsdj_song_t* song, const unsigned char* data, lsdj_compression_mode_t mode, unsigned int seed)
+{
+    static unsigned char blocks[BLOCK_COUNT * BLOCK_SIZE];
+    
+    lsdj_memory_data_t wmem;
+    wmem.begin = wmem.cur = blocks;
+    wmem.size = sizeof(blocks);
+    
+    lsdj_vio_t wvio;
+    wvio.read = NULL;
+    wvio.write = lsdj_mwrite;
+    wvio.tell = lsdj_mtell;
+    wvio.seek = lsdj_mseek;
+    wvio.user_data = &wmem;
+    
+    lsdj_error_t* error = NULL;
+    unsigned int estimatedBlockCount = 0;
+    const size_t estimatedSize = lsdj_compress_size(data, BLOCK_SIZE, mode, &estimatedBlockCount, &error);
+    const unsigned int songBlockCount = error ? 0 : lsdj_song_compressed_block_count(song, mode, &error);
+    const unsigned int writtenBlockCount = error ? 0 : lsdj_compress_with_mode(data, BLOCK_SIZE, 1, BLOCK_COUNT, &wvio, mode, &error);
+    
+    if (error)
+    {
+        fprintf(stderr, "could not compress song %u: %s\n", seed, lsdj_error_get_c_str(error));
+        lsdj_error_free(error);
+        return 1;
+    }
+    
+    const char* modeName = mode == LSDJ_COMPRESSION_OPTIMAL ? "optimal" : "greedy";
+    int failures = 0;
+    
+    if (estimatedBlockCount != writtenBlockCount || songBlockCount != writtenBlockCount)
+    {
+        fprintf(stderr, "song %u (%s) was estimated at %u blocks, counted at %u, but took %u\n", seed, modeName, estimatedBlockCount, songBlockCount, writtenBlockCount);
+        ++failures;
+    }
+    
+    // Only the last block can have room left at its end
+    if (writtenBlockCount == 0 || estimatedSize <= (writtenBlockCount - 1) * BLOCK_SIZE || estimatedSize > writtenBlockCount * BLOCK_SIZE)
+    {
+        fprintf(stderr, "song %u (%s) was estimated at 0x%zx bytes, which doesn't fit its %u blocks\n", seed, modeName, estimatedSize, writtenBlockCount);
+        ++failures;
+    }
+    
+    return failures;
+}
+
+// Check that the block usage of a sav matches the blocks every project is written with
+/*! The sav is written to data. Returns the amount of mismatches. */
+int check_block_usage(lsdj_sav_t* sav, lsdj_compression_mode_t mode, unsigned char* data)
+{
+    lsdj_error_t* error = NULL;
+    lsdj_codec_context_t* context = lsdj_codec_context_new(&error);
+    lsdj_codec_context_set_compression_mode(context, mode);
+    
+    lsdj_sav_block_usage_t usage;
+    if (error == NULL)
+        lsdj_sav_get_block_usage_with_context(sav, &usage, context, &error);
+    
+    lsdj_sav_write_options_t options;
+    lsdj_sav_write_options_init(&options);
+    options.context = context;
+    if (error == NULL)
+        lsdj_sav_write_to_memory_with_options(sav, data, LSDJ_SAV_SIZE, &options, &error);
+    
+    lsdj_codec_context_free(context);
+    
+    // Read back lazily, so every project keeps the blocks it was written with
+    lsdj_sav_t* written = error ? NULL : lsdj_sav_read_lazy_from_memory(data, LSDJ_SAV_SIZE, &error);
+    if (error)
+    {
+        fprintf(stderr, "could not write and read back the sav: %s\n", lsdj_error_get_c_str(error));
+        lsdj_error_free(error);
+        lsdj_sav_free(written);
+        return 1;
+    }
+    
+    const char* modeName = mode == LSDJ_COMPRESSION_OPTIMAL ? "optimal" : "greedy";
+    int failures = 0;
+    unsigned int usedBlockCount = 0;
+    
+    for (unsigned char i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
+    {
+        unsigned int blockCount = 0;
+        lsdj_project_get_compressed_song(lsdj_sav_get_project_const(written, i), &blockCount);
+        usedBlockCount += blockCount;
+        
+        if (usage.projectBlockCounts[i] != blockCount)
+        {
+            fprintf(stderr, "project %u (%s) was counted at %u blocks, but was written in %u\n", i, modeName, usage.projectBlockCounts[i], blockCount);
+            ++failures;
+        }
+    }
+    
+    if (usage.usedBlockCount != usedBlockCount)
+    {
+        fprintf(stderr, "the sav (%s) was counted at %u blocks, but was written in %u\n", modeName, usage.usedBlockCount, usedBlockCount);
+        ++failures;
+    }
+    
+    lsdj_sav_free(written);
+    return failures;
+}
+
+// Read through the memory functions, but from behind a vio the decompressor can't recognise as memory
+size_t wrapped_read(void* ptr, size_t size, void* user_data)
+{
+    return lsdj_mread(ptr, size, user_data);
+}
+
+long wrapped_tell(void* user_data)
+{
+    return lsdj_mtell(user_data);
+}
+
+long wrapped_seek(long offset, int whence, void* user_data)
+{
+    return lsdj_mseek(offset, whence, user_data);
+}
+
+// Check that the memory fast paths and the generic vio paths decompress every project of a sav the same
+/*! songs holds the bytes every project was written from. Returns the amount of mismatches. */
+int check_decompression(const unsigned char* data, unsigned char songs[SONG_COUNT][LSDJ_SONG_DECOMPRESSED_SIZE], lsdj_compression_mode_t mode)
+{
+    lsdj_error_t* error = NULL;
+    lsdj_sav_t* sav = lsdj_sav_read_lazy_from_memory(data, LSDJ_SAV_SIZE, &error);
+    if (error)
+    {
+        fprintf(stderr, "could not read the sav back: %s\n", lsdj_error_get_c_str(error));
+        lsdj_error_free(error);
+        return 1;
+    }
+    
+    static unsigned char song[LSDJ_SONG_DECOMPRESSED_SIZE];
+    const char* modeName = mode == LSDJ_COMPRESSION_OPTIMAL ? "optimal" : "greedy";
+    int failures = 0;
+    
+    for (unsigned char i = 0; i < SONG_COUNT; ++i)
+    {
+        unsigned int blockCount = 0;
+        const unsigned char* blocks = lsdj_project_get_compressed_song(lsdj_sav_get_project_const(sav, i), &blockCount);
+        
+        for (int generic = 0; generic < 2 && blocks; ++generic)
+        {
+            lsdj_memory_data_t rmem;
+            rmem.begin = rmem.cur = (unsigned char*)blocks;
+            rmem.size = blockCount * BLOCK_SIZE;
+            
+            lsdj_vio_t rvio;
+            rvio.read = generic ? wrapped_read : lsdj_mread;
+            rvio.write = NULL;
+            rvio.tell = generic ? wrapped_tell : lsdj_mtell;
+            rvio.seek = generic ? wrapped_seek : lsdj_mseek;
+            rvio.user_data = &rmem;
+            
+            lsdj_memory_data_t wmem;
+            wmem.begin = wmem.cur = song;
+            wmem.size = sizeof(song);
+            
+            lsdj_vio_t wvio;
+            wvio.read = NULL;
+            wvio.write = lsdj_mwrite;
+            wvio.tell = lsdj_mtell;
+            wvio.seek = lsdj_mseek;
+            wvio.user_data = &wmem;
+            
+            long block1position = 0;
+            lsdj_decompress(&rvio, &wvio, &block1position, BLOCK_SIZE, &error);
+            
+            // Ranges at the start, the middle and the very end of the song
+            for (size_t offset = 0; offset < LSDJ_SONG_DECOMPRESSED_SIZE && error == NULL; offset += LSDJ_SONG_DECOMPRESSED_SIZE / 2 - 0x20)
+            {
+                unsigned char range[0x40];
+                rmem.cur = rmem.begin;
+                lsdj_decompress_range(&rvio, &block1position, BLOCK_SIZE, offset, range, sizeof(range), &error);
+                
+                if (error == NULL && memcmp(range, songs[i] + offset, sizeof(range)) != 0)
+                {
+                    fprintf(stderr, "project %u (%s) decompressed range 0x%zx differently through the %s path\n", i, modeName, offset, generic ? "generic" : "memory");
+                    ++failures;
+                }
+            }
+            
+            if (error)
+            {
+                fprintf(stderr, "could not decompress project %u (%s) through the %s path: %s\n", i, modeName, generic ? "generic" : "memory", lsdj_error_get_c_str(error));
+                lsdj_error_free(error);
+                error = NULL;
+                ++failures;
+            } else if (memcmp(song, songs[i], sizeof(song)) != 0) {
+                fprintf(stderr, "project %u (%s) decompressed differently through the %s path\n", i, modeName, generic ? "generic" : "memory");
+                ++failures;
+            }
+        }
+    }
+    
+    lsdj_sav_free(sav);
+    return failures;
+}
+
+// Check that writing a sav back copies unchanged projects and recompresses changed ones to the same bytes
+/*! Returns the amount of mismatches */
+int check_rewrite(const unsigned char* data, lsdj_compression_mode_t mode)
+{
+    static unsigned char rewritten[LSDJ_SAV_SIZE];
+    
+    lsdj_error_t* error = NULL;
+    lsdj_codec_context_t* context = lsdj_codec_context_new(&error);
+    lsdj_codec_context_set_compression_mode(context, mode);
+    
+    lsdj_sav_write_options_t options;
+    lsdj_sav_write_options_init(&options);
+    options.context = context;
+    
+    const char* modeName = mode == LSDJ_COMPRESSION_OPTIMAL ? "optimal" : "greedy";
+    int failures = 0;
+    
+    for (int changed = 0; changed < 2 && error == NULL; ++changed)
+    {
+        lsdj_sav_t* sav = lsdj_sav_read_from_memory(data, LSDJ_SAV_SIZE, &error);
+        for (unsigned char i = 0; changed && i < SONG_COUNT && error == NULL; ++i)
+            lsdj_song_set_dirty_flag(lsdj_project_get_song(lsdj_sav_get_project(sav, i)), 1);
+        
+        if (error == NULL)
+            lsdj_sav_write_to_memory_with_options(sav, rewritten, sizeof(rewritten), &options, &error);
+        lsdj_sav_free(sav);
+        
+        if (error == NULL && memcmp(rewritten, data, sizeof(rewritten)) != 0)
+        {
+            fprintf(stderr, "the sav (%s) was written back differently with its projects %s\n", modeName, changed ? "recompressed" : "copied");
+            ++failures;
+        }
+    }
+    
+    lsdj_codec_context_free(context);
+    
+    if (error)
+    {
+        fprintf(stderr, "could not write the sav (%s) back: %s\n", modeName, lsdj_error_get_c_str(error));
+        lsdj_error_free(error);
+        return failures + 1;
+    }
+    
+    return failures;
+}
+
+int main(void)
+{
+    lsdj_error_t* error = NULL;
+    lsdj_sav_t* sav = lsdj_sav_new(&error);
+    if (error)
+    {
+        fprintf(stderr, "could not create a sav: %s\n", lsdj_error_get_c_str(error));
+        lsdj_error_free(error);
+        return 1;
+    }
+    
+    static unsigned char songs[SONG_COUNT][LSDJ_SONG_DECOMPRESSED_SIZE];
+    int failures = 0;
+    
+    for (unsigned int seed = 0; seed < SONG_COUNT; ++seed)
+    {
+        unsigned char* data = songs[seed];
+        lsdj_song_t* song = generate_song(seed, seed * MIXED_SIZE_STEP, data);
+        if (song == NULL)
+        {
+            lsdj_sav_free(sav);
+            return 1;
+        }
+        
+        failures += check_song_size(song, data, LSDJ_COMPRESSION_GREEDY, seed);
+        failures += check_song_size(song, data, LSDJ_COMPRESSION_OPTIMAL, seed);
+        
+        lsdj_project_set_song(lsdj_sav_get_project(sav, (unsigned char)seed), song);
+    }
+    
+    // Every sav written is decompressed again, both through memory and a generic vio, and written back
+    static unsigned char data[LSDJ_SAV_SIZE];
+    const lsdj_compression_mode_t modes[] = { LSDJ_COMPRESSION_GREEDY, LSDJ_COMPRESSION_OPTIMAL };
+    for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i)
+    {
+        const int usageFailures = check_block_usage(sav, modes[i], data);
+        failures += usageFailures;
+        if (usageFailures == 0)
+            failures += check_decompression(data, songs, modes[i]) + check_rewrite(data, modes[i]);
+    }
+    
+    lsdj_sav_free(sav);
+    
+    return failures ? 1 : 0;
+}
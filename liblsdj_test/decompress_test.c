@@ -0,0 +1,166 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../liblsdj/compression.h"
+#include "../liblsdj/sav.h"
+#include "../liblsdj/song.h"
+
+// The blocks follow the working memory song and the header block
+#define FIRST_BLOCK_ADDRESS (LSDJ_SONG_DECOMPRESSED_SIZE + BLOCK_SIZE)
+
+// Write a sav with one project, whose first block jumps back to itself
+/*! Returns 0 on failure */
+int build_cyclic_sav(unsigned char* data)
+{
+    lsdj_error_t* error = NULL;
+    lsdj_sav_t* sav = lsdj_sav_new(&error);
+    lsdj_song_t* song = error ? NULL : lsdj_song_new(&error);
+    if (song)
+        lsdj_project_set_song(lsdj_sav_get_project(sav, 0), song);
+    if (error == NULL)
+        lsdj_sav_write_to_memory(sav, data, LSDJ_SAV_SIZE, &error);
+    lsdj_sav_free(sav);
+    
+    if (error)
+    {
+        fprintf(stderr, "could not build the sav: %s\n", lsdj_error_get_c_str(error));
+        lsdj_error_free(error);
+        return 0;
+    }
+    
+    // The only project lands in block 1, which now jumps to block 1 without writing anything
+    data[FIRST_BLOCK_ADDRESS] = 0xE0;
+    data[FIRST_BLOCK_ADDRESS + 1] = 0x01;
+    
+    return 1;
+}
+
+// Read through the memory functions, but from behind a vio the decompressor can't recognise as memory
+size_t wrapped_read(void* ptr, size_t size, void* user_data)
+{
+    return lsdj_mread(ptr, size, user_data);
+}
+
+long wrapped_tell(void* user_data)
+{
+    return lsdj_mtell(user_data);
+}
+
+long wrapped_seek(long offset, int whence, void* user_data)
+{
+    return lsdj_mseek(offset, whence, user_data);
+}
+
+// Report whether a decompression of the cyclic blocks failed, like it should
+/*! Returns 1 when it didn't */
+int expect_cycle_error(const char* what, lsdj_error_t* error)
+{
+    if (error == NULL)
+    {
+        fprintf(stderr, "%s accepted blocks that jump in a cycle\n", what);
+        return 1;
+    }
+    
+    lsdj_error_free(error);
+    return 0;
+}
+
+int main(void)
+{
+    static unsigned char data[LSDJ_SAV_SIZE];
+    if (!build_cyclic_sav(data))
+        return 1;
+    
+    int failures = 0;
+    
+    // Reading only the range the catalog needs
+    lsdj_error_t* error = NULL;
+    lsdj_sav_catalog_t catalog;
+    lsdj_sav_read_catalog_from_memory(data, sizeof(data), &catalog, &error);
+    failures += expect_cycle_error("the catalog", error);
+    
+    lsdj_memory_data_t rmem;
+    rmem.begin = rmem.cur = data + FIRST_BLOCK_ADDRESS;
+    rmem.size = BLOCK_COUNT * BLOCK_SIZE;
+    
+    lsdj_vio_t rvio;
+    rvio.read = lsdj_mread;
+    rvio.write = NULL;
+    rvio.tell = lsdj_mtell;
+    rvio.seek = lsdj_mseek;
+    rvio.user_data = &rmem;
+    
+    long block1position = 0;
+    unsigned char range[16];
+    
+    static unsigned char song[LSDJ_SONG_DECOMPRESSED_SIZE];
+    lsdj_memory_data_t wmem;
+    
+    lsdj_vio_t wvio;
+    wvio.read = NULL;
+    wvio.write = lsdj_mwrite;
+    wvio.tell = lsdj_mtell;
+    wvio.seek = lsdj_mseek;
+    wvio.user_data = &wmem;
+    
+    // Both the memory fast paths and the generic ones
+    for (int generic = 0; generic < 2; ++generic)
+    {
+        rvio.read = generic ? wrapped_read : lsdj_mread;
+        rvio.tell = generic ? wrapped_tell : lsdj_mtell;
+        rvio.seek = generic ? wrapped_seek : lsdj_mseek;
+        
+        rmem.cur = rmem.begin;
+        wmem.begin = wmem.cur = song;
+        wmem.size = sizeof(song);
+        
+        error = NULL;
+        lsdj_decompress(&rvio, &wvio, &block1position, BLOCK_SIZE, &error);
+        failures += expect_cycle_error(generic ? "a generic decompression" : "a memory decompression", error);
+        
+        // Anything but memory falls back to a full decompression here
+        rmem.cur = rmem.begin;
+        
+        error = NULL;
+        lsdj_decompress_range(&rvio, &block1position, BLOCK_SIZE, 0, range, sizeof(range), &error);
+        failures += expect_cycle_error(generic ? "a generic range decompression" : "a memory range decompression", error);
+    }
+    
+    return failures ? 1 : 0;
+}
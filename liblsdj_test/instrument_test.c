@@ -0,0 +1,158 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../liblsdj/song.h"
+#include "../liblsdj/song_layout.h"
+
+// The format versions that decode byte 5 differently
+static const unsigned char FORMATS[] = { 0, 3, 4, 6, 7, 12 };
+#define FORMAT_COUNT (sizeof(FORMATS) / sizeof(FORMATS[0]))
+
+// FNV-1a hashes of byte 5 as written by liblsdj before the instrument decoders were
+// rewritten, for every instrument type and format, after reading every value of it
+/*! Kits before version 4 with both vibrato bits set are left out, since that version wrote
+    whatever the instrument's memory held for them. They're checked separately below. */
+static const unsigned int BASELINE_HASHES[4][FORMAT_COUNT] =
+{
+    { 0x166E42C5, 0x265296C5, 0x5D26A9C5, 0x5D26A9C5, 0x5D26A9C5, 0x5D26A9C5 },
+    { 0x166E42C5, 0x265296C5, 0x5D26A9C5, 0x5D26A9C5, 0x5D26A9C5, 0x5D26A9C5 },
+    { 0xA7D8E8C5, 0xA7D8E8C5, 0x504BE9C5, 0x504BE9C5, 0x504BE9C5, 0x504BE9C5 },
+    { 0x95CF31C5, 0x95CF31C5, 0x95CF31C5, 0x95CF31C5, 0x95CF31C5, 0x95CF31C5 }
+};
+
+// Is this a value of byte 5 the baseline didn't write deterministically?
+int is_undefined_kit_speed(unsigned char type, unsigned char format, unsigned char byte)
+{
+    return type == 2 && format < 4 && ((byte >> 1) & 3) == 3;
+}
+
+// Read a song with one instrument for every value of byte 5, and write it back
+/*! written receives byte 5 of every instrument as written. Returns 0 on failure. */
+int round_trip(unsigned char type, unsigned char format, unsigned char base, unsigned char* written)
+{
+    static unsigned char data[LSDJ_SONG_DECOMPRESSED_SIZE];
+    
+    lsdj_error_t* error = NULL;
+    lsdj_song_t* song = lsdj_song_new(&error);
+    if (error == NULL)
+        lsdj_song_write_to_memory(song, data, sizeof(data), &error);
+    lsdj_song_free(song);
+    
+    data[LSDJ_SONG_FORMAT_VERSION_ADDRESS] = format;
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+    {
+        unsigned char* instrument = data + SONG_INSTRUMENTS_ADDRESS + i * LSDJ_INSTRUMENT_BYTE_COUNT;
+        memcpy(instrument, LSDJ_DEFAULT_INSTRUMENT, LSDJ_INSTRUMENT_BYTE_COUNT);
+        instrument[0] = type;
+        instrument[5] = (unsigned char)(base + i);
+        
+        // Give waves and kits something to play, like LSDJ does
+        if (type == 1 || type == 2)
+            instrument[1] = 3;
+        
+        data[SONG_INSTR_ALLOC_TABLE_ADDRESS + i] = 1;
+    }
+    
+    song = error ? NULL : lsdj_song_read_from_memory(data, sizeof(data), &error);
+    if (error == NULL)
+        lsdj_song_write_to_memory(song, data, sizeof(data), &error);
+    lsdj_song_free(song);
+    
+    if (error)
+    {
+        fprintf(stderr, "type %d, format %d: %s\n", type, format, lsdj_error_get_c_str(error));
+        lsdj_error_free(error);
+        return 0;
+    }
+    
+    for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+        written[i] = data[SONG_INSTRUMENTS_ADDRESS + i * LSDJ_INSTRUMENT_BYTE_COUNT + 5];
+    
+    return 1;
+}
+
+int main(void)
+{
+    int failures = 0;
+    
+    for (unsigned char type = 0; type < 4; ++type)
+    {
+        for (size_t f = 0; f < FORMAT_COUNT; ++f)
+        {
+            const unsigned char format = FORMATS[f];
+            unsigned int hash = 0x811C9DC5;
+            
+            for (unsigned int base = 0; base < 256; base += LSDJ_INSTRUMENT_COUNT)
+            {
+                unsigned char written[LSDJ_INSTRUMENT_COUNT];
+                if (!round_trip(type, format, (unsigned char)base, written))
+                    return 1;
+                
+                for (unsigned int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
+                {
+                    const unsigned char byte = (unsigned char)(base + i);
+                    if (!is_undefined_kit_speed(type, format, byte))
+                    {
+                        hash = (hash ^ written[i]) * 0x01000193;
+                        continue;
+                    }
+                    
+                    // The speed bits LSDJ doesn't define are written back as they were read
+                    const unsigned char expected = byte & 0x6E;
+                    if (written[i] != expected)
+                    {
+                        fprintf(stderr, "type %d, format %d: byte 5 0x%02X written as 0x%02X, expected 0x%02X\n", type, format, byte, written[i], expected);
+                        ++failures;
+                    }
+                }
+            }
+            
+            if (hash != BASELINE_HASHES[type][f])
+            {
+                fprintf(stderr, "type %d, format %d: byte 5 hashes to 0x%08X, the baseline to 0x%08X\n", type, format, hash, BASELINE_HASHES[type][f]);
+                ++failures;
+            }
+        }
+    }
+    
+    if (failures)
+        fprintf(stderr, "%d failures\n", failures);
+    
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,284 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../liblsdj/codec.h"
+#include "../liblsdj/sav.h"
+#include "../liblsdj/song.h"
+#include "../liblsdj/song_layout.h"
+#include "../liblsdj/thread.h"
+
+#define THREAD_COUNT (8)
+#define PROJECT_COUNT (6)
+#define JOB_COUNT (THREAD_COUNT * PROJECT_COUNT * 4)
+
+// What every job should see, worked out on a single thread first
+typedef struct
+{
+    unsigned int songHashes[PROJECT_COUNT];
+    unsigned int editedHashes[PROJECT_COUNT];
+    unsigned int savHash;
+} reference_t;
+
+// The state shared by every job
+typedef struct
+{
+    const lsdj_sav_t* sav;
+    const reference_t* reference;
+    lsdj_codec_context_t* contexts[THREAD_COUNT];
+    
+    // Jobs only touch their own entry, set to 1 when it saw something it shouldn't have
+    unsigned char failed[JOB_COUNT];
+} shared_t;
+
+unsigned int hash_bytes(const unsigned char* data, size_t size)
+{
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < size; ++i)
+        hash = (hash ^ data[i]) * 16777619u;
+    
+    return hash;
+}
+
+// Hash the decompressed bytes of a song, 0 on failure
+unsigned int hash_song(const lsdj_song_t* song, unsigned char* buffer)
+{
+    lsdj_error_t* error = NULL;
+    lsdj_song_write_to_memory(song, buffer, LSDJ_SONG_DECOMPRESSED_SIZE, &error);
+    if (error)
+    {
+        lsdj_error_free(error);
+        return 0;
+    }
+    
+    return hash_bytes(buffer, LSDJ_SONG_DECOMPRESSED_SIZE);
+}
+
+// Change a shallow copy of a song and hash it, which unshares the copy's phrases
+unsigned int hash_edited_copy(const lsdj_song_t* song, unsigned char* buffer)
+{
+    lsdj_error_t* error = NULL;
+    lsdj_song_t* copy = lsdj_song_copy_shallow(song, &error);
+    if (error)
+    {
+        lsdj_error_free(error);
+        return 0;
+    }
+    
+    lsdj_song_get_phrase(copy, 1)->notes[0] = 0x30;
+    const unsigned int hash = hash_song(copy, buffer);
+    lsdj_song_free(copy);
+    
+    return hash;
+}
+
+// Create a song with its first two phrases in use, the first one starting with a given note
+lsdj_song_t* new_song(unsigned char note, lsdj_error_t** error)
+{
+    static unsigned char data[LSDJ_SONG_DECOMPRESSED_SIZE];
+    
+    lsdj_song_t* song = lsdj_song_new(error);
+    if (song)
+        lsdj_song_write_to_memory(song, data, sizeof(data), error);
+    lsdj_song_free(song);
+    if (*error)
+        return NULL;
+    
+    data[SONG_PHRASE_ALLOC_TABLE_ADDRESS] |= 0x03;
+    data[SONG_PHRASE_NOTES_ADDRESS] = note;
+    
+    return lsdj_song_read_from_memory(data, sizeof(data), error);
+}
+
+// Write a sav with songs that are all a little different
+/*! Returns 0 on failure */
+int build_sav(unsigned char* data)
+{
+    lsdj_error_t* error = NULL;
+    lsdj_sav_t* sav = lsdj_sav_new(&error);
+    for (unsigned char i = 0; i < PROJECT_COUNT && error == NULL; ++i)
+    {
+        lsdj_song_t* song = new_song((unsigned char)(i + 1), &error);
+        if (song == NULL)
+            break;
+        
+        lsdj_song_set_tempo(song, (unsigned char)(100 + i));
+        lsdj_project_set_song(lsdj_sav_get_project(sav, i), song);
+    }
+    
+    if (error == NULL)
+        lsdj_sav_write_to_memory(sav, data, LSDJ_SAV_SIZE, &error);
+    lsdj_sav_free(sav);
+    
+    if (error)
+    {
+        fprintf(stderr, "could not build the sav: %s\n", lsdj_error_get_c_str(error));
+        lsdj_error_free(error);
+        return 0;
+    }
+    
+    return 1;
+}
+
+// Read the sav on this thread alone, and note what every job should come up with
+/*! Returns 0 on failure */
+int build_reference(const unsigned char* data, reference_t* reference)
+{
+    lsdj_error_t* error = NULL;
+    lsdj_sav_t* sav = lsdj_sav_read_lazy_from_memory(data, LSDJ_SAV_SIZE, &error);
+    unsigned char* buffer = (unsigned char*)malloc(LSDJ_SAV_SIZE);
+    
+    int succeeded = error == NULL && buffer != NULL;
+    for (unsigned char i = 0; i < PROJECT_COUNT && succeeded; ++i)
+    {
+        const lsdj_song_t* song = lsdj_project_load_song(lsdj_sav_get_project_const(sav, i), &error);
+        succeeded = song != NULL;
+        if (succeeded)
+        {
+            reference->songHashes[i] = hash_song(song, buffer);
+            reference->editedHashes[i] = hash_edited_copy(song, buffer);
+        }
+    }
+    
+    if (succeeded)
+    {
+        lsdj_sav_write_to_memory(sav, buffer, LSDJ_SAV_SIZE, &error);
+        reference->savHash = hash_bytes(buffer, LSDJ_SAV_SIZE);
+    }
+    
+    free(buffer);
+    lsdj_sav_free(sav);
+    
+    if (!succeeded || error)
+    {
+        fprintf(stderr, "could not read the reference sav: %s\n", error ? lsdj_error_get_c_str(error) : "out of memory");
+        lsdj_error_free(error);
+        return 0;
+    }
+    
+    return 1;
+}
+
+// Load a project, read and copy its song, and serialize the whole sav, all through a const sav
+void run_job(unsigned int index, unsigned int worker, void* user_data)
+{
+    shared_t* shared = (shared_t*)user_data;
+    const reference_t* reference = shared->reference;
+    const unsigned char project = (unsigned char)(index % PROJECT_COUNT);
+    
+    unsigned char* buffer = (unsigned char*)malloc(LSDJ_SAV_SIZE);
+    if (buffer == NULL)
+    {
+        shared->failed[index] = 1;
+        return;
+    }
+    
+    // The first jobs to get here all race to decompress the same lazily read projects
+    lsdj_error_t* error = NULL;
+    const lsdj_song_t* song = lsdj_project_load_song(lsdj_sav_get_project_const(shared->sav, project), &error);
+    
+    int succeeded = song != NULL &&
+        lsdj_song_get_tempo(song) == 100 + project &&
+        lsdj_song_get_phrase_const(song, 0)->notes[0] == project + 1 &&
+        hash_song(song, buffer) == reference->songHashes[project] &&
+        hash_edited_copy(song, buffer) == reference->editedHashes[project];
+    
+    // Every worker writes with a context of its own
+    if (succeeded)
+    {
+        lsdj_sav_write_options_t options;
+        lsdj_sav_write_options_init(&options);
+        options.context = shared->contexts[worker];
+        
+        lsdj_sav_write_to_memory_with_options(shared->sav, buffer, LSDJ_SAV_SIZE, &options, &error);
+        succeeded = error == NULL && hash_bytes(buffer, LSDJ_SAV_SIZE) == reference->savHash;
+    }
+    
+    lsdj_error_free(error);
+    free(buffer);
+    
+    if (!succeeded)
+        shared->failed[index] = 1;
+}
+
+int main(void)
+{
+    static unsigned char data[LSDJ_SAV_SIZE];
+    if (!build_sav(data))
+        return 1;
+    
+    static reference_t reference;
+    if (!build_reference(data, &reference))
+        return 1;
+    
+    static shared_t shared;
+    shared.reference = &reference;
+    
+    lsdj_error_t* error = NULL;
+    lsdj_sav_t* sav = lsdj_sav_read_lazy_from_memory(data, LSDJ_SAV_SIZE, &error);
+    shared.sav = sav;
+    for (int i = 0; i < THREAD_COUNT && error == NULL; ++i)
+        shared.contexts[i] = lsdj_codec_context_new(&error);
+    
+    if (error == NULL)
+        lsdj_parallel_for(JOB_COUNT, THREAD_COUNT, run_job, &shared, &error);
+    
+    for (int i = 0; i < THREAD_COUNT; ++i)
+        lsdj_codec_context_free(shared.contexts[i]);
+    lsdj_sav_free(sav);
+    
+    if (error)
+    {
+        fprintf(stderr, "could not run the jobs: %s\n", lsdj_error_get_c_str(error));
+        lsdj_error_free(error);
+        return 1;
+    }
+    
+    int failures = 0;
+    for (int i = 0; i < JOB_COUNT; ++i)
+    {
+        if (shared.failed[i])
+        {
+            fprintf(stderr, "job %d (project %d) didn't see what a single thread did\n", i, i % PROJECT_COUNT);
+            ++failures;
+        }
+    }
+    
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,239 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "../common/common.hpp"
+#include "../liblsdj/carve.h"
+
+void printHelp(const boost::program_options::options_description& desc)
+{
+    std::cout << "lsdj-carve dump.bin... [-o folder]\n\n"
+              << "Version: " << lsdj::VERSION << "\n\n"
+              << desc;
+}
+
+bool verbose = false;
+bool underscore = false;
+bool dryRun = false;
+
+// Everything needed while the projects of a single dump come in
+struct Carver
+{
+    std::string stem;
+    boost::filesystem::path output;
+    unsigned int written = 0;
+    bool failed = false;
+};
+
+const char* kindName(lsdj_carve_kind_t kind)
+{
+    switch (kind)
+    {
+        case LSDJ_CARVE_PROJECT: return "project";
+        case LSDJ_CARVE_WORKING_MEMORY: return "working memory";
+        case LSDJ_CARVE_SONG: return "song";
+    }
+    
+    return "unknown";
+}
+
+// Name a recovered project after the dump, where it was found and its own name
+std::string constructCarvedName(const std::string& stem, const lsdj_carve_result_t* result)
+{
+    std::stringstream stream;
+    stream << stem << '_' << std::uppercase << std::setfill('0') << std::hex << std::setw(8) << result->offset << '_';
+    
+    if (result->kind == LSDJ_CARVE_PROJECT)
+        stream << std::setw(2) << static_cast<unsigned int>(result->projectIndex);
+    else
+        stream << (result->kind == LSDJ_CARVE_WORKING_MEMORY ? "WM" : "SONG");
+    
+    // Names in damaged dumps can contain anything, keep them safe for a file system
+    auto name = lsdj::constructProjectName(result->project, underscore);
+    for (auto& c : name)
+    {
+        if (!std::isalnum(static_cast<unsigned char>(c)))
+            c = '_';
+    }
+    
+    if (!name.empty())
+        stream << '_' << name;
+    
+    stream << ".lsdsng";
+    return stream.str();
+}
+
+int writeCarved(const lsdj_carve_result_t* result, void* userData)
+{
+    auto& carver = *static_cast<Carver*>(userData);
+    const auto path = carver.output / constructCarvedName(carver.stem, result);
+    
+    if (verbose || dryRun)
+        std::cout << "Found " << kindName(result->kind) << " at 0x" << std::hex << result->offset << std::dec << " -> " << path.filename().string() << std::endl;
+    
+    if (dryRun)
+        return 0;
+    
+    lsdj_error_t* error = nullptr;
+    lsdj_project_write_lsdsng_to_file(result->project, path.string().c_str(), &error);
+    if (error != nullptr)
+    {
+        std::cerr << "Could not write " << path.string() << ": " << lsdj_error_get_c_str(error) << std::endl;
+        lsdj_error_free(error);
+        carver.failed = true;
+        return 0;
+    }
+    
+    ++carver.written;
+    return 0;
+}
+
+bool carve(const boost::filesystem::path& path, const boost::filesystem::path& output)
+{
+    std::ifstream stream(path.string(), std::ios_base::binary);
+    if (!stream.is_open())
+    {
+        std::cerr << "Could not open " << path.string() << std::endl;
+        return false;
+    }
+    
+    std::vector<unsigned char> dump(boost::filesystem::file_size(path));
+    stream.read(reinterpret_cast<char*>(dump.data()), dump.size());
+    if (!stream)
+    {
+        std::cerr << "Could not read " << path.string() << std::endl;
+        return false;
+    }
+    
+    Carver carver;
+    carver.stem = path.stem().string();
+    carver.output = output;
+    
+    lsdj_error_t* error = nullptr;
+    const auto count = lsdj_carve_memory(dump.data(), dump.size(), writeCarved, &carver, &error);
+    if (error != nullptr)
+    {
+        lsdj::handle_error(error);
+        return false;
+    }
+    
+    if (count == 0)
+        std::cout << "Nothing found in " << path.string() << std::endl;
+    else if (!dryRun)
+        std::cout << "Recovered " << carver.written << " of " << count << " project(s) from " << path.string() << std::endl;
+    
+    return !carver.failed;
+}
+
+int main(int argc, char* argv[])
+{
+    boost::program_options::options_description hidden{"Hidden"};
+    hidden.add_options()
+        ("dump", boost::program_options::value<std::vector<std::string>>(), "Raw SRAM or flash dump(s) to recover projects from");
+    
+    boost::program_options::options_description cmd{"Options"};
+    cmd.add_options()
+        ("help,h", "Help screen")
+        ("output,o", boost::program_options::value<std::string>(), "The folder to write the recovered .lsdsng's to, defaults to the current one")
+        ("dry-run,n", "Only list what would be recovered, without writing anything")
+        ("underscore,u", "Use an underscore for the special lightning bolt character, instead of x")
+        ("verbose,v", "Verbose output");
+    
+    boost::program_options::options_description options;
+    options.add(cmd).add(hidden);
+    
+    boost::program_options::positional_options_description positionalOptions;
+    positionalOptions.add("dump", -1);
+    
+    try
+    {
+        boost::program_options::variables_map vm;
+        boost::program_options::command_line_parser parser(argc, argv);
+        parser = parser.options(options);
+        parser = parser.positional(positionalOptions);
+        boost::program_options::store(parser.run(), vm);
+        boost::program_options::notify(vm);
+        
+        if (vm.count("help") || !vm.count("dump"))
+        {
+            printHelp(cmd);
+            return 0;
+        }
+        
+        verbose = vm.count("verbose");
+        underscore = vm.count("underscore");
+        dryRun = vm.count("dry-run");
+        
+        const auto output = boost::filesystem::absolute(vm.count("output") ? vm["output"].as<std::string>() : ".");
+        if (!dryRun)
+            boost::filesystem::create_directories(output);
+        
+        bool succeeded = true;
+        for (const auto& dump : vm["dump"].as<std::vector<std::string>>())
+        {
+            const auto path = boost::filesystem::absolute(dump);
+            if (!boost::filesystem::exists(path))
+            {
+                std::cerr << path.filename().string() << " does not exist" << std::endl;
+                succeeded = false;
+                continue;
+            }
+            
+            succeeded = carve(path, output) && succeeded;
+        }
+        
+        return succeeded ? 0 : 1;
+    } catch (const boost::program_options::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+}
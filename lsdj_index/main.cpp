@@ -0,0 +1,282 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "../common/common.hpp"
+#include "../liblsdj/index.h"
+
+void printHelp(const boost::program_options::options_description& desc)
+{
+    std::cout << "lsdj-index -i library.idx --update folder...\n"
+              << "lsdj-index -i library.idx --name mysong --tempo 120-140\n\n"
+              << "Version: " << lsdj::VERSION << "\n\n"
+              << desc;
+}
+
+bool verbose = false;
+
+void collect(const boost::filesystem::path& path, std::vector<std::string>& paths)
+{
+    if (lsdj::isHiddenFile(path.filename().string()))
+        return;
+    
+    if (boost::filesystem::is_directory(path))
+    {
+        for (auto it = boost::filesystem::directory_iterator(path); it != boost::filesystem::directory_iterator(); ++it)
+            collect(it->path(), paths);
+    }
+    else if (path.extension() == ".sav" || path.extension() == ".lsdsng")
+    {
+        paths.emplace_back(path.string());
+    }
+}
+
+int update(const std::string& indexPath, const std::vector<std::string>& paths)
+{
+    // Reuse what was indexed before, if there is an index already
+    lsdj_error_t* error = nullptr;
+    lsdj_index_t* previous = nullptr;
+    if (boost::filesystem::exists(indexPath))
+    {
+        previous = lsdj_index_open(indexPath.c_str(), &error);
+        if (previous == nullptr)
+            return lsdj::handle_error(error);
+    }
+    
+    lsdj_index_builder_t* builder = lsdj_index_builder_new(previous, &error);
+    if (builder == nullptr)
+    {
+        lsdj_index_close(previous);
+        return lsdj::handle_error(error);
+    }
+    
+    unsigned int counts[LSDJ_INDEX_UNRECOGNIZED + 1] = { 0 };
+    unsigned int failedCount = 0;
+    for (const auto& path : paths)
+    {
+        const auto size = boost::filesystem::file_size(path);
+        const auto modificationTime = boost::filesystem::last_write_time(path);
+        
+        const auto result = lsdj_index_builder_add_file(builder, path.c_str(), size, static_cast<int64_t>(modificationTime), &error);
+        if (error)
+        {
+            std::cerr << path << ": " << lsdj_error_get_c_str(error) << std::endl;
+            lsdj_error_free(error);
+            error = nullptr;
+            ++failedCount;
+            continue;
+        }
+        
+        ++counts[result];
+        if (verbose && result == LSDJ_INDEX_EXTRACTED)
+            std::cout << "read\t" << path << std::endl;
+    }
+    
+    lsdj_index_close(previous);
+    
+    lsdj_index_builder_write(builder, indexPath.c_str(), &error);
+    lsdj_index_builder_free(builder);
+    if (error)
+        return lsdj::handle_error(error);
+    
+    std::cout << counts[LSDJ_INDEX_UNCHANGED] << " unchanged, "
+              << counts[LSDJ_INDEX_SAME_CONTENT] << " touched, "
+              << counts[LSDJ_INDEX_EXTRACTED] << " read, "
+              << counts[LSDJ_INDEX_UNRECOGNIZED] << " unrecognized, "
+              << failedCount << " failed" << std::endl;
+    
+    return failedCount == 0 ? 0 : 1;
+}
+
+// Parse "N" or "N-M" into an inclusive range
+void parseTempo(const std::string& text, lsdj_index_query_t& query)
+{
+    const auto dash = text.find('-');
+    query.minTempo = std::stoi(text.substr(0, dash));
+    query.maxTempo = dash == std::string::npos ? query.minTempo : std::stoi(text.substr(dash + 1));
+}
+
+int parseInstrumentType(const std::string& text)
+{
+    if (lsdj::compareCaseInsensitive(text, "pulse"))
+        return LSDJ_INSTR_PULSE;
+    if (lsdj::compareCaseInsensitive(text, "wave"))
+        return LSDJ_INSTR_WAVE;
+    if (lsdj::compareCaseInsensitive(text, "kit"))
+        return LSDJ_INSTR_KIT;
+    if (lsdj::compareCaseInsensitive(text, "noise"))
+        return LSDJ_INSTR_NOISE;
+    
+    throw std::runtime_error("unknown instrument type " + text + ", use pulse, wave, kit or noise");
+}
+
+void printMatch(const lsdj_index_t* index, size_t song, void*)
+{
+    lsdj_index_song_t result;
+    lsdj_index_get_song(index, song, &result);
+    
+    std::cout << result.path << "\t";
+    if (result.kind == LSDJ_INDEX_WORKING_MEMORY)
+        std::cout << "WM";
+    else if (result.kind == LSDJ_INDEX_SAV_PROJECT)
+        std::cout << static_cast<unsigned int>(result.project);
+    else
+        std::cout << "-";
+    
+    std::cout << "\t" << lsdj::constructProjectName(result.name, false)
+              << "\ttempo " << static_cast<unsigned int>(result.tempo)
+              << "\tformat " << static_cast<unsigned int>(result.formatVersion) << std::endl;
+}
+
+int search(const std::string& indexPath, const lsdj_index_query_t& query)
+{
+    lsdj_error_t* error = nullptr;
+    lsdj_index_t* index = lsdj_index_open(indexPath.c_str(), &error);
+    if (index == nullptr)
+        return lsdj::handle_error(error);
+    
+    const auto count = lsdj_index_search(index, &query, printMatch, nullptr);
+    if (verbose)
+        std::cout << count << " of " << lsdj_index_get_song_count(index) << " song(s) match" << std::endl;
+    
+    lsdj_index_close(index);
+    return count == 0 ? 1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+    boost::program_options::options_description hidden{"Hidden"};
+    hidden.add_options()
+        ("file", boost::program_options::value<std::vector<std::string>>(), ".sav or .lsdsng file(s) or folders to index");
+    
+    boost::program_options::options_description cmd{"Options"};
+    cmd.add_options()
+        ("help,h", "Help screen")
+        ("index,i", boost::program_options::value<std::string>(), "The index file to update or search")
+        ("update,u", "Update the index with the given files and folders, leaving out any that aren't given")
+        ("name,n", boost::program_options::value<std::string>(), "Search for projects whose name contains this")
+        ("instrument", boost::program_options::value<std::string>(), "Search for songs with an instrument whose name contains this")
+        ("type", boost::program_options::value<std::string>(), "Search for songs with an instrument of this type (pulse, wave, kit or noise)")
+        ("tempo,t", boost::program_options::value<std::string>(), "Search for songs with this tempo, or a range like 120-140")
+        ("format,f", boost::program_options::value<int>(), "Search for songs with this format version")
+        ("verbose,v", "Print more information");
+    
+    boost::program_options::options_description options;
+    options.add(cmd).add(hidden);
+    
+    boost::program_options::positional_options_description positionalOptions;
+    positionalOptions.add("file", -1);
+    
+    try
+    {
+        boost::program_options::variables_map vm;
+        boost::program_options::command_line_parser parser(argc, argv);
+        parser = parser.options(options);
+        parser = parser.positional(positionalOptions);
+        boost::program_options::store(parser.run(), vm);
+        boost::program_options::notify(vm);
+        
+        if (vm.count("help") || !vm.count("index"))
+        {
+            printHelp(cmd);
+            return 0;
+        }
+        
+        verbose = vm.count("verbose");
+        const auto indexPath = vm["index"].as<std::string>();
+        
+        if (vm.count("update"))
+        {
+            std::vector<std::string> paths;
+            if (vm.count("file"))
+            {
+                for (const auto& input : vm["file"].as<std::vector<std::string>>())
+                {
+                    const auto path = boost::filesystem::absolute(input);
+                    if (boost::filesystem::is_directory(path))
+                        collect(path, paths);
+                    else
+                        paths.emplace_back(path.string());
+                }
+            }
+            
+            return update(indexPath, paths);
+        }
+        
+        lsdj_index_query_t query;
+        lsdj_index_query_init(&query);
+        
+        std::string name, instrument;
+        if (vm.count("name"))
+        {
+            name = vm["name"].as<std::string>();
+            query.name = name.c_str();
+        }
+        
+        if (vm.count("instrument"))
+        {
+            instrument = vm["instrument"].as<std::string>();
+            query.instrumentName = instrument.c_str();
+        }
+        
+        if (vm.count("type"))
+            query.instrumentType = parseInstrumentType(vm["type"].as<std::string>());
+        
+        if (vm.count("tempo"))
+            parseTempo(vm["tempo"].as<std::string>(), query);
+        
+        if (vm.count("format"))
+            query.formatVersion = vm["format"].as<int>();
+        
+        return search(indexPath, query);
+    } catch (const boost::program_options::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+}
@@ -33,7 +33,11 @@
  
  */
 
+#include <algorithm>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
@@ -52,6 +56,8 @@ bool verbose = false;
 bool convertInstruments = false;
 bool convertTables = false;
 bool convertPhrases = false;
+bool dryRun = false;
+bool skipUnchanged = false;
 
 boost::filesystem::path addMonoSuffix(const boost::filesystem::path& path)
 {
@@ -64,98 +70,81 @@ bool alreadyEndsWithMono(const boost::filesystem::path& path)
     return stem.size() >= 5 && stem.substr(stem.size() - 5) == ".MONO";
 }
 
-void convertInstrument(lsdj_instrument_t* instrument)
+// Let the user know what happened to a file, depending on how many changes were made
+void report(const boost::filesystem::path& path, std::size_t changed, std::ostream& stream)
 {
-    if (instrument != nullptr && lsdj_instrument_get_panning(instrument) != LSDJ_PAN_NONE)
-        lsdj_instrument_set_panning(instrument, LSDJ_PAN_LEFT_RIGHT);
+    if (dryRun)
+        stream << (changed ? "Would convert '" : "Already mono '") << path.string() << "'" << std::endl;
+    else if (verbose && changed == 0 && skipUnchanged)
+        stream << "Skipping '" << path.string() << "', already mono" << std::endl;
+    else if (verbose)
+        stream << "Processing '" << path.string() << "'" << std::endl;
 }
 
-void convertCommand(lsdj_command_t* command)
+bool shouldWrite(std::size_t changed)
 {
-    if (command->command == LSDJ_COMMAND_O && command->value != LSDJ_PAN_NONE)
-    {
-        command->value = LSDJ_PAN_LEFT_RIGHT;
-    }
+    return !dryRun && (changed > 0 || !skipUnchanged);
 }
 
-void convertTable(lsdj_table_t* table)
+int processSav(const boost::filesystem::path& path, const std::vector<unsigned char>& data, unsigned int threadCount, std::ostream& stream)
 {
-    if (table == nullptr)
-        return;
-    
-    for (int i = 0; i < LSDJ_TABLE_LENGTH; ++i)
+    // Projects are only decompressed once they're converted, and unchanged ones are
+    // copied to the output as they are
+    lsdj_error_t* error = nullptr;
+    lsdj_sav_t* sav = lsdj_sav_read_lazy_from_memory(data.data(), data.size(), &error);
+    if (error != nullptr)
     {
-        convertCommand(lsdj_table_get_command1(table, i));
-        convertCommand(lsdj_table_get_command2(table, i));
+        lsdj_sav_free(sav);
+        return lsdj::handle_error(error);
     }
-}
-
-void convertPhrase(lsdj_phrase_t* phrase)
-{
-    if (phrase == nullptr)
-        return;
     
-    for (int i = 0; i < LSDJ_PHRASE_LENGTH; ++i)
-        convertCommand(&phrase->commands[i]);
-}
-
-void convertSong(lsdj_song_t* song)
-{
-    if (convertInstruments)
-    {
-        for (int i = 0; i < LSDJ_INSTRUMENT_COUNT; ++i)
-            convertInstrument(lsdj_song_get_instrument(song, i));
-    }
+    std::size_t changed = lsdj::convertSongToMono(lsdj_sav_get_working_memory_song(sav), convertInstruments, convertTables, convertPhrases);
     
-    if (convertTables)
+    // Convert the projects in parallel, each of them is independent of the others
+    const auto count = lsdj_sav_get_project_count(sav);
+    std::vector<std::size_t> projectChanges(count, 0);
+    std::vector<lsdj_error_t*> errors(count, nullptr);
+    lsdj::parallelFor(count, threadCount, [&](std::size_t i)
     {
-        for (int i = 0; i < LSDJ_TABLE_COUNT; ++i)
-            convertTable(lsdj_song_get_table(song, i));
-    }
+        lsdj_project_t* project = lsdj_sav_get_project(sav, static_cast<unsigned char>(i));
+        if (project == nullptr || !lsdj_project_has_song(project))
+            return;
+        
+        lsdj_song_t* song = lsdj_project_load_song(project, &errors[i]);
+        if (song != nullptr)
+            projectChanges[i] = lsdj::convertSongToMono(song, convertInstruments, convertTables, convertPhrases);
+    });
     
-    if (convertPhrases)
+    int result = 0;
+    for (std::size_t i = 0; i < count; ++i)
     {
-        for (int i = 0; i < LSDJ_PHRASE_COUNT; ++i)
-            convertPhrase(lsdj_song_get_phrase(song, i));
+        changed += projectChanges[i];
+        if (errors[i] && result == 0)
+            result = lsdj::handle_error(errors[i]);
+        else
+            lsdj_error_free(errors[i]);
     }
-}
-
-int processSav(const boost::filesystem::path& path)
-{
-    if (alreadyEndsWithMono(path))
-        return 0;
     
-    lsdj_error_t* error = nullptr;
-    lsdj_sav_t* sav = lsdj_sav_read_from_file(path.string().c_str(), &error);
-    if (error != nullptr)
+    if (result != 0)
     {
         lsdj_sav_free(sav);
-        return 1;
+        return result;
     }
     
-    if (verbose)
-        std::cout << "Processing '" + path.string() + "'" << std::endl;
-    
-    convertSong(lsdj_sav_get_working_memory_song(sav));
+    report(path, changed, stream);
     
-    for (int i = 0; i < lsdj_sav_get_project_count(sav); ++i)
+    if (shouldWrite(changed))
     {
-        lsdj_project_t* project = lsdj_sav_get_project(sav, i);
-        if (project == nullptr)
-            continue;
+        lsdj_sav_write_options_t options;
+        lsdj_sav_write_options_init(&options);
+        options.threadCount = threadCount;
         
-        lsdj_song_t* song = lsdj_project_get_song(project);
-        if (song == nullptr)
-            continue;
-        
-        convertSong(song);
-    }
-    
-    lsdj_sav_write_to_file(sav, addMonoSuffix(path).string().c_str(), &error);
-    if (error != nullptr)
-    {
-        lsdj_sav_free(sav);
-        return 1;
+        lsdj_sav_write_to_file_with_options(sav, addMonoSuffix(path).string().c_str(), &options, &error);
+        if (error != nullptr)
+        {
+            lsdj_sav_free(sav);
+            return lsdj::handle_error(error);
+        }
     }
     
     lsdj_sav_free(sav);
@@ -163,87 +152,106 @@ int processSav(const boost::filesystem::path& path)
     return 0;
 }
 
-int processLsdsng(const boost::filesystem::path& path)
+int processLsdsng(const boost::filesystem::path& path, const std::vector<unsigned char>& data, std::ostream& stream)
 {
-    if (alreadyEndsWithMono(path))
-        return 0;
-    
     lsdj_error_t* error = nullptr;
-    lsdj_project_t* project = lsdj_project_read_lsdsng_from_file(path.string().c_str(), &error);
+    lsdj_project_t* project = lsdj_project_read_lsdsng_from_memory(data.data(), data.size(), &error);
     if (error != nullptr)
     {
         lsdj_project_free(project);
-        return 1;
+        return lsdj::handle_error(error);
     }
     
-    if (verbose)
-        std::cout << "Processing '" + path.string() + "'" << std::endl;
+    lsdj_song_t* song = lsdj_project_load_song(project, &error);
+    if (error != nullptr)
+    {
+        lsdj_project_free(project);
+        return lsdj::handle_error(error);
+    }
     
-    lsdj_song_t* song = lsdj_project_get_song(project);
     if (song == nullptr)
-        return 0;
-    
-    convertSong(song);
-    
-    lsdj_project_write_lsdsng_to_file(project, addMonoSuffix(path).string().c_str(), &error);
-    if (error != nullptr)
     {
         lsdj_project_free(project);
-        return 1;
+        return 0;
     }
     
-    lsdj_project_free(project);
+    const auto changed = lsdj::convertSongToMono(song, convertInstruments, convertTables, convertPhrases);
+    report(path, changed, stream);
     
-    return 0;
-}
-
-int process(const boost::filesystem::path& path);
-
-int processDirectory(const boost::filesystem::path& path)
-{
-    for (auto it = boost::filesystem::directory_iterator(path); it != boost::filesystem::directory_iterator(); ++it)
+    if (shouldWrite(changed))
     {
-        if (process(it->path()) != 0)
-            return 1;
+        lsdj_project_write_lsdsng_to_file(project, addMonoSuffix(path).string().c_str(), &error);
+        if (error != nullptr)
+        {
+            lsdj_project_free(project);
+            return lsdj::handle_error(error);
+        }
     }
     
+    lsdj_project_free(project);
+    
     return 0;
 }
 
-int process(const boost::filesystem::path& path)
+// Recursively find all .sav and .lsdsng files that should be converted
+void collect(const boost::filesystem::path& path, std::vector<boost::filesystem::path>& paths)
 {
     if (lsdj::isHiddenFile(path.filename().string()))
-        return 0;
+        return;
     
     if (boost::filesystem::is_directory(path))
     {
-        if (processDirectory(path) != 0)
-            return 1;
-    }
-    else if (path.extension() == ".sav")
-    {
-        if (processSav(path) != 0)
-            return 1;
+        std::vector<boost::filesystem::path> contents;
+        for (auto it = boost::filesystem::directory_iterator(path); it != boost::filesystem::directory_iterator(); ++it)
+            contents.emplace_back(it->path());
+        
+        std::sort(contents.begin(), contents.end());
+        for (const auto& content : contents)
+            collect(content, paths);
     }
-    else if (path.extension() == ".lsdsng")
+    else if ((path.extension() == ".sav" || path.extension() == ".lsdsng") && !alreadyEndsWithMono(path))
     {
-        if (processLsdsng(path) != 0)
-            return 1;
+        paths.emplace_back(path);
     }
-    
-    return 0;
 }
 
-int process(const std::vector<std::string>& inputs)
+int process(const std::vector<std::string>& inputs, unsigned int threadCount)
 {
+    std::vector<boost::filesystem::path> paths;
     for (auto& input : inputs)
+        collect(boost::filesystem::absolute(input), paths);
+    
+    // With several files, threads pick up whole files as soon as they're done with the previous
+    // one. A single sav spreads its projects over the threads instead.
+    const unsigned int fileThreadCount = paths.size() > 1 ? threadCount : 1;
+    const unsigned int projectThreadCount = paths.size() > 1 ? 1 : threadCount;
+    
+    std::vector<int> results(paths.size(), 0);
+    lsdj::OrderedOutput out(paths.size(), std::cout);
+    
+    // The files are read in the background while the ones before them are being converted
+    std::vector<std::string> loadPaths;
+    for (const auto& path : paths)
+        loadPaths.emplace_back(path.string());
+    lsdj::FileLoader loader(std::move(loadPaths), lsdj::FILE_LOADER_THREAD_COUNT, fileThreadCount * 2);
+    
+    lsdj::parallelFor(paths.size(), fileThreadCount, [&](std::size_t i)
     {
-        const auto path = boost::filesystem::absolute(input);
-        if (process(path) != 0)
-            return 1;
-    }
+        lsdj_error_t* error = nullptr;
+        const auto data = loader.take(i, &error);
+        
+        std::ostringstream stream;
+        if (error != nullptr)
+            results[i] = lsdj::handle_error(error);
+        else if (paths[i].extension() == ".sav")
+            results[i] = processSav(paths[i], data, projectThreadCount, stream);
+        else
+            results[i] = processLsdsng(paths[i], data, stream);
+        
+        out.finish(i, stream.str());
+    });
     
-    return 0;
+    return std::find(results.begin(), results.end(), 1) == results.end() ? 0 : 1;
 }
 
 int main(int argc, char* argv[])
@@ -258,7 +266,10 @@ int main(int argc, char* argv[])
         ("verbose,v", "Verbose output during import")
         ("instrument,i", "Only adjust instruments")
         ("table,t", "Only adjust tables")
-        ("phrase,p", "Only adjust phrases");
+        ("phrase,p", "Only adjust phrases")
+        ("skip,s", "Don't write a .MONO copy of files that are already mono")
+        ("dry-run,n", "Only report which files would change, don't write anything")
+        ("jobs,j", boost::program_options::value<unsigned int>(), "The amount of threads to convert with, defaults to the amount of cores");
     
     boost::program_options::options_description options;
     options.add(cmd).add(hidden);
@@ -286,8 +297,12 @@ int main(int argc, char* argv[])
             convertTables = vm.count("table");
             if (!convertInstruments && !convertPhrases && !convertTables)
                 convertInstruments = convertPhrases = convertTables = true;
+            dryRun = vm.count("dry-run");
+            skipUnchanged = vm.count("skip");
+            
+            const unsigned int threadCount = vm.count("jobs") ? vm["jobs"].as<unsigned int>() : std::thread::hardware_concurrency();
             
-            return process(vm["file"].as<std::vector<std::string>>());
+            return process(vm["file"].as<std::vector<std::string>>(), threadCount);
         } else {
             printHelp(cmd);
             return 0;
@@ -0,0 +1,484 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "../common/common.hpp"
+#include "../liblsdj/codec.h"
+#include "../liblsdj/compression.h"
+#include "../liblsdj/project.h"
+#include "../liblsdj/sav.h"
+#include "../lsdsng_export/exporter.hpp"
+#include "../lsdsng_import/importer.hpp"
+#include "../lsdj_wavetable_import/wavetable_importer.hpp"
+
+void printHelp(const boost::program_options::options_description& desc)
+{
+    std::cout << "lsdj-pipeline mymusic.sav|song.lsdsng... [--mono] [--wavetable wavetables.snt] -o out.sav|folder\n\n"
+              << "Version: " << lsdj::VERSION << "\n\n"
+              << desc;
+}
+
+// Which transformations to apply to every song on its way through the pipeline
+struct Stages
+{
+    bool mono = false;
+    bool convertInstruments = false;
+    bool convertTables = false;
+    bool convertPhrases = false;
+    
+    // Compress every song again, instead of only the transformed ones
+    bool recompress = false;
+    
+    const lsdj::WavetableImporter::Wavetable* wavetable = nullptr;
+    unsigned char wavetableIndex = 0;
+};
+
+// Everything that was read in, which the exports point into
+struct Sources
+{
+    ~Sources()
+    {
+        for (auto sav : savs)
+            lsdj_sav_free(sav);
+        for (auto project : projects)
+            lsdj_project_free(project);
+        for (auto project : workingMemoryProjects)
+            lsdj_project_free(project);
+    }
+    
+    std::vector<lsdj_sav_t*> savs;
+    std::vector<lsdj_project_t*> projects;
+    std::vector<lsdj_project_t*> workingMemoryProjects;
+};
+
+bool verbose = false;
+
+// Read all inputs (without decompressing anything) and select the songs to pass on
+int collect(const std::vector<boost::filesystem::path>& paths, lsdj::Exporter& exporter, const boost::filesystem::path& folder, unsigned int threadCount, Sources& sources, std::vector<lsdj::Exporter::Export>& exports)
+{
+    std::vector<lsdj_sav_t*> savs(paths.size(), nullptr);
+    std::vector<lsdj_project_t*> projects(paths.size(), nullptr);
+    std::vector<lsdj_error_t*> errors(paths.size(), nullptr);
+    lsdj::parallelFor(paths.size(), threadCount, [&](std::size_t i)
+    {
+        if (paths[i].extension() == ".lsdsng")
+            projects[i] = lsdj_project_read_lsdsng_lazy_from_file(paths[i].string().c_str(), &errors[i]);
+        else
+            savs[i] = lsdj_sav_read_lazy_from_file(paths[i].string().c_str(), &errors[i]);
+    });
+    
+    int result = 0;
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+        if (savs[i])
+            sources.savs.emplace_back(savs[i]);
+        if (projects[i])
+            sources.projects.emplace_back(projects[i]);
+        
+        if (errors[i] && result == 0)
+            result = lsdj::handle_error(errors[i]);
+        else
+            lsdj_error_free(errors[i]);
+    }
+    
+    if (result != 0)
+        return result;
+    
+    // Savs go through the same selection as lsdsng-export, lsdsng's are always taken along
+    for (std::size_t i = 0; i < paths.size(); ++i)
+    {
+        if (savs[i])
+        {
+            lsdj_error_t* error = nullptr;
+            exporter.collectExports(savs[i], folder, exports, sources.workingMemoryProjects, &error);
+            if (error)
+                return lsdj::handle_error(error);
+        } else {
+            exports.push_back({ projects[i], exporter.constructPath(projects[i], folder, false) });
+        }
+    }
+    
+    return 0;
+}
+
+// Apply the transformation stages to every song, in parallel
+int transform(const std::vector<lsdj::Exporter::Export>& exports, const Stages& stages, const lsdj::WavetableImporter& wavetableImporter, unsigned int threadCount)
+{
+    if (!stages.mono && stages.wavetable == nullptr && !stages.recompress)
+        return 0;
+    
+    std::vector<char> succeeded(exports.size(), 0);
+    std::vector<lsdj_error_t*> errors(exports.size(), nullptr);
+    lsdj::OrderedOutput output(exports.size(), std::cout);
+    lsdj::OrderedOutput errorOutput(exports.size(), std::cerr);
+    lsdj::parallelFor(exports.size(), threadCount, [&](std::size_t i)
+    {
+        std::ostringstream out;
+        std::ostringstream err;
+        
+        // Only the songs that are transformed are decompressed, the rest is passed on as blocks
+        lsdj_song_t* song = lsdj_project_load_song(exports[i].project, &errors[i]);
+        if (song)
+        {
+            succeeded[i] = 1;
+            
+            if (stages.recompress)
+                lsdj_song_set_dirty_flag(song, 1);
+            
+            if (stages.mono)
+            {
+                const auto changed = lsdj::convertSongToMono(song, stages.convertInstruments, stages.convertTables, stages.convertPhrases);
+                if (verbose)
+                    out << "Converted " << changed << " instruments and commands to mono in " << exports[i].path.filename().string() << std::endl;
+            }
+            
+            if (stages.wavetable)
+                succeeded[i] = wavetableImporter.importToSong(song, { stages.wavetable, stages.wavetableIndex }, false, out, err).first;
+        }
+        
+        output.finish(i, out.str());
+        errorOutput.finish(i, err.str());
+    });
+    
+    int result = 0;
+    for (std::size_t i = 0; i < exports.size(); ++i)
+    {
+        if (errors[i] && result == 0)
+            result = lsdj::handle_error(errors[i]);
+        else
+            lsdj_error_free(errors[i]);
+        
+        if (!succeeded[i] && result == 0)
+            result = 1;
+    }
+    
+    return result;
+}
+
+// Import the songs into a new sav, the way lsdsng-import does
+int writeSav(const std::vector<lsdj::Exporter::Export>& exports, const Sources& sources, lsdj::Importer& importer, const boost::filesystem::path& path, unsigned int threadCount)
+{
+    const auto isWorkingMemory = [&](const lsdj_project_t* project)
+    {
+        return std::find(sources.workingMemoryProjects.begin(), sources.workingMemoryProjects.end(), project) != sources.workingMemoryProjects.end();
+    };
+    
+    const lsdj_project_t* workingMemoryProject = nullptr;
+    for (const auto& exp : exports)
+    {
+        if (!isWorkingMemory(exp.project))
+            continue;
+        
+        if (workingMemoryProject)
+        {
+            std::cerr << "Multiple working memory songs found" << std::endl;
+            return 1;
+        }
+        
+        workingMemoryProject = exp.project;
+    }
+    
+    lsdj_error_t* error = nullptr;
+    lsdj_sav_t* sav = lsdj_sav_new(&error);
+    if (error)
+        return lsdj::handle_error(error);
+    
+    // The working memory song belongs to the project with the same name, like in lsdsng-import
+    std::string activeStem;
+    if (workingMemoryProject)
+    {
+        for (const auto& exp : exports)
+        {
+            if (exp.project == workingMemoryProject)
+            {
+                const auto stem = exp.path.stem().string();
+                activeStem = stem.substr(0, stem.size() - 3);
+            }
+        }
+    }
+    
+    // Songs that weren't transformed are copied over as their compressed blocks
+    unsigned char active = LSDJ_NO_ACTIVE_PROJECT;
+    unsigned char index = 0;
+    for (const auto& exp : exports)
+    {
+        if (exp.project == workingMemoryProject)
+            continue;
+        
+        if (index == lsdj_sav_get_project_count(sav))
+        {
+            std::cerr << "Reached maximum project count, can't write " << exp.path.filename().string() << std::endl;
+            break;
+        }
+        
+        lsdj_project_t* project = lsdj_project_copy(exp.project, &error);
+        if (error == nullptr)
+            importer.importSong(project, sav, index, LSDJ_NO_ACTIVE_PROJECT, &error);
+        
+        if (error)
+        {
+            lsdj_sav_free(sav);
+            return lsdj::handle_error(error);
+        }
+        
+        if (workingMemoryProject && active == LSDJ_NO_ACTIVE_PROJECT && exp.path.stem().string() == activeStem)
+            active = index;
+        
+        index += 1;
+    }
+    
+    if (workingMemoryProject)
+    {
+        lsdj_song_t* song = lsdj_project_load_song(workingMemoryProject, &error);
+        if (error == nullptr)
+            song = lsdj_song_copy_shallow(song, &error);
+        if (error)
+        {
+            lsdj_sav_free(sav);
+            return lsdj::handle_error(error);
+        }
+        
+        lsdj_sav_set_working_memory_song(sav, song, active);
+    }
+    
+    lsdj_codec_context_t* context = lsdj_codec_context_new(&error);
+    if (error == nullptr)
+    {
+        lsdj_codec_context_set_compression_mode(context, importer.compressionMode);
+        importer.dropProjectsThatDontFit(sav, context, &error);
+    }
+    if (error == nullptr)
+    {
+        lsdj_sav_write_options_t options;
+        lsdj_sav_write_options_init(&options);
+        options.threadCount = threadCount;
+        options.context = context;
+        lsdj_sav_write_to_file_with_options(sav, path.string().c_str(), &options, &error);
+    }
+    lsdj_codec_context_free(context);
+    lsdj_sav_free(sav);
+    if (error)
+        return lsdj::handle_error(error);
+    
+    if (verbose)
+        std::cout << "Wrote " << path.string() << std::endl;
+    
+    return 0;
+}
+
+// Write every song to its own lsdsng, the way lsdsng-export does
+int writeLsdsngs(const std::vector<lsdj::Exporter::Export>& exports, lsdj_compression_mode_t mode, unsigned int threadCount)
+{
+    for (const auto& exp : exports)
+        boost::filesystem::create_directories(exp.path.parent_path());
+    
+    std::vector<lsdj_error_t*> errors(exports.size(), nullptr);
+    lsdj::OrderedOutput output(exports.size(), std::cout);
+    lsdj::parallelFor(exports.size(), threadCount, [&](std::size_t i)
+    {
+        // Every write gets its own context, so the threads don't share any scratch memory
+        lsdj_codec_context_t* context = lsdj_codec_context_new(&errors[i]);
+        if (errors[i] == nullptr)
+        {
+            lsdj_codec_context_set_compression_mode(context, mode);
+            lsdj_project_write_lsdsng_to_file_with_context(exports[i].project, exports[i].path.string().c_str(), context, &errors[i]);
+        }
+        lsdj_codec_context_free(context);
+        output.finish(i, verbose && errors[i] == nullptr ? "Wrote " + exports[i].path.string() + "\n" : "");
+    });
+    
+    int result = 0;
+    for (auto error : errors)
+    {
+        if (error && result == 0)
+            result = lsdj::handle_error(error);
+        else
+            lsdj_error_free(error);
+    }
+    
+    return result;
+}
+
+int main(int argc, char* argv[])
+{
+    boost::program_options::options_description hidden{"Hidden"};
+    hidden.add_options()
+        ("file", boost::program_options::value<std::vector<std::string>>(), "Input .sav and .lsdsng files");
+    
+    boost::program_options::options_description cmd{"Options"};
+    cmd.add_options()
+        ("help,h", "Help screen")
+        ("output,o", boost::program_options::value<std::string>(), "A .sav to import the songs into, or a folder to export them to as .lsdsng's")
+        ("index,i", boost::program_options::value<std::vector<int>>(), "Single out a given project index to take from the savs, 0 or more")
+        ("name,n", boost::program_options::value<std::vector<std::string>>(), "Single out a given project by name to take from the savs")
+        ("working-memory,w", "Single out the working-memory song to take from the savs")
+        ("mono,m", "Convert the songs to mono")
+        ("instrument", "Only adjust instruments when converting to mono")
+        ("table", "Only adjust tables when converting to mono")
+        ("phrase", "Only adjust phrases when converting to mono")
+        ("wavetable", boost::program_options::value<std::string>(), "A wavetable file (.snt or .wav) to import into every song")
+        ("synth,s", boost::program_options::value<std::string>(), "The synth number 0-F where the wavetable data should be written")
+        ("wavetable-index", boost::program_options::value<std::string>(), "The wavetable index 00-FF where the wavetable data should be written")
+        ("zero,0", "Pad the synth with empty wavetables if the .snt file < 256 bytes")
+        ("force,f", "Force writing the wavetables, even though non-default data may be in them")
+        ("wavetable-cycle", boost::program_options::value<std::size_t>(), "The amount of samples per frame in a .wav wavetable, the whole file is one frame by default")
+        ("noversion", "Don't add version numbers to the .lsdsng filenames")
+        ("decimal,d", "Use decimal notation for the version number, instead of hex")
+        ("underscore,u", "Use an underscore for the special lightning bolt character, instead of x")
+        ("optimal", "Compress the songs using as few blocks as possible, which is slower")
+        ("jobs,j", boost::program_options::value<unsigned int>()->default_value(1), "The amount of threads to work with")
+        ("verbose,v", "Verbose output");
+    
+    boost::program_options::options_description options;
+    options.add(cmd).add(hidden);
+    
+    boost::program_options::positional_options_description positionalOptions;
+    positionalOptions.add("file", -1);
+    
+    try
+    {
+        boost::program_options::variables_map vm;
+        boost::program_options::command_line_parser parser(argc, argv);
+        parser = parser.options(options);
+        parser = parser.positional(positionalOptions);
+        boost::program_options::store(parser.run(), vm);
+        boost::program_options::notify(vm);
+        
+        if (vm.count("help") || !vm.count("file") || !vm.count("output"))
+        {
+            printHelp(cmd);
+            return 0;
+        }
+        
+        std::vector<boost::filesystem::path> paths;
+        for (const auto& file : vm["file"].as<std::vector<std::string>>())
+        {
+            const auto path = boost::filesystem::absolute(file);
+            if (!boost::filesystem::exists(path))
+            {
+                std::cerr << "Path '" << path.string() << "' does not exist" << std::endl;
+                return 1;
+            }
+            
+            paths.emplace_back(path);
+        }
+        
+        verbose = vm.count("verbose");
+        const auto threadCount = vm["jobs"].as<unsigned int>();
+        const auto output = boost::filesystem::absolute(vm["output"].as<std::string>());
+        
+        // The export stage selects songs the same way lsdsng-export does
+        lsdj::Exporter exporter;
+        exporter.versionStyle = vm.count("noversion") ? lsdj::Exporter::VersionStyle::NONE : vm.count("decimal") ? lsdj::Exporter::VersionStyle::DECIMAL : lsdj::Exporter::VersionStyle::HEX;
+        exporter.underscore = vm.count("underscore");
+        if (vm.count("index"))
+            exporter.indices = vm["index"].as<std::vector<int>>();
+        if (vm.count("working-memory"))
+            exporter.indices.emplace_back(-1);
+        if (vm.count("name"))
+            exporter.names = vm["name"].as<std::vector<std::string>>();
+        
+        lsdj::Importer importer;
+        importer.verbose = verbose;
+        
+        lsdj::WavetableImporter wavetableImporter;
+        wavetableImporter.zero = vm.count("zero");
+        wavetableImporter.force = vm.count("force");
+        wavetableImporter.wavCycleLength = vm.count("wavetable-cycle") ? vm["wavetable-cycle"].as<std::size_t>() : 0;
+        wavetableImporter.verbose = verbose;
+        
+        Stages stages;
+        stages.mono = vm.count("mono");
+        stages.recompress = vm.count("optimal");
+        if (stages.recompress)
+            importer.compressionMode = LSDJ_COMPRESSION_OPTIMAL;
+        stages.convertInstruments = vm.count("instrument");
+        stages.convertTables = vm.count("table");
+        stages.convertPhrases = vm.count("phrase");
+        if (!stages.convertInstruments && !stages.convertTables && !stages.convertPhrases)
+            stages.convertInstruments = stages.convertTables = stages.convertPhrases = true;
+        
+        // The wavetable is read once, for all songs
+        lsdj::WavetableImporter::Wavetable wavetable;
+        if (vm.count("wavetable"))
+        {
+            if (!vm.count("synth") && !vm.count("wavetable-index"))
+            {
+                std::cerr << "A wavetable needs either --synth or --wavetable-index" << std::endl;
+                return 1;
+            }
+            
+            if (!wavetableImporter.loadWavetable(vm["wavetable"].as<std::string>(), wavetable, std::cout, std::cerr))
+                return 1;
+            
+            stages.wavetable = &wavetable;
+            stages.wavetableIndex = vm.count("synth") ?
+                static_cast<unsigned char>(std::stoul(vm["synth"].as<std::string>(), nullptr, 16) * 16) :
+                static_cast<unsigned char>(std::stoul(vm["wavetable-index"].as<std::string>(), nullptr, 16));
+        }
+        
+        Sources sources;
+        std::vector<lsdj::Exporter::Export> exports;
+        if (const auto result = collect(paths, exporter, output, threadCount, sources, exports))
+            return result;
+        
+        if (const auto result = transform(exports, stages, wavetableImporter, threadCount))
+            return result;
+        
+        // Only the final result is written to disk
+        if (output.extension() == ".sav")
+            return writeSav(exports, sources, importer, output, threadCount);
+        else
+            return writeLsdsngs(exports, importer.compressionMode, threadCount);
+    } catch (const boost::program_options::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,420 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+
+#include <cctype>
+#include <iomanip>
+#include <stdexcept>
+
+#include "json.hpp"
+
+namespace lsdj
+{
+    Json::Json(bool value) :
+        type(Type::Boolean),
+        boolean(value)
+    {
+    }
+    
+    Json::Json(const char* value) :
+        type(Type::String),
+        text(value)
+    {
+    }
+    
+    Json::Json(std::string value) :
+        type(Type::String),
+        text(std::move(value))
+    {
+    }
+    
+    Json Json::array()
+    {
+        Json json;
+        json.type = Type::Array;
+        return json;
+    }
+    
+    Json Json::object()
+    {
+        Json json;
+        json.type = Type::Object;
+        return json;
+    }
+    
+    // Reads JSON text into values that keep their type
+    class JsonParser
+    {
+    public:
+        JsonParser(const std::string& text) : text(text) { }
+        
+        Json parse()
+        {
+            auto value = parseValue();
+            skipWhitespace();
+            if (position != text.size())
+                fail("trailing characters");
+            return value;
+        }
+        
+    private:
+        Json parseValue()
+        {
+            skipWhitespace();
+            if (position == text.size())
+                fail("unexpected end");
+            
+            const char c = text[position];
+            if (c == '{')
+                return parseObject();
+            if (c == '[')
+                return parseArray();
+            if (c == '"')
+                return Json(parseString());
+            if (c == '-' || std::isdigit(static_cast<unsigned char>(c)))
+                return parseNumber();
+            if (consume("true"))
+                return Json(true);
+            if (consume("false"))
+                return Json(false);
+            if (consume("null"))
+                return Json();
+            
+            fail("unexpected character");
+            return Json();
+        }
+        
+        Json parseObject()
+        {
+            auto object = Json::object();
+            ++position;
+            
+            skipWhitespace();
+            if (consume("}"))
+                return object;
+            
+            do
+            {
+                skipWhitespace();
+                const auto key = parseString();
+                skipWhitespace();
+                if (!consume(":"))
+                    fail("expected ':'");
+                object.set(key, parseValue());
+                skipWhitespace();
+            } while (consume(","));
+            
+            if (!consume("}"))
+                fail("expected '}'");
+            return object;
+        }
+        
+        Json parseArray()
+        {
+            auto array = Json::array();
+            ++position;
+            
+            skipWhitespace();
+            if (consume("]"))
+                return array;
+            
+            do
+            {
+                array.push_back(parseValue());
+                skipWhitespace();
+            } while (consume(","));
+            
+            if (!consume("]"))
+                fail("expected ']'");
+            return array;
+        }
+        
+        std::string parseString()
+        {
+            if (!consume("\""))
+                fail("expected a string");
+            
+            std::string str;
+            while (position < text.size() && text[position] != '"')
+            {
+                const char c = text[position++];
+                if (c != '\\')
+                {
+                    str += c;
+                    continue;
+                }
+                
+                if (position == text.size())
+                    break;
+                
+                switch (text[position++])
+                {
+                    case '"': str += '"'; break;
+                    case '\\': str += '\\'; break;
+                    case '/': str += '/'; break;
+                    case 'b': str += '\b'; break;
+                    case 'f': str += '\f'; break;
+                    case 'n': str += '\n'; break;
+                    case 'r': str += '\r'; break;
+                    case 't': str += '\t'; break;
+                    case 'u': appendUtf8(str, parseCodePoint()); break;
+                    default: fail("invalid escape");
+                }
+            }
+            
+            if (!consume("\""))
+                fail("unterminated string");
+            return str;
+        }
+        
+        // Read the hex digits after a \u, combining surrogate pairs into one code point
+        unsigned long parseCodePoint()
+        {
+            unsigned long codePoint = parseHex4();
+            if (codePoint >= 0xD800 && codePoint < 0xDC00 && consume("\\u"))
+            {
+                const auto low = parseHex4();
+                if (low < 0xDC00 || low >= 0xE000)
+                    fail("invalid surrogate pair");
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+            }
+            
+            return codePoint;
+        }
+        
+        unsigned long parseHex4()
+        {
+            for (std::size_t i = 0; i < 4; ++i)
+            {
+                if (position + i >= text.size() || !std::isxdigit(static_cast<unsigned char>(text[position + i])))
+                    fail("expected four hex digits");
+            }
+            
+            const auto value = std::stoul(text.substr(position, 4), nullptr, 16);
+            position += 4;
+            return value;
+        }
+        
+        void appendUtf8(std::string& str, unsigned long codePoint)
+        {
+            if (codePoint < 0x80)
+            {
+                str += static_cast<char>(codePoint);
+            } else if (codePoint < 0x800) {
+                str += static_cast<char>(0xC0 | (codePoint >> 6));
+                str += static_cast<char>(0x80 | (codePoint & 0x3F));
+            } else if (codePoint < 0x10000) {
+                str += static_cast<char>(0xE0 | (codePoint >> 12));
+                str += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                str += static_cast<char>(0x80 | (codePoint & 0x3F));
+            } else {
+                str += static_cast<char>(0xF0 | (codePoint >> 18));
+                str += static_cast<char>(0x80 | ((codePoint >> 12) & 0x3F));
+                str += static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+                str += static_cast<char>(0x80 | (codePoint & 0x3F));
+            }
+        }
+        
+        // Numbers are kept as the text they were written as, so they're written back the same
+        Json parseNumber()
+        {
+            const auto begin = position;
+            consume("-");
+            if (skipDigits() == 0)
+                fail("expected digits");
+            if (consume(".") && skipDigits() == 0)
+                fail("expected digits after '.'");
+            if (consume("e") || consume("E"))
+            {
+                if (!consume("+"))
+                    consume("-");
+                if (skipDigits() == 0)
+                    fail("expected an exponent");
+            }
+            
+            Json number;
+            number.type = Json::Type::Number;
+            number.text = text.substr(begin, position - begin);
+            return number;
+        }
+        
+        std::size_t skipDigits()
+        {
+            const auto begin = position;
+            while (position < text.size() && std::isdigit(static_cast<unsigned char>(text[position])))
+                ++position;
+            return position - begin;
+        }
+        
+        bool consume(const std::string& token)
+        {
+            if (text.compare(position, token.size(), token) != 0)
+                return false;
+            
+            position += token.size();
+            return true;
+        }
+        
+        void skipWhitespace()
+        {
+            while (position < text.size() && std::isspace(static_cast<unsigned char>(text[position])))
+                ++position;
+        }
+        
+        void fail(const std::string& message)
+        {
+            throw std::runtime_error("invalid JSON, " + message + " at " + std::to_string(position));
+        }
+        
+    private:
+        const std::string& text;
+        std::size_t position = 0;
+    };
+    
+    Json Json::parse(const std::string& text)
+    {
+        return JsonParser(text).parse();
+    }
+    
+    Json& Json::set(const std::string& key, Json value)
+    {
+        if (type == Type::Null)
+            type = Type::Object;
+        else if (type != Type::Object)
+            throw std::logic_error("can only set members of a JSON object");
+        
+        for (auto& member : members)
+        {
+            if (member.first == key)
+            {
+                member.second = std::move(value);
+                return member.second;
+            }
+        }
+        
+        members.emplace_back(key, std::move(value));
+        return members.back().second;
+    }
+    
+    Json& Json::push_back(Json value)
+    {
+        if (type == Type::Null)
+            type = Type::Array;
+        else if (type != Type::Array)
+            throw std::logic_error("can only append to a JSON array");
+        
+        elements.push_back(std::move(value));
+        return elements.back();
+    }
+    
+    const Json* Json::find(const std::string& key) const
+    {
+        for (const auto& member : members)
+        {
+            if (member.first == key)
+                return &member.second;
+        }
+        
+        return nullptr;
+    }
+    
+    void Json::write(std::ostream& stream) const
+    {
+        switch (type)
+        {
+            case Type::Null:
+                stream << "null";
+                break;
+            case Type::Boolean:
+                stream << (boolean ? "true" : "false");
+                break;
+            case Type::Number:
+                stream << text;
+                break;
+            case Type::String:
+                writeJsonString(stream, text);
+                break;
+            case Type::Array:
+                stream << '[';
+                for (std::size_t i = 0; i < elements.size(); ++i)
+                {
+                    if (i > 0)
+                        stream << ',';
+                    elements[i].write(stream);
+                }
+                stream << ']';
+                break;
+            case Type::Object:
+                stream << '{';
+                for (std::size_t i = 0; i < members.size(); ++i)
+                {
+                    if (i > 0)
+                        stream << ',';
+                    writeJsonString(stream, members[i].first);
+                    stream << ':';
+                    members[i].second.write(stream);
+                }
+                stream << '}';
+                break;
+        }
+    }
+    
+    void writeJsonString(std::ostream& stream, const std::string& str)
+    {
+        stream << '"';
+        for (const char c : str)
+        {
+            switch (c)
+            {
+                case '"': stream << "\\\""; break;
+                case '\\': stream << "\\\\"; break;
+                case '\b': stream << "\\b"; break;
+                case '\f': stream << "\\f"; break;
+                case '\n': stream << "\\n"; break;
+                case '\r': stream << "\\r"; break;
+                case '\t': stream << "\\t"; break;
+                default:
+                    // Other control characters are written as code points, the rest as is (UTF-8)
+                    if (static_cast<unsigned char>(c) < 0x20)
+                        stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<unsigned int>(c) << std::dec << std::setfill(' ');
+                    else
+                        stream << c;
+                    break;
+            }
+        }
+        stream << '"';
+    }
+}
@@ -0,0 +1,112 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_JSON_HPP
+#define LSDJ_JSON_HPP
+
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lsdj
+{
+    // A JSON value that keeps its type, for writing responses and reading request ids
+    /*! boost::property_tree stores everything as strings, so writing one turns booleans,
+        numbers and empty arrays into strings too. Objects keep their keys in the order
+        they were first set in. */
+    class Json
+    {
+        friend class JsonParser;
+        
+    public:
+        enum class Type { Null, Boolean, Number, String, Array, Object };
+        
+    public:
+        Json() = default;
+        Json(bool value);
+        Json(const char* value);
+        Json(std::string value);
+        
+        template <typename T, typename = typename std::enable_if<std::is_integral<T>::value>::type>
+        Json(T value) : type(Type::Number), text(std::to_string(value)) { }
+        
+        // Create an empty array or object, which a default Json (null) isn't
+        static Json array();
+        static Json object();
+        
+        // Read a value from JSON text
+        /*! Numbers keep the digits they were written with. Throws std::runtime_error if the
+            text isn't valid JSON. */
+        static Json parse(const std::string& text);
+        
+        // Set a member of an object, replacing one with the same key
+        /*! A null value turns into an object first */
+        Json& set(const std::string& key, Json value);
+        
+        // Append an element to an array
+        /*! A null value turns into an array first */
+        Json& push_back(Json value);
+        
+        // Find a member of an object, or nullptr if there is none
+        const Json* find(const std::string& key) const;
+        
+        // The elements of an array
+        const std::vector<Json>& getElements() const { return elements; }
+        
+        Type getType() const { return type; }
+        bool isNull() const { return type == Type::Null; }
+        
+        // Write the value as compact JSON, without a trailing newline
+        void write(std::ostream& stream) const;
+        
+    private:
+        Type type = Type::Null;
+        bool boolean = false;
+        
+        // The digits of a number, or the contents of a string
+        std::string text;
+        
+        std::vector<Json> elements;
+        std::vector<std::pair<std::string, Json>> members;
+    };
+    
+    // Write a string as a quoted, escaped JSON string
+    void writeJsonString(std::ostream& stream, const std::string& str);
+}
+
+#endif
@@ -0,0 +1,97 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <iostream>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#include "../common/common.hpp"
+#include "service.hpp"
+
+void printHelp(const boost::program_options::options_description& desc)
+{
+    std::cout << "lsdj-service < requests.json\n\n"
+              << "Version: " << lsdj::VERSION << "\n\n"
+              << "Reads one JSON request per line from stdin, and writes one JSON response per line to stdout\n\n"
+              << desc;
+}
+
+int main(int argc, char* argv[])
+{
+    boost::program_options::options_description cmd{"Options"};
+    cmd.add_options()
+        ("help,h", "Help screen")
+        ("cache,c", boost::program_options::value<std::size_t>()->default_value(8), "The amount of files to keep decoded in memory");
+    
+    try
+    {
+        boost::program_options::variables_map vm;
+        boost::program_options::store(boost::program_options::parse_command_line(argc, argv, cmd), vm);
+        boost::program_options::notify(vm);
+        
+        if (vm.count("help"))
+        {
+            printHelp(cmd);
+            return 0;
+        }
+        
+        lsdj::Service service;
+        service.cacheSize = vm["cache"].as<std::size_t>();
+        
+        // Handle requests until stdin is closed, one line at a time
+        std::string line;
+        while (std::getline(std::cin, line))
+        {
+            if (line.find_first_not_of(" \t\r") == std::string::npos)
+                continue;
+            
+            service.handle(line).write(std::cout);
+            std::cout << std::endl;
+        }
+        
+        return 0;
+    } catch (const boost::program_options::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,511 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/property_tree/json_parser.hpp>
+
+#include "../common/common.hpp"
+#include "service.hpp"
+
+namespace lsdj
+{
+    // Throw the message of a liblsdj error, if there was one
+    void throwOnError(lsdj_error_t* error)
+    {
+        if (error == nullptr)
+            return;
+        
+        const std::string message = lsdj_error_get_c_str(error);
+        lsdj_error_free(error);
+        throw std::runtime_error(message);
+    }
+    
+    bool isSav(const boost::filesystem::path& path)
+    {
+        return path.extension() == ".sav";
+    }
+    
+    std::string versionToString(unsigned char version)
+    {
+        std::ostringstream stream;
+        stream << std::uppercase << std::setfill('0') << std::setw(2) << std::hex << static_cast<unsigned int>(version);
+        return stream.str();
+    }
+    
+    // Describe a project as its name and version
+    Json describeProject(const lsdj_project_t* project)
+    {
+        Json tree = Json::object();
+        tree.set("name", constructProjectName(project, false));
+        tree.set("version", versionToString(lsdj_project_get_version(project)));
+        return tree;
+    }
+    
+    // Read an optional hexadecimal number from a request, like an index 00-FF
+    unsigned int getHex(const boost::property_tree::ptree& request, const std::string& key, unsigned int maximum)
+    {
+        const auto str = request.get<std::string>(key);
+        
+        std::size_t end = 0;
+        unsigned long value = 0;
+        try
+        {
+            value = std::stoul(str, &end, 16);
+        } catch (const std::logic_error&) {
+            end = 0;
+        }
+        
+        if (str.empty() || end != str.size() || value > maximum)
+            throw std::runtime_error("invalid " + key + " '" + str + "'");
+        
+        return static_cast<unsigned int>(value);
+    }
+    
+    Json Service::handle(const std::string& line)
+    {
+        // The commands read their arguments from a property tree, which doesn't mind whether a
+        // value was sent as a string or a number. It doesn't keep track of which it was either,
+        // so the id is looked up in a parse that does.
+        boost::property_tree::ptree request;
+        Json typed;
+        try
+        {
+            std::istringstream stream(line);
+            boost::property_tree::read_json(stream, request);
+            typed = Json::parse(line);
+        } catch (const boost::property_tree::json_parser_error& e) {
+            Json response = Json::object();
+            response.set("ok", false);
+            response.set("error", e.message());
+            return response;
+        } catch (const std::runtime_error& e) {
+            Json response = Json::object();
+            response.set("ok", false);
+            response.set("error", e.what());
+            return response;
+        }
+        
+        Json response = dispatch(request);
+        if (const auto id = typed.find("id"))
+            response.set("id", *id);
+        
+        return response;
+    }
+    
+    Json Service::dispatch(const boost::property_tree::ptree& request)
+    {
+        Json response;
+        
+        try
+        {
+            const auto command = request.get<std::string>("command");
+            if (command == "print")
+                response = print(request);
+            else if (command == "export")
+                response = exportProjects(request);
+            else if (command == "import")
+                response = importSongs(request);
+            else if (command == "mono")
+                response = mono(request);
+            else if (command == "wavetable-import")
+                response = importWavetable(request);
+            else
+                throw std::runtime_error("unknown command '" + command + "'");
+            
+            response.set("ok", true);
+        } catch (const std::exception& e) {
+            response = Json::object();
+            response.set("ok", false);
+            response.set("error", e.what());
+        }
+        
+        return response;
+    }
+    
+    Json Service::print(const boost::property_tree::ptree& request)
+    {
+        const auto path = boost::filesystem::absolute(request.get<std::string>("path"));
+        const auto& document = load(path);
+        
+        if (document.project)
+            return describeProject(document.project.get());
+        
+        Json response = Json::object();
+        
+        const auto active = lsdj_sav_get_active_project(document.sav.get());
+        if (active != LSDJ_NO_ACTIVE_PROJECT)
+            response.set("active", static_cast<unsigned int>(active));
+        
+        Json projects = Json::array();
+        const auto count = lsdj_sav_get_project_count(document.sav.get());
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            const lsdj_project_t* project = lsdj_sav_get_project(document.sav.get(), i);
+            if (!lsdj_project_has_song(project))
+                continue;
+            
+            auto tree = describeProject(project);
+            tree.set("index", i);
+            projects.push_back(std::move(tree));
+        }
+        
+        response.set("projects", std::move(projects));
+        return response;
+    }
+    
+    Json Service::exportProjects(const boost::property_tree::ptree& request)
+    {
+        const auto path = boost::filesystem::absolute(request.get<std::string>("path"));
+        const auto& document = load(path);
+        if (!document.sav)
+            throw std::runtime_error("can only export from a .sav");
+        
+        const auto folder = boost::filesystem::absolute(request.get<std::string>("output", "."));
+        boost::filesystem::create_directories(folder);
+        
+        const auto index = request.get_optional<unsigned int>("index");
+        const auto name = request.get_optional<std::string>("name");
+        const auto workingMemory = request.get<bool>("working_memory", false);
+        
+        // Export the projects in the same way lsdsng-export names them
+        Json files = Json::array();
+        const auto write = [&](const lsdj_project_t* project, bool isWorkingMemory)
+        {
+            auto fileName = constructProjectName(project, false);
+            if (fileName.empty())
+                fileName = "(EMPTY)";
+            
+            fileName += "." + versionToString(lsdj_project_get_version(project));
+            if (isWorkingMemory)
+                fileName += ".WM";
+            fileName += ".lsdsng";
+            
+            const auto output = folder / fileName;
+            
+            lsdj_error_t* error = nullptr;
+            lsdj_project_write_lsdsng_to_file(project, output.string().c_str(), &error);
+            throwOnError(error);
+            
+            files.push_back(output.string());
+        };
+        
+        if (workingMemory || (!index && !name))
+        {
+            lsdj_error_t* error = nullptr;
+            std::unique_ptr<lsdj_project_t, void(*)(lsdj_project_t*)> project(lsdj_project_new_from_working_memory_song(document.sav.get(), &error), lsdj_project_free);
+            throwOnError(error);
+            
+            write(project.get(), true);
+        }
+        
+        const auto count = lsdj_sav_get_project_count(document.sav.get());
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            if (workingMemory && !index && !name)
+                break;
+            
+            const lsdj_project_t* project = lsdj_sav_get_project(document.sav.get(), i);
+            if (index && *index != i)
+                continue;
+            if (name && !compareCaseInsensitive(*name, constructProjectName(project, false)))
+                continue;
+            if (!lsdj_project_has_song(project))
+                continue;
+            
+            write(project, false);
+        }
+        
+        Json response = Json::object();
+        response.set("files", std::move(files));
+        return response;
+    }
+    
+    Json Service::importSongs(const boost::property_tree::ptree& request)
+    {
+        const auto path = boost::filesystem::absolute(request.get<std::string>("path"));
+        const auto output = boost::filesystem::absolute(request.get<std::string>("output", path.string()));
+        if (!isSav(path) || !isSav(output))
+            throw std::runtime_error("can only import into a .sav");
+        
+        // Import into a new sav if it doesn't exist yet
+        Document document;
+        if (boost::filesystem::exists(path))
+        {
+            document = take(path);
+        } else {
+            lsdj_error_t* error = nullptr;
+            document.sav.reset(lsdj_sav_new(&error));
+            throwOnError(error);
+        }
+        
+        // Every song goes into the next empty slot, and they're spliced in without recompression
+        Json slots = Json::array();
+        const auto count = lsdj_sav_get_project_count(document.sav.get());
+        unsigned int index = 0;
+        for (const auto& child : request.get_child("songs"))
+        {
+            const auto songPath = boost::filesystem::absolute(child.second.get_value<std::string>());
+            
+            while (index < count && lsdj_project_has_song(lsdj_sav_get_project(document.sav.get(), index)))
+                ++index;
+            if (index == count)
+                throw std::runtime_error("reached maximum project count, can't import " + songPath.string());
+            
+            lsdj_error_t* error = nullptr;
+            lsdj_project_t* project = lsdj_project_read_lsdsng_lazy_from_file(songPath.string().c_str(), &error);
+            throwOnError(error);
+            
+            lsdj_sav_set_project(document.sav.get(), index, project, &error);
+            if (error != nullptr)
+                lsdj_project_free(project);
+            throwOnError(error);
+            
+            slots.push_back(index);
+        }
+        
+        lsdj_error_t* error = nullptr;
+        lsdj_sav_write_to_file(document.sav.get(), output.string().c_str(), &error);
+        throwOnError(error);
+        store(output, std::move(document));
+        
+        Json response = Json::object();
+        response.set("slots", std::move(slots));
+        return response;
+    }
+    
+    Json Service::mono(const boost::property_tree::ptree& request)
+    {
+        const auto path = boost::filesystem::absolute(request.get<std::string>("path"));
+        const auto output = boost::filesystem::absolute(request.get<std::string>("output",
+            (path.parent_path() / (path.stem().string() + ".MONO" + path.extension().string())).string()));
+        
+        auto instruments = request.get<bool>("instruments", false);
+        auto tables = request.get<bool>("tables", false);
+        auto phrases = request.get<bool>("phrases", false);
+        if (!instruments && !tables && !phrases)
+            instruments = tables = phrases = true;
+        
+        auto document = take(path);
+        
+        std::size_t changed = 0;
+        lsdj_error_t* error = nullptr;
+        if (document.sav)
+        {
+            changed += convertSongToMono(lsdj_sav_get_working_memory_song(document.sav.get()), instruments, tables, phrases);
+            
+            const auto count = lsdj_sav_get_project_count(document.sav.get());
+            for (unsigned int i = 0; i < count; ++i)
+            {
+                const lsdj_project_t* project = lsdj_sav_get_project(document.sav.get(), i);
+                if (!lsdj_project_has_song(project))
+                    continue;
+                
+                lsdj_song_t* song = lsdj_project_load_song(project, &error);
+                throwOnError(error);
+                changed += convertSongToMono(song, instruments, tables, phrases);
+            }
+            
+            lsdj_sav_write_to_file(document.sav.get(), output.string().c_str(), &error);
+        } else {
+            lsdj_song_t* song = lsdj_project_load_song(document.project.get(), &error);
+            throwOnError(error);
+            changed += convertSongToMono(song, instruments, tables, phrases);
+            
+            lsdj_project_write_lsdsng_to_file(document.project.get(), output.string().c_str(), &error);
+        }
+        
+        throwOnError(error);
+        store(output, std::move(document));
+        
+        Json response = Json::object();
+        response.set("output", output.string());
+        response.set("changed", changed);
+        return response;
+    }
+    
+    Json Service::importWavetable(const boost::property_tree::ptree& request)
+    {
+        const auto path = boost::filesystem::absolute(request.get<std::string>("path"));
+        const auto output = boost::filesystem::absolute(request.get<std::string>("output", path.string()));
+        const auto wavetablePath = boost::filesystem::absolute(request.get<std::string>("wavetable"));
+        const auto force = request.get<bool>("force", false);
+        const auto zero = request.get<bool>("zero", false);
+        
+        unsigned int wavetableIndex = 0;
+        if (request.count("synth"))
+            wavetableIndex = getHex(request, "synth", 0xF) * 16;
+        else
+            wavetableIndex = getHex(request, "index", 0xFF);
+        
+        // Load the wavetable file
+        std::ifstream stream(wavetablePath.string(), std::ios_base::binary);
+        if (!stream.is_open())
+            throw std::runtime_error("could not open " + wavetablePath.string());
+        
+        std::vector<unsigned char> wavetable((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+        if (wavetable.size() % LSDJ_WAVE_LENGTH != 0)
+            throw std::runtime_error("the wavetable file size is not a multiple of 16 bytes");
+        
+        auto document = take(path);
+        
+        lsdj_error_t* error = nullptr;
+        lsdj_song_t* song = document.sav ? lsdj_sav_get_working_memory_song(document.sav.get()) : lsdj_project_load_song(document.project.get(), &error);
+        throwOnError(error);
+        
+        const auto frameCount = std::min<std::size_t>(0x100 - wavetableIndex, wavetable.size() / LSDJ_WAVE_LENGTH);
+        const auto padCount = zero ? std::min<std::size_t>(0x100 - wavetableIndex, 16) : 0;
+        
+        // Without force, refuse to overwrite anything that isn't a default wave
+        if (!force)
+        {
+            for (std::size_t frame = 0; frame < std::max(frameCount, padCount); ++frame)
+            {
+                if (std::memcmp(lsdj_song_get_wave(song, wavetableIndex + frame)->data, LSDJ_DEFAULT_WAVE, LSDJ_WAVE_LENGTH) != 0)
+                    throw std::runtime_error("wavetable frames already contain data, set force to overwrite them");
+            }
+        }
+        
+        for (std::size_t frame = 0; frame < frameCount; ++frame)
+            std::memcpy(lsdj_song_get_wave(song, wavetableIndex + frame)->data, wavetable.data() + frame * LSDJ_WAVE_LENGTH, LSDJ_WAVE_LENGTH);
+        
+        for (std::size_t frame = frameCount; frame < padCount; ++frame)
+            std::memset(lsdj_song_get_wave(song, wavetableIndex + frame)->data, 0x88, LSDJ_WAVE_LENGTH);
+        
+        if (document.sav)
+            lsdj_sav_write_to_file(document.sav.get(), output.string().c_str(), &error);
+        else
+            lsdj_project_write_lsdsng_to_file(document.project.get(), output.string().c_str(), &error);
+        
+        throwOnError(error);
+        store(output, std::move(document));
+        
+        Json response = Json::object();
+        response.set("frames", frameCount);
+        return response;
+    }
+    
+    Service::Document& Service::load(const boost::filesystem::path& path)
+    {
+        if (!boost::filesystem::is_regular_file(path))
+            throw std::runtime_error(path.string() + " does not exist");
+        
+        const auto writeTime = boost::filesystem::last_write_time(path);
+        const auto fileSize = boost::filesystem::file_size(path);
+        
+        // Reuse the decoded file if it hasn't changed on disk
+        auto it = lookup.find(path.string());
+        if (it != lookup.end())
+        {
+            auto& document = it->second->second;
+            if (document.writeTime == writeTime && document.fileSize == fileSize)
+            {
+                entries.splice(entries.begin(), entries, it->second);
+                return document;
+            }
+            
+            entries.erase(it->second);
+            lookup.erase(it);
+        }
+        
+        // Projects in savs stay compressed until they're needed
+        Document document;
+        lsdj_error_t* error = nullptr;
+        if (isSav(path))
+            document.sav.reset(lsdj_sav_read_lazy_from_file(path.string().c_str(), &error));
+        else if (path.extension() == ".lsdsng")
+            document.project.reset(lsdj_project_read_lsdsng_lazy_from_file(path.string().c_str(), &error));
+        else
+            throw std::runtime_error("unknown file format at '" + path.string() + "'");
+        throwOnError(error);
+        
+        document.writeTime = writeTime;
+        document.fileSize = fileSize;
+        
+        return insert(path, std::move(document));
+    }
+    
+    Service::Document Service::take(const boost::filesystem::path& path)
+    {
+        load(path);
+        
+        // load() always leaves the document at the front
+        auto document = std::move(entries.front().second);
+        lookup.erase(entries.front().first);
+        entries.pop_front();
+        
+        return document;
+    }
+    
+    void Service::store(const boost::filesystem::path& path, Document document)
+    {
+        auto it = lookup.find(path.string());
+        if (it != lookup.end())
+        {
+            entries.erase(it->second);
+            lookup.erase(it);
+        }
+        
+        document.writeTime = boost::filesystem::last_write_time(path);
+        document.fileSize = boost::filesystem::file_size(path);
+        
+        insert(path, std::move(document));
+    }
+    
+    Service::Document& Service::insert(const boost::filesystem::path& path, Document document)
+    {
+        entries.emplace_front(path.string(), std::move(document));
+        lookup[path.string()] = entries.begin();
+        
+        // Evict the least recently used files
+        while (entries.size() > std::max<std::size_t>(cacheSize, 1))
+        {
+            lookup.erase(entries.back().first);
+            entries.pop_back();
+        }
+        
+        return entries.front().second;
+    }
+}
@@ -0,0 +1,113 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#ifndef LSDJ_SERVICE_HPP
+#define LSDJ_SERVICE_HPP
+
+#include <cstddef>
+#include <ctime>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+
+#include <boost/cstdint.hpp>
+#include <boost/filesystem/path.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include "../liblsdj/project.h"
+#include "../liblsdj/sav.h"
+#include "json.hpp"
+
+namespace lsdj
+{
+    // Handles requests one by one, keeping recently used savs and lsdsngs decoded in memory
+    class Service
+    {
+    public:
+        // Handle a single request line, giving back the response
+        /*! Failures never throw, they end up in the response as "ok": false with an "error".
+            The request's "id" is sent back as it came in, be it a string, number or anything else. */
+        Json handle(const std::string& line);
+        
+    public:
+        // The maximum amount of files kept decoded in memory
+        std::size_t cacheSize = 8;
+        
+    private:
+        // A decoded sav or lsdsng, along with the state of the file it was loaded from
+        struct Document
+        {
+            std::unique_ptr<lsdj_sav_t, void(*)(lsdj_sav_t*)> sav{nullptr, lsdj_sav_free};
+            std::unique_ptr<lsdj_project_t, void(*)(lsdj_project_t*)> project{nullptr, lsdj_project_free};
+            std::time_t writeTime = 0;
+            boost::uintmax_t fileSize = 0;
+        };
+        
+        using Entry = std::pair<std::string, Document>;
+        
+    private:
+        // Run the command of a parsed request
+        Json dispatch(const boost::property_tree::ptree& request);
+        
+        Json print(const boost::property_tree::ptree& request);
+        Json exportProjects(const boost::property_tree::ptree& request);
+        Json importSongs(const boost::property_tree::ptree& request);
+        Json mono(const boost::property_tree::ptree& request);
+        Json importWavetable(const boost::property_tree::ptree& request);
+        
+    private:
+        // Find a decoded file in the cache, or load it, and mark it as most recently used
+        /*! Documents whose file changed on disk since they were loaded are reloaded */
+        Document& load(const boost::filesystem::path& path);
+        
+        // Take a decoded file out of the cache (loading it if needed), to be modified
+        Document take(const boost::filesystem::path& path);
+        
+        // Put a file that was just written back into the cache, evicting the least recently used
+        void store(const boost::filesystem::path& path, Document document);
+        
+        // Add a document at the front of the cache, the path must not be in it yet
+        Document& insert(const boost::filesystem::path& path, Document document);
+        
+    private:
+        // The cached documents, from most to least recently used
+        std::list<Entry> entries;
+        std::map<std::string, std::list<Entry>::iterator> lookup;
+    };
+}
+
+#endif
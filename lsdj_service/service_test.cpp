@@ -0,0 +1,176 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+#include <boost/filesystem.hpp>
+
+#include "../liblsdj/sav.h"
+#include "json.hpp"
+#include "service.hpp"
+
+int failures = 0;
+
+void expect(bool condition, const std::string& description)
+{
+    if (condition)
+        return;
+    
+    std::cerr << "failed: " << description << std::endl;
+    ++failures;
+}
+
+// Check that a member of a response exists and has the right type
+void expectMember(const lsdj::Json& response, const std::string& key, lsdj::Json::Type type)
+{
+    const auto member = response.find(key);
+    expect(member != nullptr && member->getType() == type, "type of \"" + key + "\"");
+}
+
+// Send a request to the service, and parse what it would write back
+lsdj::Json request(lsdj::Service& service, const std::string& line)
+{
+    std::ostringstream output;
+    service.handle(line).write(output);
+    
+    return lsdj::Json::parse(output.str());
+}
+
+// Write a sav with a single song in its first slot
+void writeSav(const boost::filesystem::path& path)
+{
+    lsdj_error_t* error = nullptr;
+    lsdj_sav_t* sav = lsdj_sav_new(&error);
+    lsdj_song_t* song = error ? nullptr : lsdj_song_new(&error);
+    if (song)
+    {
+        lsdj_project_t* project = lsdj_sav_get_project(sav, 0);
+        lsdj_project_set_song(project, song);
+        lsdj_project_set_name(project, "TEST", 4);
+    }
+    
+    if (error == nullptr)
+        lsdj_sav_write_to_file(sav, path.string().c_str(), &error);
+    lsdj_sav_free(sav);
+    
+    if (error)
+    {
+        const std::string message = lsdj_error_get_c_str(error);
+        lsdj_error_free(error);
+        throw std::runtime_error(message);
+    }
+}
+
+int main()
+{
+    using Type = lsdj::Json::Type;
+    
+    const auto folder = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("lsdj-service-test-%%%%-%%%%");
+    boost::filesystem::create_directories(folder);
+    
+    try
+    {
+        const auto sav = (folder / "test.sav").string();
+        writeSav(sav);
+        
+        lsdj::Service service;
+        
+        auto response = request(service, "{\"id\": \"1\", \"command\": \"print\", \"path\": \"" + sav + "\"}");
+        expectMember(response, "ok", Type::Boolean);
+        expectMember(response, "id", Type::String);
+        expectMember(response, "projects", Type::Array);
+        if (const auto projects = response.find("projects"))
+        {
+            expect(projects->getElements().size() == 1, "one project printed");
+            for (const auto& project : projects->getElements())
+            {
+                expectMember(project, "index", Type::Number);
+                expectMember(project, "name", Type::String);
+                expectMember(project, "version", Type::String);
+            }
+        }
+        
+        // Exporting a slot without a song gives an empty array, not an empty string
+        response = request(service, "{\"command\": \"export\", \"path\": \"" + sav + "\", \"output\": \"" + folder.string() + "\", \"index\": \"5\"}");
+        expectMember(response, "ok", Type::Boolean);
+        expectMember(response, "files", Type::Array);
+        if (const auto files = response.find("files"))
+            expect(files->getElements().empty(), "no files exported");
+        
+        response = request(service, "{\"command\": \"mono\", \"path\": \"" + sav + "\"}");
+        expectMember(response, "ok", Type::Boolean);
+        expectMember(response, "output", Type::String);
+        expectMember(response, "changed", Type::Number);
+        
+        // Ids come back with the type they were sent with, so clients can match them
+        response = request(service, "{\"id\": 7, \"command\": \"frobnicate\"}");
+        expectMember(response, "id", Type::Number);
+        
+        std::ostringstream id;
+        if (const auto member = response.find("id"))
+            member->write(id);
+        expect(id.str() == "7", "numeric id sent back as 7, got " + id.str());
+        
+        response = request(service, "{\"id\": [1, \"a\"], \"command\": \"frobnicate\"}");
+        expectMember(response, "id", Type::Array);
+        
+        // Requests that aren't JSON fail without an id
+        response = request(service, "{\"id\": 8, \"command\"");
+        expectMember(response, "ok", Type::Boolean);
+        expectMember(response, "error", Type::String);
+        expect(response.find("id") == nullptr, "no id for a request that isn't JSON");
+        
+        response = request(service, "{\"command\": \"frobnicate\"}");
+        expectMember(response, "ok", Type::Boolean);
+        expectMember(response, "error", Type::String);
+        
+        // The exact text of a response, to catch booleans and numbers turning into strings
+        std::ostringstream text;
+        response.write(text);
+        expect(text.str().compare(0, 12, "{\"ok\":false,") == 0, "failures start with \"ok\":false, got " + text.str());
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        ++failures;
+    }
+    
+    boost::filesystem::remove_all(folder);
+    
+    return failures ? 1 : 0;
+}
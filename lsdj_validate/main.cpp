@@ -0,0 +1,208 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+
+#include "../common/common.hpp"
+#include "../liblsdj/validate.h"
+
+void printHelp(const boost::program_options::options_description& desc)
+{
+    std::cout << "lsdj-validate mymusic.sav song.lsdsng folder...\n\n"
+              << "Version: " << lsdj::VERSION << "\n\n"
+              << desc;
+}
+
+bool verbose = false;
+
+void collect(const boost::filesystem::path& path, std::vector<std::string>& paths)
+{
+    if (lsdj::isHiddenFile(path.filename().string()))
+        return;
+    
+    if (boost::filesystem::is_directory(path))
+    {
+        for (auto it = boost::filesystem::directory_iterator(path); it != boost::filesystem::directory_iterator(); ++it)
+            collect(it->path(), paths);
+    }
+    else if (path.extension() == ".sav" || path.extension() == ".lsdsng")
+    {
+        paths.emplace_back(path.string());
+    }
+}
+
+// Read one path per line from a file, or from stdin if the name is "-"
+void collectList(const std::string& list, std::vector<std::string>& paths)
+{
+    std::ifstream file;
+    if (list != "-")
+    {
+        file.open(list);
+        if (!file.is_open())
+            throw std::runtime_error("could not open " + list);
+    }
+    
+    std::istream& stream = list == "-" ? std::cin : file;
+    
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        if (!line.empty())
+            paths.emplace_back(line);
+    }
+}
+
+const char* kindName(lsdj_validate_kind_t kind)
+{
+    switch (kind)
+    {
+        case LSDJ_VALIDATE_SAV: return "sav";
+        case LSDJ_VALIDATE_LSDSNG: return "lsdsng";
+        default: return "unknown";
+    }
+}
+
+int validate(const std::vector<std::string>& paths, unsigned int threadCount)
+{
+    if (paths.empty())
+        return 0;
+    
+    std::vector<const char*> cpaths;
+    cpaths.reserve(paths.size());
+    for (const auto& path : paths)
+        cpaths.emplace_back(path.c_str());
+    
+    std::vector<lsdj_validate_result_t> results(paths.size());
+    
+    lsdj_error_t* error = nullptr;
+    lsdj_validate_files(cpaths.data(), static_cast<unsigned int>(cpaths.size()), threadCount, results.data(), &error);
+    if (error != nullptr)
+        return lsdj::handle_error(error);
+    
+    unsigned int invalidCount = 0;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        const auto& result = results[i];
+        if (result.code == LSDJ_SUCCESS)
+        {
+            if (verbose)
+                std::cout << "ok\t" << paths[i] << "\t" << kindName(result.kind) << ", " << result.songCount << " song(s)" << std::endl;
+        } else {
+            ++invalidCount;
+            std::cout << "invalid\t" << paths[i] << "\t" << lsdj_error_code_get_c_str(result.code) << ": " << result.reason << std::endl;
+        }
+    }
+    
+    if (verbose)
+        std::cout << (paths.size() - invalidCount) << " valid, " << invalidCount << " invalid" << std::endl;
+    
+    return invalidCount == 0 ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    boost::program_options::options_description hidden{"Hidden"};
+    hidden.add_options()
+        ("file", boost::program_options::value<std::vector<std::string>>(), ".sav or .lsdsng file(s) or folders, 0 or more");
+    
+    boost::program_options::options_description cmd{"Options"};
+    cmd.add_options()
+        ("help,h", "Help screen")
+        ("list,l", boost::program_options::value<std::string>(), "A file listing one path per line, or - for stdin")
+        ("jobs,j", boost::program_options::value<unsigned int>(), "The amount of threads to validate with, defaults to the amount of cores")
+        ("verbose,v", "Also print valid files and a summary");
+    
+    boost::program_options::options_description options;
+    options.add(cmd).add(hidden);
+    
+    boost::program_options::positional_options_description positionalOptions;
+    positionalOptions.add("file", -1);
+    
+    try
+    {
+        boost::program_options::variables_map vm;
+        boost::program_options::command_line_parser parser(argc, argv);
+        parser = parser.options(options);
+        parser = parser.positional(positionalOptions);
+        boost::program_options::store(parser.run(), vm);
+        boost::program_options::notify(vm);
+        
+        if (vm.count("help") || (!vm.count("file") && !vm.count("list")))
+        {
+            printHelp(cmd);
+            return 0;
+        }
+        
+        verbose = vm.count("verbose");
+        
+        std::vector<std::string> paths;
+        if (vm.count("file"))
+        {
+            for (const auto& input : vm["file"].as<std::vector<std::string>>())
+            {
+                // Explicitly named files are validated regardless of their extension
+                const auto path = boost::filesystem::absolute(input);
+                if (boost::filesystem::is_directory(path))
+                    collect(path, paths);
+                else
+                    paths.emplace_back(path.string());
+            }
+        }
+        
+        if (vm.count("list"))
+            collectList(vm["list"].as<std::string>(), paths);
+        
+        const unsigned int threadCount = vm.count("jobs") ? vm["jobs"].as<unsigned int>() : std::thread::hardware_concurrency();
+        
+        return validate(paths, threadCount);
+    } catch (const boost::program_options::error& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    } catch (...) {
+        std::cerr << "unknown error" << std::endl;
+        return 1;
+    }
+}
@@ -39,7 +39,10 @@
 #include <cstring>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
 #include <string>
+#include <vector>
 
 #include <boost/filesystem.hpp>
 #include <boost/program_options.hpp>
@@ -51,7 +54,8 @@
 
 void printHelp(const boost::program_options::options_description& desc)
 {
-    std::cout << "lsdj-wavetable-import source.lsdsng wavetables.snt --[synth 0-F | index 00-FF]\n\n"
+    std::cout << "lsdj-wavetable-import source.lsdsng wavetables.snt --[synth 0-F | index 00-FF]\n"
+              << "lsdj-wavetable-import --manifest jobs.txt\n\n"
               << "Version: " << lsdj::VERSION << "\n\n"
               << desc;
 }
@@ -66,11 +70,65 @@ unsigned char parseIndex(const std::string& str)
     return static_cast<unsigned char>(std::stoul(str, nullptr, 16));
 }
 
+// Read a manifest of tab-separated "target wavetable index" jobs, one per line
+std::vector<lsdj::WavetableImporter::Job> parseManifest(const std::string& manifest)
+{
+    std::ifstream file;
+    if (manifest != "-")
+    {
+        file.open(manifest);
+        if (!file.is_open())
+            throw std::runtime_error("could not open " + manifest);
+    }
+    
+    std::istream& stream = manifest == "-" ? std::cin : file;
+    
+    std::vector<lsdj::WavetableImporter::Job> jobs;
+    std::string line;
+    for (std::size_t number = 1; std::getline(stream, line); ++number)
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        
+        // Skip empty lines and comments
+        if (line.empty() || line[0] == '#')
+            continue;
+        
+        std::vector<std::string> fields;
+        std::istringstream lineStream(line);
+        for (std::string field; std::getline(lineStream, field, '\t'); )
+            fields.emplace_back(field);
+        
+        if (fields.size() != 3 || fields[0].empty() || fields[1].empty() || fields[2].empty())
+            throw std::runtime_error(manifest + ":" + std::to_string(number) + ": expected a target, wavetable and index separated by tabs");
+        
+        std::size_t end = 0;
+        unsigned long index = 0;
+        try
+        {
+            index = std::stoul(fields[2], &end, 16);
+        } catch (const std::logic_error&) {
+            end = 0;
+        }
+        
+        if (end != fields[2].size() || index > 0xFF)
+            throw std::runtime_error(manifest + ":" + std::to_string(number) + ": the index should be 00-FF");
+        
+        lsdj::WavetableImporter::Job job;
+        job.target = fields[0];
+        job.wavetable = fields[1];
+        job.wavetableIndex = static_cast<unsigned char>(index);
+        jobs.emplace_back(job);
+    }
+    
+    return jobs;
+}
+
 int main(int argc, char* argv[])
 {
     boost::program_options::options_description hidden{"Hidden"};
     hidden.add_options()
-        ("input", boost::program_options::value<std::vector<std::string>>(), "A .lsdsng project, .sav or wavetable (.snt)");
+        ("input", boost::program_options::value<std::vector<std::string>>(), "A .lsdsng project, .sav or wavetable (.snt or .wav)");
     
     boost::program_options::options_description cmd{"Options"};
     cmd.add_options()
@@ -79,7 +137,10 @@ int main(int argc, char* argv[])
         ("synth,s", boost::program_options::value<std::string>(), "The synth number 0-F where the wavetable data should be written")
         ("zero,0", "Pad the synth with empty wavetables if the .snt file < 256 bytes")
         ("force,f", "Force writing the wavetables, even though non-default data may be in them")
+        ("cycle,c", boost::program_options::value<std::size_t>(), "The amount of samples per frame in a .wav wavetable, the whole file is one frame by default")
         ("output,o", boost::program_options::value<std::string>(), "The output .lsdsng to write to")
+        ("manifest,m", boost::program_options::value<std::string>(), "A file listing tab-separated 'target wavetable index' jobs per line, or - for stdin")
+        ("jobs,j", boost::program_options::value<unsigned int>()->default_value(1), "The amount of targets to import into at the same time")
         ("verbose,v", "Verbose output");
     
     boost::program_options::options_description options;
@@ -101,6 +162,32 @@ int main(int argc, char* argv[])
             printHelp(cmd);
             return 0;
         }
+        else if (vm.count("manifest"))
+        {
+            if (vm.count("input") || vm.count("output") || vm.count("synth") || vm.count("index"))
+            {
+                std::cerr << "A manifest can't be combined with inputs, --output, --synth or --index" << std::endl;
+                return 1;
+            }
+            
+            lsdj::WavetableImporter importer;
+            importer.threadCount = vm["jobs"].as<unsigned int>();
+            importer.zero = vm.count("zero");
+            importer.force = vm.count("force");
+            importer.wavCycleLength = vm.count("cycle") ? vm["cycle"].as<std::size_t>() : 0;
+            importer.verbose = vm.count("verbose");
+            
+            std::vector<lsdj::WavetableImporter::Job> jobs;
+            try
+            {
+                jobs = parseManifest(vm["manifest"].as<std::string>());
+            } catch (const std::runtime_error& e) {
+                std::cerr << e.what() << std::endl;
+                return 1;
+            }
+            
+            return importer.importBatch(jobs) ? 0 : 1;
+        }
         else if (vm.count("input") == 1 && (vm.count("synth") || vm.count("index")))
         {
             lsdj::WavetableImporter importer;
@@ -133,6 +220,7 @@ int main(int argc, char* argv[])
             importer.wavetableIndex = vm.count("synth") ? parseSynthIndex(vm["synth"].as<std::string>()) : parseIndex(vm["index"].as<std::string>());
             importer.zero = vm.count("zero");
             importer.force = vm.count("force");
+            importer.wavCycleLength = vm.count("cycle") ? vm["cycle"].as<std::size_t>() : 0;
             importer.verbose = vm.count("verbose");
             
             return importer.import(source, wavetable) ? 0 : 1;
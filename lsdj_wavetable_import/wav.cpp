@@ -0,0 +1,165 @@
+/*
+ 
+ This file is a part of liblsdj, a C library for managing everything
+ that has to do with LSDJ, software for writing music (chiptune) with
+ your gameboy. For more information, see:
+ 
+ * https://github.com/stijnfrishert/liblsdj
+ * http://www.littlesounddj.com
+ 
+ --------------------------------------------------------------------------------
+ 
+ MIT License
+ 
+ Copyright (c) 2018 - 2019 Stijn Frishert
+ 
+ Permission is hereby granted, free of charge, to any person obtaining a copy
+ of this software and associated documentation files (the "Software"), to deal
+ in the Software without restriction, including without limitation the rights
+ to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ copies of the Software, and to permit persons to whom the Software is
+ furnished to do so, subject to the following conditions:
+ 
+ The above copyright notice and this permission notice shall be included in all
+ copies or substantial portions of the Software.
+ 
+ THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ SOFTWARE.
+ 
+ */
+
+
+#include <cstdint>
+#include <cstring>
+
+#include "wav.hpp"
+
+namespace lsdj
+{
+    // The format tags a .wav fmt chunk can declare
+    constexpr std::uint16_t WAV_FORMAT_PCM = 0x0001;
+    constexpr std::uint16_t WAV_FORMAT_FLOAT = 0x0003;
+    constexpr std::uint16_t WAV_FORMAT_EXTENSIBLE = 0xFFFE;
+    
+    std::uint32_t readLittleEndian(const unsigned char* data, unsigned int byteCount)
+    {
+        std::uint32_t value = 0;
+        for (unsigned int i = 0; i < byteCount; ++i)
+            value |= static_cast<std::uint32_t>(data[i]) << (i * 8);
+        
+        return value;
+    }
+    
+    float decodeWavSample(const unsigned char* data, std::uint16_t format, unsigned int byteCount)
+    {
+        if (format == WAV_FORMAT_FLOAT)
+        {
+            const std::uint32_t bits = readLittleEndian(data, 4);
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            return value;
+        }
+        
+        // 8-bit samples are unsigned, everything wider is signed
+        if (byteCount == 1)
+            return (static_cast<int>(data[0]) - 128) / 128.0f;
+        
+        const unsigned int shift = 32 - byteCount * 8;
+        const std::int32_t value = static_cast<std::int32_t>(readLittleEndian(data, byteCount) << shift);
+        return value / 2147483648.0f;
+    }
+    
+    bool decodeWav(const std::vector<unsigned char>& file, std::vector<float>& samples, std::ostream& err)
+    {
+        if (file.size() < 12 || std::memcmp(file.data(), "RIFF", 4) != 0 || std::memcmp(file.data() + 8, "WAVE", 4) != 0)
+        {
+            err << "Not a RIFF/WAVE file" << std::endl;
+            return false;
+        }
+        
+        std::uint16_t format = 0;
+        unsigned int channelCount = 0;
+        unsigned int bitsPerSample = 0;
+        const unsigned char* data = nullptr;
+        std::size_t dataSize = 0;
+        
+        // Walk the chunks, we only need the format and the sample data
+        std::size_t position = 12;
+        while (position + 8 <= file.size())
+        {
+            const unsigned char* chunk = file.data() + position;
+            const std::size_t available = file.size() - position - 8;
+            std::size_t size = readLittleEndian(chunk + 4, 4);
+            
+            if (std::memcmp(chunk, "fmt ", 4) == 0)
+            {
+                if (size < 16 || size > available)
+                {
+                    err << "The wav format chunk is corrupt" << std::endl;
+                    return false;
+                }
+                
+                format = static_cast<std::uint16_t>(readLittleEndian(chunk + 8, 2));
+                channelCount = readLittleEndian(chunk + 10, 2);
+                bitsPerSample = readLittleEndian(chunk + 22, 2);
+                
+                // Extensible formats store the actual format tag in the sub-format GUID
+                if (format == WAV_FORMAT_EXTENSIBLE && size >= 40)
+                    format = static_cast<std::uint16_t>(readLittleEndian(chunk + 32, 2));
+            } else if (std::memcmp(chunk, "data", 4) == 0) {
+                // Some writers leave the size of a streamed data chunk unset
+                if (size > available)
+                    size = available;
+                
+                data = chunk + 8;
+                dataSize = size;
+                break;
+            }
+            
+            // Chunks are padded to an even size
+            position += 8 + size + (size & 1);
+        }
+        
+        if (channelCount == 0)
+        {
+            err << "The wav file has no format chunk" << std::endl;
+            return false;
+        }
+        
+        if (data == nullptr)
+        {
+            err << "The wav file has no sample data" << std::endl;
+            return false;
+        }
+        
+        const bool supported = (format == WAV_FORMAT_PCM && (bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 24 || bitsPerSample == 32)) ||
+                               (format == WAV_FORMAT_FLOAT && bitsPerSample == 32);
+        if (!supported)
+        {
+            err << "Unsupported wav sample format (only 8, 16, 24 and 32-bit PCM and 32-bit float are supported)" << std::endl;
+            return false;
+        }
+        
+        // Mix every frame down to a single mono sample
+        const unsigned int byteCount = bitsPerSample / 8;
+        const std::size_t frameSize = byteCount * channelCount;
+        samples.resize(dataSize / frameSize);
+        for (std::size_t i = 0; i < samples.size(); ++i)
+        {
+            const unsigned char* frame = data + i * frameSize;
+            
+            float sum = 0;
+            for (unsigned int channel = 0; channel < channelCount; ++channel)
+                sum += decodeWavSample(frame + channel * byteCount, format, byteCount);
+            
+            samples[i] = sum / channelCount;
+        }
+        
+        return true;
+    }
+}
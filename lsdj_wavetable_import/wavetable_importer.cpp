@@ -35,12 +35,17 @@
 
 #include <algorithm>
 #include <array>
+#include <fstream>
 #include <iostream>
+#include <map>
+#include <sstream>
 
 #include "../liblsdj/project.h"
 #include "../liblsdj/sav.h"
+#include "../liblsdj/wave.h"
 
 #include "../common/common.hpp"
+#include "wav.hpp"
 #include "wavetable_importer.hpp"
 
 namespace lsdj
@@ -54,138 +59,243 @@ namespace lsdj
             return false;
         }
         
-        if (path.extension() == ".sav")
-            return importToSav(path, wavetableName);
-        else if (path.extension() == ".lsdsng")
-            return importToLsdsng(path, wavetableName);
-        else
+        if (path.extension() != ".sav" && path.extension() != ".lsdsng")
         {
             std::cerr << "Unknown file format at '" << path.string() << "'" << std::endl;
             return false;
         }
+        
+        Wavetable wavetable;
+        if (!loadWavetable(wavetableName, wavetable, std::cout, std::cerr))
+            return false;
+        
+        return importToTarget(path, boost::filesystem::absolute(outputName), {{&wavetable, wavetableIndex}}, !force, std::cout, std::cerr);
     }
     
-    bool WavetableImporter::importToSav(const boost::filesystem::path& path, const std::string& wavetableName)
+    bool WavetableImporter::importBatch(const std::vector<Job>& jobs)
     {
-        // Load the sav
-        lsdj_error_t* error = nullptr;
-        lsdj_sav_t* sav = lsdj_sav_read_from_file(path.string().c_str(), &error);
-        if (error != nullptr)
+        // Load every distinct wavetable file once, so targets sharing one don't re-read it
+        std::map<std::string, Wavetable> wavetables;
+        for (const auto& job : jobs)
+            wavetables[boost::filesystem::absolute(job.wavetable).string()];
+        
+        std::vector<std::map<std::string, Wavetable>::iterator> loads;
+        for (auto it = wavetables.begin(); it != wavetables.end(); ++it)
+            loads.emplace_back(it);
+        
+        std::vector<char> loaded(loads.size(), 0);
+        OrderedOutput loadOutput(loads.size(), std::cout);
+        OrderedOutput loadErrors(loads.size(), std::cerr);
+        parallelFor(loads.size(), threadCount, [&](std::size_t index)
         {
-            lsdj_sav_free(sav);
+            std::ostringstream out;
+            std::ostringstream err;
+            loaded[index] = loadWavetable(loads[index]->first, loads[index]->second, out, err);
+            loadOutput.finish(index, out.str());
+            loadErrors.finish(index, err.str());
+        });
+        
+        if (std::find(loaded.begin(), loaded.end(), 0) != loaded.end())
             return false;
+        
+        // Group the jobs by target, in the order the targets first appear
+        std::vector<boost::filesystem::path> targets;
+        std::vector<std::vector<Edit>> edits;
+        std::map<boost::filesystem::path, std::size_t> targetIndices;
+        for (const auto& job : jobs)
+        {
+            const auto path = boost::filesystem::absolute(job.target);
+            const auto result = targetIndices.emplace(path, targets.size());
+            if (result.second)
+            {
+                targets.emplace_back(path);
+                edits.emplace_back();
+            }
+            
+            edits[result.first->second].push_back({&wavetables.at(boost::filesystem::absolute(job.wavetable).string()), job.wavetableIndex});
         }
         
-        if (verbose)
-            std::cout << "Loaded sav " + path.string() << std::endl;
+        // Import into every target in parallel, each one is read and written once
+        std::vector<char> imported(targets.size(), 0);
+        OrderedOutput output(targets.size(), std::cout);
+        OrderedOutput errors(targets.size(), std::cerr);
+        parallelFor(targets.size(), threadCount, [&](std::size_t index)
+        {
+            std::ostringstream out;
+            std::ostringstream err;
+            
+            const auto& path = targets[index];
+            if (!boost::filesystem::exists(path))
+                err << path.filename().string() << " does not exist" << std::endl;
+            else if (path.extension() != ".sav" && path.extension() != ".lsdsng")
+                err << "Unknown file format at '" << path.string() << "'" << std::endl;
+            else
+                imported[index] = importToTarget(path, path, edits[index], false, out, err);
+            
+            output.finish(index, out.str());
+            errors.finish(index, err.str());
+        });
         
-        lsdj_song_t* song = lsdj_sav_get_working_memory_song(sav);
-        if (!song)
+        return std::find(imported.begin(), imported.end(), 0) == imported.end();
+    }
+    
+    bool WavetableImporter::loadWavetable(const std::string& wavetableName, Wavetable& wavetable, std::ostream& out, std::ostream& err) const
+    {
+        // Find the wavetable file
+        const auto wavetablePath = boost::filesystem::absolute(wavetableName);
+        if (!boost::filesystem::exists(wavetablePath))
         {
-            lsdj_sav_free(sav);
+            err << wavetablePath.filename().string() << " does not exist" << std::endl;
             return false;
         }
         
-        // Do the actual import
-        const auto result = importToSong(song, wavetableName);
-        if (!result.first)
+        // Load the wavetable file
+        std::ifstream wavetableStream(wavetablePath.string(), std::ios_base::binary);
+        if (!wavetableStream.is_open())
         {
-            lsdj_sav_free(sav);
+            err << "Could not open " << wavetablePath.filename().string() << std::endl;
             return false;
         }
-        const auto frameCount = result.second;
         
-        // Write the sav back to file
-        const auto outputPath = boost::filesystem::absolute(outputName);
-        lsdj_sav_write_to_file(sav, outputPath.string().c_str(), &error);
-        if (error != nullptr)
+        std::vector<unsigned char> contents(boost::filesystem::file_size(wavetablePath));
+        wavetableStream.read(reinterpret_cast<char*>(contents.data()), contents.size());
+        if (!wavetableStream)
         {
-            lsdj_sav_free(sav);
+            err << "Could not read " << wavetablePath.filename().string() << std::endl;
             return false;
         }
         
-        std::cout << "Wrote " << std::dec << frameCount << " frames starting at 0x" << std::hex << (int)wavetableIndex << " to " << outputPath.string() << std::endl;
+        if (compareCaseInsensitive(wavetablePath.extension().string(), ".wav"))
+        {
+            // Audio gets resampled and quantized into frames, one per cycle
+            std::vector<float> samples;
+            if (!decodeWav(contents, samples, err))
+                return false;
+            
+            const std::size_t cycleLength = wavCycleLength ? wavCycleLength : samples.size();
+            if (samples.empty() || samples.size() % cycleLength != 0)
+            {
+                err << "The wav sample count is not a multiple of the cycle length" << std::endl;
+                return false;
+            }
+            
+            const std::size_t frameCount = samples.size() / cycleLength;
+            std::vector<lsdj_wave_t> waves(frameCount);
+            
+            lsdj_error_t* error = nullptr;
+            lsdj_wave_from_samples(samples.data(), cycleLength, frameCount, waves.data(), &error);
+            if (error)
+            {
+                err << "ERROR: " << lsdj_error_get_c_str(error) << std::endl;
+                lsdj_error_free(error);
+                return false;
+            }
+            
+            wavetable.resize(frameCount * LSDJ_WAVE_LENGTH);
+            for (std::size_t i = 0; i < frameCount; ++i)
+                std::copy(waves[i].data, waves[i].data + LSDJ_WAVE_LENGTH, wavetable.begin() + i * LSDJ_WAVE_LENGTH);
+        } else {
+            // Make sure the wavetable is the correct size
+            if (contents.size() % 16 != 0)
+            {
+                err << "The wavetable file size is not a multiple of 16 bytes" << std::endl;
+                return false;
+            }
+            
+            wavetable = std::move(contents);
+        }
+        
+        if (verbose)
+            out << "Found " << std::dec << (wavetable.size() / 16) << " frames in " << wavetablePath.string() << std::endl;
         
         return true;
     }
     
-    bool WavetableImporter::importToLsdsng(const boost::filesystem::path& path, const std::string& wavetableName)
+    bool WavetableImporter::importToTarget(const boost::filesystem::path& path, const boost::filesystem::path& outputPath, const std::vector<Edit>& edits, bool interactive, std::ostream& out, std::ostream& err) const
     {
-        // Load the project
+        const bool isSav = path.extension() == ".sav";
+        
+        // Load the sav or project, untouched projects in a sav stay compressed
         lsdj_error_t* error = nullptr;
-        lsdj_project_t* project = lsdj_project_read_lsdsng_from_file(path.string().c_str(), &error);
-        if (error != nullptr)
+        lsdj_sav_t* sav = nullptr;
+        lsdj_project_t* project = nullptr;
+        lsdj_song_t* song = nullptr;
+        if (isSav)
+        {
+            sav = lsdj_sav_read_lazy_from_file(path.string().c_str(), &error);
+            if (error == nullptr)
+                song = lsdj_sav_get_working_memory_song(sav);
+        } else {
+            project = lsdj_project_read_lsdsng_from_file(path.string().c_str(), &error);
+            if (error == nullptr)
+                song = lsdj_project_load_song(project, &error);
+        }
+        
+        const auto cleanup = [&]()
         {
+            lsdj_error_free(error);
+            lsdj_sav_free(sav);
             lsdj_project_free(project);
+        };
+        
+        if (error != nullptr || song == nullptr)
+        {
+            if (error != nullptr)
+                err << "Could not load " << path.string() << ": " << lsdj_error_get_c_str(error) << std::endl;
+            cleanup();
             return false;
         }
         
         if (verbose)
-            std::cout << "Loaded project " + path.string() << std::endl;
+            out << (isSav ? "Loaded sav " : "Loaded project ") + path.string() << std::endl;
         
-        lsdj_song_t* song = lsdj_project_get_song(project);
-        
-        // Do the actual import
-        const auto result = importToSong(song, wavetableName);
-        if (!result.first)
+        // Do the actual imports
+        std::vector<unsigned int> frameCounts;
+        for (const auto& edit : edits)
         {
-            lsdj_project_free(project);
-            return false;
+            const auto result = importToSong(song, edit, interactive, out, err);
+            if (!result.first)
+            {
+                cleanup();
+                return false;
+            }
+            frameCounts.emplace_back(result.second);
         }
-        const auto frameCount = result.second;
         
-        // Write the project back to file
-        const auto outputPath = boost::filesystem::absolute(outputName);
-        lsdj_project_write_lsdsng_to_file(project, outputPath.string().c_str(), &error);
+        // Write the sav or project back to file, once for all edits
+        if (isSav)
+            lsdj_sav_write_to_file(sav, outputPath.string().c_str(), &error);
+        else
+            lsdj_project_write_lsdsng_to_file(project, outputPath.string().c_str(), &error);
+        
         if (error != nullptr)
         {
-            lsdj_project_free(project);
+            err << "Could not write " << outputPath.string() << ": " << lsdj_error_get_c_str(error) << std::endl;
+            cleanup();
             return false;
         }
         
-        std::cout << "Wrote " << std::dec << frameCount << " frames starting at 0x" << std::hex << (int)wavetableIndex << " to " << outputPath.string() << std::endl;
+        for (std::size_t i = 0; i < edits.size(); ++i)
+            out << "Wrote " << std::dec << frameCounts[i] << " frames starting at 0x" << std::hex << (int)edits[i].wavetableIndex << " to " << outputPath.string() << std::endl;
         
+        cleanup();
         return true;
     }
     
-    std::pair<bool, unsigned int> WavetableImporter::importToSong(lsdj_song_t* song, const std::string& wavetableName)
+    std::pair<bool, unsigned int> WavetableImporter::importToSong(lsdj_song_t* song, const Edit& edit, bool interactive, std::ostream& out, std::ostream& err) const
     {
-        // Find the wavetable file
-        const auto wavetablePath = boost::filesystem::absolute(wavetableName);
-        if (!boost::filesystem::exists(wavetablePath))
-        {
-            std::cerr << wavetablePath.filename().string() << " does not exist" << std::endl;
-            return {false, 0};
-        }
-        
-        // Make sure the wavetable is the correct size
-        const auto wavetableSize = boost::filesystem::file_size(wavetablePath);
-        if (wavetableSize % 16 != 0)
-        {
-            std::cerr << "The wavetable file size is not a multiple of 16 bytes" << std::endl;
-            return {false, 0};
-        }
-        
-        // Load the wavetable file
-        std::ifstream wavetableStream(wavetablePath.string(), std::ios_base::binary);
-        if (!wavetableStream.is_open())
-        {
-            std::cerr << "Could not open " << wavetablePath.filename().string() << std::endl;
-            return {false, 0};
-        }
+        const auto wavetableIndex = edit.wavetableIndex;
+        const auto& wavetable = *edit.wavetable;
         
         // Compute the amount of frames we will write
-        const auto frameCount = wavetableSize / 16;
-        if (verbose)
-            std::cout << "Found " << std::dec << frameCount << " frames in " << wavetablePath.string() << std::endl;
-        
+        const auto frameCount = static_cast<unsigned int>(wavetable.size() / 16);
         const auto actualFrameCount = std::min<unsigned int>(0x100 - wavetableIndex, frameCount);
         if (frameCount != actualFrameCount)
         {
-            std::cout << "Last " << std::dec << (frameCount - actualFrameCount) << " won't fit in the song" << std::endl;
+            out << "Last " << std::dec << (frameCount - actualFrameCount) << " won't fit in the song" << std::endl;
             
             if (verbose)
-                std::cout << "Writing only " << std::dec << actualFrameCount << " frames due to space limits" << std::endl;
+                out << "Writing only " << std::dec << actualFrameCount << " frames due to space limits" << std::endl;
         }
         
         // Check to see if we're overwriting non-default wavetables
@@ -193,9 +303,9 @@ namespace lsdj
         {
             if (verbose)
             {
-                std::cout << "Comparing frames to ensure no overwriting" << std::endl;
-                std::cout << "Going to write into frames 0x" << std::hex << static_cast<int>(wavetableIndex)
-                          << " to 0x" << static_cast<int>(wavetableIndex + actualFrameCount) << std::endl;
+                out << "Comparing frames to ensure no overwriting" << std::endl;
+                out << "Going to write into frames 0x" << std::hex << static_cast<int>(wavetableIndex)
+                    << " to 0x" << static_cast<int>(wavetableIndex + actualFrameCount) << std::endl;
             }
             
             for (auto frame = 0; frame < actualFrameCount; frame++)
@@ -203,7 +313,13 @@ namespace lsdj
                 lsdj_wave_t* wave = lsdj_song_get_wave(song, wavetableIndex + frame);
                 if (memcmp(wave->data, LSDJ_DEFAULT_WAVE, LSDJ_WAVE_LENGTH) != 0)
                 {
-                    std::cout << "Some of the wavetable frames you are trying to overwrite already contain data.\nDo you want to continue? y/n\n> ";
+                    if (!interactive)
+                    {
+                        err << "Frame 0x" << std::hex << (wavetableIndex + frame) << " already contains data, use --force to overwrite it" << std::endl;
+                        return {false, 0};
+                    }
+                    
+                    out << "Some of the wavetable frames you are trying to overwrite already contain data.\nDo you want to continue? y/n\n> " << std::flush;
                     char answer = 'n';
                     std::cin >> answer;
                     if (answer != 'y')
@@ -213,37 +329,37 @@ namespace lsdj
                         break;
                     }
                 } else if (verbose) {
-                    std::cout << "Frame 0x" << std::hex << (wavetableIndex + frame) << " is default" << std::endl;
+                    out << "Frame 0x" << std::hex << (wavetableIndex + frame) << " is default" << std::endl;
                 }
             }
         }
         
         // Apply the wavetable
-        for (unsigned char frame = 0; frame < actualFrameCount; frame++)
+        for (unsigned int frame = 0; frame < actualFrameCount; frame++)
         {
             lsdj_wave_t* wave = lsdj_song_get_wave(song, wavetableIndex + frame);
-            wavetableStream.read(reinterpret_cast<char*>(wave->data), sizeof(wave->data));
+            memcpy(wave->data, wavetable.data() + frame * sizeof(wave->data), sizeof(wave->data));
             
             if (verbose)
-                std::cout << "Wrote " << std::dec << sizeof(wave->data) << " bytes to frame 0x" << std::hex << (wavetableIndex + frame) << std::endl;
+                out << "Wrote " << std::dec << sizeof(wave->data) << " bytes to frame 0x" << std::hex << (wavetableIndex + frame) << std::endl;
         }
         
         // Write zero wavetables
         if (zero)
         {
             if (verbose)
-                std::cout << "Padding empty frames" << std::endl;
+                out << "Padding empty frames" << std::endl;
             
             std::array<char, LSDJ_WAVE_LENGTH> table;
             table.fill(0x88);
             
-            for (unsigned char frame = actualFrameCount; frame < 16; frame++)
+            for (unsigned int frame = actualFrameCount; frame < 16 && wavetableIndex + frame < 0x100; frame++)
             {
                 lsdj_wave_t* wave = lsdj_song_get_wave(song, wavetableIndex + frame);
                 memcpy(wave->data, table.data(), sizeof(table));
                 
                 if (verbose)
-                    std::cout << "Wrote default bytes to frame 0x" << std::hex << (wavetableIndex + frame) << std::endl;
+                    out << "Wrote default bytes to frame 0x" << std::hex << (wavetableIndex + frame) << std::endl;
             }
         }
         
@@ -37,6 +37,7 @@
 #define LSDJ_WAVETABLE_IMPORTER_HPP
 
 #include <boost/filesystem.hpp>
+#include <ostream>
 #include <string>
 #include <vector>
 
@@ -47,21 +48,54 @@ namespace lsdj
 {
     class WavetableImporter
     {
+    public:
+        // A single wavetable to write into a target .sav or .lsdsng
+        struct Job
+        {
+            std::string target;
+            std::string wavetable;
+            unsigned char wavetableIndex = 0;
+        };
+        
+        using Wavetable = std::vector<unsigned char>;
+        
+        // A loaded wavetable to write into a song
+        struct Edit
+        {
+            const Wavetable* wavetable;
+            unsigned char wavetableIndex;
+        };
+        
     public:
         bool import(const std::string& projectName, const std::string& wavetableName);
         
+        // Import a list of jobs, writing every target back to itself once
+        /*! Every wavetable file is loaded only once, and targets are processed in parallel.
+            Overwriting non-default frames requires force, as there is no one to prompt. */
+        bool importBatch(const std::vector<Job>& jobs);
+        
+        // Read a wavetable file, making sure it consists of whole frames
+        /*! .wav files are converted into frames, every wavCycleLength samples making up one */
+        bool loadWavetable(const std::string& wavetableName, Wavetable& wavetable, std::ostream& out, std::ostream& err) const;
+        
+        // Write a loaded wavetable into a song, returns whether it succeeded and how many frames were written
+        /*! When interactive, the user is asked before overwriting non-default frames (unless force is set) */
+        std::pair<bool, unsigned int> importToSong(lsdj_song_t* song, const Edit& edit, bool interactive, std::ostream& out, std::ostream& err) const;
+        
     public:
         std::string outputName;
         unsigned char wavetableIndex = 0;
+        unsigned int threadCount = 1;
+        
+        // The amount of .wav samples in a single frame, 0 means the whole file is one
+        std::size_t wavCycleLength = 0;
         
         bool zero = false;
         bool force = false;
         bool verbose = false;
         
     private:
-        bool importToSav(const boost::filesystem::path& path, const std::string& wavetableName);
-        bool importToLsdsng(const boost::filesystem::path& path, const std::string& wavetableName);
-        std::pair<bool, unsigned int> importToSong(lsdj_song_t* song, const std::string& wavetableName);
+        bool importToTarget(const boost::filesystem::path& path, const boost::filesystem::path& outputPath, const std::vector<Edit>& edits, bool interactive, std::ostream& out, std::ostream& err) const;
     };
 }
 
@@ -33,6 +33,8 @@
  
  */
 
+#include <algorithm>
+#include <atomic>
 #include <iomanip>
 #include <iostream>
 #include <sstream>
@@ -44,90 +46,290 @@
 
 namespace lsdj
 {
-    int Exporter::exportProjects(const boost::filesystem::path& path, const std::string& output)
+    int Exporter::exportProjects(const std::vector<boost::filesystem::path>& paths, const std::string& output)
     {
-        // Load in the save file
-        lsdj_error_t* error = nullptr;
-        lsdj_sav_t* sav = lsdj_sav_read_from_file(path.string().c_str(), &error);
-        if (sav == nullptr)
-            return handle_error(error);
+        if (streaming)
+            return exportProjectsStreaming(paths, output);
+        
+        // Load in the save files (projects are only decompressed once they're exported),
+        // reading the next ones from disk while the previous ones are being parsed
+        std::vector<std::string> loadPaths;
+        for (const auto& path : paths)
+            loadPaths.emplace_back(path.string());
+        FileLoader loader(std::move(loadPaths), FILE_LOADER_THREAD_COUNT, std::max(threadCount, 1u) * 2);
+        
+        std::vector<lsdj_sav_t*> savs(paths.size(), nullptr);
+        std::vector<lsdj_error_t*> errors(paths.size(), nullptr);
+        parallelFor(paths.size(), threadCount, [&](std::size_t i)
+        {
+            const auto data = loader.take(i, &errors[i]);
+            if (errors[i] == nullptr)
+                savs[i] = lsdj_sav_read_lazy_from_memory(data.data(), data.size(), &errors[i]);
+        });
+        
+        const auto cleanup = [&]
+        {
+            for (auto sav : savs)
+                lsdj_sav_free(sav);
+            for (auto error : errors)
+                lsdj_error_free(error);
+        };
         
-        if (verbose)
-            std::cout << "Read '" << path.string() << "'" << std::endl;
+        for (auto& error : errors)
+        {
+            if (error)
+            {
+                const auto result = handle_error(error);
+                error = nullptr;
+                cleanup();
+                return result;
+            }
+        }
         
         const auto outputFolder = boost::filesystem::absolute(output);
         
-        // If no specific indices were given, or -w was flagged (index == -1),
-        // display the working memory song as well
-        if ((indices.empty() && names.empty()) || std::find(std::begin(indices), std::end(indices), -1) != std::end(indices))
+        // Figure out what to export where. With several savs, each one gets its own folder,
+        // so that projects with the same name don't overwrite each other.
+        std::vector<Export> exports;
+        std::vector<lsdj_project_t*> workingMemoryProjects;
+        const auto cleanupProjects = [&]
         {
-            lsdj_project_t* project = lsdj_project_new_from_working_memory_song(sav, &error);
+            for (auto project : workingMemoryProjects)
+                lsdj_project_free(project);
+            cleanup();
+        };
+        
+        for (std::size_t i = 0; i < savs.size(); ++i)
+        {
+            if (verbose)
+                std::cout << "Read '" << paths[i].string() << "'" << std::endl;
+            
+            const auto folder = paths.size() > 1 ? outputFolder / paths[i].stem() : outputFolder;
+            
+            lsdj_error_t* error = nullptr;
+            collectExports(savs[i], folder, exports, workingMemoryProjects, &error);
             if (error)
             {
-                lsdj_sav_free(sav);
+                cleanupProjects();
                 return handle_error(error);
             }
+        }
+        
+        // Directories are created up front, so export threads don't race to create them
+        for (const auto& exp : exports)
+            boost::filesystem::create_directories(exp.path.parent_path());
+        
+        // Export the projects. Output is printed in the order of the exports, and once
+        // one fails, the ones that haven't started yet are skipped.
+        std::vector<lsdj_error_t*> exportErrors(exports.size(), nullptr);
+        std::atomic<bool> failed{false};
+        OrderedOutput out(exports.size(), std::cout);
+        
+        parallelFor(exports.size(), threadCount, [&](std::size_t i)
+        {
+            if (failed)
+                return out.finish(i, "");
             
-            exportProject(project, outputFolder, true, &error);
-            if (error)
+            const auto& exp = exports[i];
+            lsdj_project_write_lsdsng_to_file(exp.project, exp.path.string().c_str(), &exportErrors[i]);
+            if (exportErrors[i])
             {
-                lsdj_sav_free(sav);
+                failed = true;
+                return out.finish(i, "");
+            }
+            
+            // Let the user know if verbose output has been toggled on
+            out.finish(i, verbose ? "Exported " + boost::filesystem::relative(exp.path, outputFolder).string() + "\n" : "");
+        });
+        
+        int result = 0;
+        for (auto error : exportErrors)
+        {
+            if (error && result == 0)
+                result = handle_error(error);
+            else
+                lsdj_error_free(error);
+        }
+        
+        cleanupProjects();
+        
+        return result;
+    }
+    
+    int Exporter::exportProjectsStreaming(const std::vector<boost::filesystem::path>& paths, const std::string& output)
+    {
+        const auto outputFolder = boost::filesystem::absolute(output);
+        
+        // Decide what to export from the catalogs, which don't decompress anything
+        std::vector<StreamedExport> exports;
+        std::vector<std::size_t> firstExports;
+        for (std::size_t i = 0; i < paths.size(); ++i)
+        {
+            lsdj_error_t* error = nullptr;
+            lsdj_sav_catalog_t catalog;
+            lsdj_sav_read_catalog_from_file(paths[i].string().c_str(), &catalog, &error);
+            if (error)
                 return handle_error(error);
+            
+            if (verbose)
+                std::cout << "Read '" << paths[i].string() << "'" << std::endl;
+            
+            firstExports.emplace_back(exports.size());
+            collectStreamedExports(catalog, i, paths.size() > 1 ? outputFolder / paths[i].stem() : outputFolder, exports);
+        }
+        firstExports.emplace_back(exports.size());
+        
+        // Directories are created up front, so export threads don't race to create them
+        for (const auto& exp : exports)
+            boost::filesystem::create_directories(exp.path.parent_path());
+        
+        // Every thread takes on a whole sav, and holds one project of it at a time. Output is
+        // printed in the order of the exports, and once one fails, the rest is skipped.
+        std::vector<lsdj_error_t*> exportErrors(exports.size(), nullptr);
+        std::atomic<bool> failed{false};
+        OrderedOutput out(exports.size(), std::cout);
+        
+        parallelFor(paths.size(), threadCount, [&](std::size_t sav)
+        {
+            const auto first = firstExports[sav];
+            const auto last = firstExports[sav + 1];
+            
+            // The sav is mapped once, and every project is read straight from the mapping
+            lsdj_mapped_file_t* file = nullptr;
+            if (first != last && !failed)
+            {
+                file = lsdj_mapped_file_open(paths[sav].string().c_str(), &exportErrors[first]);
+                if (file == nullptr)
+                    failed = true;
+            }
+            
+            for (auto i = first; i < last; ++i)
+            {
+                if (failed)
+                {
+                    out.finish(i, "");
+                    continue;
+                }
+                
+                const auto& exp = exports[i];
+                lsdj_project_t* project = lsdj_sav_read_project_from_memory(lsdj_mapped_file_get_data(file), lsdj_mapped_file_get_size(file), exp.index, &exportErrors[i]);
+                if (project)
+                    lsdj_project_write_lsdsng_to_file(project, exp.path.string().c_str(), &exportErrors[i]);
+                lsdj_project_free(project);
+                
+                if (exportErrors[i])
+                {
+                    failed = true;
+                    out.finish(i, "");
+                    continue;
+                }
+                
+                out.finish(i, verbose ? "Exported " + boost::filesystem::relative(exp.path, outputFolder).string() + "\n" : "");
             }
+            
+            lsdj_mapped_file_close(file);
+        });
+        
+        int result = 0;
+        for (auto error : exportErrors)
+        {
+            if (error && result == 0)
+                result = handle_error(error);
+            else
+                lsdj_error_free(error);
+        }
+        
+        return result;
+    }
+    
+    void Exporter::collectExports(lsdj_sav_t* sav, const boost::filesystem::path& folder, std::vector<Export>& exports, std::vector<lsdj_project_t*>& workingMemoryProjects, lsdj_error_t** error)
+    {
+        // If no specific indices were given, or -w was flagged (index == -1),
+        // export the working memory song as well
+        if (isWorkingMemorySelected())
+        {
+            lsdj_project_t* project = lsdj_project_new_from_working_memory_song(sav, error);
+            if (*error)
+                return;
+            
+            workingMemoryProjects.emplace_back(project);
+            exports.push_back({ project, constructPath(project, folder, true) });
         }
         
         // Go through every project
         const auto count = lsdj_sav_get_project_count(sav);
         for (int i = 0; i < count; ++i)
         {
-            // See if we're using indices and this project hasn't been specified
-            // If so, skip it and move on to the next one
-            if (!indices.empty() && std::find(std::begin(indices), std::end(indices), i) == std::end(indices))
-                continue;
-            
-            // Retrieve the project
+            // Retrieve the project, and skip it if it hasn't been singled out
             lsdj_project_t* project = lsdj_sav_get_project(sav, i);
             
-            // See if we're using name-based specification and whether this project has been singled out
-            // If not, skip it and move on to the next one
-            if (!names.empty())
-            {
-                char name[9];
-                std::fill_n(name, 9, '\0');
-                lsdj_project_get_name(project, name, sizeof(name));
-                const auto namestr = std::string(name);
-                if (std::find_if(std::begin(names), std::end(names), [&](const auto& x){ return compareCaseInsensitive(x, namestr); }) == std::end(names))
-                    continue;
-            }
+            char name[9];
+            std::fill_n(name, 9, '\0');
+            lsdj_project_get_name(project, name, sizeof(name));
+            if (!isProjectSelected(i, name))
+                continue;
             
-            // Does this project contain a song? If not, it's empty
-            if (lsdj_project_get_song(project) == NULL)
+            // See if there's actually a song here. If not, this is an (EMPTY) project among
+            // existing projects, which is a thing that can happen in older versions of LSDJ
+            // Since we're exporting, let's skip this project entirely
+            if (!lsdj_project_has_song(project))
                 continue;
             
-            // Export the project
-            exportProject(project, outputFolder, false, &error);
-            if (error)
-            {
-                lsdj_sav_free(sav);
-                return handle_error(error);
-            }
+            exports.push_back({ project, constructPath(project, folder, false) });
+        }
+    }
+    
+    void Exporter::collectStreamedExports(const lsdj_sav_catalog_t& catalog, std::size_t sav, const boost::filesystem::path& folder, std::vector<StreamedExport>& exports)
+    {
+        // The working memory song is named after the project it represents, if any
+        if (isWorkingMemorySelected())
+        {
+            const auto active = catalog.activeProject;
+            if (active < LSDJ_SAV_PROJECT_COUNT)
+                exports.push_back({ sav, LSDJ_NO_ACTIVE_PROJECT, constructPath(catalog.projects[active].name, catalog.projects[active].version, folder, true) });
+            else
+                exports.push_back({ sav, LSDJ_NO_ACTIVE_PROJECT, constructPath("", 0, folder, true) });
         }
         
-        lsdj_sav_free(sav);
+        // Projects without any blocks are empty, and skipped like collectExports() does
+        for (int i = 0; i < LSDJ_SAV_PROJECT_COUNT; ++i)
+        {
+            const auto& project = catalog.projects[i];
+            if (isProjectSelected(i, project.name) && project.blockCount > 0)
+                exports.push_back({ sav, static_cast<unsigned char>(i), constructPath(project.name, project.version, folder, false) });
+        }
+    }
+    
+    bool Exporter::isWorkingMemorySelected() const
+    {
+        return (indices.empty() && names.empty()) || std::find(std::begin(indices), std::end(indices), -1) != std::end(indices);
+    }
+    
+    bool Exporter::isProjectSelected(int index, const std::string& name) const
+    {
+        // See if we're using indices and this project hasn't been specified
+        if (!indices.empty() && std::find(std::begin(indices), std::end(indices), index) == std::end(indices))
+            return false;
         
-        return 0;
+        // See if we're using name-based specification and whether this project has been singled out
+        if (!names.empty() && std::find_if(std::begin(names), std::end(names), [&](const auto& x){ return compareCaseInsensitive(x, name); }) == std::end(names))
+            return false;
+        
+        return true;
     }
     
-    void Exporter::exportProject(const lsdj_project_t* project, boost::filesystem::path folder, bool workingMemory, lsdj_error_t** error)
+    boost::filesystem::path Exporter::constructPath(const lsdj_project_t* project, const boost::filesystem::path& folder, bool workingMemory)
     {
-        // See if there's actually a song here. If not, this is an (EMPTY) project among
-        // existing projects, which is a thing that can happen in older versions of LSDJ
-        // Since we're exporting, let's skip this project entirely
-        const auto song = lsdj_project_get_song(project);
-        if (!song)
-            return;
+        char name[9];
+        std::fill_n(name, 9, '\0');
+        lsdj_project_get_name(project, name, sizeof(name));
         
-        auto name = constructName(project);
+        return constructPath(name, lsdj_project_get_version(project), folder, workingMemory);
+    }
+    
+    boost::filesystem::path Exporter::constructPath(const char* projectName, unsigned char version, const boost::filesystem::path& folder, bool workingMemory)
+    {
+        auto name = constructName(projectName);
         if (name.empty())
             name = "(EMPTY)";
         
@@ -135,10 +337,9 @@ namespace lsdj
         
         if (putInFolder)
             path /= name;
-        boost::filesystem::create_directories(folder);
         
         std::stringstream stream;
-        stream << name << convertVersionToString(lsdj_project_get_version(project), true);
+        stream << name << convertVersionToString(version, true);
         
         if (workingMemory)
             stream << ".WM";
@@ -146,15 +347,7 @@ namespace lsdj
         stream << ".lsdsng";
         path /= stream.str();
         
-        lsdj_project_write_lsdsng_to_file(project, path.string().c_str(), error);
-        if (*error != nullptr)
-            return;
-        
-        // Let the user know if verbose output has been toggled on
-        if (verbose)
-        {
-            std::cout << "Exported " << boost::filesystem::relative(path, folder).string() << std::endl;
-        }
+        return path;
     }
     
     int Exporter::print(const boost::filesystem::path& path)
@@ -167,49 +360,90 @@ namespace lsdj
     
     int Exporter::printFolder(const boost::filesystem::path& path)
     {
+        // Gather all savs up front, so they can be listed in sorted order
+        std::vector<boost::filesystem::path> paths;
         for (auto it = boost::filesystem::directory_iterator(path); it != boost::filesystem::directory_iterator(); ++it)
         {
             const auto path = it->path();
             if (isHiddenFile(path.filename().string()) || path.extension() != ".sav")
                 continue;
             
-            std::cout << path.filename().string() << std::endl;
-            if (printSav(path) != 0)
-                return 1;
+            paths.emplace_back(path);
         }
         
-        return 0;
+        std::sort(paths.begin(), paths.end());
+        
+        // Read the catalogs concurrently, but print them in order. Once one fails,
+        // the ones that haven't started yet are skipped.
+        std::vector<lsdj_error_t*> errors(paths.size(), nullptr);
+        std::atomic<bool> failed{false};
+        OrderedOutput out(paths.size(), std::cout);
+        
+        parallelFor(paths.size(), threadCount, [&](std::size_t i)
+        {
+            if (failed)
+                return out.finish(i, "");
+            
+            lsdj_sav_catalog_t catalog;
+            lsdj_sav_read_catalog_from_file(paths[i].string().c_str(), &catalog, &errors[i]);
+            if (errors[i])
+            {
+                failed = true;
+                return out.finish(i, paths[i].filename().string() + "\n");
+            }
+            
+            std::ostringstream stream;
+            stream << paths[i].filename().string() << std::endl;
+            printCatalog(catalog, stream);
+            out.finish(i, stream.str());
+        });
+        
+        int result = 0;
+        for (auto error : errors)
+        {
+            if (error && result == 0)
+                result = handle_error(error);
+            else
+                lsdj_error_free(error);
+        }
+        
+        return result;
     }
     
     int Exporter::printSav(const boost::filesystem::path& path)
     {
-        // Try and read the sav
+        // Try and read the sav catalog, we don't need the songs themselves
         lsdj_error_t* error = nullptr;
-        lsdj_sav_t* sav = lsdj_sav_read_from_file(path.string().c_str(), &error);
-        if (sav == nullptr)
+        lsdj_sav_catalog_t catalog;
+        lsdj_sav_read_catalog_from_file(path.string().c_str(), &catalog, &error);
+        if (error)
             return lsdj::handle_error(error);
         
+        printCatalog(catalog, std::cout);
+        
+        return 0;
+    }
+    
+    void Exporter::printCatalog(const lsdj_sav_catalog_t& catalog, std::ostream& stream)
+    {
         // Header
-        std::cout << "#   Name     ";
+        stream << "#   Name     ";
         if (versionStyle != VersionStyle::NONE)
-            std::cout << "Ver    ";
-        std::cout << "Fmt    BPM" << std::endl;
+            stream << "Ver    ";
+        stream << "Fmt    BPM" << std::endl;
         
         // If no specific indices were given, or -w was flagged (index == -1),
         // display the working memory song as well
         if ((indices.empty() && names.empty()) || std::find(std::begin(indices), std::end(indices), -1) != std::end(indices))
         {
-            printWorkingMemorySong(sav);
+            printWorkingMemorySong(catalog, stream);
         }
         
         // Find out what the last non-empty project is
-        const auto count = lsdj_sav_get_project_count(sav);
-        int lastNonEmptyProject = count - 1;
+        int lastNonEmptyProject = LSDJ_SAV_PROJECT_COUNT - 1;
         while (lastNonEmptyProject != 0)
         {
-            const auto project = lsdj_sav_get_project(sav, lastNonEmptyProject);
-            const auto song = lsdj_project_get_song(project);
-            if (song)
+            if (catalog.projects[lastNonEmptyProject].blockCount > 0)
                 break;
             
             lastNonEmptyProject -= 1;
@@ -222,10 +456,8 @@ namespace lsdj
             if (!indices.empty() && std::find(std::begin(indices), std::end(indices), i) == std::end(indices))
                 continue;
             
-            printProject(sav, i);
+            printProject(catalog, i, stream);
         }
-        
-        return 0;
     }
     
     std::string Exporter::convertVersionToString(unsigned char version, bool prefixDot) const
@@ -251,129 +483,112 @@ namespace lsdj
         return stream.str();
     }
     
-    void Exporter::printWorkingMemorySong(const lsdj_sav_t* sav)
+    void Exporter::printWorkingMemorySong(const lsdj_sav_catalog_t& catalog, std::ostream& stream)
     {
-        std::cout << "WM  ";
+        stream << "WM  ";
         
         // If the working memory song represent one of the projects, display that name
-        const auto active = lsdj_sav_get_active_project(sav);
-        if (active != LSDJ_NO_ACTIVE_PROJECT)
+        const auto active = catalog.activeProject;
+        if (active < LSDJ_SAV_PROJECT_COUNT)
         {
-            lsdj_project_t* project = lsdj_sav_get_project(sav, active);
-            
-            const auto name = constructName(project);
-            std::cout << name;
+            const auto name = constructName(catalog.projects[active].name);
+            stream << name;
             for (auto i = 0; i < (9 - name.length()); ++i)
-                std::cout << ' ';
+                stream << ' ';
         } else {
             // The working memory doesn't represent one of the projects, so it
             // doesn't really have a name
-            std::cout << "         ";
+            stream << "         ";
         }
         
         // Display whether the working memory song is "dirty"/edited, and display that
         // as version number (it doesn't really have a version number otherwise)
-        const lsdj_song_t* song = lsdj_sav_get_working_memory_song(sav);
-        if (lsdj_song_get_file_changed_flag(song))
+        if (catalog.workingMemoryFileChangedFlag)
         {
             switch (versionStyle)
             {
                 case VersionStyle::NONE:
-                    std::cout << "";
+                    stream << "";
                     break;
                 case VersionStyle::HEX:
-                    std::cout << (lsdj_song_get_file_changed_flag(song) ? "*" : " ") << "  \t";
-                    break;
                 case VersionStyle::DECIMAL:
-                    std::cout << (lsdj_song_get_file_changed_flag(song) ? "*" : " ") << "  \t";
+                    stream << "*  \t";
                     break;
             }
         } else {
-            std::cout << "\t\t";
+            stream << "\t\t";
         }
         
         // Retrieve the sav format version of the song and display it as well
-        const auto versionString = std::to_string(lsdj_song_get_format_version(song));
-        std::cout << versionString;
+        const auto versionString = std::to_string(catalog.workingMemoryFormatVersion);
+        stream << versionString;
         for (auto i = 0; i < 7 - versionString.length(); i++)
-            std::cout << ' ';
+            stream << ' ';
         
         // Display the bpm of the project
-        if (song)
-        {
-            int tempo = lsdj_song_get_tempo(song);
-            std::cout << tempo;
-        }
-        
-        std::cout << std::endl;
+        stream << static_cast<int>(catalog.workingMemoryTempo) << std::endl;
     }
 
-    void Exporter::printProject(const lsdj_sav_t* sav, std::size_t index)
+    void Exporter::printProject(const lsdj_sav_catalog_t& catalog, std::size_t index, std::ostream& stream)
     {
-        // Retrieve the project
-        const lsdj_project_t* project = lsdj_sav_get_project(sav, index);
+        const lsdj_sav_catalog_project_t& project = catalog.projects[index];
         
         // See if we're using name-based specification and whether this project has been singled out
         // If not, skip it and move on to the next one
         if (!names.empty())
         {
-            char name[9];
-            std::fill_n(name, 9, '\0');
-            lsdj_project_get_name(project, name, sizeof(name));
-            const auto namestr = std::string(name);
+            const auto namestr = std::string(project.name);
             if (std::find_if(std::begin(names), std::end(names), [&](const auto& x){ return lsdj::compareCaseInsensitive(x, namestr); }) == std::end(names))
                 return;
         }
         
         // Print out the index
-        std::cout << std::to_string(index) << "  ";
+        stream << std::to_string(index) << "  ";
         if (index < 10)
-            std::cout << ' ';
+            stream << ' ';
         
         // See if there's actually a song here. If not, this is an (EMPTY) project among
         // existing projects, which is a thing that can happen in older versions of LSDJ
         // Since we're printing, we should show the user this slot is effectively empty
-        const lsdj_song_t* song = lsdj_project_get_song(project);
-        if (!song)
+        if (project.blockCount == 0)
         {
-            std::cout << "(EMPTY)" << std::endl;
+            stream << "(EMPTY)" << std::endl;
             return;
         }
         
         // Display the name of the project
-        const auto name = constructName(project);
-        std::cout << name;
+        const auto name = constructName(project.name);
+        stream << name;
         
         for (auto i = 0; i < (9 - name.length()); ++i)
-            std::cout << ' ';
+            stream << ' ';
         
         // Display the version number of the project
-        std::cout << convertVersionToString(lsdj_project_get_version(project), false);
+        stream << convertVersionToString(project.version, false);
         switch (versionStyle)
         {
             case VersionStyle::NONE: break;
-            case VersionStyle::HEX: std::cout << " \t"; break;
-            case VersionStyle::DECIMAL: std::cout << "\t"; break;
+            case VersionStyle::HEX: stream << " \t"; break;
+            case VersionStyle::DECIMAL: stream << "\t"; break;
         }
         
         // Retrieve the sav format version of the song and display it as well
-        const auto versionString = std::to_string(lsdj_song_get_format_version(song));
-        std::cout << versionString;
+        const auto versionString = std::to_string(project.formatVersion);
+        stream << versionString;
         for (auto i = 0; i < 7 - versionString.length(); i++)
-            std::cout << ' ';
+            stream << ' ';
         
         // Display the bpm of the project
-        if (song)
-        {
-            int tempo = lsdj_song_get_tempo(song);
-            std::cout << tempo;
-        }
-        
-        std::cout << std::endl;
+        stream << static_cast<int>(project.tempo) << std::endl;
     }
     
     std::string Exporter::constructName(const lsdj_project_t* project)
     {
         return constructProjectName(project, underscore);
     }
+    
+    std::string Exporter::constructName(const char* name)
+    {
+        return constructProjectName(name, underscore);
+    }
 }
@@ -36,6 +36,9 @@
 #ifndef LSDJ_EXPORTER_HPP
 #define LSDJ_EXPORTER_HPP
 
+#include <ostream>
+#include <vector>
+
 #include <boost/filesystem/path.hpp>
 
 #include "../liblsdj/error.h"
@@ -55,10 +58,39 @@ namespace lsdj
         };
         
     public:
-        int exportProjects(const boost::filesystem::path& path, const std::string& output);
-        void exportProject(const lsdj_project_t* project, boost::filesystem::path folder, bool workingMemory, lsdj_error_t** error);
+        // A single project that should be written to an lsdsng
+        struct Export
+        {
+            const lsdj_project_t* project;
+            boost::filesystem::path path;
+        };
+        
+        // A single project that is read from its sav on its own, right before it's written
+        struct StreamedExport
+        {
+            std::size_t sav;
+            
+            // The project index, LSDJ_NO_ACTIVE_PROJECT for the working memory song
+            unsigned char index;
+            
+            boost::filesystem::path path;
+        };
+        
+    public:
+        int exportProjects(const std::vector<boost::filesystem::path>& paths, const std::string& output);
         int print(const boost::filesystem::path& path);
         
+        // Find out which projects in a sav should be exported, and where to
+        /*! The working memory song is turned into a new project, added to workingMemoryProjects */
+        void collectExports(lsdj_sav_t* sav, const boost::filesystem::path& folder, std::vector<Export>& exports, std::vector<lsdj_project_t*>& workingMemoryProjects, lsdj_error_t** error);
+        
+        // Find out which projects in a sav should be exported, and where to, using only its catalog
+        void collectStreamedExports(const lsdj_sav_catalog_t& catalog, std::size_t sav, const boost::filesystem::path& folder, std::vector<StreamedExport>& exports);
+        
+        // Construct the path an exported project ends up at
+        boost::filesystem::path constructPath(const lsdj_project_t* project, const boost::filesystem::path& folder, bool workingMemory);
+        boost::filesystem::path constructPath(const char* name, unsigned char version, const boost::filesystem::path& folder, bool workingMemory);
+        
     public:
         // The version exporting style
         VersionStyle versionStyle = VersionStyle::HEX;
@@ -67,10 +99,24 @@ namespace lsdj
         bool putInFolder = false;
         bool verbose = false;
         
+        // Read, write and free the projects one by one, instead of loading whole savs up front
+        /*! This keeps memory down to about a single song per thread, at the cost of going
+            back to the sav file for every project */
+        bool streaming = false;
+        
+        // The amount of threads used to read, print and export savs
+        unsigned int threadCount = 1;
+        
         std::vector<int> indices;
         std::vector<std::string> names;
         
     private:
+        int exportProjectsStreaming(const std::vector<boost::filesystem::path>& paths, const std::string& output);
+        
+        // Whether the working memory song and a given project have been singled out for export
+        bool isWorkingMemorySelected() const;
+        bool isProjectSelected(int index, const std::string& name) const;
+        
         int printFolder(const boost::filesystem::path& path);
         int printSav(const boost::filesystem::path& path);
         
@@ -78,13 +124,17 @@ namespace lsdj
         // Converts a project version to a string representation using the current VersionStyle
         std::string convertVersionToString(unsigned char version, bool prefixDot) const;
         
+        // Print the song list of a sav
+        void printCatalog(const lsdj_sav_catalog_t& catalog, std::ostream& stream);
+        
         // Print the working memory song line
-        void printWorkingMemorySong(const lsdj_sav_t* sav);
+        void printWorkingMemorySong(const lsdj_sav_catalog_t& catalog, std::ostream& stream);
         
         // Print a sav project line
-        void printProject(const lsdj_sav_t* sav, std::size_t index);
+        void printProject(const lsdj_sav_catalog_t& catalog, std::size_t index, std::ostream& stream);
         
         std::string constructName(const lsdj_project_t* project);
+        std::string constructName(const char* name);
     };
 }
 
@@ -47,7 +47,7 @@
 
 void printHelp(const boost::program_options::options_description& desc)
 {
-    std::cout << "lsdsng-export mymusic.sav\n\n"
+    std::cout << "lsdsng-export mymusic.sav [more.sav...]\n\n"
               << "Version: " << lsdj::VERSION << "\n\n"
               << desc;
 }
@@ -57,7 +57,7 @@ int main(int argc, char* argv[])
     // Setup the command-line options
     boost::program_options::options_description hidden{"Hidden"};
     hidden.add_options()
-        ("file", boost::program_options::value<std::string>(), "Input save file, or folder for print");
+        ("file", boost::program_options::value<std::vector<std::string>>(), "Input save file(s), or folder for print");
     
     boost::program_options::options_description cmd{"Options"};
     cmd.add_options()
@@ -71,14 +71,16 @@ int main(int argc, char* argv[])
         ("verbose,v", "Verbose output during export")
         ("index,i", boost::program_options::value<std::vector<int>>(), "Single out a given project index to export, 0 or more")
         ("name,n", boost::program_options::value<std::vector<std::string>>(), "Single out a given project by name to export")
-        ("working-memory,w", "Single out the working-memory song to export");
+        ("working-memory,w", "Single out the working-memory song to export")
+        ("stream,s", "Export one project at a time, keeping at most a single song in memory per thread")
+        ("jobs,j", boost::program_options::value<unsigned int>()->default_value(1), "The amount of threads to export or print with");
     
     boost::program_options::options_description options;
     options.add(cmd).add(hidden);
     
     // Set up the input file command-line argument
     boost::program_options::positional_options_description positionalOptions;
-    positionalOptions.add("file", 1);
+    positionalOptions.add("file", -1);
     
     try
     {
@@ -95,14 +97,20 @@ int main(int argc, char* argv[])
         {
             printHelp(cmd);
             return 0;
-        // Do we have an input file?
+        // Do we have one or more input files?
         } else if (vm.count("file")) {
-            // What is the path of the input file, and does it exist on disk?
-            const auto path = boost::filesystem::absolute(vm["file"].as<std::string>());
-            if (!boost::filesystem::exists(path))
+            // What are the paths of the input files, and do they exist on disk?
+            std::vector<boost::filesystem::path> paths;
+            for (const auto& file : vm["file"].as<std::vector<std::string>>())
             {
-                std::cerr << "Path '" << path.string() << "' does not exist" << std::endl;
-                return 1;
+                const auto path = boost::filesystem::absolute(file);
+                if (!boost::filesystem::exists(path))
+                {
+                    std::cerr << "Path '" << path.string() << "' does not exist" << std::endl;
+                    return 1;
+                }
+                
+                paths.emplace_back(path);
             }
             
             // Create the exporter, that will do the work
@@ -113,6 +121,8 @@ int main(int argc, char* argv[])
             exporter.underscore = vm.count("underscore");
             exporter.putInFolder = vm.count("folder");
             exporter.verbose = vm.count("verbose");
+            exporter.threadCount = vm["jobs"].as<unsigned int>();
+            exporter.streaming = vm.count("stream");
             
             // Has the user specified one or more specific indices to export?
             if (vm.count("index"))
@@ -124,9 +134,17 @@ int main(int argc, char* argv[])
 
             // Has the user requested a print, or an actual export?
             if (vm.count("print"))
-                return exporter.print(path);
-            else
-                return exporter.exportProjects(path, vm["output"].as<std::string>());
+            {
+                for (const auto& path : paths)
+                {
+                    if (exporter.print(path) != 0)
+                        return 1;
+                }
+                
+                return 0;
+            } else {
+                return exporter.exportProjects(paths, vm["output"].as<std::string>());
+            }
         } else {
             printHelp(cmd);
             return 0;
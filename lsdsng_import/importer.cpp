@@ -36,6 +36,7 @@
 #include <algorithm>
 #include <array>
 #include <iostream>
+#include <thread>
 
 #include "../liblsdj/song.h"
 #include "../liblsdj/project.h"
@@ -105,6 +106,16 @@ namespace lsdj
                 break;
         }
         
+        if (recompress)
+        {
+            for (unsigned int i = 0; i < lsdj_sav_get_project_count(sav); ++i)
+            {
+                lsdj_song_t* song = lsdj_project_get_song(lsdj_sav_get_project(sav, i));
+                if (song)
+                    lsdj_song_set_dirty_flag(song, 1);
+            }
+        }
+        
         if (savName && verbose)
             std::cout << "Read " << savName << ", containing " << std::to_string(index) << " saves" << std::endl;
         
@@ -134,41 +145,102 @@ namespace lsdj
                 outputFile = "out.sav";
         }
         
-        // Import all lsdsng files
-        const auto active = lsdj_sav_get_active_project(sav);
-        for (auto i = 0; i < paths.size(); ++i)
+        // Only the songs that fit in the remaining slots need to be loaded
+        const auto fitCount = std::min<std::size_t>(paths.size(), lsdj_sav_get_project_count(sav) - index);
+        
+        // Read all lsdsng files (and the working memory one) in parallel. Their compressed
+        // blocks are spliced into the sav as they are, so the songs are only decompressed
+        // and parsed when they're needed (like for the working memory).
+        std::vector<boost::filesystem::path> loadPaths(paths.begin(), paths.begin() + fitCount);
+        if (!workingMemoryPath.empty())
+            loadPaths.emplace_back(workingMemoryPath);
+        
+        std::vector<std::string> filePaths;
+        for (const auto& path : loadPaths)
+            filePaths.emplace_back(path.string());
+        FileLoader loader(std::move(filePaths), FILE_LOADER_THREAD_COUNT, std::max(threadCount, 1u) * 2);
+        
+        std::vector<lsdj_project_t*> projects(loadPaths.size(), nullptr);
+        std::vector<lsdj_error_t*> errors(loadPaths.size(), nullptr);
+        parallelFor(loadPaths.size(), threadCount, [&](std::size_t i)
         {
-            if (index == lsdj_sav_get_project_count(sav))
+            const auto data = loader.take(i, &errors[i]);
+            if (errors[i] == nullptr)
+                projects[i] = lsdj_project_read_lsdsng_lazy_from_memory(data.data(), data.size(), &errors[i]);
+            
+            lsdj_song_t* song = recompress && projects[i] ? lsdj_project_load_song(projects[i], &errors[i]) : nullptr;
+            if (song)
+                lsdj_song_set_dirty_flag(song, 1);
+        });
+        
+        // Place them into the sav in order, so slot assignment doesn't depend on thread timing
+        const auto fail = [&](std::size_t failed)
+        {
+            for (auto i = failed; i < loadPaths.size(); ++i)
             {
-                std::cerr << "Reached maximum project count, can't write " << paths[i].string() << std::endl;
-                break;
+                if (i != failed)
+                    lsdj_error_free(errors[i]);
+                lsdj_project_free(projects[i]);
             }
             
-            importSong(paths[i].string(), sav, index, active, &error);
-            if (error)
+            lsdj_sav_free(sav);
+            return handle_error(errors[failed]);
+        };
+        
+        const auto active = lsdj_sav_get_active_project(sav);
+        for (std::size_t i = 0; i < fitCount; ++i)
+        {
+            if (errors[i])
+                return fail(i);
+            
+            importSong(projects[i], sav, index, active, &errors[i]);
+            if (errors[i])
             {
-                lsdj_sav_free(sav);
-                return handle_error(error);
+                projects[i] = nullptr;
+                return fail(i);
             }
             
             index += 1;
         }
         
+        if (fitCount < paths.size())
+            std::cerr << "Reached maximum project count, can't write " << paths[fitCount].string() << std::endl;
+        
         if (!workingMemoryPath.empty())
         {
-            importWorkingMemorySong(sav, paths, &error);
-            if (error)
+            const auto i = loadPaths.size() - 1;
+            if (errors[i])
+                return fail(i);
+            
+            importWorkingMemorySong(projects[i], sav, paths, &errors[i]);
+            if (errors[i])
             {
                 lsdj_sav_free(sav);
-                return handle_error(error);
+                return handle_error(errors[i]);
             }
         }
         
         if (outputFile.empty())
             outputFile = "out.sav";
         
+        lsdj_codec_context_t* context = lsdj_codec_context_new(&error);
+        if (error == nullptr)
+        {
+            lsdj_codec_context_set_compression_mode(context, compressionMode);
+            dropProjectsThatDontFit(sav, context, &error);
+        }
+        
         // Write the sav to file
-        lsdj_sav_write_to_file(sav, boost::filesystem::absolute(outputFile).string().c_str(), &error);
+        if (error == nullptr)
+        {
+            lsdj_sav_write_options_t options;
+            lsdj_sav_write_options_init(&options);
+            options.threadCount = std::thread::hardware_concurrency();
+            options.context = context;
+            lsdj_sav_write_to_file_with_options(sav, boost::filesystem::absolute(outputFile).string().c_str(), &options, &error);
+        }
+        
+        lsdj_codec_context_free(context);
         if (error)
         {
             lsdj_sav_free(sav);
@@ -178,12 +250,8 @@ namespace lsdj
         return 0;
     }
     
-    void Importer::importSong(const std::string& path, lsdj_sav_t* sav, unsigned char index, unsigned char active, lsdj_error_t** error)
+    void Importer::importSong(lsdj_project_t* project, lsdj_sav_t* sav, unsigned char index, unsigned char active, lsdj_error_t** error)
     {
-        lsdj_project_t* project = lsdj_project_read_lsdsng_from_file(path.c_str(), error);
-        if (*error != nullptr)
-            return;
-        
         lsdj_sav_set_project(sav, index, project, error);
         if (*error != nullptr)
             return lsdj_project_free(project);
@@ -203,13 +271,34 @@ namespace lsdj
         }
     }
     
-    void Importer::importWorkingMemorySong(lsdj_sav_t* sav, const std::vector<boost::filesystem::path>& paths, lsdj_error_t** error)
+    void Importer::dropProjectsThatDontFit(lsdj_sav_t* sav, const lsdj_codec_context_t* context, lsdj_error_t** error)
     {
-        lsdj_project_t* project = lsdj_project_read_lsdsng_from_file(workingMemoryPath.string().c_str(), error);
+        lsdj_sav_block_usage_t usage;
+        lsdj_sav_get_block_usage_with_context(sav, &usage, context, error);
         if (*error != nullptr)
-            return lsdj_project_free(project);
+            return;
         
-        lsdj_song_t* song = lsdj_song_copy(lsdj_project_get_song(project), error);
+        for (unsigned char i = 0; i < lsdj_sav_get_project_count(sav); ++i)
+        {
+            if (usage.fits[i] || usage.projectBlockCounts[i] == 0)
+                continue;
+            
+            std::array<char, 9> name;
+            name.fill('\0');
+            lsdj_project_get_name(lsdj_sav_get_project(sav, i), name.data(), 8);
+            std::cerr << "Not enough space for " << name.data() << " (" << usage.projectBlockCounts[i] << " blocks), leaving it out" << std::endl;
+            
+            lsdj_sav_erase_project(sav, i, error);
+            if (*error != nullptr)
+                return;
+        }
+    }
+    
+    void Importer::importWorkingMemorySong(lsdj_project_t* project, lsdj_sav_t* sav, const std::vector<boost::filesystem::path>& paths, lsdj_error_t** error)
+    {
+        lsdj_song_t* song = lsdj_project_load_song(project, error);
+        if (*error == nullptr)
+            song = lsdj_song_copy_shallow(song, error);
         if (*error != nullptr)
             return lsdj_project_free(project);
         
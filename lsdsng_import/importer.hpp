@@ -50,14 +50,31 @@ namespace lsdj
     public:
         int importSongs(const char* savName);
         
+        // Put a project into a sav slot, taking ownership of it (also on failure)
+        /*! Without a working memory song, the first slot also becomes the working memory song */
+        void importSong(lsdj_project_t* project, lsdj_sav_t* sav, unsigned char index, unsigned char active, lsdj_error_t** error);
+        
+        // Erase the projects that don't fit in the sav's blocks, so the sav can be written
+        /*! Every project that's left out is reported on stderr, the other slots stay as they are.
+            Changed songs are counted with the compression mode of the context. */
+        void dropProjectsThatDontFit(lsdj_sav_t* sav, const lsdj_codec_context_t* context, lsdj_error_t** error);
+        
     public:
         std::vector<std::string> inputs;
         std::string outputFile;
         bool verbose = false;
         
+        // The amount of threads used to read and decompress .lsdsng's
+        unsigned int threadCount = 1;
+        
+        // Recompress every song instead of copying its blocks, for when the compression mode changed
+        bool recompress = false;
+        
+        // The way the songs written to the sav are compressed
+        lsdj_compression_mode_t compressionMode = LSDJ_COMPRESSION_GREEDY;
+        
     private:
-        void importSong(const std::string& path, lsdj_sav_t* sav, unsigned char index, unsigned char active, lsdj_error_t** error);
-        void importWorkingMemorySong(lsdj_sav_t* sav, const std::vector<boost::filesystem::path>& paths, lsdj_error_t** error);
+        void importWorkingMemorySong(lsdj_project_t* project, lsdj_sav_t* sav, const std::vector<boost::filesystem::path>& paths, lsdj_error_t** error);
         
     private:
         //! The path that refers to the working memory song
@@ -38,6 +38,7 @@
 #include <iostream>
 
 #include "../common/common.hpp"
+#include "../liblsdj/compression.h"
 #include "importer.hpp"
 
 void printHelp(const boost::program_options::options_description& desc)
@@ -72,7 +73,9 @@ int main(int argc, char* argv[])
         ("help,h", "Help screen")
         ("output,o", boost::program_options::value<std::string>(), "The output file (.sav)")
         ("sav,s", boost::program_options::value<std::string>(), "A sav file to append all .lsdsng's to")
-        ("verbose,v", "Verbose output during import");
+        ("verbose,v", "Verbose output during import")
+        ("optimal", "Compress the songs using as few blocks as possible, which is slower")
+        ("jobs,j", boost::program_options::value<unsigned int>()->default_value(1), "The amount of threads to read .lsdsng's with");
     
     boost::program_options::options_description options;
     options.add(cmd).add(hidden);
@@ -98,6 +101,13 @@ int main(int argc, char* argv[])
             
             importer.inputs = vm["file"].as<std::vector<std::string>>();
             importer.verbose = vm.count("verbose");
+            importer.threadCount = vm["jobs"].as<unsigned int>();
+            
+            if (vm.count("optimal"))
+            {
+                importer.compressionMode = LSDJ_COMPRESSION_OPTIMAL;
+                importer.recompress = true;
+            }
             
             if (vm.count("output"))
                 importer.outputFile = vm["output"].as<std::string>();